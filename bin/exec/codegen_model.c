@@ -0,0 +1,217 @@
+/**
+ * Generated by cnet-codegen from test/codegen.cnet.
+ * Standalone fixed-shape inference, do not edit.
+ **/
+
+#include <math.h>
+
+#define model_IN_SIZE 64
+#define model_OUT_SIZE 4
+
+void model_predict(double const *in, double *out);
+
+
+_Alignas(64) static const double b0[3] = {
+    0.090376591398556055, -0.08997283391187566, -0.056847370768360501,
+};
+
+_Alignas(64) static const double w0[27] = {
+    -0.56834587434695383, -0.23494015412169511, -0.98427586722386806, 0.097564390440268545,
+    0.077798958438354937, -0.82851664434583705, -0.027359919169619662, 0.82771849717372969,
+    0.64105896728162604, 0.50987889222329441, 0.87873298017249124, -0.52538043052208627,
+    0.69920006566643722, 0.30928415586672919, 0.51153246476851977, 0.16727016641165604,
+    0.10333275939493114, 0.22413837594172836, 0.08641761498824585, 0.021696671387970712,
+    0.11967529315486325, 0.22998510917182324, -0.55223343873034858, 0.66573133583447497,
+    -0.13950389397307483, 0.92139136973833269, 0.10284050046598558,
+};
+
+_Alignas(64) static const double b3[10] = {
+    -0.04690304992110611, -0.037406967271774519, -0.080493067754662168, -0.021473937351942973,
+    -0.056403072996252718, -0.005523916196787701, 0.037983539951026241, -0.092789582811663676,
+    0.088904369710434389, 0.03333148170883371,
+};
+
+_Alignas(64) static const int r3[11] = {
+    0, 6, 12, 19,
+    26, 28, 35, 43,
+    51, 59, 66,
+};
+
+_Alignas(64) static const int c3[66] = {
+    1, 2, 4, 5,
+    7, 10, 1, 3,
+    6, 7, 8, 10,
+    1, 2, 6, 7,
+    8, 9, 11, 0,
+    2, 3, 4, 5,
+    8, 9, 4, 8,
+    0, 2, 3, 6,
+    8, 9, 11, 0,
+    1, 3, 5, 7,
+    8, 10, 11, 0,
+    2, 3, 4, 6,
+    7, 8, 9, 2,
+    3, 4, 5, 6,
+    7, 8, 9, 0,
+    1, 2, 3, 5,
+    7, 10,
+};
+
+_Alignas(64) static const double v3[66] = {
+    -0.46807421253438775, 0.19658613819469983, 0.62949017790588102, -0.72561490336694523,
+    -0.39786974219506133, -0.8879908509030896, 0.81120921476334762, -0.99626203439955696,
+    0.2278763415421714, -0.93510300476807307, 0.41515015876626138, 0.29488210440375018,
+    -0.84462178956932465, 0.7843080888429228, 0.5476497623825678, -0.75153639994167554,
+    -0.58349446281022133, -0.25576410035405495, -0.95400428583566299, 0.018620996278999824,
+    -0.35187402803072432, 0.12072459008578429, -0.15237989516573958, -0.23986487800249123,
+    -0.42865566417046619, -0.60831810981422574, -0.081008452494166994, 0.064981026139567133,
+    0.73209009307068307, 0.37258875061412744, -0.85140437067086083, -0.80540865650652382,
+    -0.34386986742907666, -0.15728268453724803, 0.50375023740518388, 0.60285243746026063,
+    0.58119039590525934, -0.82580322671020556, -0.8128605856620057, -0.24199233727622416,
+    -0.24142067192188499, -0.041706802808543109, 0.67757087558394802, -0.75165598362295705,
+    -0.39015460824135439, 0.31332504344793266, -0.13099420588975508, -0.56254980692758683,
+    -0.39890411375039447, -0.74570887430836863, 0.81003894368654072, 0.95347941757807475,
+    -0.70773496651450873, 0.78700017453497284, -0.56689134965040311, 0.79601527182199772,
+    0.38985261199523347, -0.98570095374514388, -0.36040888603795729, -0.17326947076864052,
+    0.28806987464803724, -0.25482100586165723, 0.5853098573094746, 0.70347219226112223,
+    -0.12484490830676853, -0.81151986579015845,
+};
+
+_Alignas(64) static const double b4[8] = {
+    -0.077492890589634378, 0.085179566305680021, 0.033980222946954991, -0.016789985595638851,
+    -0.048627927875438674, 0.096901731471019686, 0.010298214997303767, 0.084600741967838622,
+};
+
+_Alignas(64) static const double w4[80] = {
+    -0.63563079463114536, 0.67604387070799432, 0.76642346743793399, -0.83961552374047022,
+    0.065896481771905213, 0.78072251369279, -0.20002440884710493, -0.37005413387438946,
+    0.7678938460386795, 0.62670612038425455, 0.918015740773648, -0.48692716075430031,
+    0.21201597676240658, -0.45517318484148628, -0.78345496942450055, -0.52510329220681606,
+    0.41998190778306776, -0.058487326399650152, -0.65237716941739299, 0.60846204199290921,
+    -0.46451389019587719, -0.12140766862845409, -0.76560763072483595, -0.26944456774249881,
+    0.6638529578521164, -0.32963836068736307, 0.67531627028962427, 0.043688356431055952,
+    -0.25753418880399981, 0.56435996646264575, -0.62299682741192952, 0.10683501749617741,
+    0.24040383717063984, -0.85657335997399564, 0.2672194937557073, -0.69369968198877752,
+    0.92414915371879425, -0.9328049160227202, -0.063753814931844288, 0.69204299882615117,
+    0.69390120436153424, -0.14573807508951897, -0.79488416192814904, -0.094082819807381757,
+    0.39908874100031744, -0.57833913135264958, 0.38081388798580229, -0.18092935214793748,
+    0.36317354317902284, 0.7284367185684093, -0.57246731108635074, 0.89865965298314565,
+    -0.39297095099136747, -0.33807494181118669, -0.37078491475935327, -0.72911799407057365,
+    0.33228669843277281, -0.69546864540105158, 0.31457036329180488, -0.92524749130254957,
+    0.86889132199291663, 0.69157353587987536, 0.18158752619362795, 0.10929515823223412,
+    0.8350001759058796, -0.55119298005066486, 0.41559547624345661, 0.75914932962467407,
+    -0.48399789607338506, -0.64815833961971026, 0.45119232751950267, -0.79009669171185082,
+    0.20610358622209346, 0.65630816559135363, 0.11582048848076743, -0.39480767370891179,
+    -0.92203096576129595, -0.50336562353343028, 0.42426297414315073, 0.44114257741772689,
+};
+
+_Alignas(64) static const double b5[4] = {
+    -0.053277934879659643, -0.06129850994856028, -0.094530414135442317, -0.042365330058320119,
+};
+
+_Alignas(64) static const double w5[32] = {
+    -0.72645133069085488, -0.58244748766648002, 0.92075992837583653, -0.85756000962926082,
+    -0.89087395178660467, 0.10234745456946426, 0.2517351486029733, 0.94412622411927494,
+    0.55115447451879951, -0.33266937608489267, 0.70327555281262644, -0.93284342248590824,
+    0.019172285226719543, 0.1544678803321291, -0.72294011419775894, -0.77472412948250957,
+    -0.18922395500783995, 0.39288037521433106, -0.16953180319142147, -0.1112549207691359,
+    0.88951475168090077, -0.74526882997959332, -0.67011234428273159, -0.88541415514676558,
+    -0.8934731678541159, 0.66968988611814084, -0.053314011103154146, -0.3797524466085026,
+    0.63870719989701508, -0.95033186113011647, -0.53374502786143918, 0.9122558692061602,
+};
+
+
+void model_predict(double const *in, double *out)
+{
+    double h0[192];
+    double h1[48];
+    double h2[12];
+    double h3[10];
+    double h4[8];
+
+    /* layer 0 */
+    for (int f = 0; f < 3; f++)
+    for (int oy = 0; oy < 8; oy++)
+    for (int ox = 0; ox < 8; ox++) {
+        double z = 0;
+        for (int c = 0; c < 1; c++)
+        for (int ky = 0; ky < 3; ky++)
+        for (int kx = 0; kx < 3; kx++) {
+            int iy = oy*1 - 1 + ky, ix = ox*1 - 1 + kx;
+            if (iy < 0 || iy >= 8 || ix < 0 || ix >= 8) continue;
+            z += w0[f*9 + (c*3 + ky)*3 + kx] *
+                 in[(c*8 + iy)*8 + ix];
+        }
+        h0[(f*8 + oy)*8 + ox] = z + b0[f];
+    }
+    for (int i = 0; i < 192; i++)
+        h0[i] = h0[i] > 0 ? h0[i] : 0;
+
+    /* layer 1 */
+    for (int c = 0; c < 3; c++)
+    for (int oy = 0; oy < 4; oy++)
+    for (int ox = 0; ox < 4; ox++) {
+        double const *win = h0 + (c*8 + oy*2)*8 + ox*2;
+        double res = win[0];
+        for (int ky = 0; ky < 2; ky++)
+        for (int kx = 0; kx < 2; kx++)
+            res = win[ky*8 + kx] > res ? win[ky*8 + kx] : res;
+        h1[(c*4 + oy)*4 + ox] = res;
+    }
+
+    /* layer 2 */
+    for (int c = 0; c < 3; c++)
+    for (int oy = 0; oy < 2; oy++)
+    for (int ox = 0; ox < 2; ox++) {
+        double const *win = h1 + (c*4 + oy*2)*4 + ox*2;
+        double res = 0;
+        for (int ky = 0; ky < 2; ky++)
+        for (int kx = 0; kx < 2; kx++)
+            res += win[ky*4 + kx];
+        h2[(c*2 + oy)*2 + ox] = res / 4;
+    }
+
+    /* layer 3 */
+    for (int k = 0; k < 10; k++) {
+        double z0 = 0, z1 = 0, z2 = 0, z3 = 0;
+        int t = r3[k];
+        for (; t + 3 < r3[k + 1]; t += 4) {
+            z0 += v3[t] * h2[c3[t]];
+            z1 += v3[t + 1] * h2[c3[t + 1]];
+            z2 += v3[t + 2] * h2[c3[t + 2]];
+            z3 += v3[t + 3] * h2[c3[t + 3]];
+        }
+        for (; t < r3[k + 1]; t++)
+            z0 += v3[t] * h2[c3[t]];
+        h3[k] = (z0 + z1) + (z2 + z3) + b3[k];
+    }
+    for (int i = 0; i < 10; i++)
+        h3[i] = h3[i] > 0 ? h3[i] : 0;
+
+    /* layer 4 */
+    for (int k = 0; k < 8; k++) {
+        double z = 0;
+        for (int j = 0; j < 10; j++)
+            z += w4[k*10 + j] * h3[j];
+        h4[k] = z + b4[k];
+    }
+    for (int i = 0; i < 8; i++)
+        h4[i] = 1/(1 + expf(-h4[i]));
+
+    /* layer 5 */
+    for (int k = 0; k < 4; k++) {
+        double z = 0;
+        for (int j = 0; j < 8; j++)
+            z += w5[k*8 + j] * h4[j];
+        out[k] = z + b5[k];
+    }
+    {
+        double max = out[0], sum = 0;
+        for (int i = 0; i < 4; i++)
+            max = max < out[i] ? out[i] : max;
+        for (int i = 0; i < 4; i++)
+            sum += expf(out[i] - max);
+        for (int i = 0; i < 4; i++)
+            out[i] = expf(out[i] - max) / sum;
+    }
+}
@@ -10,7 +10,8 @@
 enum cnet_act_type {
     relu_act,                   // Rectified Linear Units
     sigmoid_act,                // Sigmoid
-    softmax_act                 // Softmax
+    softmax_act,                // Softmax
+    linear_act                  // Identity (no activation)
 };
 
 
@@ -29,20 +30,24 @@ typedef void cnet_act_func(double *, int);
 /**
  * Activation Function Derivative.
  *
- * This funcions will be in charge of computing the activation derivative.
- * The resulting value will be used, in conjunction with the cost
- * derivative, to compute the layer's delta.
+ * This funcions will be in charge of backpropagating the layer's delta
+ * through the activation: the given delta (the cost derivative over the
+ * activation output) is multiplied in-place by the activation derivative,
+ * giving the cost derivative over the original values.
  * IMPORTANT:
  *  - it will take as parameter the layer's output, and not the
  *    original values fed to the function.
- *  - it takes a single number, as the responsibility to update
- *    the layers delta using this value corresponds to the layer.
+ *  - it takes the whole layer, since some activations (softmax) are not
+ *    elementwise.
  *
- * @param double: Activation Output
- * @return double: Activation Derivative
+ * @param double const *: Activation Output
+ * @param double *: Delta (updated in-place)
+ * @param int: Size
  */
-typedef double cnet_act_func_dx(
-    double
+typedef void cnet_act_func_dx(
+    double const *,
+    double *,
+    int
 );
 
 
@@ -0,0 +1,254 @@
+/*****************************************************************************
+ *                                  BLAS
+ * Linear algebra routines used by the layers (dot, axpy, gemv, ger, gemm),
+ * over row-major matrices with leading dimensions (row lengths).
+ * The library ships its own implementation, built with the library by
+ * default. Building with CNET_CBLAS defined (make BLAS=openblas, or any
+ * CBLAS library) routes every call to the system CBLAS instead, so tuned
+ * vendor kernels are used with no changes in the layers code.
+ * The builtin gemm blocking and threads can be tuned per matrix shape
+ * (see tune.h): cnet_gemm looks up the parameters registered for its
+ * shape, falling back to the defaults.
+ * As the reference BLAS, the builtin backend skips the products by a zero
+ * of x (transposed gemv, ger) or of op(A) (gemm without B transposed), so
+ * that sparse activations and gradients cost little: a NaN or infinity
+ * only ever multiplied by such zeros may then not reach the result
+ * (whether a gemm product is skipped depends on its blocking).
+ ****************************************************************************/
+
+#ifndef CNET_BLAS_H
+#define CNET_BLAS_H
+
+
+/**
+ * Active backend name ("builtin" or "cblas").
+ *
+ * @return char const *: Backend name
+ */
+char const *cnet_blas_backend(void);
+
+
+/**
+ * Dot Product
+ *
+ * @param int n: Vectors size
+ * @param double const *x: Vector x
+ * @param double const *y: Vector y
+ * @return double: x . y
+ */
+double cnet_dot(
+    int n,
+    double const *x,
+    double const *y
+);
+
+
+/**
+ * Scaled Vector Addition
+ *
+ * Computes y += alpha * x.
+ *
+ * @param int n: Vectors size
+ * @param double alpha: Scale for x
+ * @param double const *x: Vector x
+ * @param double *y: Vector y
+ */
+void cnet_axpy(
+    int n,
+    double alpha,
+    double const *x,
+    double *y
+);
+
+
+/**
+ * General Matrix Vector Multiplication
+ *
+ * Computes y = alpha * op(A) * x + beta * y, where A is m x n and op(A)
+ * is A or its transpose (then x is sized m and y is sized n).
+ *
+ * @param int trans: Use A transposed
+ * @param int m: Rows of A
+ * @param int n: Columns of A
+ * @param double alpha: Scale for op(A) * x
+ * @param double const *a: Matrix A
+ * @param int lda: Leading dimension of A
+ * @param double const *x: Vector x
+ * @param double beta: Scale for y (0 to overwrite y)
+ * @param double *y: Vector y
+ */
+void cnet_gemv(
+    int trans,
+    int m,
+    int n,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *x,
+    double beta,
+    double *y
+);
+
+
+/**
+ * Rank One Update
+ *
+ * Computes A += alpha * x * y^T, where A is m x n.
+ *
+ * @param int m: Rows of A (size of x)
+ * @param int n: Columns of A (size of y)
+ * @param double alpha: Scale for x * y^T
+ * @param double const *x: Vector x
+ * @param double const *y: Vector y
+ * @param double *a: Matrix A
+ * @param int lda: Leading dimension of A
+ */
+void cnet_ger(
+    int m,
+    int n,
+    double alpha,
+    double const *x,
+    double const *y,
+    double *a,
+    int lda
+);
+
+
+/**
+ * General Matrix Multiplication
+ *
+ * Computes C = alpha * op(A) * op(B) + beta * C, where op(X) is X or its
+ * transpose. C is m x n, op(A) is m x k and op(B) is k x n.
+ *
+ * @param int trans_a: Use A transposed
+ * @param int trans_b: Use B transposed
+ * @param int m: Rows of C
+ * @param int n: Columns of C
+ * @param int k: Inner dimension
+ * @param double alpha: Scale for op(A) * op(B)
+ * @param double const *a: Matrix A
+ * @param int lda: Leading dimension of A
+ * @param double const *b: Matrix B
+ * @param int ldb: Leading dimension of B
+ * @param double beta: Scale for C (0 to overwrite C)
+ * @param double *c: Matrix C
+ * @param int ldc: Leading dimension of C
+ */
+void cnet_gemm(
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *b,
+    int ldb,
+    double beta,
+    double *c,
+    int ldc
+);
+
+
+/// Builtin gemm parameters
+
+
+#define CNET_GEMM_MAX_NR 8
+
+
+typedef struct cnet_gemm_params {
+
+    /* B rows per register block (1, 2, 4 or 8, others are rounded down) */
+    int nr;
+
+    /* inner dimension tile (0 for the whole inner dimension), changes
+       the rounding of the A * B^T products */
+    int kc;
+
+    /* parts of C (rows, or columns if wider than tall) computed in
+       parallel on the library pool (see tpool.h), 0 to split large
+       products automatically */
+    int threads;
+
+} cnet_gemm_params;
+
+
+/**
+ * Default gemm parameters (4 B rows per block, no tile, automatic split).
+ *
+ * @return cnet_gemm_params: Defaults
+ */
+cnet_gemm_params cnet_gemm_defaults(void);
+
+
+/**
+ * General Matrix Multiplication with the given parameters.
+ *
+ * Same as cnet_gemm (see its arguments), with the given parameters
+ * instead of the registered ones. The CBLAS backend ignores them.
+ *
+ * @param cnet_gemm_params const *params: Parameters
+ */
+void cnet_gemm_ex(
+    cnet_gemm_params const *params,
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *b,
+    int ldb,
+    double beta,
+    double *c,
+    int ldc
+);
+
+
+/**
+ * Register the gemm parameters for a shape.
+ *
+ * Every following cnet_gemm with this exact shape uses them. Registering
+ * a shape again replaces its parameters. Not thread safe: register at
+ * startup, before any gemm runs.
+ *
+ * @param int trans_a: Use A transposed
+ * @param int trans_b: Use B transposed
+ * @param int m: Rows of C
+ * @param int n: Columns of C
+ * @param int k: Inner dimension
+ * @param cnet_gemm_params params: Parameters
+ */
+void cnet_gemm_register(
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    cnet_gemm_params params
+);
+
+
+/**
+ * Registered gemm parameters for a shape.
+ *
+ * @param int trans_a: Use A transposed
+ * @param int trans_b: Use B transposed
+ * @param int m: Rows of C
+ * @param int n: Columns of C
+ * @param int k: Inner dimension
+ * @return cnet_gemm_params const *: Parameters, NULL if not registered
+ */
+cnet_gemm_params const *cnet_gemm_lookup(
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k
+);
+
+
+#endif /* CNET_BLAS_H */
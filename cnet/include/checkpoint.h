@@ -0,0 +1,101 @@
+/*****************************************************************************
+ *                               CHECKPOINT
+ * Background checkpoint writer for CNet.
+ * A snapshot of the network parameters is handed to a writer thread, which
+ * saves it into a temporary file, syncs it and atomically renames it over
+ * the checkpoint path (syncing its directory, so that the rename survives a
+ * crash). A failed write never replaces the last checkpoint. Training keeps
+ * going while the file is written.
+ ****************************************************************************/
+
+#ifndef CNET_CHECKPOINT_H
+#define CNET_CHECKPOINT_H
+
+#include "cnet.h"
+
+
+typedef struct cnet_ckpt cnet_ckpt;
+
+
+typedef struct cnet_ckpt_stats {
+
+    /* number of checkpoints written / dropped because a write was busy */
+    int written, skipped;
+
+    /* bytes written by the last checkpoint and in total */
+    long last_bytes, total_bytes;
+
+    /* write latency (snapshot handed over -> file renamed), in ms */
+    double last_ms, total_ms;
+
+} cnet_ckpt_stats;
+
+
+/**
+ * Create a checkpoint writer.
+ *
+ * Starts the writer thread. The snapshot buffers are allocated with the
+ * same layers as the given network, so only networks sharing its layers
+ * can be submitted afterwards.
+ *
+ * @param const cnet *nn: network to checkpoint
+ * @param char const *path: checkpoint file path
+ * @return cnet_ckpt *: writer, or NULL if the thread could not be started
+ */
+cnet_ckpt *cnet_ckpt_init(
+    cnet const *nn,
+    char const *path
+);
+
+
+/**
+ * Submit a checkpoint.
+ *
+ * Copies the current parameters into the snapshot buffers and wakes up the
+ * writer. At most one write is in flight: if the writer is still busy
+ * with the previous snapshot, the checkpoint is skipped and 0 is returned.
+ *
+ * @param cnet_ckpt *ckpt: writer
+ * @param const cnet *nn: network to snapshot
+ * @return int: 1 if the checkpoint was submitted, 0 if skipped
+ */
+int cnet_ckpt_submit(
+    cnet_ckpt *ckpt,
+    cnet const *nn
+);
+
+
+/**
+ * Wait for the in-flight checkpoint (if any) to be written.
+ *
+ * @param cnet_ckpt *ckpt: writer
+ */
+void cnet_ckpt_wait(
+    cnet_ckpt *ckpt
+);
+
+
+/**
+ * Get the writer statistics.
+ *
+ * @param cnet_ckpt *ckpt: writer
+ * @return cnet_ckpt_stats: copy of the current statistics
+ */
+cnet_ckpt_stats cnet_ckpt_get_stats(
+    cnet_ckpt *ckpt
+);
+
+
+/**
+ * Free the checkpoint writer.
+ *
+ * Waits for the in-flight checkpoint and stops the writer thread.
+ *
+ * @param cnet_ckpt *ckpt: writer
+ */
+void cnet_ckpt_free(
+    cnet_ckpt *ckpt
+);
+
+
+#endif /* CNET_CHECKPOINT_H */
@@ -7,6 +7,7 @@
 #ifndef CNET_H
 #define CNET_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include "activation.h"
 #include "loss.h"
@@ -15,6 +16,10 @@
 
 struct cnet;
 struct clayer;
+struct cnet_ckpt;
+struct cnet_team;
+struct cnet_dist;
+struct cnet_dataset;
 
 
 typedef struct cnet {
@@ -28,27 +33,111 @@ typedef struct cnet {
     /* layers */
     struct clayer **layers;
 
+    /* max input density (non-zero ratio) for the sparse input path */
+    double sparse_density;
+
+    /* background checkpoint writer (optional) */
+    struct cnet_ckpt *ckpt;
+    int ckpt_every;
+
+    /* samples accumulated per optimizer step */
+    int accum_steps;
+
+    /* worker team splitting the layers of nn_predict (optional) */
+    struct cnet_team *team;
+
+    /* pipeline parallel training stages, and samples per micro-batch */
+    int pipe_stages, pipe_micro;
+
+    /* ring of processes averaging the training gradients (optional) */
+    struct cnet_dist *dist;
+
 } cnet;
 
 
+enum cnet_layer_type {
+    dense_layer,                // Fully Connected
+    conv2d_layer,               // 2D Convolution
+    maxpool_layer,              // 2D Max Pooling
+    avgpool_layer,              // 2D Average Pooling
+    sparse_layer,               // Fully Connected, CSR weights (inference)
+    embedding_layer             // Categorical indices to learned vectors
+};
+
+
+enum cnet_half_type {
+    half_none,                  // Full precision weights only
+    half_bf16,                  // bfloat16 weights (8 bits exponent)
+    half_fp16                   // IEEE fp16 weights (5 bits exponent)
+};
+
+
+typedef struct cnet_shape {
+
+    /* channels x height x width, stored channel by channel */
+    int channels, height, width;
+
+} cnet_shape;
+
+
 typedef struct clayer {
 
+    /* layer type */
+    enum cnet_layer_type type;
+
     /* input/output dimensions */
     int in_size, out_size;
 
+    /* spatial dimensions and window (conv/pool layers) */
+    cnet_shape in_shape, out_shape;
+    int kernel, stride, padding;
+
     /* activation type */
     enum cnet_act_type activation; 
 
-    /* trainable parameters */
+    /* trainable parameters (weights rows share one contiguous block) */
+    int w_rows, w_cols, b_size;
     double **weights;
     double *bias;
 
+    /* 16 bit copy of the weights read by the forward passes (dense
+       layers, see half.h), NULL when using the weights directly */
+    enum cnet_half_type half_type;
+    uint16_t *half;
+
+    /* accumulated gradient (weights, then biases), inside the nn_train
+       gradient buffer, NULL if the updates are applied at every sample */
+    double *grad;
+
+    /* rows of the accumulated gradient touched since the last optimizer
+       step, and a mark per row (embedding layers, see embedding.h) */
+    int n_touched;
+    int *touched;
+    unsigned char *touched_mark;
+
+    /* pruning mask (1 keeps the weight), kept during training if set */
+    unsigned char *mask;
+
+    /* compressed sparse row weights (sparse layers) */
+    int csr_nnz;
+    int *csr_rows, *csr_cols;
+    double *csr_vals;
+
     /* output */
     double *output;
 
     /* delta (backprop purposes) */
     double *delta;
 
+    /* im2col buffer (conv layers), or widened weights row (half layers) */
+    double *cols;
+
+    /* non-zero inputs of the last sample, or nnz = -1 if it was dense
+       (first layer only, when dense) */
+    int nnz;
+    int *nz_idx;
+    double *nz_val;
+
 } clayer;
 
 
@@ -86,7 +175,7 @@ void nn_free(
  * Assumes that the nn_init method was called, and all cnet* attributes
  * are correctly initialized.
  * The weights for the layer will be initialized with uniform
- * random numbers between 0 and 1.
+ * random numbers between -0.5 and 0.5 (seeded through cnet_seed).
  * Will assert if there is any inconsistency when adding a new layer.
  *
  * @param cnet *nn: cnet
@@ -102,6 +191,227 @@ void nn_add(
 );
 
 
+/**
+ * Add a 2D Convolution Layer to the cnet.
+ *
+ * The layer input is seen as an image with the given shape, convolved
+ * with `filters` square kernels. Its output has one channel per filter.
+ * Computed through im2col and a matrix product (see conv.h).
+ *
+ * @param cnet *nn: cnet
+ * @param cnet_shape in_shape: Input shape (must match the previous layer size)
+ * @param int filters: Number of filters (output channels)
+ * @param int kernel: Kernel size
+ * @param int stride: Stride
+ * @param int padding: Zero padding added to every border
+ * @param cnet_act_type activation: Activation type for the new layer.
+ */
+void nn_add_conv2d(
+    cnet *nn,
+    cnet_shape in_shape,
+    int filters,
+    int kernel,
+    int stride,
+    int padding,
+    enum cnet_act_type activation
+);
+
+
+/**
+ * Add a 2D Pooling Layer to the cnet.
+ *
+ * Downsamples every channel of the input using square windows.
+ * Pooling layers have no trainable parameters nor activation.
+ *
+ * @param cnet *nn: cnet
+ * @param cnet_layer_type type: maxpool_layer or avgpool_layer
+ * @param cnet_shape in_shape: Input shape (must match the previous layer size)
+ * @param int size: Window size
+ * @param int stride: Stride
+ */
+void nn_add_pool(
+    cnet *nn,
+    enum cnet_layer_type type,
+    cnet_shape in_shape,
+    int size,
+    int stride
+);
+
+
+/**
+ * Add a Sparse Layer to the cnet.
+ *
+ * Fully connected layer holding its weights in CSR format, with room for
+ * nnz non-zero weights (all zeros until filled). Sparse layers are meant
+ * for inference: they are usually created by nn_sparsify (see sparse.h)
+ * and cannot be trained.
+ *
+ * @param cnet *nn: cnet
+ * @param int in_size: Input size for the new layer
+ * @param int out_size: Output size for the new layer
+ * @param int nnz: Number of non-zero weights
+ * @param cnet_act_type activation: Activation type for the new layer.
+ */
+void nn_add_sparse(
+    cnet *nn,
+    int in_size,
+    int out_size,
+    int nnz,
+    enum cnet_act_type activation
+);
+
+
+/**
+ * Add an Embedding Layer to the cnet.
+ *
+ * The network input holds `fields` category indices (integer values
+ * stored as doubles, between 0 and vocab - 1). Each of them is replaced
+ * by its row of a vocab x dim table, so the layer outputs fields x dim
+ * values. Only the rows of the given indices are read and trained (see
+ * embedding.h). Must be the first layer, has no biases nor activation.
+ *
+ * @param cnet *nn: cnet
+ * @param int fields: Number of categorical inputs
+ * @param int vocab: Number of categories (table rows)
+ * @param int dim: Embedding size (table columns)
+ */
+void nn_add_embedding(
+    cnet *nn,
+    int fields,
+    int vocab,
+    int dim
+);
+
+
+/**
+ * Clone cnet.
+ *
+ * Creates a new cnet with the same layers as the given one,
+ * and copies all the trainable parameters into it.
+ *
+ * @param const cnet *nn: cnet
+ * @return cnet *: newly allocated clone
+ */
+cnet *nn_clone(
+    cnet const *nn
+);
+
+
+/**
+ * Copy cnet parameters.
+ *
+ * Copies every layer bias and weights from src into dst.
+ * Both networks must share the same layers.
+ *
+ * @param cnet *dst: destination cnet
+ * @param const cnet *src: source cnet
+ */
+void nn_copy_params(
+    cnet *dst,
+    cnet const *src
+);
+
+
+/**
+ * Set the checkpoint writer.
+ *
+ * During nn_train, a snapshot of the network will be handed to the given
+ * writer every `every` training steps. The writer saves it in the background,
+ * so training is not stalled by the I/O. Pass NULL to disable.
+ *
+ * @param cnet *nn: cnet
+ * @param cnet_ckpt *ckpt: checkpoint writer (see checkpoint.h)
+ * @param int every: number of training steps between checkpoints
+ */
+void nn_set_checkpoint(
+    cnet *nn,
+    struct cnet_ckpt *ckpt,
+    int every
+);
+
+
+/**
+ * Set the gradient accumulation.
+ *
+ * During nn_train, the gradients of `steps` consecutive samples are
+ * accumulated into a single gradient buffer, then averaged and applied in
+ * one optimizer step, for an effective batch of `steps` samples. Memory
+ * stays bounded by a single sample activations, plus one gradient per
+ * parameter. Defaults to 1 (SGD, weights updated after every sample).
+ *
+ * @param cnet *nn: cnet
+ * @param int steps: Samples per optimizer step
+ */
+void nn_set_accumulation(
+    cnet *nn,
+    int steps
+);
+
+
+/**
+ * Set the single sample prediction team.
+ *
+ * nn_predict splits the output neurons of every dense layer between the
+ * threads of the team (see team.h), which meet at a spin barrier before
+ * the next layer; the other layers (and dense layers with 16 bit weights
+ * or sparse inputs) are computed by the calling thread. This cuts the
+ * latency of single predictions through wide layers, the results are the
+ * same as without a team. The team is still owned by the caller.
+ *
+ * @param cnet *nn: cnet
+ * @param cnet_team *team: worker team, NULL to predict on the caller only
+ */
+void nn_set_team(
+    cnet *nn,
+    struct cnet_team *team
+);
+
+
+/**
+ * Set the pipeline parallel training.
+ *
+ * During nn_train, the layers are split into `stages` groups of
+ * consecutive layers, each one trained by its own thread (see
+ * pipeline.h). Every batch of nn_set_accumulation samples is cut into
+ * micro-batches of `micro_batch` samples streamed through the stages,
+ * and its gradient is applied once the whole batch went through: the
+ * updates are those of the accumulation alone, up to rounding. Dense
+ * layers with full precision weights only. Defaults to 1 (no pipeline).
+ *
+ * @param cnet *nn: cnet
+ * @param int stages: Number of stages (threads)
+ * @param int micro_batch: Samples per micro-batch
+ */
+void nn_set_pipeline(
+    cnet *nn,
+    int stages,
+    int micro_batch
+);
+
+
+/**
+ * Set the distributed training.
+ *
+ * nn_train starts by copying the parameters of the rank 0 to every rank of
+ * the ring (see dist.h), which then train the same network over their own
+ * shard of the dataset: every optimizer step applies the gradient summed
+ * over all the ranks, averaged over all their samples (nn_set_accumulation
+ * samples per rank). The ranks must train for the same number of epochs;
+ * the ones with smaller shards take empty steps at the end of the epochs.
+ * The losses and metrics are those of the local shards. The whole
+ * gradients are summed at every step, embedding tables included (the
+ * ranks touch different rows), so large vocabularies make for costly
+ * steps. The communicator is still owned by the caller.
+ *
+ * @param cnet *nn: cnet
+ * @param cnet_dist *dist: communicator, NULL to train alone
+ */
+void nn_set_dist(
+    cnet *nn,
+    struct cnet_dist *dist
+);
+
+
 /**
  * CNet Prediction. 
  *
@@ -115,11 +425,89 @@ const double *nn_predict(
 );
 
 
+/**
+ * CNet Sparse Prediction.
+ *
+ * Predicts over a single sample given as a list of non-zero inputs.
+ * The first layer must be a dense layer.
+ *
+ * @param const cnet *nn: cnet
+ * @param int const *idx: Non-zero inputs indices
+ * @param double const *val: Non-zero inputs values
+ * @param int nnz: Number of non-zero inputs
+ * @return const double *: Pointer to results (sized nn->out_size)
+ */
+const double *nn_predict_sparse(
+    cnet const *nn,
+    int const *idx,
+    double const *val,
+    int nnz
+);
+
+
+/**
+ * Set the sparse input threshold.
+ *
+ * When the first layer is dense, nn_predict and nn_train check every input
+ * for zeros. Inputs with a density (non-zero ratio) up to the given
+ * threshold only go through the weights of their non-zero values, in both
+ * the forward and the backward passes. Results are the same as the dense
+ * path. Defaults to 0.5, use 0 to disable.
+ *
+ * @param cnet *nn: cnet
+ * @param double density: Max density for the sparse path
+ */
+void nn_set_sparse_input(
+    cnet *nn,
+    double density
+);
+
+
+/**
+ * CNet Batch Workspace Size.
+ *
+ * Number of doubles needed as workspace by nn_predict_batch.
+ *
+ * @param const cnet *nn: cnet
+ * @param int batch: Number of samples per batch
+ * @return int: Workspace size (in doubles)
+ */
+int nn_workspace_size(
+    cnet const *nn,
+    int batch
+);
+
+
+/**
+ * CNet Batch Prediction.
+ *
+ * Predicts over a batch of samples. Unlike nn_predict, the intermediate
+ * outputs are kept in the given workspace instead of the layers, so
+ * several threads can predict with the same cnet at the same time,
+ * as long as each one uses its own workspace.
+ *
+ * @param const cnet *nn: cnet
+ * @param double **X: Inputs (batch samples, sized nn->in_size)
+ * @param int batch: Number of samples
+ * @param double *out: Results (sized batch x nn->out_size)
+ * @param double *workspace: Workspace (sized nn_workspace_size)
+ */
+void nn_predict_batch(
+    cnet const *nn,
+    double **X,
+    int batch,
+    double *out,
+    double *workspace
+);
+
+
 /**
  * Train the network.
  *
- * Performs backward passes through the net using SGD (single training sample)
- * It shuffles (in-place) the X and Y in every epoch to achieve better results.
+ * Performs backward passes through the net using SGD (single training sample),
+ * or mini-batches when accumulating gradients (see nn_set_accumulation).
+ * The samples are visited in a new random order in every epoch, through a
+ * shuffled index: the X and Y arrays are left untouched.
  *
  * @param const cnet *nn: cnet
  * @param double const** X_train: Train Inputs
@@ -148,15 +536,88 @@ void nn_train(
 );
 
 
+/**
+ * Train the network with class index targets.
+ *
+ * Same as nn_train, with the expected outputs given as class indices
+ * instead of one-hot rows: y[i] = c stands for an expected output with a
+ * 1 at position c and zeros elsewhere. The loss and metric only read the
+ * target class, so no one-hot row is ever built, nor scanned. Nothing is
+ * trained if a class is out of [0, out_size) (reported on stderr).
+ *
+ * @param const cnet *nn: cnet
+ * @param double const** X_train: Train Inputs
+ * @param int const* y_train: Train Expected classes
+ * @param double const** X_val: Val Inputs
+ * @param int const* y_val: Val Expected classes
+ * @param int train_size: Number of training samples
+ * @param int val_size: Number of validation samples
+ * @param cnet_loss_type loss_type: Cost function type
+ * @param cnet_metric_type metric_type: Metric type to use
+ * @param double learning_rate: Learning rate
+ * @return int: 0, or -1 if a class is out of the network outputs
+ */
+int nn_train_labels(
+    cnet const *nn,
+    double **X_train,
+    int const *y_train,
+    double **X_val,
+    int const *y_val,
+    int train_size,
+    int val_size,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double learning_rate,
+    int epochs,
+    FILE *history_file
+);
+
+
+/**
+ * Train the network over dataset sources.
+ *
+ * Same as nn_train, with the samples handed out a batch at a time by the
+ * datasets (see dataset.h): the training set is shuffled by the source at
+ * every epoch, so a file source trains over a dataset larger than the
+ * memory with only a chunk of it loaded. nn_train is this function over
+ * in-memory datasets. With a pipeline (see nn_set_pipeline), the batches of
+ * accumulated samples do not span two batches of the dataset: use dataset
+ * batches of a multiple of the accumulated samples. The training stops
+ * at the first batch which fails to load, or holds a class out of the
+ * network outputs (reported on stderr), the network keeping the steps
+ * taken so far; a distributed training then leaves the other ranks on a
+ * broken ring. Without validation samples, the validation loss and metric
+ * are logged as zeros.
+ *
+ * @param const cnet *nn: cnet
+ * @param cnet_dataset *train: Training set
+ * @param cnet_dataset *val: Validation set (NULL for none)
+ * @param cnet_loss_type loss_type: Cost function type
+ * @param cnet_metric_type metric_type: Metric type to use
+ * @param double learning_rate: Learning rate
+ * @return int: 0, or -1 if the training stopped on a batch
+ */
+int nn_train_dataset(
+    cnet const *nn,
+    struct cnet_dataset *train,
+    struct cnet_dataset *val,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double learning_rate,
+    int epochs,
+    FILE *history_file
+);
+
+
 /**
  * Load the network from FILE.
  *
  * Initializes and reads the network weights from the given FILE.
- * The FILE must follow the given structure, or else this function will return
- * a corrupt nn and maybe even crash when being fred.
+ * Every value is checked as it is read, and every layer against the
+ * previous ones: a truncated or corrupted FILE gives no network.
  *
  * @param FILE: network saved file.
- * @return cnet *: cnet
+ * @return cnet *: cnet, or NULL if the FILE is not a complete network
  */
 cnet *nn_load(
     FILE *in
@@ -167,11 +628,17 @@ cnet *nn_load(
  * Save the network into FILE.
  *
  * Saves the given network into a file, following the following structure:
+ * cnet version
  * in_size out_size n_layers
- * layer_in_size layer_out_size layer_act_type
+ * layer_type layer_in_size layer_out_size layer_act_type
+ * channels height width kernel stride padding (conv/pool layers only)
+ * nnz row_offsets ... (sparse layers only)
+ * vocab dim (embedding layers only)
  * layer_bias ...
- * layer_weights ...
+ * layer_weights ... (col value pairs per row for sparse layers)
  * ...
+ * Files without the version line (version 1) only contain dense layers,
+ * with no layer_type; these can still be loaded.
  *
  * @param cnet *nn: cnet
  * @param FILE out: output file
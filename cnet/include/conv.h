@@ -0,0 +1,148 @@
+/*****************************************************************************
+ *                               CONVOLUTION
+ * Forward and backward passes for the 2D convolution and pooling layers.
+ * Convolutions are lowered to matrix products through im2col/col2im:
+ * every column of the im2col matrix holds the input window of one output
+ * position, so the layer output is simply weights x columns.
+ ****************************************************************************/
+
+#ifndef CNET_CONV_H
+#define CNET_CONV_H
+
+#include "cnet.h"
+
+
+/**
+ * Image to Columns
+ *
+ * Unrolls every kernel window of the input into a column of the
+ * destination matrix, sized (channels * kernel * kernel) x (out_h * out_w).
+ * Windows falling on the padding are filled with zeros.
+ *
+ * @param double const *in: Input image (shape)
+ * @param cnet_shape shape: Input shape
+ * @param int kernel: Kernel size
+ * @param int stride: Stride
+ * @param int padding: Zero padding
+ * @param double *cols: Destination matrix
+ */
+void cnet_im2col(
+    double const *in,
+    cnet_shape shape,
+    int kernel,
+    int stride,
+    int padding,
+    double *cols
+);
+
+
+/**
+ * Columns to Image
+ *
+ * Inverse of cnet_im2col: accumulates every column back into its window
+ * of the destination image. The destination is not cleared.
+ *
+ * @param double const *cols: Columns matrix
+ * @param cnet_shape shape: Image shape
+ * @param int kernel: Kernel size
+ * @param int stride: Stride
+ * @param int padding: Zero padding
+ * @param double *in: Destination image
+ */
+void cnet_col2im(
+    double const *cols,
+    cnet_shape shape,
+    int kernel,
+    int stride,
+    int padding,
+    double *in
+);
+
+
+/**
+ * Convolution Forward Pass
+ *
+ * Computes the (not activated) convolution output for a single sample.
+ *
+ * @param clayer const *layer: Convolution layer
+ * @param double const *in: Input (sized layer->in_size)
+ * @param double *out: Output (sized layer->out_size)
+ * @param double *cols: im2col buffer (sized layer->w_cols x output positions)
+ */
+void cnet_conv_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    double *cols
+);
+
+
+/**
+ * Convolution Parameters Gradient
+ *
+ * Adds the scaled filters and biases gradient, computed from the layer
+ * delta and the im2col buffer filled by the last forward pass, to the
+ * given buffers. Pass the layer parameters and -learning_rate to update
+ * them directly, or a gradient buffer and 1 to accumulate.
+ *
+ * @param clayer const *layer: Convolution layer
+ * @param double scale: Gradient scale
+ * @param double *dw: Filters destination (w_rows x w_cols)
+ * @param double *db: Biases destination (w_rows)
+ */
+void cnet_conv_gradient(
+    clayer const *layer,
+    double scale,
+    double *dw,
+    double *db
+);
+
+
+/**
+ * Convolution Delta Backpropagation
+ *
+ * Computes the derivative of the cost over the layer input, using the
+ * layer delta. The im2col buffer is used as scratch space.
+ *
+ * @param clayer *layer: Convolution layer
+ * @param double *dst: Destination (sized layer->in_size)
+ */
+void cnet_conv_backprop(
+    clayer *layer,
+    double *dst
+);
+
+
+/**
+ * Pooling Forward Pass
+ *
+ * @param clayer const *layer: Pooling layer
+ * @param double const *in: Input (sized layer->in_size)
+ * @param double *out: Output (sized layer->out_size)
+ */
+void cnet_pool_forward(
+    clayer const *layer,
+    double const *in,
+    double *out
+);
+
+
+/**
+ * Pooling Delta Backpropagation
+ *
+ * Routes the layer delta back to the input positions of every window:
+ * the max element for max pooling, evenly spread for average pooling.
+ * Max positions are recomputed from the input.
+ *
+ * @param clayer const *layer: Pooling layer
+ * @param double const *in: Input used in the forward pass
+ * @param double *dst: Destination (sized layer->in_size)
+ */
+void cnet_pool_backprop(
+    clayer const *layer,
+    double const *in,
+    double *dst
+);
+
+
+#endif /* CNET_CONV_H */
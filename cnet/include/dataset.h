@@ -0,0 +1,189 @@
+/*****************************************************************************
+ *                                 DATASET
+ * Dataset sources, for training over datasets larger than the memory.
+ * A dataset yields its samples a batch at a time, in a new order at every
+ * shuffled epoch (see nn_train_dataset). Three sources are provided:
+ *   - arrays: samples already in memory (what nn_train uses)
+ *   - mapped: inputs and targets read from memory mapped files (see
+ *     matrix.h), converted a chunk of rows at a time, the pages of a chunk
+ *     being prefetched before and dropped after its conversion
+ *   - chunked: same, with every chunk read by a large sequential read of
+ *     each file, the next chunk being read by a thread while the current
+ *     one is trained
+ * The files sources only hold a chunk of converted rows (and for the
+ * chunked one, the bytes of the chunk read ahead), whatever the size of
+ * the files.
+ * Shuffling a file source shuffles the order of its chunks, and the rows
+ * within every chunk, so that the files are still read chunk by chunk.
+ * Other sources implement cnet_dataset_ops, in a struct starting with a
+ * cnet_dataset.
+ ****************************************************************************/
+
+#ifndef CNET_DATASET_H
+#define CNET_DATASET_H
+
+#include "matrix.h"
+
+
+typedef struct cnet_dataset cnet_dataset;
+
+
+typedef struct cnet_batch {
+
+    /* inputs */
+    double **X;
+
+    /* expected outputs, or expected classes (the other one is NULL) */
+    double **Y;
+    int const *labels;
+
+    /* number of samples */
+    int size;
+
+} cnet_batch;
+
+
+typedef struct cnet_dataset_ops {
+
+    /* number of samples */
+    int (*size)(cnet_dataset *ds);
+
+    /* start an epoch, in a new random order if shuffle is set, else in the
+       dataset order */
+    void (*rewind)(cnet_dataset *ds, int shuffle);
+
+    /* next batch of the epoch (valid until the next call): 1, 0 at its end,
+       -1 if it failed to load */
+    int (*next)(cnet_dataset *ds, cnet_batch *batch);
+
+    /* free the dataset */
+    void (*free)(cnet_dataset *ds);
+
+} cnet_dataset_ops;
+
+
+struct cnet_dataset {
+    cnet_dataset_ops const *ops;
+};
+
+
+/**
+ * Create a dataset over samples in memory.
+ *
+ * Shuffling only permutes the pointers handed out, the arrays are still
+ * owned by the caller and are never modified.
+ *
+ * @param double **X: Inputs
+ * @param double **Y: Expected outputs (NULL if labels is given)
+ * @param int const *labels: Expected classes (NULL if Y is given)
+ * @param int size: Number of samples
+ * @param int batch: Samples per batch
+ * @return cnet_dataset *: Dataset
+ */
+cnet_dataset *cnet_dataset_arrays(
+    double **X,
+    double **Y,
+    int const *labels,
+    int size,
+    int batch
+);
+
+
+/**
+ * Create a dataset over memory mapped files.
+ *
+ * The targets are the expected outputs, or the expected classes (a single
+ * column) if labels is set; they are not scaled. Loading a class which is
+ * not a whole non negative number fails the batch. The dataset takes the
+ * ownership of the matrices.
+ *
+ * @param cnet_matrix *inputs: Inputs, a sample per row
+ * @param cnet_matrix *targets: Targets, as many rows as the inputs
+ * @param int labels: The targets are the expected classes
+ * @param int chunk: Rows per chunk
+ * @param int batch: Samples per batch (the chunks are rounded up to whole
+ *                   batches)
+ * @return cnet_dataset *: Dataset, or NULL if the matrices do not match
+ *                         (they are then still owned by the caller)
+ */
+cnet_dataset *cnet_dataset_mapped(
+    cnet_matrix *inputs,
+    cnet_matrix *targets,
+    int labels,
+    int chunk,
+    int batch
+);
+
+
+/**
+ * Create a dataset over files read a chunk at a time.
+ *
+ * Same as cnet_dataset_mapped, the files being read with sequential reads
+ * of whole chunks (the mappings are not used), and dropped from the page
+ * cache once read. A file which cannot be read anymore fails the batch.
+ *
+ * @param cnet_matrix *inputs: Inputs, a sample per row
+ * @param cnet_matrix *targets: Targets, as many rows as the inputs
+ * @param int labels: The targets are the expected classes
+ * @param int chunk: Rows per chunk
+ * @param int batch: Samples per batch
+ * @return cnet_dataset *: Dataset, or NULL if the matrices do not match
+ */
+cnet_dataset *cnet_dataset_chunked(
+    cnet_matrix *inputs,
+    cnet_matrix *targets,
+    int labels,
+    int chunk,
+    int batch
+);
+
+
+/**
+ * Number of samples of a dataset.
+ *
+ * @param cnet_dataset *ds: Dataset
+ * @return int: Number of samples
+ */
+int cnet_dataset_size(
+    cnet_dataset *ds
+);
+
+
+/**
+ * Start an epoch.
+ *
+ * @param cnet_dataset *ds: Dataset
+ * @param int shuffle: 1 for a new random order, 0 for the dataset order
+ */
+void cnet_dataset_rewind(
+    cnet_dataset *ds,
+    int shuffle
+);
+
+
+/**
+ * Next batch of the epoch.
+ *
+ * @param cnet_dataset *ds: Dataset
+ * @param cnet_batch *batch: Destination of the batch, valid until the
+ *                           next call on the dataset
+ * @return int: 1, 0 at the end of the epoch, or -1 if the batch failed to
+ *              load (reported on stderr)
+ */
+int cnet_dataset_next(
+    cnet_dataset *ds,
+    cnet_batch *batch
+);
+
+
+/**
+ * Free a dataset (NULL is ignored).
+ *
+ * @param cnet_dataset *ds: Dataset
+ */
+void cnet_dataset_free(
+    cnet_dataset *ds
+);
+
+
+#endif /* CNET_DATASET_H */
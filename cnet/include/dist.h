@@ -0,0 +1,135 @@
+/*****************************************************************************
+ *                                  DIST
+ * Multi-process data parallel training (see nn_set_dist).
+ * Every process (rank) trains the same network over its own shard of the
+ * dataset, and the ranks sum their gradients before every optimizer step
+ * with a ring all-reduce: each rank only talks to its two neighbours of a
+ * ring of TCP or Unix domain socket connections, and sends 2 (n - 1) / n
+ * times the gradient size whatever the number of ranks. The transfers are
+ * cut into chunks, sent and received at once, and run on a communication
+ * thread: the gradient of a layer is reduced while the next layers are
+ * still backpropagating.
+ ****************************************************************************/
+
+#ifndef CNET_DIST_H
+#define CNET_DIST_H
+
+
+typedef struct cnet_dist cnet_dist;
+
+
+/**
+ * Join a ring of processes.
+ *
+ * Every rank listens on its own address, connects to the next rank and
+ * accepts the previous one, retrying until the whole ring is up. The
+ * addresses are given as:
+ *   - "unix:<path>": Unix domain sockets, rank r listening on <path>.r
+ *   - "tcp:<host>:<port>": rank r listening on port <port> + r of a single
+ *     host (local processes over loopback)
+ *   - "tcp:<host>:<port>,<host>:<port>,...": one address per rank
+ *
+ * @param int rank: Rank of this process (0 to size - 1)
+ * @param int size: Number of processes
+ * @param char const *address: Ring addresses
+ * @return cnet_dist *: Communicator, or NULL if the ring could not be set up
+ */
+cnet_dist *cnet_dist_init(
+    int rank,
+    int size,
+    char const *address
+);
+
+
+/**
+ * Leave the ring, closing the connections.
+ *
+ * @param cnet_dist *dist: Communicator
+ */
+void cnet_dist_free(
+    cnet_dist *dist
+);
+
+
+/**
+ * Rank of this process.
+ *
+ * @param cnet_dist const *dist: Communicator
+ * @return int: Rank
+ */
+int cnet_dist_rank(
+    cnet_dist const *dist
+);
+
+
+/**
+ * Number of processes of the ring.
+ *
+ * @param cnet_dist const *dist: Communicator
+ * @return int: Number of processes
+ */
+int cnet_dist_size(
+    cnet_dist const *dist
+);
+
+
+/**
+ * Start summing a buffer over all the ranks.
+ *
+ * The buffer is reduced in the background, in the submission order, and
+ * must not be touched until cnet_dist_wait. Every rank must submit the
+ * same sizes in the same order.
+ *
+ * @param cnet_dist *dist: Communicator
+ * @param double *buf: Buffer, replaced by its sum over the ranks
+ * @param long n: Buffer size
+ */
+void cnet_dist_allreduce_async(
+    cnet_dist *dist,
+    double *buf,
+    long n
+);
+
+
+/**
+ * Wait for the submitted all-reduces.
+ *
+ * @param cnet_dist *dist: Communicator
+ * @return int: 0, or -1 if a connection failed (the ring is then broken)
+ */
+int cnet_dist_wait(
+    cnet_dist *dist
+);
+
+
+/**
+ * Sum a buffer over all the ranks.
+ *
+ * @param cnet_dist *dist: Communicator
+ * @param double *buf: Buffer, replaced by its sum over the ranks
+ * @param long n: Buffer size
+ * @return int: 0, or -1 if a connection failed
+ */
+int cnet_dist_allreduce(
+    cnet_dist *dist,
+    double *buf,
+    long n
+);
+
+
+/**
+ * Copy a buffer of rank 0 to all the ranks.
+ *
+ * @param cnet_dist *dist: Communicator
+ * @param double *buf: Buffer, replaced by the one of rank 0
+ * @param long n: Buffer size
+ * @return int: 0, or -1 if a connection failed
+ */
+int cnet_dist_broadcast(
+    cnet_dist *dist,
+    double *buf,
+    long n
+);
+
+
+#endif /* CNET_DIST_H */
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *                                EMBEDDING
+ * Forward and backward passes for the embedding layers.
+ * An embedding layer maps categorical inputs to learned vectors: its input
+ * holds one category index per field (stored as doubles), and every field
+ * is replaced by its row of the embeddings table (vocab x dim, the layer
+ * weights). The output is the concatenation of the fields rows.
+ * Only the rows of the given indices are read in the forward pass, and
+ * updated in the backward pass, so a sample costs a few rows no matter
+ * the vocabulary size. When accumulating gradients, the optimizer steps
+ * only apply and clear the touched rows too, except in distributed
+ * training, where the whole table gradient is summed over the ranks.
+ ****************************************************************************/
+
+#ifndef CNET_EMBEDDING_H
+#define CNET_EMBEDDING_H
+
+#include "cnet.h"
+
+
+/**
+ * Embedding Forward Pass
+ *
+ * Gathers the embeddings rows of the given indices, for a batch of inputs.
+ *
+ * @param clayer const *layer: Embedding layer
+ * @param double const *in: Indices (sized batch x layer->in_size)
+ * @param double *out: Outputs (sized batch x layer->out_size)
+ * @param int batch: Number of samples
+ */
+void cnet_embedding_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    int batch
+);
+
+
+/**
+ * Embedding Weights Gradient
+ *
+ * Scatters the scaled layer delta into the rows of the given indices
+ * (a field index appearing twice gets both contributions), every other
+ * row is left untouched.
+ *
+ * @param clayer const *layer: Embedding layer
+ * @param double const *in: Indices of the last forwarded sample
+ * @param double scale: Gradient scale
+ * @param double *dw: Destination table (vocab x dim)
+ */
+void cnet_embedding_gradient(
+    clayer const *layer,
+    double const *in,
+    double scale,
+    double *dw
+);
+
+
+/**
+ * Embedding Touched Rows
+ *
+ * Records the rows of the given indices as touched since the last
+ * optimizer step (once each), when the layer tracks them.
+ *
+ * @param clayer *layer: Embedding layer
+ * @param double const *in: Indices of the last forwarded sample
+ */
+void cnet_embedding_touch(
+    clayer *layer,
+    double const *in
+);
+
+
+/**
+ * Embedding Optimizer Step
+ *
+ * Applies the accumulated gradient of the touched rows (scaled) to the
+ * embeddings table, then clears them: a step costs the rows touched since
+ * the previous one, no matter the vocabulary size.
+ *
+ * @param clayer *layer: Embedding layer (tracking its touched rows)
+ * @param double scale: Gradient scale
+ */
+void cnet_embedding_step(
+    clayer *layer,
+    double scale
+);
+
+
+#endif /* CNET_EMBEDDING_H */
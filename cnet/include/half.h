@@ -0,0 +1,105 @@
+/*****************************************************************************
+ *                                  HALF
+ * 16 bit weights storage (bfloat16 or IEEE fp16) for the dense layers.
+ * A half layer keeps its full precision weights as master copy, for the
+ * training updates, plus a 16 bit copy that the forward passes read: rows
+ * are widened back to double right before their dot products, so memory
+ * traffic for the weights is divided by four, while accumulating in
+ * double. Saved models only store the 16 bit weights.
+ * Conversions use F16C when the library is built with it (e.g. -mf16c or
+ * -march=native), and a portable software fallback otherwise.
+ ****************************************************************************/
+
+#ifndef CNET_HALF_H
+#define CNET_HALF_H
+
+#include <stdint.h>
+#include "cnet.h"
+
+
+/**
+ * Set the weights storage of the network.
+ *
+ * Every dense layer gets a 16 bit copy of its weights (or drops it with
+ * half_none), used from then on by the forward passes. nn_train keeps
+ * updating the master weights, refreshing the 16 bit copy after each
+ * update. Plans must be compiled again.
+ *
+ * @param cnet *nn: cnet
+ * @param cnet_half_type type: Storage type
+ */
+void nn_set_half(
+    cnet *nn,
+    enum cnet_half_type type
+);
+
+
+/**
+ * Set the weights storage of a layer (dense layers only).
+ *
+ * @param clayer *layer: Dense layer
+ * @param cnet_half_type type: Storage type
+ */
+void cnet_layer_half(
+    clayer *layer,
+    enum cnet_half_type type
+);
+
+
+/**
+ * Refresh the 16 bit weights of a layer from its master weights.
+ * Does nothing if the layer has no 16 bit copy.
+ *
+ * @param clayer *layer: Layer
+ */
+void cnet_half_refresh(
+    clayer *layer
+);
+
+
+/**
+ * Pack doubles into 16 bit values (rounded to nearest even).
+ *
+ * @param cnet_half_type type: half_bf16 or half_fp16
+ * @param double const *src: Source
+ * @param uint16_t *dst: Destination
+ * @param int size: Number of values
+ */
+void cnet_half_pack(
+    enum cnet_half_type type,
+    double const *src,
+    uint16_t *dst,
+    int size
+);
+
+
+/**
+ * Widen 16 bit values into doubles (exact).
+ *
+ * @param cnet_half_type type: half_bf16 or half_fp16
+ * @param uint16_t const *src: Source
+ * @param double *dst: Destination
+ * @param int size: Number of values
+ */
+void cnet_half_widen(
+    enum cnet_half_type type,
+    uint16_t const *src,
+    double *dst,
+    int size
+);
+
+
+/**
+ * Widen a single 16 bit value.
+ *
+ * @param cnet_half_type type: half_bf16 or half_fp16
+ * @param uint16_t value: 16 bit value
+ * @return double: Widened value
+ */
+double cnet_half_get(
+    enum cnet_half_type type,
+    uint16_t value
+);
+
+
+#endif /* CNET_HALF_H */
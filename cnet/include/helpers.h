@@ -37,6 +37,8 @@ double cnet_mean(double *arr, int size);
 
 /**
  * Random shuffle an array (in-place).
+ * Draws from the calling thread generator (see random.h), so workers can
+ * shuffle their own arrays in parallel.
  *
  * @param double *: The array
  * @param int: Array size
@@ -57,49 +59,28 @@ int *cnet_idx(int size);
 
 
 /**
- * ArgMax
+ * Check Labels
  *
- * Returns the index for the max element in a given array.
+ * Finds the first class index out of [0, classes).
  *
- * @param double *arr;
- * @param int size: arr size
- * @return double: Index of max element (as double) 
+ * @param int const *: Class indices
+ * @param int: Number of indices
+ * @param int: Number of classes
+ * @return int: Position of the first invalid index, -1 if they are all valid
  */
-double cnet_argmax(double const *arr, int size);
+int cnet_check_labels(int const *labels, int size, int classes);
 
 
 /**
- * Vector Dot Product
- *
- * Performs a dot product between two vectors.
- *
- * @param double *: Vector A (n)
- * @param double *: Vector B (nxn)
- * @param int: Vector Size (n)
- * @return double: Result
- */
-double cnet_dot_vector(
-    double const *x,
-    double const *y,
-    int size
-);
-
-
-/**
- * Vector Matrix Dot Product
+ * ArgMax
  *
- * Performs a dot product between a vector and a matrix.
- * Stores the result in the given vector (in-place).
+ * Returns the index for the max element in a given array.
  *
- * @param double *: Vector (n)
- * @param double **: Matrix (nxn)
- * @param int: Vector Size (n)
+ * @param double *arr;
+ * @param int size: arr size
+ * @return double: Index of max element (as double) 
  */
-void cnet_dot_mat(
-    double *vector,
-    double **matrix,
-    int size
-);
+double cnet_argmax(double const *arr, int size);
 
 
 /**
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ *                                LOCALITY
+ * NUMA-aware memory placement and thread pinning.
+ * On multi-socket machines, memory is placed on the node of the thread
+ * first touching it: a dataset and weights loaded by the main thread all
+ * end up on its node, and the threads of the other sockets read them
+ * remotely. The NUMA mode pins the library pool (see tpool.h) node by
+ * node, and these helpers spread the shared data (weights, datasets)
+ * over all the nodes, while the per-thread buffers (evaluation and
+ * validation workspaces) are allocated on the node of their thread.
+ *
+ * Built with libnuma when compiled with CNET_NUMA (make NUMA=1), every
+ * helper is a no-op otherwise (a single node, plain malloc).
+ ****************************************************************************/
+
+#ifndef CNET_LOCALITY_H
+#define CNET_LOCALITY_H
+
+#include <stddef.h>
+#include "cnet.h"
+
+
+/**
+ * Number of NUMA nodes (1 without libnuma, or if NUMA is not available).
+ *
+ * @return int: Number of nodes
+ */
+int cnet_numa_nodes(void);
+
+
+/**
+ * Enable the NUMA mode.
+ *
+ * Replaces the library pool with one thread per core the process may run
+ * on (its affinity mask), pinned node by node (so consecutive ranges of a
+ * parallel for share a node), and pins the calling thread to the first
+ * core of the first node.
+ *
+ * @return int: Number of nodes, -1 if the calling thread could not be
+ *              pinned (the library pool is left as is)
+ */
+int cnet_numa_init(void);
+
+
+/**
+ * Allocate memory on the node of the calling thread.
+ *
+ * @param size_t size: Size in bytes
+ * @return void *: Memory, freed with cnet_numa_free
+ */
+void *cnet_numa_alloc_local(
+    size_t size
+);
+
+
+/**
+ * Free memory from cnet_numa_alloc_local.
+ *
+ * @param void *ptr: Memory
+ * @param size_t size: Size in bytes
+ */
+void cnet_numa_free(
+    void *ptr,
+    size_t size
+);
+
+
+/**
+ * Interleave the pages of a memory range over all the nodes, moving the
+ * pages already touched.
+ *
+ * @param void *ptr: Memory
+ * @param size_t size: Size in bytes
+ */
+void cnet_numa_interleave(
+    void *ptr,
+    size_t size
+);
+
+
+/**
+ * Interleave the rows of a dataset over all the nodes.
+ *
+ * @param double **X: Rows
+ * @param int size: Number of rows
+ * @param int cols: Values per row
+ */
+void cnet_numa_interleave_rows(
+    double **X,
+    int size,
+    int cols
+);
+
+
+/**
+ * Interleave the parameters of a network (weights, biases, 16 bit and
+ * sparse weights) over all the nodes, as every thread reads them.
+ *
+ * @param cnet *nn: cnet
+ */
+void nn_numa_interleave(
+    cnet *nn
+);
+
+
+#endif /* CNET_LOCALITY_H */
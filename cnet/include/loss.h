@@ -52,6 +52,43 @@ typedef void cnet_loss_func_dx(
 );
 
 
+/**
+ * Sparse Loss function
+ *
+ * Same as the loss function, with the target given as a class index
+ * (the position of the 1 in an one-hot target).
+ *
+ * @param double *: Prediction
+ * @param int: Target class
+ * @param int : size
+ * @return double
+ */
+typedef double cnet_loss_sparse_func(
+    double const *,
+    int,
+    int
+);
+
+
+/**
+ * Sparse Loss function derivative.
+ *
+ * Same as the loss function derivative, with the target given as a
+ * class index.
+ *
+ * @param double *: Prediction
+ * @param int: Target class
+ * @param double *: Destination array
+ * @param int: Size of the given arrays
+ */
+typedef void cnet_loss_sparse_func_dx(
+    double const *,
+    int,
+    double *,
+    int
+);
+
+
 /**
  * Get Loss
  * Returns the loss function pointer, dependending on the loss type.
@@ -72,4 +109,68 @@ cnet_loss_func *cnet_get_loss(enum cnet_loss_type type);
 cnet_loss_func_dx *cnet_get_loss_dx(enum cnet_loss_type type);
 
 
+/**
+ * Get Sparse Loss
+ * Returns the class index loss function pointer, dependending on the
+ * loss type.
+ *
+ * @param cnet_loss_type
+ * @return cnet_loss_sparse_func
+ */
+cnet_loss_sparse_func *cnet_get_loss_sparse(enum cnet_loss_type type);
+
+
+/**
+ * Get Sparse Loss Derivative
+ * Returns the class index loss function derivative pointer, dependending
+ * on the loss type.
+ *
+ * @param cnet_loss_type
+ * @return cnet_loss_sparse_func_dx
+ */
+cnet_loss_sparse_func_dx *cnet_get_loss_sparse_dx(enum cnet_loss_type type);
+
+
+/**
+ * Fused Softmax Cross Entropy
+ *
+ * Output layer kernel for a softmax paired with the cross entropy.
+ * Computes the log-softmax of the given logits through log-sum-exp (no
+ * epsilon needed), the cross entropy, and its gradient over the logits
+ * (probabilities - target), replacing the logits by the probabilities.
+ *
+ * @param double *z: Logits, replaced by the softmax probabilities
+ * @param double const *target: Target
+ * @param double *delta: Destination of the gradient over the logits
+ * @param int size: Size of the given arrays
+ * @return double: Cross entropy
+ */
+double cnet_softmax_cross_entropy(
+    double *z,
+    double const *target,
+    double *delta,
+    int size
+);
+
+
+/**
+ * Fused Softmax Sparse Cross Entropy
+ *
+ * Same as cnet_softmax_cross_entropy, with the target given as a class
+ * index: the loss only reads the target logit.
+ *
+ * @param double *z: Logits, replaced by the softmax probabilities
+ * @param int target: Target class
+ * @param double *delta: Destination of the gradient over the logits
+ * @param int size: Size of the given arrays
+ * @return double: Cross entropy
+ */
+double cnet_softmax_sparse_cross_entropy(
+    double *z,
+    int target,
+    double *delta,
+    int size
+);
+
+
 #endif /* CNET_LOSS_H */
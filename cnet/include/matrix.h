@@ -0,0 +1,158 @@
+/*****************************************************************************
+ *                                 MATRIX
+ * Memory mapped input matrices.
+ * Large datasets are read straight from their file mapping, one row per
+ * sample, and converted to doubles a few rows at a time: the kernel pages
+ * the file in and out as it is read, so files much larger than the memory
+ * can be scanned. Two formats are supported:
+ *   - IDX files (as the mnist dataset): big endian dimensions and values,
+ *     the first dimension being the rows
+ *   - raw matrices: native values, row after row, given their columns
+ ****************************************************************************/
+
+#ifndef CNET_MATRIX_H
+#define CNET_MATRIX_H
+
+#include <stddef.h>
+
+
+enum cnet_matrix_type {
+    matrix_u8,                  // unsigned bytes
+    matrix_i8,                  // signed bytes
+    matrix_i16,                 // 16 bits integers
+    matrix_i32,                 // 32 bits integers
+    matrix_f32,                 // floats
+    matrix_f64                  // doubles
+};
+
+
+typedef struct cnet_matrix {
+
+    /* dimensions */
+    long rows;
+    int cols;
+
+    /* values type, and their byte order */
+    enum cnet_matrix_type type;
+    int big_endian;
+
+    /* factor applied to every value when converted (1 / 255 for unsigned
+       bytes, so that pixels are in [0, 1], else 1) */
+    double scale;
+
+    /* first value, inside the file mapping, its offset in the file, and
+       the size of a row */
+    unsigned char const *data;
+    size_t offset;
+    size_t row_bytes;
+
+    /* file mapping, and the file (kept open to be read directly) */
+    void *map;
+    size_t map_size;
+    int fd;
+
+} cnet_matrix;
+
+
+/**
+ * Map an IDX file.
+ *
+ * @param char const *path: File path
+ * @return cnet_matrix *: Matrix, or NULL if the file could not be mapped,
+ *                        is not an IDX file, or its rows are empty or do
+ *                        not fit in it
+ */
+cnet_matrix *cnet_matrix_open_idx(
+    char const *path
+);
+
+
+/**
+ * Map a raw matrix file. The rows are the whole rows the file holds.
+ *
+ * @param char const *path: File path
+ * @param int cols: Number of columns
+ * @param cnet_matrix_type type: Values type
+ * @return cnet_matrix *: Matrix, or NULL if the file could not be mapped
+ */
+cnet_matrix *cnet_matrix_open_raw(
+    char const *path,
+    int cols,
+    enum cnet_matrix_type type
+);
+
+
+/**
+ * Unmap a matrix.
+ *
+ * @param cnet_matrix *m: Matrix
+ */
+void cnet_matrix_close(
+    cnet_matrix *m
+);
+
+
+/**
+ * Parse a values type name (u8, i8, i16, i32, f32 or f64).
+ *
+ * @param char const *name: Type name
+ * @param cnet_matrix_type *type: Destination of the type
+ * @return int: 0, or -1 if the name is unknown
+ */
+int cnet_matrix_type_parse(
+    char const *name,
+    enum cnet_matrix_type *type
+);
+
+
+/**
+ * Convert rows laid out as the matrix ones (e.g. read from its file) to
+ * doubles (scaled).
+ *
+ * @param cnet_matrix const *m: Matrix
+ * @param void const *rows: Rows (count x row_bytes bytes)
+ * @param int count: Number of rows
+ * @param double *out: Destination (count x cols)
+ */
+void cnet_matrix_convert(
+    cnet_matrix const *m,
+    void const *rows,
+    int count,
+    double *out
+);
+
+
+/**
+ * Convert consecutive rows to doubles (scaled).
+ *
+ * @param cnet_matrix const *m: Matrix
+ * @param long first: First row
+ * @param int count: Number of rows
+ * @param double *out: Destination (count x cols)
+ */
+void cnet_matrix_rows(
+    cnet_matrix const *m,
+    long first,
+    int count,
+    double *out
+);
+
+
+/**
+ * Hint that rows will be read soon, or not anymore (the kernel prefetches
+ * them, or drops their pages).
+ *
+ * @param cnet_matrix const *m: Matrix
+ * @param long first: First row
+ * @param long count: Number of rows
+ * @param int needed: 1 if the rows will be read soon, 0 if done with them
+ */
+void cnet_matrix_advise(
+    cnet_matrix const *m,
+    long first,
+    long count,
+    int needed
+);
+
+
+#endif /* CNET_MATRIX_H */
@@ -5,6 +5,11 @@
 #ifndef CNET_METRICS_H
 #define CNET_METRICS_H
 
+#include <stdio.h>
+
+
+struct cnet;
+
 
 /* Available Types */
 
@@ -31,6 +36,23 @@ typedef double cnet_metric_fun(
 );
 
 
+/**
+ * Sparse Metric function
+ *
+ * Computes the metric of a predicted output, with the expected value
+ * given as a class index (the position of the 1 in an one-hot target).
+ *
+ * @param const double *pred: Predictions array
+ * @param int real: Expected class
+ * @param int size: Predictions size.
+ */
+typedef double cnet_metric_sparse_fun(
+    double const *pred,
+    int real,
+    int size
+);
+
+
 /**
  * Get metric function
  * Given a metric type, returns a pointer to the function.
@@ -40,5 +62,126 @@ typedef double cnet_metric_fun(
 cnet_metric_fun *cnet_get_metric(enum cnet_metric_type type);
 
 
+/**
+ * Get sparse metric function
+ * Given a metric type, returns a pointer to the class index function.
+ *
+ * @param enum cnet_metric_type: Metric Type
+ */
+cnet_metric_sparse_fun *cnet_get_metric_sparse(enum cnet_metric_type type);
+
+
+/* Evaluation */
+
+typedef struct cnet_report {
+
+    /* number of classes and evaluated samples */
+    int n_classes, samples;
+
+    /* confusion matrix (n_classes x n_classes), indexed [real][pred] */
+    int *confusion;
+
+    /* per class metrics */
+    int *support;
+    double *precision, *recall, *f1;
+
+    /* overall accuracy */
+    double accuracy;
+
+} cnet_report;
+
+
+/**
+ * Evaluate a network over a dataset.
+ *
+ * Predicts over every sample in batches, splitting the dataset between
+ * several threads of the library pool (see tpool.h). Every range keeps
+ * its own confusion matrix, these are merged at the end to compute the
+ * classification report.
+ * The predicted and real classes are taken as the argmax of the
+ * network output and the expected output.
+ *
+ * @param const cnet *nn: cnet
+ * @param double **X: Inputs
+ * @param double **Y: Expected outputs
+ * @param int size: Number of samples
+ * @param int n_threads: Number of ranges evaluated in parallel (0 for one
+ *                      per pool thread)
+ * @return cnet_report *: Classification report
+ */
+cnet_report *nn_evaluate(
+    struct cnet const *nn,
+    double **X,
+    double **Y,
+    int size,
+    int n_threads
+);
+
+
+/**
+ * Evaluate a network over a dataset with class index targets.
+ *
+ * Same as nn_evaluate, with the expected classes given as indices.
+ *
+ * @param const cnet *nn: cnet
+ * @param double **X: Inputs
+ * @param int const *labels: Expected classes
+ * @param int size: Number of samples
+ * @param int n_threads: Number of ranges evaluated in parallel (0 for one
+ *                      per pool thread)
+ * @return cnet_report *: Classification report, or NULL if a class is out
+ *                        of [0, out_size)
+ */
+cnet_report *nn_evaluate_labels(
+    struct cnet const *nn,
+    double **X,
+    int const *labels,
+    int size,
+    int n_threads
+);
+
+
+/**
+ * Free a classification report.
+ *
+ * @param cnet_report *report: Report
+ */
+void cnet_report_free(
+    cnet_report *report
+);
+
+
+/**
+ * Print a classification report.
+ *
+ * Writes precision, recall, f1-score and support for every class,
+ * followed by the overall accuracy.
+ *
+ * @param const cnet_report *report: Report
+ * @param char const *label: Name used for each class row (e.g. "Class")
+ * @param FILE *out: Output file
+ */
+void cnet_report_print(
+    cnet_report const *report,
+    char const *label,
+    FILE *out
+);
+
+
+/**
+ * Save the confusion matrix.
+ *
+ * Writes the confusion matrix normalized by the support of each class,
+ * one row per real class.
+ *
+ * @param const cnet_report *report: Report
+ * @param FILE *out: Output file
+ */
+void cnet_report_save_confusion(
+    cnet_report const *report,
+    FILE *out
+);
+
+
 
 #endif /* CNET_METRICS_H */
@@ -0,0 +1,120 @@
+/*****************************************************************************
+ *                                  MODEL
+ * Model handles, for serving processes swapping their network live.
+ * A handle holds the current version of a network. Readers acquire a
+ * reference to the current version without locking (a few atomic
+ * operations, no waiting), and predict with it for as long as they need.
+ * A new network, typically loaded by a background thread, is published
+ * atomically: readers acquiring after the publication get the new
+ * version, while the previous one is freed by the last reader releasing
+ * it. Publishing only waits for the readers that are in the middle of an
+ * acquisition, never for the ones predicting.
+ ****************************************************************************/
+
+#ifndef CNET_MODEL_H
+#define CNET_MODEL_H
+
+#include "cnet.h"
+
+
+typedef struct cnet_model cnet_model;
+
+
+typedef struct cnet_ref {
+
+    /* network of the acquired version, valid until released */
+    cnet const *nn;
+
+    /* version number (1 for the initial network, then every publication) */
+    long serial;
+
+    /* acquired version (private) */
+    struct cnet_version *version;
+
+} cnet_ref;
+
+
+/**
+ * Create a model handle.
+ *
+ * @param cnet *nn: Initial network (the handle takes its ownership)
+ * @return cnet_model *: Handle
+ */
+cnet_model *cnet_model_init(
+    cnet *nn
+);
+
+
+/**
+ * Free a model handle, releasing its current version. Every reference
+ * must have been released.
+ *
+ * @param cnet_model *model: Handle
+ */
+void cnet_model_free(
+    cnet_model *model
+);
+
+
+/**
+ * Acquire the current version.
+ *
+ * Lock-free, and safe from any thread. The reference must be released
+ * once the network is not used anymore.
+ *
+ * @param cnet_model *model: Handle
+ * @return cnet_ref: Reference
+ */
+cnet_ref cnet_model_acquire(
+    cnet_model *model
+);
+
+
+/**
+ * Release a reference, freeing its version if it was replaced and this
+ * was its last reference. A reference without a version is ignored.
+ *
+ * @param cnet_ref *ref: Reference
+ */
+void cnet_model_release(
+    cnet_ref *ref
+);
+
+
+/**
+ * Publish a new network as the current version.
+ *
+ * The handle takes the ownership of the network. The previous version is
+ * freed once its last reference is released. Publications from several
+ * threads are serialized.
+ *
+ * @param cnet_model *model: Handle
+ * @param cnet *nn: New network
+ * @return long: Serial of the new version
+ */
+long cnet_model_publish(
+    cnet_model *model,
+    cnet *nn
+);
+
+
+/**
+ * Load a saved network and publish it.
+ *
+ * Meant to be called from a background thread: the readers keep
+ * predicting with the previous version while the file is read. Only a
+ * completely read network is published, the current version stays
+ * otherwise.
+ *
+ * @param cnet_model *model: Handle
+ * @param char const *path: Saved network (see nn_save)
+ * @return long: Serial of the new version, or -1 if the file could not be
+ *               opened or is not a complete network
+ */
+long cnet_model_load(
+    cnet_model *model,
+    char const *path
+);
+
+
+#endif /* CNET_MODEL_H */
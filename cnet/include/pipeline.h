@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *                                PIPELINE
+ * Pipeline parallel training (see nn_set_pipeline).
+ * Consecutive layers of a net are split into stages, each one run by its
+ * own thread of a worker team (see team.h) and only touching its own
+ * weights, which can then stay in that core's cache. A batch is cut into
+ * micro-batches streamed through the stages GPipe style: every stage
+ * forwards the micro-batches as the previous stage hands them over, then
+ * backpropagates them as the next stage hands their deltas back, through
+ * bounded queues. The gradients are accumulated in the layers gradient
+ * buffers, and applied by the caller once the whole batch went through.
+ ****************************************************************************/
+
+#ifndef CNET_PIPELINE_H
+#define CNET_PIPELINE_H
+
+#include "cnet.h"
+
+
+typedef struct cnet_pipeline cnet_pipeline;
+
+
+/**
+ * Create a training pipeline.
+ *
+ * The layers are split into consecutive stages of about the same number
+ * of weights. Only dense layers with full precision weights are supported.
+ * The stages get fewer when the net has fewer layers, or when their
+ * threads could not be started.
+ *
+ * @param cnet const *nn: cnet
+ * @param int stages: Number of stages (threads)
+ * @param int micro_batch: Samples per micro-batch
+ * @param int max_batch: Max samples per batch
+ * @return cnet_pipeline *: Pipeline
+ */
+cnet_pipeline *cnet_pipeline_init(
+    cnet const *nn,
+    int stages,
+    int micro_batch,
+    int max_batch
+);
+
+
+/**
+ * Free a training pipeline.
+ *
+ * @param cnet_pipeline *pipe: Pipeline
+ */
+void cnet_pipeline_free(
+    cnet_pipeline *pipe
+);
+
+
+/**
+ * Number of stages of a pipeline.
+ *
+ * @param cnet_pipeline const *pipe: Pipeline
+ * @return int: Number of stages
+ */
+int cnet_pipeline_stages(
+    cnet_pipeline const *pipe
+);
+
+
+/**
+ * Pipeline Batch
+ *
+ * Streams a batch through the stages, accumulating its gradient into the
+ * layers gradient buffers (layer->grad, which must be set) without
+ * updating the weights. The loss and metric sums are added in sample
+ * order, so they do not depend on the number of stages.
+ *
+ * @param cnet_pipeline *pipe: Pipeline
+ * @param double **X: Inputs
+ * @param double **Y: Expected outputs, or NULL to use the labels
+ * @param int const *labels: Class indices (when Y is NULL)
+ * @param int const *samples: Indices of the batch samples
+ * @param int size: Number of samples (at most max_batch)
+ * @param cnet_loss_type loss_type: Loss type
+ * @param cnet_metric_type metric_type: Metric type
+ * @param double *loss: Destination of the batch loss sum
+ * @param double *metric: Destination of the batch metric sum
+ */
+void cnet_pipeline_batch(
+    cnet_pipeline *pipe,
+    double **X,
+    double **Y,
+    int const *labels,
+    int const *samples,
+    int size,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double *loss,
+    double *metric
+);
+
+
+#endif /* CNET_PIPELINE_H */
@@ -0,0 +1,79 @@
+/*****************************************************************************
+ *                                  PLAN
+ * Compiled execution plans for CNet inference.
+ * nn_compile walks the network once and builds an immutable list of steps:
+ * one kernel per layer, picked for its type, activation and the batch size,
+ * with the layers reading and writing preallocated ping-pong buffers.
+ * Predicting through a plan then only runs these steps, without looking up
+ * activations or allocating anything. Large dense layers split their
+ * output neurons between the threads of the library pool (see tpool.h).
+ ****************************************************************************/
+
+#ifndef CNET_PLAN_H
+#define CNET_PLAN_H
+
+#include "cnet.h"
+
+
+typedef struct cnet_plan cnet_plan;
+
+
+/**
+ * Compile a network.
+ *
+ * The plan reads the network weights in place, so it keeps predicting with
+ * the current weights if the network is trained afterwards, but it must be
+ * compiled again if layers are added, pruned or converted. A plan owns its
+ * buffers: use one plan per thread.
+ *
+ * @param const cnet *nn: cnet
+ * @param int max_batch: Max number of samples per prediction
+ * @return cnet_plan *: Plan
+ */
+cnet_plan *nn_compile(
+    cnet const *nn,
+    int max_batch
+);
+
+
+/**
+ * Plan Prediction.
+ *
+ * @param cnet_plan *plan: Plan
+ * @param double const *X: Input (sized nn->in_size)
+ * @return const double *: Pointer to results (sized nn->out_size), valid
+ *                         until the next prediction
+ */
+const double *cnet_plan_predict(
+    cnet_plan *plan,
+    double const *X
+);
+
+
+/**
+ * Plan Batch Prediction.
+ *
+ * @param cnet_plan *plan: Plan
+ * @param double **X: Inputs (batch samples, sized nn->in_size)
+ * @param int batch: Number of samples (up to the plan max_batch)
+ * @return const double *: Pointer to results (sized batch x nn->out_size),
+ *                         valid until the next prediction
+ */
+const double *cnet_plan_predict_batch(
+    cnet_plan *plan,
+    double **X,
+    int batch
+);
+
+
+/**
+ * Free a plan.
+ *
+ * @param cnet_plan *plan: Plan
+ */
+void cnet_plan_free(
+    cnet_plan *plan
+);
+
+
+#endif /* CNET_PLAN_H */
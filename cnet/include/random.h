@@ -0,0 +1,143 @@
+/*****************************************************************************
+ *                                 RANDOM
+ * Seedable random number generation for CNet (xoshiro256+).
+ * Every thread draws from its own generator (cnet_rng_local), so there is
+ * no shared state or lock between workers. Thread generators are derived
+ * from the global seed (cnet_seed) and a stream number, the calling thread
+ * of cnet_seed always gets stream 0, so single threaded runs are
+ * reproducible per seed. Work that must be reproducible regardless of
+ * the threads should use explicit streams (cnet_rng_init), e.g. one per
+ * chunk of data, as cnet_rng_fill_streams does.
+ ****************************************************************************/
+
+#ifndef CNET_RANDOM_H
+#define CNET_RANDOM_H
+
+#include <stdint.h>
+
+
+#define CNET_DEFAULT_SEED 23
+
+
+typedef struct cnet_rng {
+    uint64_t s[4];
+} cnet_rng;
+
+
+/**
+ * Set the global seed.
+ *
+ * Thread generators are derived again from the new seed on their next use.
+ * Should be called before starting any worker.
+ *
+ * @param uint64_t seed: Seed
+ */
+void cnet_seed(
+    uint64_t seed
+);
+
+
+/**
+ * Initialize a generator.
+ *
+ * Different streams of the same seed give independent sequences.
+ *
+ * @param cnet_rng *rng: Generator
+ * @param uint64_t seed: Seed
+ * @param uint64_t stream: Stream number
+ */
+void cnet_rng_init(
+    cnet_rng *rng,
+    uint64_t seed,
+    uint64_t stream
+);
+
+
+/**
+ * Thread Generator.
+ *
+ * @return cnet_rng *: Generator of the calling thread
+ */
+cnet_rng *cnet_rng_local(void);
+
+
+/**
+ * Next 64 random bits.
+ *
+ * @param cnet_rng *rng: Generator
+ * @return uint64_t: Random bits
+ */
+uint64_t cnet_rng_next(
+    cnet_rng *rng
+);
+
+
+/**
+ * Uniform double in [0, 1).
+ *
+ * @param cnet_rng *rng: Generator
+ * @return double: Random number
+ */
+double cnet_rng_uniform(
+    cnet_rng *rng
+);
+
+
+/**
+ * Uniform integer in [0, n), without modulo bias.
+ *
+ * @param cnet_rng *rng: Generator
+ * @param uint32_t n: Upper bound (> 0)
+ * @return uint32_t: Random integer
+ */
+uint32_t cnet_rng_below(
+    cnet_rng *rng,
+    uint32_t n
+);
+
+
+/**
+ * Bulk uniform generation.
+ *
+ * Fills an array with uniform doubles in [lo, hi). Large arrays are
+ * generated by several interleaved generators, so the loop vectorizes.
+ *
+ * @param cnet_rng *rng: Generator
+ * @param double *out: Destination
+ * @param long size: Number of values
+ * @param double lo: Lower bound
+ * @param double hi: Upper bound
+ */
+void cnet_rng_fill(
+    cnet_rng *rng,
+    double *out,
+    long size,
+    double lo,
+    double hi
+);
+
+
+/**
+ * Multi-threaded bulk uniform generation.
+ *
+ * The array is split into fixed chunks, each one filled from its own
+ * stream of the given seed and filled on the library pool (see tpool.h),
+ * so the result only depends on the seed (and not on the number of
+ * threads).
+ *
+ * @param uint64_t seed: Seed
+ * @param double *out: Destination
+ * @param long size: Number of values
+ * @param double lo: Lower bound
+ * @param double hi: Upper bound
+ */
+void cnet_rng_fill_streams(
+    uint64_t seed,
+    double *out,
+    long size,
+    double lo,
+    double hi
+);
+
+
+#endif /* CNET_RANDOM_H */
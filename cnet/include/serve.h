@@ -0,0 +1,234 @@
+/*****************************************************************************
+ *                                  SERVE
+ * Inference server with dynamic request batching, and its client.
+ * The server listens on a Unix domain socket or a TCP port, and answers
+ * the requests of every connection in order. Concurrent prediction
+ * requests are coalesced into batches by the batching workers: a worker
+ * waits for a batch to fill up, at most for a latency window after the
+ * arrival of its first request, then predicts it with nn_predict_batch
+ * (whose products run on the thread pool). Every request latency, from
+ * its arrival to its result, is recorded into a histogram.
+ *
+ * Protocol (native byte order), any number of requests per connection:
+ *   - request: uint32 op, uint32 payload bytes, payload
+ *   - response: uint32 status, uint32 payload bytes, payload
+ * with the ops:
+ *   - CNET_SERVE_PREDICT: in_size doubles -> out_size doubles
+ *   - CNET_SERVE_INFO: nothing -> uint32 in_size, uint32 out_size
+ *   - CNET_SERVE_STATS: nothing -> statistics text
+ ****************************************************************************/
+
+#ifndef CNET_SERVE_H
+#define CNET_SERVE_H
+
+#include <stdint.h>
+#include "cnet.h"
+#include "model.h"
+
+#define CNET_SERVE_HISTOGRAM 128    // latency buckets, 4 per power of two (us)
+
+
+enum cnet_serve_op {
+    CNET_SERVE_PREDICT = 1,
+    CNET_SERVE_INFO = 2,
+    CNET_SERVE_STATS = 3
+};
+
+
+enum cnet_serve_status {
+    CNET_SERVE_OK = 0,
+    CNET_SERVE_BAD_REQUEST = 1      // unknown op, or wrong input size
+};
+
+
+typedef struct cnet_server cnet_server;
+
+
+typedef struct cnet_server_config {
+
+    /* max requests per batch */
+    int max_batch;
+
+    /* max wait for a batch to fill up, after its first request (us) */
+    int window_us;
+
+    /* batching workers (batches predicted at once) */
+    int workers;
+
+} cnet_server_config;
+
+
+typedef struct cnet_server_stats {
+
+    /* answered predictions, and the batches they went through */
+    long requests, batches;
+
+    /* seconds since the server started */
+    double elapsed;
+
+    /* latency percentiles (upper bounds of their buckets, us) */
+    double p50, p90, p99, max;
+
+    /* latency histogram: bucket i holds the latencies of
+       [2^(i/4) - 1, 2^((i+1)/4) - 1) us */
+    long histogram[CNET_SERVE_HISTOGRAM];
+
+} cnet_server_stats;
+
+
+/**
+ * Create an inference server.
+ *
+ * Listens on the given address, "unix:<path>" or "tcp:<host>:<port>",
+ * and starts the batching workers. The network is only read, and is
+ * still owned by the caller.
+ *
+ * @param cnet const *nn: Network
+ * @param char const *address: Address
+ * @param cnet_server_config const *config: Batching configuration
+ * @return cnet_server *: Server, or NULL if it could not listen
+ */
+cnet_server *cnet_server_init(
+    cnet const *nn,
+    char const *address,
+    cnet_server_config const *config
+);
+
+
+/**
+ * Create an inference server over a model handle.
+ *
+ * Same as cnet_server_init, serving the current version of the handle:
+ * every batch is predicted by the version current when it leaves, so the
+ * network can be swapped (see cnet_model_publish) while serving, without
+ * dropping or stalling requests. Requests whose input size does not match
+ * the version predicting them get CNET_SERVE_BAD_REQUEST. The handle is
+ * still owned by the caller.
+ *
+ * @param cnet_model *model: Model handle
+ * @param char const *address: Address
+ * @param cnet_server_config const *config: Batching configuration
+ * @return cnet_server *: Server, or NULL if it could not listen
+ */
+cnet_server *cnet_server_init_model(
+    cnet_model *model,
+    char const *address,
+    cnet_server_config const *config
+);
+
+
+/**
+ * Serve the connections, until cnet_server_stop.
+ *
+ * @param cnet_server *server: Server
+ */
+void cnet_server_run(
+    cnet_server *server
+);
+
+
+/**
+ * Stop a running server (async-signal-safe).
+ *
+ * @param cnet_server *server: Server
+ */
+void cnet_server_stop(
+    cnet_server *server
+);
+
+
+/**
+ * Free a server, closing its connections.
+ *
+ * @param cnet_server *server: Server
+ */
+void cnet_server_free(
+    cnet_server *server
+);
+
+
+/**
+ * Get the server statistics.
+ *
+ * @param cnet_server *server: Server
+ * @return cnet_server_stats: Copy of the current statistics
+ */
+cnet_server_stats cnet_server_get_stats(
+    cnet_server *server
+);
+
+
+/**
+ * Write the server statistics as text: throughput, mean batch,
+ * latency percentiles and the non-empty histogram buckets.
+ *
+ * @param cnet_server_stats const *stats: Statistics
+ * @param FILE *out: Destination
+ */
+void cnet_server_print_stats(
+    cnet_server_stats const *stats,
+    FILE *out
+);
+
+
+/**
+ * Connect to an inference server.
+ *
+ * @param char const *address: Server address (see cnet_server_init)
+ * @return int: Connection, or -1 on failure
+ */
+int cnet_client_connect(
+    char const *address
+);
+
+
+/**
+ * Get the input and output sizes of the served network.
+ *
+ * @param int fd: Connection
+ * @param int *in_size: Destination of the input size
+ * @param int *out_size: Destination of the output size
+ * @return int: 0, or -1 on failure
+ */
+int cnet_client_info(
+    int fd,
+    int *in_size,
+    int *out_size
+);
+
+
+/**
+ * Predict a sample on the server.
+ *
+ * @param int fd: Connection
+ * @param double const *X: Input (in_size doubles)
+ * @param int in_size: Input size
+ * @param double *out: Destination of the prediction (out_size doubles)
+ * @param int out_size: Output size
+ * @return int: 0, or -1 on failure
+ */
+int cnet_client_predict(
+    int fd,
+    double const *X,
+    int in_size,
+    double *out,
+    int out_size
+);
+
+
+/**
+ * Get the server statistics text.
+ *
+ * @param int fd: Connection
+ * @param char *text: Destination (nul terminated, truncated to size)
+ * @param int size: Destination size
+ * @return int: 0, or -1 on failure
+ */
+int cnet_client_stats(
+    int fd,
+    char *text,
+    int size
+);
+
+
+#endif /* CNET_SERVE_H */
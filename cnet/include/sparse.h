@@ -0,0 +1,128 @@
+/*****************************************************************************
+ *                                 SPARSE
+ * Magnitude pruning and sparse (CSR) layers for CNet.
+ * A trained network can be pruned to a target sparsity, fine-tuned with
+ * nn_train (pruned weights are kept at zero through a mask) and finally
+ * converted into CSR layers, which only store and multiply the
+ * remaining weights.
+ ****************************************************************************/
+
+#ifndef CNET_SPARSE_H
+#define CNET_SPARSE_H
+
+#include "cnet.h"
+
+
+/**
+ * Magnitude Pruning
+ *
+ * Zeros the smallest-magnitude weights of every dense layer, until each
+ * layer reaches the given sparsity. The pruned weights are recorded in the
+ * layer mask, so they stay at zero if the network is trained afterwards.
+ *
+ * @param cnet *nn: cnet
+ * @param double sparsity: Ratio of weights to prune per layer (0 to 1)
+ */
+void nn_prune(
+    cnet *nn,
+    double sparsity
+);
+
+
+/**
+ * Clear the pruning masks.
+ *
+ * Pruned weights remain at zero, but can be trained again.
+ *
+ * @param cnet *nn: cnet
+ */
+void nn_unmask(
+    cnet *nn
+);
+
+
+/* Neuron scores for structured pruning */
+
+enum cnet_neuron_score {
+    neuron_weight_norm,         // incoming x outgoing weights L2 norms
+    neuron_activation           // mean |activation| x outgoing L2 norm
+};
+
+
+/**
+ * Structured Neuron Pruning
+ *
+ * Shrinks a hidden dense layer down to its `keep` highest scoring neurons:
+ * the weakest rows are removed from the layer, along with their matching
+ * columns in the next layer. Both layers stay dense, so the resulting
+ * network is smaller but runs through the regular kernels and saves and
+ * loads as any other network.
+ * Activation scores are averaged over the given calibration inputs.
+ *
+ * @param cnet *nn: cnet
+ * @param int index: Index of the layer to shrink (both it and the next
+ *                   one must be dense layers)
+ * @param int keep: Number of neurons to keep
+ * @param cnet_neuron_score score: How to rank the neurons
+ * @param double **X: Calibration inputs (neuron_activation only)
+ * @param int size: Number of calibration inputs
+ */
+void nn_prune_neurons(
+    cnet *nn,
+    int index,
+    int keep,
+    enum cnet_neuron_score score,
+    double **X,
+    int size
+);
+
+
+/**
+ * Sparsify
+ *
+ * Converts every dense layer with at least the given ratio of zero weights
+ * into a sparse (CSR) layer. The converted layers can only be used for
+ * inference, and are saved in the sparse format by nn_save.
+ *
+ * @param cnet *nn: cnet
+ * @param double min_sparsity: Min ratio of zero weights to convert a layer
+ * @return int: Number of converted layers
+ */
+int nn_sparsify(
+    cnet *nn,
+    double min_sparsity
+);
+
+
+/**
+ * Layer Sparsity
+ *
+ * @param clayer const *layer: Dense or sparse layer
+ * @return double: Ratio of zero weights
+ */
+double cnet_layer_sparsity(
+    clayer const *layer
+);
+
+
+/**
+ * CSR Forward Pass
+ *
+ * Computes the (not activated) output of a sparse layer for a batch of
+ * inputs: a sparse matrix x vector product per sample, or sparse matrix x
+ * dense matrix for a batch, reusing every row over the whole batch.
+ *
+ * @param clayer const *layer: Sparse layer
+ * @param double const *in: Inputs (sized batch x layer->in_size)
+ * @param double *out: Outputs (sized batch x layer->out_size)
+ * @param int batch: Number of samples
+ */
+void cnet_csr_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    int batch
+);
+
+
+#endif /* CNET_SPARSE_H */
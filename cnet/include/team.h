@@ -0,0 +1,97 @@
+/*****************************************************************************
+ *                                  TEAM
+ * Worker teams for low-latency parallel sections.
+ * A team is a fixed set of (optionally pinned) threads which all run the
+ * same function, each one knowing its index, and meet at spin barriers
+ * inside it. Unlike the thread pool (see tpool.h), which spreads ranges
+ * over whatever thread is free, a team dispatches a whole run at once and
+ * keeps its workers spinning between runs, trading CPU time for the
+ * microseconds a pool task or a sleeping thread costs to wake up: it is
+ * meant for many short synchronized steps, such as the layers of a single
+ * sample prediction (see nn_set_team).
+ ****************************************************************************/
+
+#ifndef CNET_TEAM_H
+#define CNET_TEAM_H
+
+
+typedef struct cnet_team cnet_team;
+
+
+/**
+ * Team function, run by every thread of the team.
+ *
+ * @param void *: User argument
+ * @param int: Thread index (0 for the calling thread)
+ * @param int: Number of threads
+ */
+typedef void cnet_team_func(void *, int, int);
+
+
+/**
+ * Create a worker team.
+ *
+ * The calling thread of every run is the thread 0 of the team, hence
+ * the team starts n_threads - 1 workers. Workers spin while waiting for
+ * the next run, and only go to sleep after a few milliseconds idle.
+ *
+ * @param int n_threads: Number of threads (at least 1)
+ * @param int const *cpus: CPU to pin every worker to (n_threads - 1
+ *                         entries), NULL to leave them to the scheduler
+ * @return cnet_team *: Team
+ */
+cnet_team *cnet_team_init(
+    int n_threads,
+    int const *cpus
+);
+
+
+/**
+ * Free a worker team, stopping its workers.
+ *
+ * @param cnet_team *team: Team
+ */
+void cnet_team_free(
+    cnet_team *team
+);
+
+
+/**
+ * Number of threads of a team (its workers and the caller).
+ *
+ * @param cnet_team const *team: Team
+ * @return int: Number of threads
+ */
+int cnet_team_threads(
+    cnet_team const *team
+);
+
+
+/**
+ * Run a function on every thread of a team.
+ *
+ * Returns once every thread is done. A team runs one function at a
+ * time: runs from several threads must be serialized by the caller.
+ *
+ * @param cnet_team *team: Team
+ * @param cnet_team_func *func: Function
+ * @param void *arg: Argument given to func
+ */
+void cnet_team_run(
+    cnet_team *team,
+    cnet_team_func *func,
+    void *arg
+);
+
+
+/**
+ * Spin barrier, waiting for every thread of a team run to reach it.
+ *
+ * @param cnet_team *team: Team
+ */
+void cnet_team_barrier(
+    cnet_team *team
+);
+
+
+#endif /* CNET_TEAM_H */
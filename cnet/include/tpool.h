@@ -0,0 +1,118 @@
+/*****************************************************************************
+ *                               THREAD POOL
+ * Work-stealing thread pool shared by the whole library.
+ * Every worker owns a deque of ranges: it splits the ranges it runs in
+ * halves, keeps working on the lower half and leaves the upper one at the
+ * bottom of its deque, where idle workers steal from the top. Threads
+ * waiting on a parallel for (including the caller) run pending ranges
+ * instead of blocking, so nested parallel fors do not deadlock.
+ *
+ * The library (gemm, plans, evaluation, training validation, weights
+ * initialization) schedules onto a single pool, created on first use with
+ * a thread per online core, unless another pool is set with cnet_tpool_use.
+ ****************************************************************************/
+
+#ifndef CNET_TPOOL_H
+#define CNET_TPOOL_H
+
+
+typedef struct cnet_tpool cnet_tpool;
+
+
+/**
+ * Range function, run by the pool threads.
+ *
+ * @param void *: User argument
+ * @param long: Range start
+ * @param long: Range end (excluded)
+ */
+typedef void cnet_range_func(void *, long, long);
+
+
+/**
+ * Create a thread pool.
+ *
+ * The calling thread of every parallel for takes part in it, hence the
+ * pool starts n_threads - 1 worker threads.
+ *
+ * @param int n_threads: Number of threads (0 for one per online core)
+ * @param int const *cpus: CPU to pin every worker thread to (n_threads - 1
+ *                         entries), NULL to leave them to the scheduler
+ * @return cnet_tpool *: Pool
+ */
+cnet_tpool *cnet_tpool_init(
+    int n_threads,
+    int const *cpus
+);
+
+
+/**
+ * Free a thread pool, stopping its workers.
+ * No parallel for can be running on it.
+ *
+ * @param cnet_tpool *pool: Pool
+ */
+void cnet_tpool_free(
+    cnet_tpool *pool
+);
+
+
+/**
+ * Number of threads of a pool (its workers and the caller).
+ *
+ * @param cnet_tpool const *pool: Pool
+ * @return int: Number of threads
+ */
+int cnet_tpool_threads(
+    cnet_tpool const *pool
+);
+
+
+/**
+ * Library pool: the one set by cnet_tpool_use, or the default pool
+ * (created on the first call).
+ *
+ * @return cnet_tpool *: Pool
+ */
+cnet_tpool *cnet_tpool_get(void);
+
+
+/**
+ * Set the pool used by the library.
+ *
+ * The pool is still owned by the caller, and must outlive its use by the
+ * library (reset it before freeing it).
+ *
+ * @param cnet_tpool *pool: Pool, NULL to go back to the default pool
+ */
+void cnet_tpool_use(
+    cnet_tpool *pool
+);
+
+
+/**
+ * Parallel For
+ *
+ * Runs func over [from, to), split in ranges of at least grain elements
+ * run by the pool threads. Returns when the whole range is done.
+ * Pools without workers (or ranges under two grains) run func once,
+ * on the calling thread.
+ *
+ * @param cnet_tpool *pool: Pool
+ * @param long from: Range start
+ * @param long to: Range end (excluded)
+ * @param long grain: Min elements per range (at least 1)
+ * @param cnet_range_func *func: Function to run over every range
+ * @param void *arg: Argument given to func
+ */
+void cnet_parallel_for(
+    cnet_tpool *pool,
+    long from,
+    long to,
+    long grain,
+    cnet_range_func *func,
+    void *arg
+);
+
+
+#endif /* CNET_TPOOL_H */
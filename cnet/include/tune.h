@@ -0,0 +1,70 @@
+/*****************************************************************************
+ *                                  TUNE
+ * Autotuning of the builtin gemm (see blas.h) for the layers of a network.
+ * nn_autotune benchmarks every candidate blocking (B rows per register
+ * block, inner dimension tile) and thread count on the gemm shapes of the
+ * network layers, registers the fastest parameters for each shape, and
+ * keeps them in a small cache file keyed by CPU model, so every machine of
+ * a mixed fleet gets its own winners. cnet_tune_load reads the entries of
+ * the running CPU back at startup: from then on, the layers (training and
+ * prediction) and the plans compiled afterwards use them.
+ *
+ * Cache files hold one line per CPU model and shape, tab separated:
+ * cpu model, trans_a trans_b m n k, nr kc threads
+ ****************************************************************************/
+
+#ifndef CNET_TUNE_H
+#define CNET_TUNE_H
+
+#include <stdio.h>
+#include "cnet.h"
+
+
+/**
+ * CPU model of the running machine (the "model name" of /proc/cpuinfo),
+ * or "unknown" if not available.
+ *
+ * @return char const *: CPU model
+ */
+char const *cnet_cpu_model(void);
+
+
+/**
+ * Autotune the gemm shapes of a network.
+ *
+ * Tunes the forward pass of dense layers for single samples and for
+ * batches of the given size, and the forward and backward passes of
+ * convolution layers. Every winner is registered, and saved into the
+ * cache file (created if missing, entries of other CPU models and shapes
+ * are kept). Does nothing with the CBLAS backend.
+ *
+ * @param const cnet *nn: cnet
+ * @param int batch: Batch size used for predictions (plans, nn_evaluate)
+ * @param char const *cache_path: Tuning cache file
+ * @param FILE *log: Where to report every tuned shape (NULL for none)
+ * @return int: Number of tuned shapes, -1 if the cache could not be saved
+ */
+int nn_autotune(
+    cnet const *nn,
+    int batch,
+    char const *cache_path,
+    FILE *log
+);
+
+
+/**
+ * Load a tuning cache.
+ *
+ * Registers the parameters of every entry for the running CPU model.
+ * Entries with unsupported parameters are skipped. Call it at startup,
+ * before training or compiling plans.
+ *
+ * @param char const *cache_path: Tuning cache file
+ * @return int: Number of loaded entries, -1 if the file could not be read
+ */
+int cnet_tune_load(
+    char const *cache_path
+);
+
+
+#endif /* CNET_TUNE_H */
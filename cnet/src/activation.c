@@ -32,13 +32,17 @@ void ReLU(
 /**
  * ReLU Derivative.
  *
- * @param double: ReLU Output
- * @return double: ReLU Derivative
+ * @param double const *: ReLU Output
+ * @param double *: Delta
+ * @param int: Size
  */
-double ReLU_Dx(
-    double s
+void ReLU_Dx(
+    double const *s,
+    double *delta,
+    int size
 ){
-    return s >= 0 ? 1 : 0;
+    for(int i = 0; i < size; i++)
+        delta[i] *= s[i] >= 0 ? 1 : 0;
 }
 
 
@@ -63,14 +67,17 @@ void Sigmoid(
 /**
  * Sigmoid Derivative
  *
- *
- * @param double: Sigmoid Output
- * @return double: Sigmoid Derivative
+ * @param double const *: Sigmoid Output
+ * @param double *: Delta
+ * @param int: Size
  */
-double Sigmoid_Dx(
-    double s
+void Sigmoid_Dx(
+    double const *s,
+    double *delta,
+    int size
 ){
-    return s * (1 - s);
+    for(int i = 0; i < size; i++)
+        delta[i] *= s[i] * (1 - s[i]);
 }
 
 
@@ -106,20 +113,62 @@ void SoftMax(
 /**
  * SoftMax Derivative
  *
- * We don't do anything here, just return 1, as the derivative is
- * already handled in the derivative of the cross entropy loss.
- * As per this, we cannot use the cross entropy with anything else than
- * the softmax.
+ * Product with the softmax Jacobian (diag(s) - s s^T), which is symmetric:
+ * delta_i = s_i * (delta_i - sum_j delta_j s_j).
+ * Paired with the cross entropy, nn_train uses the fused kernel instead
+ * (see loss.h), which skips this step.
  *
- * @param double *s: The output vector of the softmax function
- * @param double **d: Destination Matrix
- * @param int size: Input Z size (Jacobian Matrix size being: size x size)
+ * @param double const *: SoftMax Output
+ * @param double *: Delta
+ * @param int: Size
  */
-#pragma clang diagnostic ignored "-Wunused-parameter"
-double SoftMax_Dx(
-    double s
+void SoftMax_Dx(
+    double const *s,
+    double *delta,
+    int size
+){
+    double dot = 0;
+    for(int i = 0; i < size; i++)
+        dot += delta[i] * s[i];
+    for(int i = 0; i < size; i++)
+        delta[i] = s[i] * (delta[i] - dot);
+}
+
+
+/// Linear
+
+
+/**
+ * Linear
+ * Identity, leaves the given values untouched.
+ *
+ * @param double *: Sum of weights * inputs + Bias
+ * @param int: Size
+ */
+void Linear(
+    double *a,
+    int size
+){
+    (void)a;
+    (void)size;
+}
+
+
+/**
+ * Linear Derivative.
+ *
+ * @param double const *: Linear Output
+ * @param double *: Delta
+ * @param int: Size
+ */
+void Linear_Dx(
+    double const *s,
+    double *delta,
+    int size
 ){
-    return 1.0;
+    (void)s;
+    (void)delta;
+    (void)size;
 }
 
 
@@ -131,7 +180,9 @@ cnet_act_func *cnet_get_act(enum cnet_act_type type) {
         case relu_act: return ReLU;
         case sigmoid_act: return Sigmoid;
         case softmax_act: return SoftMax;
+        case linear_act: return Linear;
     }
+    return NULL;
 }
 
 
@@ -140,5 +191,7 @@ cnet_act_func_dx *cnet_get_act_dx(enum cnet_act_type type) {
         case relu_act: return ReLU_Dx;
         case sigmoid_act: return Sigmoid_Dx;
         case softmax_act: return SoftMax_Dx;
+        case linear_act: return Linear_Dx;
     }
+    return NULL;
 }
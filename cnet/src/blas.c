@@ -0,0 +1,576 @@
+/*****************************************************************************
+ *                                  BLAS
+ * Implementation of the linear algebra routines: thin wrappers over the
+ * system CBLAS when built with CNET_CBLAS, the builtin kernels otherwise.
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include "../include/blas.h"
+#include "../include/tpool.h"
+
+#ifdef CNET_CBLAS
+#include <cblas.h>
+#endif
+
+
+/// Gemm parameters registry
+
+
+typedef struct gemm_entry {
+    int trans_a, trans_b, m, n, k;
+    cnet_gemm_params params;
+} gemm_entry;
+
+static gemm_entry *registry = NULL;
+static int registry_size = 0, registry_cap = 0;
+
+
+/**
+ * Default gemm parameters. */
+cnet_gemm_params cnet_gemm_defaults(void) {
+    return (cnet_gemm_params){.nr = 4, .kc = 0, .threads = 0};
+}
+
+
+/**
+ * Valid gemm parameters: nr rounded down to a supported block (out of
+ * range values get the default), no negative tile or threads. */
+static cnet_gemm_params gemm_params_check(
+    cnet_gemm_params params
+){
+    if (params.nr < 1 || params.nr > CNET_GEMM_MAX_NR)
+        params.nr = cnet_gemm_defaults().nr;
+    while(params.nr & (params.nr - 1))
+        params.nr &= params.nr - 1;
+    if (params.kc < 0) params.kc = 0;
+    if (params.threads < 0) params.threads = 0;
+    return params;
+}
+
+
+/**
+ * Registered gemm parameters for a shape. */
+cnet_gemm_params const *cnet_gemm_lookup(
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k
+){
+    for(int i = 0; i < registry_size; i++) {
+        gemm_entry const *e = &registry[i];
+        if (e->m == m && e->n == n && e->k == k &&
+            e->trans_a == !!trans_a && e->trans_b == !!trans_b)
+            return &e->params;
+    }
+    return NULL;
+}
+
+
+/**
+ * Register the gemm parameters for a shape. */
+void cnet_gemm_register(
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    cnet_gemm_params params
+){
+    params = gemm_params_check(params);
+    cnet_gemm_params *found =
+        (cnet_gemm_params *)cnet_gemm_lookup(trans_a, trans_b, m, n, k);
+    if (found) {
+        *found = params;
+        return;
+    }
+
+    if (registry_size == registry_cap) {
+        registry_cap = registry_cap ? 2*registry_cap : 16;
+        registry = realloc(registry, sizeof(gemm_entry)*registry_cap);
+    }
+    registry[registry_size++] = (gemm_entry){
+        !!trans_a, !!trans_b, m, n, k, params
+    };
+}
+
+
+/**
+ * General Matrix Multiplication, with the registered parameters. */
+void cnet_gemm(
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *b,
+    int ldb,
+    double beta,
+    double *c,
+    int ldc
+){
+    cnet_gemm_params const *params = cnet_gemm_lookup(trans_a, trans_b, m, n, k);
+    cnet_gemm_params defaults = cnet_gemm_defaults();
+    cnet_gemm_ex(
+        params ? params : &defaults,
+        trans_a, trans_b,
+        m, n, k,
+        alpha, a, lda,
+        b, ldb,
+        beta, c, ldc
+    );
+}
+
+
+#ifdef CNET_CBLAS
+
+
+/// CBLAS backend
+
+
+char const *cnet_blas_backend(void) {
+    return "cblas";
+}
+
+
+double cnet_dot(
+    int n,
+    double const *x,
+    double const *y
+){
+    return cblas_ddot(n, x, 1, y, 1);
+}
+
+
+void cnet_axpy(
+    int n,
+    double alpha,
+    double const *x,
+    double *y
+){
+    cblas_daxpy(n, alpha, x, 1, y, 1);
+}
+
+
+void cnet_gemv(
+    int trans,
+    int m,
+    int n,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *x,
+    double beta,
+    double *y
+){
+    cblas_dgemv(
+        CblasRowMajor,
+        trans ? CblasTrans : CblasNoTrans,
+        m, n,
+        alpha, a, lda,
+        x, 1,
+        beta, y, 1
+    );
+}
+
+
+void cnet_ger(
+    int m,
+    int n,
+    double alpha,
+    double const *x,
+    double const *y,
+    double *a,
+    int lda
+){
+    cblas_dger(CblasRowMajor, m, n, alpha, x, 1, y, 1, a, lda);
+}
+
+
+void cnet_gemm_ex(
+    cnet_gemm_params const *params,
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *b,
+    int ldb,
+    double beta,
+    double *c,
+    int ldc
+){
+    (void)params;
+    cblas_dgemm(
+        CblasRowMajor,
+        trans_a ? CblasTrans : CblasNoTrans,
+        trans_b ? CblasTrans : CblasNoTrans,
+        m, n, k,
+        alpha, a, lda,
+        b, ldb,
+        beta, c, ldc
+    );
+}
+
+
+#else
+
+
+/// Builtin backend
+
+
+char const *cnet_blas_backend(void) {
+    return "builtin";
+}
+
+
+/**
+ * Scale (or clear, if beta is 0) a vector. */
+static inline void scale_vector(
+    int n,
+    double beta,
+    double *y
+){
+    if (beta == 1) return;
+    for(int i = 0; i < n; i++)
+        y[i] = beta == 0 ? 0 : beta * y[i];
+}
+
+
+/**
+ * Dot Product, with independent accumulators. */
+double cnet_dot(
+    int n,
+    double const *x,
+    double const *y
+){
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for(; i + 4 <= n; i += 4) {
+        s0 += x[i] * y[i];
+        s1 += x[i + 1] * y[i + 1];
+        s2 += x[i + 2] * y[i + 2];
+        s3 += x[i + 3] * y[i + 3];
+    }
+    for(; i < n; i++)
+        s0 += x[i] * y[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+
+/**
+ * Scaled Vector Addition */
+void cnet_axpy(
+    int n,
+    double alpha,
+    double const *x,
+    double *y
+){
+    for(int i = 0; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+
+/**
+ * General Matrix Vector Multiplication */
+void cnet_gemv(
+    int trans,
+    int m,
+    int n,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *x,
+    double beta,
+    double *y
+){
+    if (!trans) {
+        for(int i = 0; i < m; i++) {
+            double z = alpha * cnet_dot(n, a + i*lda, x);
+            y[i] = beta == 0 ? z : z + beta * y[i];
+        }
+        return;
+    }
+
+    // transposed: y accumulates the rows of A, walking them contiguously
+    scale_vector(n, beta, y);
+    for(int i = 0; i < m; i++)
+        if (x[i] != 0)
+            cnet_axpy(n, alpha * x[i], a + i*lda, y);
+}
+
+
+/**
+ * Rank One Update */
+void cnet_ger(
+    int m,
+    int n,
+    double alpha,
+    double const *x,
+    double const *y,
+    double *a,
+    int lda
+){
+    // zeros of x skipped (see blas.h)
+    for(int i = 0; i < m; i++)
+        if (x[i] != 0)
+            cnet_axpy(n, alpha * x[i], y, a + i*lda);
+}
+
+
+/**
+ * Element (i, p) of op(A). */
+static inline double op_elem(
+    double const *a,
+    int lda,
+    int trans,
+    int i,
+    int p
+){
+    return trans ? a[p*lda + i] : a[i*lda + p];
+}
+
+
+/**
+ * A gemm call (or the block of it computed by a thread). */
+typedef struct gemm_args {
+    cnet_gemm_params params;
+    int trans_a, trans_b, m, n, k;
+    double alpha;
+    double const *a, *b;
+    int lda, ldb;
+    double beta;
+    double *c;
+    int ldc;
+} gemm_args;
+
+
+/**
+ * One pass over a C row, accumulating nr scaled rows of B.
+ * Inlined with a constant nr, so the inner loop is fully unrolled. */
+static inline void gemm_nn_pass(
+    int nr,
+    int n,
+    double const *s,
+    double const *b,
+    int ldb,
+    double *ci
+){
+    for(int j = 0; j < n; j++) {
+        double x = ci[j];
+        for(int r = 0; r < nr; r++)
+            x += s[r] * b[r*ldb + j];
+        ci[j] = x;
+    }
+}
+
+
+/**
+ * C += alpha * op(A) * B, for the inner range [p0, p1). */
+static void gemm_nn(
+    gemm_args const *g,
+    int p0,
+    int p1
+){
+    int nr = g->params.nr;
+    for(int i = 0; i < g->m; i++) {
+        double *ci = g->c + i*g->ldc;
+        int p = p0;
+        for(; p + nr <= p1; p += nr) {
+            double s[CNET_GEMM_MAX_NR];
+            int zero = 1;
+            for(int r = 0; r < nr; r++) {
+                s[r] = g->alpha * op_elem(g->a, g->lda, g->trans_a, i, p + r);
+                zero &= s[r] == 0;
+            }
+            // blocks of zeros skipped (see blas.h)
+            if (zero) continue;
+
+            double const *bp = g->b + p*g->ldb;
+            switch(nr) {
+                case 8: gemm_nn_pass(8, g->n, s, bp, g->ldb, ci); break;
+                case 4: gemm_nn_pass(4, g->n, s, bp, g->ldb, ci); break;
+                case 2: gemm_nn_pass(2, g->n, s, bp, g->ldb, ci); break;
+                default: gemm_nn_pass(1, g->n, s, bp, g->ldb, ci); break;
+            }
+        }
+        for(; p < p1; p++) {
+            double s = g->alpha * op_elem(g->a, g->lda, g->trans_a, i, p);
+            if (s != 0) gemm_nn_pass(1, g->n, &s, g->b + p*g->ldb, g->ldb, ci);
+        }
+    }
+}
+
+
+/**
+ * Dot products of every A row with nr rows of B, over [p0, p1).
+ * Inlined with a constant nr, each A value is loaded once for nr rows. */
+static inline void gemm_nt_block(
+    int nr,
+    gemm_args const *g,
+    int j,
+    int p0,
+    int p1
+){
+    double const *bj = g->b + j*g->ldb;
+    for(int i = 0; i < g->m; i++) {
+        double const *ai = g->a + i*g->lda;
+        double s[CNET_GEMM_MAX_NR] = {0};
+        for(int p = p0; p < p1; p++)
+            for(int r = 0; r < nr; r++)
+                s[r] += ai[p] * bj[r*g->ldb + p];
+
+        double *ci = g->c + i*g->ldc + j;
+        for(int r = 0; r < nr; r++)
+            ci[r] += g->alpha * s[r];
+    }
+}
+
+
+/**
+ * C += alpha * A * B^T, for the inner range [p0, p1). */
+static void gemm_nt(
+    gemm_args const *g,
+    int p0,
+    int p1
+){
+    int nr = g->params.nr, j = 0;
+    for(; j + nr <= g->n; j += nr) {
+        switch(nr) {
+            case 8: gemm_nt_block(8, g, j, p0, p1); break;
+            case 4: gemm_nt_block(4, g, j, p0, p1); break;
+            case 2: gemm_nt_block(2, g, j, p0, p1); break;
+            default: gemm_nt_block(1, g, j, p0, p1); break;
+        }
+    }
+    for(; j < g->n; j++)
+        gemm_nt_block(1, g, j, p0, p1);
+}
+
+
+/**
+ * Single thread gemm. */
+static void gemm_serial(
+    gemm_args const *g
+){
+    // scale (or clear) the destination
+    for(int i = 0; i < g->m; i++)
+        scale_vector(g->n, g->beta, g->c + i*g->ldc);
+
+    if (g->trans_a && g->trans_b) {
+        for(int i = 0; i < g->m; i++) {
+            for(int j = 0; j < g->n; j++) {
+                double s = 0;
+                for(int p = 0; p < g->k; p++)
+                    s += g->a[p*g->lda + i] * g->b[j*g->ldb + p];
+                g->c[i*g->ldc + j] += g->alpha * s;
+            }
+        }
+        return;
+    }
+
+    // inner dimension tiles, so the B rows of a tile stay in cache
+    // while every row of A goes through them
+    int kc = g->params.kc > 0 ? g->params.kc : g->k;
+    for(int p0 = 0; p0 < g->k; p0 += kc) {
+        int p1 = g->k - p0 < kc ? g->k : p0 + kc;
+        if (g->trans_b) gemm_nt(g, p0, p1);
+        else gemm_nn(g, p0, p1);
+    }
+}
+
+
+/* multiply-adds per part of automatically split gemms */
+#define GEMM_PART_SIZE (1L << 18)
+
+
+/**
+ * A gemm split in parts: C rows, or register blocks of C columns. */
+typedef struct gemm_split {
+    gemm_args args;
+    int split_rows, blocks, parts;
+} gemm_split;
+
+
+/**
+ * Compute a range of parts of a split gemm. */
+static void gemm_parts(
+    void *arg,
+    long from,
+    long to
+){
+    gemm_split const *split = arg;
+    gemm_args const *g = &split->args;
+    int nr = g->params.nr;
+
+    for(long t = from; t < to; t++) {
+        int lo = (int)((long)split->blocks * t / split->parts);
+        int hi = (int)((long)split->blocks * (t + 1) / split->parts);
+        gemm_args part = *g;
+        if (split->split_rows) {
+            part.m = hi - lo;
+            part.a = g->trans_a ? g->a + lo : g->a + lo*g->lda;
+            part.c = g->c + lo*g->ldc;
+        } else {
+            lo *= nr;
+            hi = hi * nr < g->n ? hi * nr : g->n;
+            part.n = hi - lo;
+            part.b = g->trans_b ? g->b + lo*g->ldb : g->b + lo;
+            part.c = g->c + lo;
+        }
+        gemm_serial(&part);
+    }
+}
+
+
+/**
+ * General Matrix Multiplication with the given parameters. */
+void cnet_gemm_ex(
+    cnet_gemm_params const *params,
+    int trans_a,
+    int trans_b,
+    int m,
+    int n,
+    int k,
+    double alpha,
+    double const *a,
+    int lda,
+    double const *b,
+    int ldb,
+    double beta,
+    double *c,
+    int ldc
+){
+    gemm_args args = {
+        gemm_params_check(*params), !!trans_a, !!trans_b, m, n, k,
+        alpha, a, b, lda, ldb, beta, c, ldc
+    };
+
+    // split the larger dimension of C, in whole register blocks
+    gemm_split split = {args, m >= n, 0, args.params.threads};
+    split.blocks = split.split_rows ? m : (n + args.params.nr - 1) / args.params.nr;
+
+    // automatic split: as many parts as pool threads, if big enough
+    cnet_tpool *pool = cnet_tpool_get();
+    if (split.parts <= 0) {
+        long parts = (long)m * n * k / GEMM_PART_SIZE;
+        int threads = cnet_tpool_threads(pool);
+        split.parts = parts < threads ? (int)parts : threads;
+    }
+    if (split.parts > split.blocks) split.parts = split.blocks;
+    if (split.parts <= 1) {
+        gemm_serial(&args);
+        return;
+    }
+
+    cnet_parallel_for(pool, 0, split.parts, 1, gemm_parts, &split);
+}
+
+
+#endif
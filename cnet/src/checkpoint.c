@@ -0,0 +1,237 @@
+/*****************************************************************************
+ *                               CHECKPOINT
+ * Implementation of the background checkpoint writer.
+ ****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/checkpoint.h"
+#include "../include/cnet.h"
+
+#define CKPT_TMP_SUFFIX ".tmp"
+#define CKPT_IO_BUFFER (1 << 20)
+
+
+struct cnet_ckpt {
+
+    /* checkpoint path and its temporary sibling */
+    char *path, *tmp_path;
+
+    /* parameters snapshot, only read by the writer while pending */
+    cnet *snapshot;
+
+    /* large buffer for sequential writes */
+    char *io_buffer;
+
+    /* writer thread state */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    int pending, stop;
+    struct timespec submitted;
+
+    cnet_ckpt_stats stats;
+};
+
+
+/**
+ * Milliseconds elapsed since a given time. */
+static double ckpt_elapsed_ms(
+    struct timespec const *since
+){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1e3 +
+           (now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+
+/**
+ * Sync the directory of a path, so that a rename in it is durable. */
+static int ckpt_sync_dir(
+    char const *path
+){
+    char const *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : slash - path) : strdup(".");
+    int fd = open(dir, O_RDONLY);
+    free(dir);
+    if (fd < 0) return -1;
+    int failed = fsync(fd) != 0;
+    close(fd);
+    return failed ? -1 : 0;
+}
+
+
+/**
+ * Write the snapshot into the temporary file and rename it.
+ *
+ * @param cnet_ckpt *ckpt: writer
+ * @return long: bytes written, or -1 on failure
+ */
+static long ckpt_write(
+    cnet_ckpt *ckpt
+){
+    FILE *out = fopen(ckpt->tmp_path, "w");
+    if (!out) return -1;
+    setvbuf(out, ckpt->io_buffer, _IOFBF, CKPT_IO_BUFFER);
+
+    nn_save(ckpt->snapshot, out);
+
+    // flush and sync before publishing the file (a buffered write may
+    // have failed earlier, leaving the stream error set), then sync the
+    // directory holding the rename
+    long bytes = ftell(out);
+    int failed = fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0;
+    failed |= fclose(out) != 0;
+    failed |= !failed && rename(ckpt->tmp_path, ckpt->path) != 0;
+    failed |= !failed && ckpt_sync_dir(ckpt->path) != 0;
+    return failed ? -1 : bytes;
+}
+
+
+/**
+ * Writer thread loop. */
+static void *ckpt_worker(
+    void *arg
+){
+    cnet_ckpt *ckpt = arg;
+
+    pthread_mutex_lock(&ckpt->lock);
+    for(;;) {
+        while(!ckpt->pending && !ckpt->stop)
+            pthread_cond_wait(&ckpt->work, &ckpt->lock);
+        if (!ckpt->pending) break;
+
+        // the snapshot is not touched by submitters while pending
+        pthread_mutex_unlock(&ckpt->lock);
+        long bytes = ckpt_write(ckpt);
+        pthread_mutex_lock(&ckpt->lock);
+
+        if (bytes < 0) {
+            fprintf(stderr, "Failed to write checkpoint: %s\n", ckpt->path);
+        } else {
+            ckpt->stats.written++;
+            ckpt->stats.last_bytes = bytes;
+            ckpt->stats.total_bytes += bytes;
+            ckpt->stats.last_ms = ckpt_elapsed_ms(&ckpt->submitted);
+            ckpt->stats.total_ms += ckpt->stats.last_ms;
+        }
+
+        ckpt->pending = 0;
+        pthread_cond_broadcast(&ckpt->done);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+    return NULL;
+}
+
+
+/**
+ * Create a checkpoint writer. */
+cnet_ckpt *cnet_ckpt_init(
+    cnet const *nn,
+    char const *path
+){
+    cnet_ckpt *ckpt = calloc(1, sizeof(cnet_ckpt));
+
+    ckpt->path = malloc(strlen(path) + 1);
+    strcpy(ckpt->path, path);
+    ckpt->tmp_path = malloc(strlen(path) + sizeof(CKPT_TMP_SUFFIX));
+    strcpy(ckpt->tmp_path, path);
+    strcat(ckpt->tmp_path, CKPT_TMP_SUFFIX);
+
+    ckpt->snapshot = nn_clone(nn);
+    ckpt->io_buffer = malloc(CKPT_IO_BUFFER);
+
+    pthread_mutex_init(&ckpt->lock, NULL);
+    pthread_cond_init(&ckpt->work, NULL);
+    pthread_cond_init(&ckpt->done, NULL);
+
+    if (pthread_create(&ckpt->thread, NULL, ckpt_worker, ckpt) != 0) {
+        ckpt->stop = 1;
+        cnet_ckpt_free(ckpt);
+        return NULL;
+    }
+    return ckpt;
+}
+
+
+/**
+ * Submit a checkpoint. */
+int cnet_ckpt_submit(
+    cnet_ckpt *ckpt,
+    cnet const *nn
+){
+    pthread_mutex_lock(&ckpt->lock);
+    if (ckpt->pending) {
+        ckpt->stats.skipped++;
+        pthread_mutex_unlock(&ckpt->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+
+    // the writer is idle, so the snapshot can be refreshed without the lock
+    nn_copy_params(ckpt->snapshot, nn);
+
+    pthread_mutex_lock(&ckpt->lock);
+    clock_gettime(CLOCK_MONOTONIC, &ckpt->submitted);
+    ckpt->pending = 1;
+    pthread_cond_signal(&ckpt->work);
+    pthread_mutex_unlock(&ckpt->lock);
+    return 1;
+}
+
+
+/**
+ * Wait for the in-flight checkpoint. */
+void cnet_ckpt_wait(
+    cnet_ckpt *ckpt
+){
+    pthread_mutex_lock(&ckpt->lock);
+    while(ckpt->pending)
+        pthread_cond_wait(&ckpt->done, &ckpt->lock);
+    pthread_mutex_unlock(&ckpt->lock);
+}
+
+
+/**
+ * Get the writer statistics. */
+cnet_ckpt_stats cnet_ckpt_get_stats(
+    cnet_ckpt *ckpt
+){
+    pthread_mutex_lock(&ckpt->lock);
+    cnet_ckpt_stats stats = ckpt->stats;
+    pthread_mutex_unlock(&ckpt->lock);
+    return stats;
+}
+
+
+/**
+ * Free the checkpoint writer. */
+void cnet_ckpt_free(
+    cnet_ckpt *ckpt
+){
+    if (!ckpt->stop) {
+        pthread_mutex_lock(&ckpt->lock);
+        ckpt->stop = 1;
+        pthread_cond_signal(&ckpt->work);
+        pthread_mutex_unlock(&ckpt->lock);
+        pthread_join(ckpt->thread, NULL);
+    }
+
+    pthread_mutex_destroy(&ckpt->lock);
+    pthread_cond_destroy(&ckpt->work);
+    pthread_cond_destroy(&ckpt->done);
+
+    nn_free(ckpt->snapshot);
+    free(ckpt->io_buffer);
+    free(ckpt->tmp_path);
+    free(ckpt->path);
+    free(ckpt);
+}
@@ -7,15 +7,31 @@
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../include/cnet.h"
+#include "../include/blas.h"
+#include "../include/checkpoint.h"
+#include "../include/conv.h"
+#include "../include/dataset.h"
+#include "../include/dist.h"
+#include "../include/embedding.h"
+#include "../include/half.h"
+#include "../include/sparse.h"
 #include "../include/loss.h"
 #include "../include/activation.h"
 #include "../include/helpers.h"
+#include "../include/locality.h"
 #include "../include/metrics.h"
 #include "../include/pbar.h"
+#include "../include/pipeline.h"
+#include "../include/random.h"
+#include "../include/team.h"
+#include "../include/tpool.h"
 
 #define INIT_BIAS 0
-#define INIT_WEIGHT ((double)rand() / (RAND_MAX)) - 0.5
+#define SPARSE_INPUT_DENSITY 0.5
+#define INIT_WEIGHT 0.5
+#define VAL_BATCH 64
 
 /**
  * Create CNet. */
@@ -30,6 +46,14 @@ cnet *nn_init(
     nn->n_layers = n_layers;
     nn->layers = malloc(sizeof(clayer*) * n_layers);
     nn->last_layer = 0;
+    nn->ckpt = NULL;
+    nn->ckpt_every = 0;
+    nn->accum_steps = 1;
+    nn->team = NULL;
+    nn->pipe_stages = 1;
+    nn->pipe_micro = 1;
+    nn->dist = NULL;
+    nn->sparse_density = SPARSE_INPUT_DENSITY;
     return nn;
 }
 
@@ -41,13 +65,19 @@ void nn_free(
 ){
     for(int i = 0; i < nn->n_layers; i++) {
         struct clayer *layer = nn->layers[i];
-        for(int j = 0; j < layer->out_size; j++)
-            free(layer->weights[j]);
-
+        if (layer->weights) free(layer->weights[0]);
         free(layer->weights);
         free(layer->bias);
         free(layer->output);
         free(layer->delta);
+        free(layer->cols);
+        free(layer->nz_idx);
+        free(layer->nz_val);
+        free(layer->mask);
+        free(layer->half);
+        free(layer->csr_rows);
+        free(layer->csr_cols);
+        free(layer->csr_vals);
         free(layer);
     }
     free(nn->layers);
@@ -56,43 +86,641 @@ void nn_free(
 
 
 /**
- * Add a Layer to the CNet. */
-void nn_add(
-    cnet *nn,
+ * Allocate a Layer
+ *
+ * Allocs the layer buffers and randomizes its trainable parameters:
+ * a w_rows x w_cols weights matrix and w_rows biases.
+ * Layers without parameters (w_rows = 0) get NULL weights and biases.
+ *
+ * @param enum cnet_layer_type type: Layer type
+ * @param int in_size: Input size
+ * @param int out_size: Output size
+ * @param int w_rows: Weights rows
+ * @param int w_cols: Weights columns
+ * @param cnet_act_type activation: Activation type
+ * @return clayer *: Allocated layer (geometry fields are left to the caller)
+ */
+static clayer *clayer_alloc(
+    enum cnet_layer_type type,
     int in_size,
     int out_size,
+    int w_rows,
+    int w_cols,
     enum cnet_act_type activation
 ){
-    // check the input/output size
-    assert(nn->last_layer == 0 ||
-           in_size == nn->layers[nn->last_layer - 1]->out_size);
-    assert(nn->last_layer < nn->n_layers - 1 || out_size == nn->out_size);
-
-    // alloc the layer
-    struct clayer* layer = malloc(sizeof(clayer));
+    struct clayer* layer = calloc(1, sizeof(clayer));
+    layer->type = type;
     layer->in_size = in_size;
     layer->out_size = out_size;
     layer->activation = activation;
+    layer->w_rows = w_rows;
+    layer->w_cols = w_cols;
+    layer->b_size = w_rows;
 
-    layer->weights = malloc(sizeof(double*)*layer->out_size);
-    layer->bias = malloc(sizeof(double)*layer->out_size);
     layer->output = malloc(sizeof(double)*layer->out_size);
     layer->delta = malloc(sizeof(double)*layer->out_size);
+    if (!w_rows) return layer;
 
-    // randomize weights and biases between 0 and 1
-    for(int i = 0; i < layer->out_size; i++) {
+    // weights are a single contiguous block, indexed through row pointers
+    layer->weights = malloc(sizeof(double*)*w_rows);
+    layer->weights[0] = malloc(sizeof(double)*w_rows*w_cols);
+    layer->bias = malloc(sizeof(double)*layer->b_size);
+
+    for(int i = 0; i < w_rows; i++) {
         layer->bias[i] = INIT_BIAS;
-        layer->weights[i] = malloc(sizeof(double)*layer->in_size);
-        for(int j = 0; j < layer->in_size; j++)
-            layer->weights[i][j] = INIT_WEIGHT;
+        layer->weights[i] = layer->weights[0] + i*w_cols;
     }
 
+    // randomize weights between -INIT_WEIGHT and INIT_WEIGHT, large
+    // layers are filled by several threads (one stream per chunk)
+    cnet_rng_fill_streams(
+        cnet_rng_next(cnet_rng_local()),
+        layer->weights[0],
+        (long)w_rows * w_cols,
+        -INIT_WEIGHT,
+        INIT_WEIGHT
+    );
+
+    return layer;
+}
+
+
+/**
+ * Push a Layer into the CNet.
+ *
+ * Will assert if there is any inconsistency with the previous layers.
+ *
+ * @param cnet *nn: CNet
+ * @param clayer *layer: Layer to add
+ */
+static void nn_push(
+    cnet *nn,
+    clayer *layer
+){
+    // check the input/output size
+    assert(nn->last_layer == 0 ||
+           layer->in_size == nn->layers[nn->last_layer - 1]->out_size);
+    assert(nn->last_layer < nn->n_layers - 1 ||
+           layer->out_size == nn->out_size);
+
     // add layer to the net
     assert(nn->last_layer < nn->n_layers);
     nn->layers[nn->last_layer++] = layer;
 }
 
 
+/**
+ * Add a Layer to the CNet. */
+void nn_add(
+    cnet *nn,
+    int in_size,
+    int out_size,
+    enum cnet_act_type activation
+){
+    clayer *layer = clayer_alloc(
+        dense_layer,
+        in_size,
+        out_size,
+        out_size,
+        in_size,
+        activation
+    );
+
+    // the first layer can take the sparse input path
+    if (nn->last_layer == 0) {
+        layer->nnz = -1;
+        layer->nz_idx = malloc(sizeof(int)*in_size);
+        layer->nz_val = malloc(sizeof(double)*in_size);
+    }
+
+    nn_push(nn, layer);
+}
+
+
+/**
+ * Add a 2D Convolution Layer to the CNet. */
+void nn_add_conv2d(
+    cnet *nn,
+    cnet_shape in_shape,
+    int filters,
+    int kernel,
+    int stride,
+    int padding,
+    enum cnet_act_type activation
+){
+    cnet_shape out_shape = {
+        .channels = filters,
+        .height = (in_shape.height + 2*padding - kernel) / stride + 1,
+        .width = (in_shape.width + 2*padding - kernel) / stride + 1
+    };
+    assert(out_shape.height > 0 && out_shape.width > 0);
+
+    // one filter per weights row, over a whole input window
+    clayer *layer = clayer_alloc(
+        conv2d_layer,
+        in_shape.channels * in_shape.height * in_shape.width,
+        out_shape.channels * out_shape.height * out_shape.width,
+        filters,
+        in_shape.channels * kernel * kernel,
+        activation
+    );
+    layer->in_shape = in_shape;
+    layer->out_shape = out_shape;
+    layer->kernel = kernel;
+    layer->stride = stride;
+    layer->padding = padding;
+    layer->cols = malloc(
+        sizeof(double) * layer->w_cols * out_shape.height * out_shape.width
+    );
+
+    nn_push(nn, layer);
+}
+
+
+/**
+ * Add a 2D Pooling Layer to the CNet. */
+void nn_add_pool(
+    cnet *nn,
+    enum cnet_layer_type type,
+    cnet_shape in_shape,
+    int size,
+    int stride
+){
+    assert(type == maxpool_layer || type == avgpool_layer);
+    cnet_shape out_shape = {
+        .channels = in_shape.channels,
+        .height = (in_shape.height - size) / stride + 1,
+        .width = (in_shape.width - size) / stride + 1
+    };
+    assert(out_shape.height > 0 && out_shape.width > 0);
+
+    clayer *layer = clayer_alloc(
+        type,
+        in_shape.channels * in_shape.height * in_shape.width,
+        out_shape.channels * out_shape.height * out_shape.width,
+        0,
+        0,
+        linear_act
+    );
+    layer->in_shape = in_shape;
+    layer->out_shape = out_shape;
+    layer->kernel = size;
+    layer->stride = stride;
+
+    nn_push(nn, layer);
+}
+
+
+/**
+ * Add a Sparse Layer to the CNet. */
+void nn_add_sparse(
+    cnet *nn,
+    int in_size,
+    int out_size,
+    int nnz,
+    enum cnet_act_type activation
+){
+    clayer *layer = clayer_alloc(
+        sparse_layer,
+        in_size,
+        out_size,
+        0,
+        0,
+        activation
+    );
+
+    layer->b_size = out_size;
+    layer->bias = malloc(sizeof(double)*out_size);
+    for(int i = 0; i < out_size; i++)
+        layer->bias[i] = INIT_BIAS;
+
+    layer->csr_nnz = nnz;
+    layer->csr_rows = calloc(out_size + 1, sizeof(int));
+    layer->csr_cols = calloc(nnz, sizeof(int));
+    layer->csr_vals = calloc(nnz, sizeof(double));
+
+    nn_push(nn, layer);
+}
+
+
+/**
+ * Add an Embedding Layer to the CNet. */
+void nn_add_embedding(
+    cnet *nn,
+    int fields,
+    int vocab,
+    int dim
+){
+    // categorical indices are only found in the network input
+    assert(nn->last_layer == 0);
+
+    // one table row per category, no biases
+    clayer *layer = clayer_alloc(
+        embedding_layer,
+        fields,
+        fields * dim,
+        vocab,
+        dim,
+        linear_act
+    );
+    free(layer->bias);
+    layer->bias = NULL;
+    layer->b_size = 0;
+
+    nn_push(nn, layer);
+}
+
+
+/**
+ * Clone CNet. */
+cnet *nn_clone(
+    cnet const *nn
+){
+    cnet *clone = nn_init(nn->in_size, nn->out_size, nn->n_layers);
+    for(int i = 0; i < nn->last_layer; i++) {
+        clayer const *layer = nn->layers[i];
+        switch(layer->type) {
+            case dense_layer:
+                nn_add(
+                    clone,
+                    layer->in_size,
+                    layer->out_size,
+                    layer->activation
+                );
+                break;
+            case conv2d_layer:
+                nn_add_conv2d(
+                    clone,
+                    layer->in_shape,
+                    layer->w_rows,
+                    layer->kernel,
+                    layer->stride,
+                    layer->padding,
+                    layer->activation
+                );
+                break;
+            case maxpool_layer:
+            case avgpool_layer:
+                nn_add_pool(
+                    clone,
+                    layer->type,
+                    layer->in_shape,
+                    layer->kernel,
+                    layer->stride
+                );
+                break;
+            case sparse_layer:
+                nn_add_sparse(
+                    clone,
+                    layer->in_size,
+                    layer->out_size,
+                    layer->csr_nnz,
+                    layer->activation
+                );
+                break;
+            case embedding_layer:
+                nn_add_embedding(
+                    clone,
+                    layer->in_size,
+                    layer->w_rows,
+                    layer->w_cols
+                );
+                break;
+        }
+    }
+    nn_copy_params(clone, nn);
+
+    // keep the 16 bit storage, refreshed from the copied weights
+    for(int i = 0; i < nn->last_layer; i++)
+        if (nn->layers[i]->half)
+            cnet_layer_half(clone->layers[i], nn->layers[i]->half_type);
+    return clone;
+}
+
+
+/**
+ * Copy CNet trainable parameters. */
+void nn_copy_params(
+    cnet *dst,
+    cnet const *src
+){
+    assert(dst->last_layer == src->last_layer);
+    for(int i = 0; i < src->last_layer; i++) {
+        clayer *to = dst->layers[i];
+        clayer const *from = src->layers[i];
+        assert(to->type == from->type);
+        assert(to->w_rows == from->w_rows && to->w_cols == from->w_cols);
+        assert(to->b_size == from->b_size && to->csr_nnz == from->csr_nnz);
+
+        if (from->b_size)
+            memcpy(to->bias, from->bias, sizeof(double)*from->b_size);
+        if (from->w_rows)
+            memcpy(
+                to->weights[0],
+                from->weights[0],
+                sizeof(double)*from->w_rows*from->w_cols
+            );
+
+        // 16 bit weights, used by the forward passes and the saved models
+        if (to->half && from->half)
+            memcpy(to->half, from->half, sizeof(uint16_t)*from->w_rows*from->w_cols);
+        else
+            cnet_half_refresh(to);
+
+        if (from->type != sparse_layer) continue;
+        memcpy(to->csr_rows, from->csr_rows, sizeof(int)*(from->out_size + 1));
+        memcpy(to->csr_cols, from->csr_cols, sizeof(int)*from->csr_nnz);
+        memcpy(to->csr_vals, from->csr_vals, sizeof(double)*from->csr_nnz);
+    }
+}
+
+
+/**
+ * Set CNet checkpoint writer. */
+void nn_set_checkpoint(
+    cnet *nn,
+    struct cnet_ckpt *ckpt,
+    int every
+){
+    assert(!ckpt || every > 0);
+    nn->ckpt = ckpt;
+    nn->ckpt_every = every;
+}
+
+
+/**
+ * Set CNet gradient accumulation. */
+void nn_set_accumulation(
+    cnet *nn,
+    int steps
+){
+    assert(steps > 0);
+    nn->accum_steps = steps;
+}
+
+
+/**
+ * Set CNet prediction team. */
+void nn_set_team(
+    cnet *nn,
+    struct cnet_team *team
+){
+    nn->team = team;
+}
+
+
+/**
+ * Set CNet pipeline parallel training. */
+void nn_set_pipeline(
+    cnet *nn,
+    int stages,
+    int micro_batch
+){
+    assert(stages > 0 && micro_batch > 0);
+    nn->pipe_stages = stages;
+    nn->pipe_micro = micro_batch;
+}
+
+
+/**
+ * Set CNet distributed training. */
+void nn_set_dist(
+    cnet *nn,
+    struct cnet_dist *dist
+){
+    nn->dist = dist;
+}
+
+
+/**
+ * Layer Forward Pass
+ *
+ * Computes the activated output of a layer for a batch of inputs.
+ * Dense layers reuse each weights row over the whole batch before moving
+ * on to the next neuron, so it is only fetched once per batch.
+ *
+ * @param clayer const *layer: Layer
+ * @param double const *in: Inputs (sized batch x layer->in_size)
+ * @param double *out: Outputs (sized batch x layer->out_size)
+ * @param int batch: Number of samples
+ * @param double *cols: im2col buffer (conv layers), or row buffer (half layers)
+ * @param int activate: Apply the activation (0 leaves the logits)
+ */
+static void clayer_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    int batch,
+    double *cols,
+    int activate
+){
+    switch(layer->type) {
+        case dense_layer:
+            if (!layer->half) {
+                // out (batch x out_size) = in (batch x in_size) * weights^T
+                cnet_gemm(
+                    0, 1,
+                    batch, layer->out_size, layer->in_size,
+                    1, in, layer->in_size,
+                    layer->weights[0], layer->in_size,
+                    0, out, layer->out_size
+                );
+                for(int b = 0; b < batch; b++)
+                    cnet_axpy(
+                        layer->out_size,
+                        1,
+                        layer->bias,
+                        out + b*layer->out_size
+                    );
+                break;
+            }
+
+            // 16 bit weights rows are widened once for the whole batch
+            for(int k = 0; k < layer->out_size; k++) {
+                cnet_half_widen(
+                    layer->half_type,
+                    layer->half + k*layer->in_size,
+                    cols,
+                    layer->in_size
+                );
+                for(int b = 0; b < batch; b++)
+                    out[b*layer->out_size + k] = layer->bias[k] +
+                        cnet_dot(layer->in_size, cols, in + b*layer->in_size);
+            }
+            break;
+        case conv2d_layer:
+            for(int b = 0; b < batch; b++)
+                cnet_conv_forward(
+                    layer,
+                    in + b*layer->in_size,
+                    out + b*layer->out_size,
+                    cols
+                );
+            break;
+        case maxpool_layer:
+        case avgpool_layer:
+            for(int b = 0; b < batch; b++)
+                cnet_pool_forward(
+                    layer,
+                    in + b*layer->in_size,
+                    out + b*layer->out_size
+                );
+            break;
+        case sparse_layer:
+            cnet_csr_forward(layer, in, out, batch);
+            break;
+        case embedding_layer:
+            cnet_embedding_forward(layer, in, out, batch);
+            break;
+    }
+
+    // activate the layer output
+    if (!activate) return;
+    cnet_act_func *act = cnet_get_act(layer->activation);
+    for(int b = 0; b < batch; b++)
+        act(out + b*layer->out_size, layer->out_size);
+}
+
+
+/**
+ * Sparse Layer Forward Pass
+ *
+ * Computes the activated output of a dense layer for a single sample,
+ * given only its non-zero inputs: each neuron only gathers the weights
+ * for these inputs.
+ *
+ * @param clayer const *layer: Dense layer
+ * @param int const *idx: Non-zero inputs indices
+ * @param double const *val: Non-zero inputs values
+ * @param int nnz: Number of non-zero inputs
+ * @param double *out: Output (sized layer->out_size)
+ * @param int activate: Apply the activation (0 leaves the logits)
+ */
+static void clayer_forward_sparse(
+    clayer const *layer,
+    int const *idx,
+    double const *val,
+    int nnz,
+    double *out,
+    int activate
+){
+    for(int k = 0; k < layer->out_size; k++) {
+        double z = 0;
+        if (layer->half) {
+            uint16_t const *w = layer->half + k*layer->in_size;
+            for(int t = 0; t < nnz; t++)
+                z += cnet_half_get(layer->half_type, w[idx[t]]) * val[t];
+        } else {
+            double const *w = layer->weights[k];
+            for(int t = 0; t < nnz; t++)
+                z += w[idx[t]] * val[t];
+        }
+
+        out[k] = z + layer->bias[k];
+    }
+
+    if (activate) cnet_get_act(layer->activation)(out, layer->out_size);
+}
+
+
+/**
+ * Gather Sparse Input
+ *
+ * Collects the non-zero inputs into the first layer buffers, as long as
+ * their density stays under the cnet threshold. Gives up as soon as the
+ * threshold is exceeded, leaving layer->nnz at -1.
+ *
+ * @param cnet const *nn: CNet
+ * @param clayer *layer: First layer (dense)
+ * @param double const *X: Input (sized nn->in_size)
+ * @return int: 1 if the input was gathered as sparse
+ */
+static int nn_gather_sparse(
+    cnet const *nn,
+    clayer *layer,
+    double const *X
+){
+    int limit = (int)(nn->sparse_density * layer->in_size);
+
+    layer->nnz = 0;
+    for(int j = 0; j < layer->in_size; j++) {
+        if (X[j] == 0) continue;
+        if (layer->nnz == limit) {
+            layer->nnz = -1;
+            return 0;
+        }
+        layer->nz_idx[layer->nnz] = j;
+        layer->nz_val[layer->nnz++] = X[j];
+    }
+    return 1;
+}
+
+
+/**
+ * Set CNet sparse input threshold. */
+void nn_set_sparse_input(
+    cnet *nn,
+    double density
+){
+    assert(density >= 0 && density <= 1);
+    nn->sparse_density = density;
+}
+
+
+/**
+ * Dense Parameters Gradient
+ *
+ * Adds the scaled weights and biases gradient of a dense layer, computed
+ * from its delta and input, to the given buffers (see cnet_conv_gradient).
+ * Only the non-zero inputs are visited when the sample was sparse.
+ *
+ * @param clayer const *layer: Dense layer
+ * @param double const *input: Layer input
+ * @param double scale: Gradient scale
+ * @param double *dw: Weights destination (out_size x in_size)
+ * @param double *db: Biases destination (out_size)
+ */
+static void clayer_dense_gradient(
+    clayer const *layer,
+    double const *input,
+    double scale,
+    double *dw,
+    double *db
+){
+    cnet_axpy(layer->out_size, scale, layer->delta, db);
+
+    // dw += scale * delta * input^T
+    if (!layer->nz_idx || layer->nnz < 0) {
+        cnet_ger(
+            layer->out_size, layer->in_size,
+            scale, layer->delta, input,
+            dw, layer->in_size
+        );
+        return;
+    }
+
+    // sparse inputs only touch the columns of their non-zero values
+    for(int k = 0; k < layer->out_size; k++) {
+        double update = scale * layer->delta[k];
+        double *row = dw + k*layer->in_size;
+        for(int t = 0; t < layer->nnz; t++)
+            row[layer->nz_idx[t]] += update * layer->nz_val[t];
+    }
+}
+
+
+/**
+ * Keep the pruned weights of a layer at zero. */
+static void clayer_apply_mask(
+    clayer *layer
+){
+    if (!layer->mask) return;
+    double *w = layer->weights[0];
+    for(int i = 0; i < layer->w_rows * layer->w_cols; i++)
+        if (!layer->mask[i]) w[i] = 0;
+}
+
+
 /**
  * CNet Forward Pass
  *
@@ -102,57 +730,229 @@ void nn_add(
  *
  * @param cnet const *nn: CNet
  * @param double const *X: Input (sized nn->in_size)
+ * @param int logits: Leave the last layer output un-activated (logits)
  */
 void nn_forward(
     cnet const *nn,
-    double const *X
+    double const *X,
+    int logits
 ){
     double const *in = X;
 
     // pass through every layer in the net
     for(int i = 0; i < nn->n_layers; i++) {
         struct clayer *layer = nn->layers[i];
+        int activate = !logits || i < nn->n_layers - 1;
 
-        // pass through every neuron in the net
-        for(int k = 0; k < layer->out_size; k++) {
-            // compute z for neuron
-            double z = 0;
-            for(int j = 0; j < layer->in_size; j++)
-                z += layer->weights[k][j] * in[j];
-            
-            z += layer->bias[k];
-            layer->output[k] = z;
+        // mostly zero inputs only go through their non-zero weights
+        if (layer->type == dense_layer && layer->nz_idx &&
+            nn_gather_sparse(nn, layer, in))
+            clayer_forward_sparse(
+                layer,
+                layer->nz_idx,
+                layer->nz_val,
+                layer->nnz,
+                layer->output,
+                activate
+            );
+        else
+            clayer_forward(layer, in, layer->output, 1, layer->cols, activate);
+
+        // set input for next layer
+        in = layer->output;
+    }
+}
+
+
+/**
+ * Team forward pass argument. */
+typedef struct nn_team_pass {
+    cnet const *nn;
+    double const *X;
+} nn_team_pass;
+
+
+/**
+ * Whether a layer output neurons are split between the team threads
+ * (the sparse input was gathered beforehand). */
+static int nn_team_splits(
+    clayer const *layer
+){
+    return layer->type == dense_layer && !layer->half &&
+           !(layer->nz_idx && layer->nnz >= 0);
+}
+
+
+/**
+ * Team Forward Pass: every thread computes its slice of the output
+ * neurons of the split layers, through the same gemm parameters as the
+ * whole layer (so with the same rounding). Softmax layers are activated
+ * by the first thread once the whole layer is done. */
+static void nn_team_forward(
+    void *arg,
+    int thread,
+    int n_threads
+){
+    cnet const *nn = ((nn_team_pass const *)arg)->nn;
+    double const *in = ((nn_team_pass const *)arg)->X;
+
+    for(int i = 0; i < nn->n_layers; i++) {
+        clayer *layer = nn->layers[i];
+        int last = i == nn->n_layers - 1;
+
+        if (!nn_team_splits(layer)) {
+            if (!thread && layer->nz_idx && layer->nnz >= 0)
+                clayer_forward_sparse(
+                    layer,
+                    layer->nz_idx,
+                    layer->nz_val,
+                    layer->nnz,
+                    layer->output,
+                    1
+                );
+            else if (!thread)
+                clayer_forward(layer, in, layer->output, 1, layer->cols, 1);
+            if (!last) cnet_team_barrier(nn->team);
+            in = layer->output;
+            continue;
         }
 
-        // activate the layer output
-        cnet_act_func *activate = cnet_get_act(layer->activation);
-        activate(layer->output, layer->out_size);
+        int n = layer->in_size, m = layer->out_size;
+        int from = (int)((long)m * thread / n_threads);
+        int to = (int)((long)m * (thread + 1) / n_threads);
+        int softmax = layer->activation == softmax_act;
 
-        // set input for next layer
+        cnet_gemm_params const *tuned = cnet_gemm_lookup(0, 1, 1, m, n);
+        cnet_gemm_params params = tuned ? *tuned : cnet_gemm_defaults();
+        params.threads = 1;
+        if (from < to) {
+            cnet_gemm_ex(
+                &params,
+                0, 1,
+                1, to - from, n,
+                1, in, n,
+                layer->weights[from], n,
+                0, layer->output + from, m
+            );
+            cnet_axpy(to - from, 1, layer->bias + from, layer->output + from);
+            if (!softmax)
+                cnet_get_act(layer->activation)(layer->output + from, to - from);
+        }
+
+        if (!last || softmax) cnet_team_barrier(nn->team);
+        if (softmax && !thread) cnet_get_act(softmax_act)(layer->output, m);
+        if (softmax && !last) cnet_team_barrier(nn->team);
         in = layer->output;
     }
 }
 
 
 /**
+ * Whether the output layer and loss use the fused softmax cross entropy. */
+static int nn_fused_loss(
+    cnet const *nn,
+    enum cnet_loss_type loss_type
+){
+    return loss_type == cross_entropy_loss &&
+           nn->layers[nn->n_layers - 1]->activation == softmax_act;
+}
+
+
+/**
+ * Training targets: one-hot (or any expected output) rows, or class
+ * indices when Y is NULL. */
+typedef struct nn_targets {
+    double **Y;
+    int const *labels;
+} nn_targets;
+
+
+/**
+ * Forward Pass and Loss
  *
- * CNet Backward Pass
- *
- * Performs a single backpropagation step, using SGD, hence
- * it only takes one train sample.
+ * Passes a training sample through the net and computes its loss.
+ * Softmax outputs paired with the cross entropy go through the fused
+ * kernel, which also leaves the output layer delta for nn_backward.
+ * Otherwise the delta (loss derivative) is only computed if asked for.
  *
  * @param cnet const *nn: CNet
- * @param double *X: Input (sized nn->in_size)
- * @param double *Y: Expected output (sized nn->out_size)
- * @param cnet_loss_type: Loss type to use
- * @param double learning_rate: Learning Rate
+ * @param double const *X: Input (sized nn->in_size)
+ * @param nn_targets const *targets: Targets
+ * @param int sample: Sample index in the targets
+ * @param cnet_loss_type loss_type: Loss type
+ * @param int backward: Leave the loss derivative in the output layer delta
+ * @return double: Loss
  */
-void nn_backward(
+static double nn_forward_loss(
+    cnet const *nn,
+    double const *X,
+    nn_targets const *targets,
+    int sample,
+    enum cnet_loss_type loss_type,
+    int backward
+){
+    clayer *last = nn->layers[nn->n_layers - 1];
+    double const *Y = targets->Y ? targets->Y[sample] : NULL;
+    int label = targets->labels ? targets->labels[sample] : -1;
+
+    if (nn_fused_loss(nn, loss_type)) {
+        nn_forward(nn, X, 1);
+        return Y ?
+            cnet_softmax_cross_entropy(last->output, Y, last->delta, nn->out_size) :
+            cnet_softmax_sparse_cross_entropy(
+                last->output,
+                label,
+                last->delta,
+                nn->out_size
+            );
+    }
+
+    nn_forward(nn, X, 0);
+    if (Y) {
+        if (backward)
+            cnet_get_loss_dx(loss_type)(last->output, Y, last->delta, nn->out_size);
+        return cnet_get_loss(loss_type)(last->output, Y, nn->out_size);
+    }
+
+    if (backward)
+        cnet_get_loss_sparse_dx(loss_type)(
+            last->output,
+            label,
+            last->delta,
+            nn->out_size
+        );
+    return cnet_get_loss_sparse(loss_type)(last->output, label, nn->out_size);
+}
+
+
+/**
+ * Metric over a sample, using the last forward pass output. */
+static double nn_sample_metric(
+    cnet const *nn,
+    nn_targets const *targets,
+    int sample,
+    enum cnet_metric_type metric_type
+){
+    double const *pred = nn->layers[nn->n_layers - 1]->output;
+    if (targets->Y)
+        return cnet_get_metric(metric_type)(pred, targets->Y[sample], nn->out_size);
+    return cnet_get_metric_sparse(metric_type)(
+        pred,
+        targets->labels[sample],
+        nn->out_size
+    );
+}
+
+
+/**
+ * Backward pass, handing every finished layer gradient over to the given
+ * ring all-reduce (if any) before backpropagating the previous layer. */
+static void nn_backward_reduce(
     cnet const *nn,
     double *X,
-    double *Y,
     enum cnet_loss_type loss_type,
-    double learning_rate
+    double learning_rate,
+    cnet_dist *reduce
 ){
     for(int l = nn->n_layers; l-->0;) {
 
@@ -160,65 +960,226 @@ void nn_backward(
         struct clayer* next = l < (nn->n_layers - 1) ? nn->layers[l + 1] : NULL;
         struct clayer* previous = l > 0 ? nn->layers[l - 1] : NULL;
 
-        // we start by computing the derivative of the loss
-        // over the current output and saving it in the layer's delta
-        if (!next) {
-            // this is the output layer,
-            // we need to compute the loss over the network's output
-            cnet_loss_func_dx *loss_dx = cnet_get_loss_dx(loss_type);
-            loss_dx(
-                layer->output,
-                Y,
-                layer->delta,
-                layer->out_size
-            );
-        } else {
+        // sparse layers are inference only
+        assert(layer->type != sparse_layer);
+
+        // we start from the derivative of the loss over the current
+        // output, saved in the layer's delta; for the output layer it was
+        // left by nn_forward_loss (over the logits, if fused)
+        int fused = !next && nn_fused_loss(nn, loss_type);
+        if (next) {
             // we need to compute the derivative of the cost over the current
             // activation output using the previously computed delta, along
             // with the dependencies of these values for the current layer
             // activation output and weights.
-            for(int k = 0; k < layer->out_size; k++) {
-                double delta = 0;
-                for(int j = 0; j < next->out_size; j++)
-                    delta += next->delta[j] * next->weights[j][k];
-
-                layer->delta[k] = delta;
+            switch(next->type) {
+                case dense_layer:
+                    // delta = next weights^T * next delta
+                    cnet_gemv(
+                        1,
+                        next->out_size, next->in_size,
+                        1, next->weights[0], next->in_size,
+                        next->delta,
+                        0, layer->delta
+                    );
+                    break;
+                case conv2d_layer:
+                    cnet_conv_backprop(next, layer->delta);
+                    break;
+                case maxpool_layer:
+                case avgpool_layer:
+                    cnet_pool_backprop(next, layer->output, layer->delta);
+                    break;
+                case sparse_layer:
+                case embedding_layer:
+                    break;
             }
         }
 
-        // get the activation derivative function, to update the layers delta
-        cnet_act_func_dx *act_dx = cnet_get_act_dx(layer->activation);
+        // compute final delta using the activation derivative
+        if (!fused) {
+            cnet_act_func_dx *act_dx = cnet_get_act_dx(layer->activation);
+            act_dx(layer->output, layer->delta, layer->out_size);
+        }
 
         // layer's input: the Z derivative over the weights
         double *input = !previous ? X : previous->output;
 
-        // update trainable parameters
-        for(int k = 0; k < layer->out_size; k++) {
-            // compute final delta using the activation derivative
-            layer->delta[k] *= act_dx(layer->output[k]);
+        // update trainable parameters, or accumulate their gradient
+        // until the next optimizer step
+        double scale = layer->grad ? 1 : -learning_rate;
+        double *dw = layer->grad ? layer->grad :
+            layer->weights ? layer->weights[0] : NULL;
+        double *db = layer->grad ?
+            layer->grad + layer->w_rows * layer->w_cols : layer->bias;
+
+        switch(layer->type) {
+            case dense_layer:
+                clayer_dense_gradient(layer, input, scale, dw, db);
+                if (!layer->grad) {
+                    clayer_apply_mask(layer);
+                    cnet_half_refresh(layer);
+                }
+                break;
+            case conv2d_layer:
+                cnet_conv_gradient(layer, scale, dw, db);
+                break;
+            case embedding_layer:
+                cnet_embedding_gradient(layer, input, scale, dw);
+                cnet_embedding_touch(layer, input);
+                break;
+            case maxpool_layer:
+            case avgpool_layer:
+            case sparse_layer:
+                break;
+        }
+
+        // the previous layers do not touch this gradient anymore
+        if (reduce && layer->grad)
+            cnet_dist_allreduce_async(
+                reduce,
+                layer->grad,
+                layer->w_rows * layer->w_cols + layer->b_size
+            );
+    }
+}
+
+
+/**
+ *
+ * CNet Backward Pass
+ *
+ * Performs a single backpropagation step, using SGD, hence
+ * it only takes one train sample. Layers with a gradient buffer
+ * accumulate their gradient instead of being updated.
+ * Expects the sample to be forwarded through nn_forward_loss, which
+ * leaves the loss derivative in the output layer delta.
+ *
+ * @param cnet const *nn: CNet
+ * @param double *X: Input (sized nn->in_size)
+ * @param cnet_loss_type: Loss type to use
+ * @param double learning_rate: Learning Rate
+ */
+void nn_backward(
+    cnet const *nn,
+    double *X,
+    enum cnet_loss_type loss_type,
+    double learning_rate
+){
+    nn_backward_reduce(nn, X, loss_type, learning_rate, NULL);
+}
 
-            // comput the neccessary update for the layer
-            double update = learning_rate * layer->delta[k];
 
-            // update bias
-            layer->bias[k] -= update;
+/**
+ * Optimizer Step
+ *
+ * Applies the accumulated gradients, averaged over the given number of
+ * samples, with a single pass over each layer parameters. Then clears the
+ * layers gradients for the next accumulation. The embedding layers which
+ * track their touched rows only apply and clear those.
+ *
+ * @param cnet const *nn: CNet
+ * @param double learning_rate: Learning Rate
+ * @param int samples: Number of accumulated samples
+ */
+static void nn_step(
+    cnet const *nn,
+    double learning_rate,
+    int samples
+){
+    double scale = learning_rate / samples;
+    for(int l = 0; l < nn->n_layers; l++) {
+        clayer *layer = nn->layers[l];
+        if (!layer->grad) continue;
 
-            // update weights
-            for(int j = 0; j < layer->in_size; j++)
-                layer->weights[k][j] -= update * input[j];
+        // embeddings: only the touched rows
+        if (layer->touched) {
+            cnet_embedding_step(layer, -scale);
+            continue;
         }
+
+        int n = layer->w_rows * layer->w_cols;
+        cnet_axpy(n, -scale, layer->grad, layer->weights[0]);
+        if (layer->b_size)
+            cnet_axpy(layer->b_size, -scale, layer->grad + n, layer->bias);
+
+        clayer_apply_mask(layer);
+        cnet_half_refresh(layer);
+        memset(layer->grad, 0, sizeof(double)*(n + layer->b_size));
     }
 }
 
 
+/**
+ * A broken ring leaves the ranks on diverging parameters: stop training. */
+static void nn_dist_check(
+    int status
+){
+    if (!status) return;
+    fprintf(stderr, "Distributed training failed: lost the ring connection\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Distributed Optimizer Step
+ *
+ * Sums the gradients of all the ranks, along with their numbers of
+ * samples (kept right after the gradient buffer), then applies their
+ * average. The gradients handed over by the backward pass of the last
+ * sample are only waited for.
+ *
+ * @param cnet const *nn: CNet
+ * @param double *grads: Gradient buffer (of all the layers, then the samples)
+ * @param int size: Gradient buffer size (without the samples)
+ * @param double learning_rate: Learning Rate
+ * @param int samples: Number of local accumulated samples
+ * @param int submitted: The layers gradients were already handed over
+ */
+static void nn_dist_step(
+    cnet const *nn,
+    double *grads,
+    int size,
+    double learning_rate,
+    int samples,
+    int submitted
+){
+    // same order as the backward pass
+    for(int l = nn->n_layers; !submitted && l-->0;) {
+        clayer *layer = nn->layers[l];
+        if (layer->grad)
+            cnet_dist_allreduce_async(
+                nn->dist,
+                layer->grad,
+                layer->w_rows * layer->w_cols + layer->b_size
+            );
+    }
+    grads[size] = samples;
+    cnet_dist_allreduce_async(nn->dist, grads + size, 1);
+    nn_dist_check(cnet_dist_wait(nn->dist));
+
+    if (grads[size] > 0)
+        nn_step(nn, learning_rate, (int)grads[size]);
+}
+
+
 /**
  * CNet Prediction. */
 const double *nn_predict(
     cnet const *nn,
     double const *X
 ){
-    // pass the input through the net
-    nn_forward(nn, X);
+    // pass the input through the net, split between the team threads
+    // once the sparse input path is decided
+    if (nn->team && cnet_team_threads(nn->team) > 1) {
+        clayer *first = nn->layers[0];
+        if (first->type == dense_layer && first->nz_idx)
+            nn_gather_sparse(nn, first, X);
+        nn_team_pass pass = {nn, X};
+        cnet_team_run(nn->team, nn_team_forward, &pass);
+    } else {
+        nn_forward(nn, X, 0);
+    }
 
     // return the output for the last layer
     return nn->layers[nn->n_layers - 1]->output;
@@ -226,15 +1187,302 @@ const double *nn_predict(
 
 
 /**
- * CNet Train Algorithm */
-void nn_train(
+ * CNet Sparse Prediction. */
+const double *nn_predict_sparse(
     cnet const *nn,
-    double **X_train,
-    double **Y_train,
-    double **X_val,
-    double **Y_val,
-    int train_size,
-    int val_size,
+    int const *idx,
+    double const *val,
+    int nnz
+){
+    clayer *first = nn->layers[0];
+    assert(first->nz_idx && nnz <= first->in_size);
+
+    // keep the non-zero inputs, so a backward pass can follow
+    memcpy(first->nz_idx, idx, sizeof(int)*nnz);
+    memcpy(first->nz_val, val, sizeof(double)*nnz);
+    first->nnz = nnz;
+    clayer_forward_sparse(first, idx, val, nnz, first->output, 1);
+
+    // pass through the rest of the net
+    for(int i = 1; i < nn->n_layers; i++) {
+        clayer *layer = nn->layers[i];
+        clayer_forward(
+            layer,
+            nn->layers[i - 1]->output,
+            layer->output,
+            1,
+            layer->cols,
+            1
+        );
+    }
+
+    return nn->layers[nn->n_layers - 1]->output;
+}
+
+
+/**
+ * CNet Batch Workspace Size. */
+int nn_workspace_size(
+    cnet const *nn,
+    int batch
+){
+    // room for the gathered input, two ping-pong layer outputs
+    // and the largest im2col (or widened weights row) buffer
+    int width = 0, cols = 0;
+    for(int i = 0; i < nn->n_layers; i++) {
+        clayer const *layer = nn->layers[i];
+        width = layer->out_size > width ? layer->out_size : width;
+        if (layer->type == conv2d_layer) {
+            int size = layer->w_cols *
+                layer->out_shape.height * layer->out_shape.width;
+            cols = size > cols ? size : cols;
+        }
+        if (layer->half)
+            cols = layer->w_cols > cols ? layer->w_cols : cols;
+    }
+    return batch * (nn->in_size + 2 * width) + cols;
+}
+
+
+/**
+ * CNet Batch Prediction. */
+void nn_predict_batch(
+    cnet const *nn,
+    double **X,
+    int batch,
+    double *out,
+    double *workspace
+){
+    // largest layer output, to place the ping-pong buffers
+    int width = 0;
+    for(int i = 0; i < nn->n_layers; i++)
+        width = nn->layers[i]->out_size > width ? nn->layers[i]->out_size : width;
+
+    // gather the inputs into a contiguous block
+    double *in = workspace;
+    for(int b = 0; b < batch; b++)
+        memcpy(in + b*nn->in_size, X[b], sizeof(double)*nn->in_size);
+
+    // ping-pong between the two output buffers
+    double *ping = in + batch*nn->in_size;
+    double *pong = ping + batch*width;
+    double *cols = pong + batch*width;
+    for(int i = 0; i < nn->n_layers; i++) {
+        double *dst = i == nn->n_layers - 1 ? out : ping;
+        clayer_forward(nn->layers[i], in, dst, batch, cols, 1);
+        in = dst;
+        ping = pong;
+        pong = dst;
+    }
+}
+
+
+/**
+ * Validation pass: loss and metric sums of every batch, predicted in
+ * parallel on the pool and summed in order afterwards. */
+typedef struct nn_val_pass {
+    cnet const *nn;
+    double **X;
+    nn_targets const *targets;
+    int size;
+    enum cnet_loss_type loss_type;
+    enum cnet_metric_type metric_type;
+    double *loss, *metric;
+} nn_val_pass;
+
+
+/**
+ * Validate a range of batches. */
+static void nn_val_batches(
+    void *arg,
+    long from,
+    long to
+){
+    nn_val_pass const *pass = arg;
+    cnet const *nn = pass->nn;
+    nn_targets const *targets = pass->targets;
+
+    // buffers on the node of the running thread
+    size_t ws_size = sizeof(double)*nn_workspace_size(nn, VAL_BATCH);
+    size_t out_size = sizeof(double)*VAL_BATCH*nn->out_size;
+    double *workspace = cnet_numa_alloc_local(ws_size);
+    double *out = cnet_numa_alloc_local(out_size);
+
+    for(long i = from; i < to; i++) {
+        int first = (int)i*VAL_BATCH;
+        int batch = pass->size - first < VAL_BATCH ? pass->size - first : VAL_BATCH;
+        nn_predict_batch(nn, pass->X + first, batch, out, workspace);
+
+        pass->loss[i] = pass->metric[i] = 0;
+        for(int b = 0; b < batch; b++) {
+            double const *pred = out + b*nn->out_size;
+            int s = first + b;
+            if (targets->Y) {
+                pass->loss[i] += cnet_get_loss(pass->loss_type)(
+                    pred, targets->Y[s], nn->out_size);
+                pass->metric[i] += cnet_get_metric(pass->metric_type)(
+                    pred, targets->Y[s], nn->out_size);
+            } else {
+                pass->loss[i] += cnet_get_loss_sparse(pass->loss_type)(
+                    pred, targets->labels[s], nn->out_size);
+                pass->metric[i] += cnet_get_metric_sparse(pass->metric_type)(
+                    pred, targets->labels[s], nn->out_size);
+            }
+        }
+    }
+
+    cnet_numa_free(out, out_size);
+    cnet_numa_free(workspace, ws_size);
+}
+
+
+/**
+ * Training state, carried from a batch of the dataset to the next. */
+typedef struct nn_train_state {
+
+    /* progress */
+    int epoch, epochs, size, done;
+
+    /* pipeline stages, and the indices of the samples of its batches */
+    cnet_pipeline *pipe;
+    int *samples;
+
+    /* gradient buffer, and the samples accumulated into it */
+    double *grads;
+    int grads_size, pending;
+
+    /* optimizer steps of the epoch, training steps */
+    int epoch_steps;
+    long step;
+
+    /* epoch loss and metric sums */
+    double loss, metric;
+
+} nn_train_state;
+
+
+/**
+ * Train over a batch of the dataset. */
+static void nn_train_batch(
+    cnet const *nn,
+    nn_train_state *state,
+    cnet_batch const *data,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double learning_rate
+){
+    double **X = data->X;
+    nn_targets targets = {data->Y, data->labels};
+
+    // a batch of accum_steps samples at a time through the pipeline
+    for(int s = 0; state->pipe && s < data->size; s += nn->accum_steps) {
+        int batch = data->size - s < nn->accum_steps ? data->size - s : nn->accum_steps;
+        cnet_pbar_update(state->epoch, state->epochs, state->done + s, state->size);
+
+        double batch_loss, batch_metric;
+        cnet_pipeline_batch(
+            state->pipe,
+            X + s,
+            targets.Y ? targets.Y + s : NULL,
+            targets.labels ? targets.labels + s : NULL,
+            state->samples,
+            batch,
+            loss_type,
+            metric_type,
+            &batch_loss,
+            &batch_metric
+        );
+        state->loss += batch_loss;
+        state->metric += batch_metric;
+        if (nn->dist)
+            nn_dist_step(nn, state->grads, state->grads_size, learning_rate, batch, 0);
+        else
+            nn_step(nn, learning_rate, batch);
+        state->epoch_steps++;
+
+        // hand a snapshot to the checkpoint writer
+        if (nn->ckpt && (state->step + batch) / nn->ckpt_every > state->step / nn->ckpt_every)
+            cnet_ckpt_submit(nn->ckpt, nn);
+        state->step += batch;
+    }
+
+    // SGD - batch size 1
+    for(int s = 0; !state->pipe && s < data->size; s++) {
+
+        // update progress bar
+        cnet_pbar_update(
+            state->epoch,
+            state->epochs,
+            state->done + s,
+            state->size
+        );
+
+        // pass the training sample through the net,
+        // and compute training loss and metric
+        state->loss += nn_forward_loss(
+            nn,
+            X[s],
+            &targets,
+            s,
+            loss_type,
+            1
+        );
+
+        state->metric += nn_sample_metric(nn, &targets, s, metric_type);
+
+        // backprop step, the last sample of a distributed batch
+        // reducing the gradients of the layers as they are done
+        int reduce = nn->dist && state->pending + 1 == nn->accum_steps;
+        nn_backward_reduce(
+            nn,
+            X[s],
+            loss_type,
+            learning_rate,
+            reduce ? nn->dist : NULL
+        );
+
+        // single optimizer step for the accumulated samples
+        if (state->grads && ++state->pending == nn->accum_steps) {
+            if (nn->dist)
+                nn_dist_step(nn, state->grads, state->grads_size, learning_rate, state->pending, 1);
+            else
+                nn_step(nn, learning_rate, state->pending);
+            state->pending = 0;
+            state->epoch_steps++;
+        }
+
+        // hand a snapshot to the checkpoint writer
+        if (nn->ckpt && ++state->step % nn->ckpt_every == 0)
+            cnet_ckpt_submit(nn->ckpt, nn);
+    }
+
+    state->done += data->size;
+}
+
+
+/**
+ * Next batch of a dataset, checking its classes against the network
+ * outputs (they would be read past them). */
+static int nn_next_batch(
+    cnet const *nn,
+    cnet_dataset *ds,
+    cnet_batch *batch
+){
+    int status = cnet_dataset_next(ds, batch);
+    if (status <= 0 || !batch->labels) return status;
+    int bad = cnet_check_labels(batch->labels, batch->size, nn->out_size);
+    if (bad < 0) return status;
+    fprintf(stderr, "Invalid class label: %d\n", batch->labels[bad]);
+    return -1;
+}
+
+
+/**
+ * CNet Train Algorithm, over datasets */
+int nn_train_dataset(
+    cnet const *nn,
+    cnet_dataset *train,
+    cnet_dataset *val,
     enum cnet_loss_type loss_type,
     enum cnet_metric_type metric_type,
     double learning_rate,
@@ -249,76 +1497,127 @@ void nn_train(
     // init history file
     fprintf(history_file, "train_loss val_loss train_acc val_acc\n");
 
-    // init temporary helper arrays
-    int *idx_arr = cnet_idx(train_size);
+    int train_size = cnet_dataset_size(train);
+    int val_size = val ? cnet_dataset_size(val) : 0;
+    nn_train_state state = {.epochs = epochs, .size = train_size};
 
-    // init functions
-    cnet_loss_func *loss = cnet_get_loss(loss_type);
-    cnet_metric_fun *metric = cnet_get_metric(metric_type);
+    // validation sums of the batches of a dataset batch
+    int val_capacity = 0;
+    double *val_loss_batches = NULL, *val_metric_batches = NULL;
 
-    for(int epoch = 0; epoch < epochs; epoch++) {
-        double train_loss = 0, val_loss = 0; 
-        double train_metric = 0, val_metric = 0;
-
-        // shuffle the training set
-        cnet_shuffle(idx_arr, train_size);
-
-        // epoch training
-        // SGD - batch size 1
-        for(int s = 0; s < train_size; s++) {
-            int sample = idx_arr[s];
-
-            // update progress bar
-            cnet_pbar_update(
-                epoch,
-                epochs,
-                s,
-                train_size
-            );
+    // every rank starts from the parameters of the rank 0, and takes as
+    // many optimizer steps per epoch as the rank with the largest shard
+    int dist_steps = 0, status = 0;
+    if (nn->dist) {
+        for(int l = 0; l < nn->n_layers; l++) {
+            clayer *layer = nn->layers[l];
+            if (!layer->w_rows) continue;
+            nn_dist_check(cnet_dist_broadcast(
+                nn->dist,
+                layer->weights[0],
+                layer->w_rows * layer->w_cols
+            ));
+            if (layer->b_size)
+                nn_dist_check(cnet_dist_broadcast(nn->dist, layer->bias, layer->b_size));
+            cnet_half_refresh(layer);
+        }
 
-            // pass the training sample through the net
-            double const *train_pred = nn_predict(nn, X_train[sample]);
+        int ranks = cnet_dist_size(nn->dist);
+        double *steps = calloc(ranks, sizeof(double));
+        steps[cnet_dist_rank(nn->dist)] = (train_size + nn->accum_steps - 1) / nn->accum_steps;
+        nn_dist_check(cnet_dist_allreduce(nn->dist, steps, ranks));
+        for(int r = 0; r < ranks; r++)
+            if (steps[r] > dist_steps) dist_steps = (int)steps[r];
+        free(steps);
+    }
 
-            // compute training loss and metric
-            train_loss += loss(
-                train_pred,
-                Y_train[sample],
-                nn->out_size
-            );
+    // pipeline stages, streaming batches of accum_steps samples
+    if (nn->pipe_stages > 1) {
+        state.pipe = cnet_pipeline_init(nn, nn->pipe_stages, nn->pipe_micro, nn->accum_steps);
+        state.samples = cnet_idx(nn->accum_steps);
+    }
 
-            train_metric += metric(
-                train_pred, 
-                Y_train[sample],
-                nn->out_size
-            );
+    // one gradient buffer for all the trainable layers, when accumulating
+    // (and a slot for the samples count of the distributed steps)
+    if (nn->accum_steps > 1 || state.pipe || nn->dist) {
+        for(int l = 0; l < nn->n_layers; l++) {
+            clayer const *layer = nn->layers[l];
+            if (layer->w_rows)
+                state.grads_size += layer->w_rows * layer->w_cols + layer->b_size;
+        }
+        state.grads = calloc(state.grads_size + 1, sizeof(double));
 
-            // backprop step
-            nn_backward(
-                nn,
-                X_train[sample],
-                Y_train[sample],
-                loss_type,
-                learning_rate
-            );
+        double *grad = state.grads;
+        for(int l = 0; l < nn->n_layers; l++) {
+            clayer *layer = nn->layers[l];
+            if (!layer->w_rows) continue;
+            layer->grad = grad;
+            grad += layer->w_rows * layer->w_cols + layer->b_size;
+
+            // the steps only apply the touched embeddings (all of them are
+            // summed over the ranks though)
+            if (layer->type == embedding_layer && !nn->dist) {
+                layer->touched = malloc(sizeof(int)*layer->w_rows);
+                layer->touched_mark = calloc(layer->w_rows, 1);
+            }
         }
+    }
 
-        // epoch validation
-        for(int s = 0; s < val_size; s++) {
-            // pass the training sample through the net
-            double const *val_pred = nn_predict(nn, X_val[s]);
+    for(int epoch = 0; epoch < epochs; epoch++) {
+        double val_loss = 0, val_metric = 0;
+        state.epoch = epoch;
+        state.done = state.epoch_steps = 0;
+        state.loss = state.metric = 0;
 
-            val_loss += loss(
-                val_pred,
-                Y_val[s],
-                nn->out_size
-            );
+        // epoch training, over the shuffled training set
+        cnet_batch batch;
+        cnet_dataset_rewind(train, 1);
+        while ((status = nn_next_batch(nn, train, &batch)) > 0)
+            nn_train_batch(nn, &state, &batch, loss_type, metric_type, learning_rate);
+        if (status < 0) break;
 
-            val_metric += metric(
-                val_pred, 
-                Y_val[s],
-                nn->out_size
-            );
-        } 
+        // apply what is left of the epoch
+        if (state.pending) {
+            if (nn->dist)
+                nn_dist_step(nn, state.grads, state.grads_size, learning_rate, state.pending, 0);
+            else
+                nn_step(nn, learning_rate, state.pending);
+            state.pending = 0;
+            state.epoch_steps++;
+        }
+
+        // empty steps, until the ranks with larger shards are done
+        for(; nn->dist && state.epoch_steps < dist_steps; state.epoch_steps++)
+            nn_dist_step(nn, state.grads, state.grads_size, learning_rate, 0, 0);
+
+        // epoch validation, batches predicted on the pool
+        if (val) cnet_dataset_rewind(val, 0);
+        while (val && (status = nn_next_batch(nn, val, &batch)) > 0) {
+            int val_batches = (batch.size + VAL_BATCH - 1) / VAL_BATCH;
+            if (val_batches > val_capacity) {
+                val_capacity = val_batches;
+                val_loss_batches = realloc(val_loss_batches, sizeof(double)*val_capacity);
+                val_metric_batches = realloc(val_metric_batches, sizeof(double)*val_capacity);
+            }
+
+            nn_targets targets = {batch.Y, batch.labels};
+            nn_val_pass pass = {
+                nn, batch.X, &targets, batch.size, loss_type, metric_type,
+                val_loss_batches, val_metric_batches
+            };
+            cnet_parallel_for(cnet_tpool_get(), 0, val_batches, 1, nn_val_batches, &pass);
+            for(int i = 0; i < val_batches; i++) {
+                val_loss += val_loss_batches[i];
+                val_metric += val_metric_batches[i];
+            }
+        }
+        if (status < 0) break;
+
+        // without validation samples, the validation columns are zeros
+        if (val_size) {
+            val_loss /= val_size;
+            val_metric /= val_size;
+        }
 
         // log metrics
         printf(
@@ -327,21 +1626,175 @@ void nn_train(
             "- Train Accuracy: %lf "
             "- Val Loss: %lf "
             "- Val Accuracy: %lf \n",
-            train_loss / train_size,
-            train_metric / train_size,
-            val_loss / val_size,
-            val_metric / val_size
+            state.loss / train_size,
+            state.metric / train_size,
+            val_loss,
+            val_metric
         );
 
+        // log checkpoint writer stats
+        if (nn->ckpt) {
+            cnet_ckpt_stats stats = cnet_ckpt_get_stats(nn->ckpt);
+            printf(
+                "Checkpoints: %d written "
+                "- %d skipped "
+                "- Last: %ld bytes in %.3lf ms "
+                "- Total: %ld bytes \n",
+                stats.written,
+                stats.skipped,
+                stats.last_bytes,
+                stats.last_ms,
+                stats.total_bytes
+            );
+        }
+
         // save history
         fprintf(
             history_file,
             "%.20e %.20e %.20e %.20e\n",
-            train_loss / train_size,
-            val_loss / val_size,
-            train_metric / train_size,
-            val_metric / val_size
+            state.loss / train_size,
+            val_loss,
+            state.metric / train_size,
+            val_metric
         );
     }
-    free(idx_arr);
+
+    // make sure the last checkpoint is on disk
+    if (nn->ckpt) cnet_ckpt_wait(nn->ckpt);
+
+    if (state.pipe) cnet_pipeline_free(state.pipe);
+    for(int l = 0; l < nn->n_layers; l++) {
+        clayer *layer = nn->layers[l];
+        free(layer->touched);
+        free(layer->touched_mark);
+        layer->grad = NULL;
+        layer->touched = NULL;
+        layer->touched_mark = NULL;
+        layer->n_touched = 0;
+    }
+    free(state.grads);
+    free(state.samples);
+    free(val_metric_batches);
+    free(val_loss_batches);
+    return status;
+}
+
+
+/**
+ * CNet Train Algorithm, over in-memory datasets (in a single batch). */
+static int nn_train_arrays(
+    cnet const *nn,
+    double **X_train,
+    double **Y_train,
+    int const *y_train,
+    double **X_val,
+    double **Y_val,
+    int const *y_val,
+    int train_size,
+    int val_size,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double learning_rate,
+    int epochs,
+    FILE *history_file
+){
+    cnet_dataset *train = cnet_dataset_arrays(X_train, Y_train, y_train, train_size, train_size);
+    cnet_dataset *val = cnet_dataset_arrays(X_val, Y_val, y_val, val_size, val_size);
+    int status = nn_train_dataset(
+        nn,
+        train,
+        val,
+        loss_type,
+        metric_type,
+        learning_rate,
+        epochs,
+        history_file
+    );
+    cnet_dataset_free(val);
+    cnet_dataset_free(train);
+    return status;
+}
+
+
+/**
+ * CNet Train Algorithm */
+void nn_train(
+    cnet const *nn,
+    double **X_train,
+    double **Y_train,
+    double **X_val,
+    double **Y_val,
+    int train_size,
+    int val_size,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double learning_rate,
+    int epochs,
+    FILE *history_file
+){
+    // expected outputs in memory: nothing to fail on
+    nn_train_arrays(
+        nn,
+        X_train,
+        Y_train,
+        NULL,
+        X_val,
+        Y_val,
+        NULL,
+        train_size,
+        val_size,
+        loss_type,
+        metric_type,
+        learning_rate,
+        epochs,
+        history_file
+    );
+}
+
+
+/**
+ * CNet Train Algorithm, with class index targets */
+int nn_train_labels(
+    cnet const *nn,
+    double **X_train,
+    int const *y_train,
+    double **X_val,
+    int const *y_val,
+    int train_size,
+    int val_size,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double learning_rate,
+    int epochs,
+    FILE *history_file
+){
+    int bad_train = cnet_check_labels(y_train, train_size, nn->out_size);
+    int bad_val = cnet_check_labels(y_val, val_size, nn->out_size);
+    if (bad_train >= 0 || bad_val >= 0) {
+        fprintf(
+            stderr,
+            "Invalid class label: %d (%s sample %d)\n",
+            bad_train >= 0 ? y_train[bad_train] : y_val[bad_val],
+            bad_train >= 0 ? "training" : "validation",
+            bad_train >= 0 ? bad_train : bad_val
+        );
+        return -1;
+    }
+
+    return nn_train_arrays(
+        nn,
+        X_train,
+        NULL,
+        y_train,
+        X_val,
+        NULL,
+        y_val,
+        train_size,
+        val_size,
+        loss_type,
+        metric_type,
+        learning_rate,
+        epochs,
+        history_file
+    );
 }
@@ -4,8 +4,24 @@
  * Load & Save the CNet model from a given file.
  */
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "cnet.h"
+#include "half.h"
+
+#define CNET_FILE_VERSION 4
+
+
+/**
+ * Whether a layer type saves its spatial geometry. */
+static int has_shape(
+    int type
+){
+    return type == conv2d_layer ||
+           type == maxpool_layer ||
+           type == avgpool_layer;
+}
 
 
 /**
@@ -14,7 +30,8 @@ void nn_save(
     cnet const* nn,
     FILE *out
 ){
-    // save basic network info
+    // save file version and basic network info
+    fprintf(out, "cnet %d \n", CNET_FILE_VERSION);
     fprintf(out, "%d %d %d \n", nn->in_size, nn->out_size, nn->n_layers);
 
     // save every layer info
@@ -22,74 +39,282 @@ void nn_save(
         clayer *layer = nn->layers[i];
         fprintf(
             out,
-            "%d %d %d \n",
+            "%d %d %d %d %d \n",
+            layer->type,
             layer->in_size,
             layer->out_size,
-            layer->activation
+            layer->activation,
+            layer->half ? layer->half_type : half_none
         );
 
+        // save spatial layers geometry
+        if (has_shape(layer->type)) {
+            fprintf(
+                out,
+                "%d %d %d %d %d %d \n",
+                layer->in_shape.channels,
+                layer->in_shape.height,
+                layer->in_shape.width,
+                layer->kernel,
+                layer->stride,
+                layer->padding
+            );
+        }
+
+        // save sparse layers row offsets
+        if (layer->type == sparse_layer) {
+            fprintf(out, "%d", layer->csr_nnz);
+            for(int j = 0; j <= layer->out_size; j++)
+                fprintf(out, " %d", layer->csr_rows[j]);
+            fprintf(out, "\n");
+        }
+
+        // save embedding layers table size
+        if (layer->type == embedding_layer)
+            fprintf(out, "%d %d \n", layer->w_rows, layer->w_cols);
+
         // save every layer biases
-        for(int j = 0; j < layer->out_size; j++) {
+        for(int j = 0; j < layer->b_size; j++) {
             fprintf(out, " %.20e", layer->bias[j]);
         }
         fprintf(out, "\n");
 
-        // save every layer weights
-        for(int j = 0; j < layer->out_size; j++) {
-            for(int k = 0; k < layer->in_size; k++) {
-                fprintf(out, " %.20e", layer->weights[j][k]);
+        // save every layer weights, 16 bit weights as hex values
+        for(int j = 0; j < layer->w_rows; j++) {
+            for(int k = 0; k < layer->w_cols; k++) {
+                if (layer->half)
+                    fprintf(out, " %04x", layer->half[j*layer->w_cols + k]);
+                else
+                    fprintf(out, " %.20e", layer->weights[j][k]);
             }
             fprintf(out, "\n");
         }
+
+        // save sparse weights, as column value pairs
+        if (layer->type != sparse_layer) continue;
+        for(int j = 0; j < layer->out_size; j++) {
+            for(int t = layer->csr_rows[j]; t < layer->csr_rows[j + 1]; t++)
+                fprintf(
+                    out,
+                    " %d %.20e",
+                    layer->csr_cols[t],
+                    layer->csr_vals[t]
+                );
+            fprintf(out, "\n");
+        }
     }
 }
 
 
 /**
- * Load CNet from File. */
-cnet *nn_load(
+ * Read the end of a row of values, so that a truncated last value is not
+ * taken for a whole one.
+ *
+ * @return int: 0, or -1 if the row goes on or is cut
+ */
+static int read_eol(
     FILE *in
 ){
-    // load basic network info
-    int in_size, out_size, n_layers;
-    fscanf(in, "%d %d %d \n", &in_size, &out_size, &n_layers);
+    int c;
+    while((c = fgetc(in)) == ' ' || c == '\t' || c == '\r');
+    return c == '\n' ? 0 : -1;
+}
 
-    // init cnet
-    cnet *nn = nn_init(in_size, out_size, n_layers);
 
-    for(int i = 0; i < nn->n_layers; i++) {
-        // load layer info
-        int in_size, out_size;
-        enum cnet_act_type act_type;
-        fscanf(
+/**
+ * Whether a spatial layer geometry matches its sizes (pools have no
+ * padding, convolutions any number of filters). */
+static int shape_valid(
+    int type,
+    cnet_shape shape,
+    int kernel,
+    int stride,
+    int padding,
+    int in_size,
+    int out_size
+){
+    if (shape.channels < 1 || shape.height < 1 || shape.width < 1 ||
+        kernel < 1 || stride < 1 || padding < 0 ||
+        (type != conv2d_layer && padding) ||
+        (long)shape.channels * shape.height * shape.width != in_size ||
+        (long)shape.height + 2*padding < kernel ||
+        (long)shape.width + 2*padding < kernel) return 0;
+
+    long windows = ((shape.height + 2L*padding - kernel) / stride + 1) *
+                   ((shape.width + 2L*padding - kernel) / stride + 1);
+    long window_size = (long)shape.channels * kernel * kernel;
+    if (type == conv2d_layer)
+        return out_size % windows == 0 &&
+               out_size / windows * window_size <= INT_MAX &&
+               windows * window_size <= INT_MAX;
+    return out_size == shape.channels * windows;
+}
+
+
+/**
+ * Load a layer, checking it against the previous ones.
+ *
+ * @return int: 0, or -1 if the layer is truncated or inconsistent
+ */
+static int load_layer(
+    cnet *nn,
+    FILE *in,
+    int version
+){
+    int i = nn->last_layer;
+    int prev_size = i ? nn->layers[i - 1]->out_size : nn->in_size;
+
+    // load layer info
+    int type = dense_layer, in_size, out_size, act_type;
+    int half_type = half_none;
+    if (version > 1 && fscanf(in, "%d", &type) != 1) return -1;
+    if (fscanf(in, "%d %d %d", &in_size, &out_size, &act_type) != 3)
+        return -1;
+    if (version > 2 && fscanf(in, "%d", &half_type) != 1) return -1;
+    fscanf(in, " \n");
+
+    if (type < dense_layer || type > embedding_layer ||
+        act_type < relu_act || act_type > linear_act ||
+        half_type < half_none || half_type > half_fp16 ||
+        (half_type != half_none && type != dense_layer) ||
+        in_size != prev_size || out_size < 1 ||
+        (i == nn->n_layers - 1 && out_size != nn->out_size)) return -1;
+
+    // load spatial layers geometry
+    cnet_shape shape = {0, 0, 0};
+    int kernel = 0, stride = 0, padding = 0, nnz = 0, vocab = 0, dim = 0;
+    if (has_shape(type)) {
+        if (fscanf(
             in,
-            "%d %d %d \n",
-            &in_size,
-            &out_size,
-            &act_type
-        );
+            "%d %d %d %d %d %d \n",
+            &shape.channels,
+            &shape.height,
+            &shape.width,
+            &kernel,
+            &stride,
+            &padding
+        ) != 6) return -1;
+        if (!shape_valid(type, shape, kernel, stride, padding, in_size, out_size))
+            return -1;
+    }
 
-        // create layer
-        nn_add(
-            nn,
-            in_size,
-            out_size,
-            act_type
+    // create layer
+    switch((enum cnet_layer_type)type) {
+        case dense_layer:
+            if ((long)in_size * out_size > INT_MAX) return -1;
+            nn_add(nn, in_size, out_size, act_type);
+            break;
+        case conv2d_layer:
+            nn_add_conv2d(
+                nn,
+                shape,
+                out_size / (
+                    ((shape.height + 2*padding - kernel) / stride + 1) *
+                    ((shape.width + 2*padding - kernel) / stride + 1)
+                ),
+                kernel,
+                stride,
+                padding,
+                act_type
+            );
+            break;
+        case maxpool_layer:
+        case avgpool_layer:
+            nn_add_pool(nn, type, shape, kernel, stride);
+            break;
+        case sparse_layer: {
+            if (fscanf(in, "%d", &nnz) != 1 || nnz < 0) return -1;
+            nn_add_sparse(nn, in_size, out_size, nnz, act_type);
+            int *rows = nn->layers[i]->csr_rows;
+            for(int j = 0; j <= out_size; j++)
+                if (fscanf(in, " %d", &rows[j]) != 1 ||
+                    rows[j] < (j ? rows[j - 1] : 0) || rows[j] > nnz)
+                    return -1;
+            if (rows[out_size] != nnz || read_eol(in) < 0) return -1;
+            break;
+        }
+        case embedding_layer:
+            if (fscanf(in, "%d %d \n", &vocab, &dim) != 2 || i ||
+                vocab < 1 || dim < 1 || (long)in_size * dim != out_size ||
+                (long)vocab * dim > INT_MAX) return -1;
+            nn_add_embedding(nn, in_size, vocab, dim);
+            break;
+    }
+    clayer *layer = nn->layers[i];
+
+    // load biases
+    for(int j = 0; j < layer->b_size; j++) {
+        if (fscanf(in, " %le", &(layer->bias[j])) != 1) return -1;
+    }
+    if (layer->b_size && read_eol(in) < 0) return -1;
+
+    // load weights, 16 bit weights are widened into the master copy
+    if (half_type != half_none) {
+        cnet_layer_half(layer, half_type);
+        for(int j = 0; j < layer->w_rows * layer->w_cols; j++) {
+            unsigned value;
+            if (fscanf(in, " %x", &value) != 1 || value > UINT16_MAX)
+                return -1;
+            layer->half[j] = (uint16_t)value;
+        }
+        if (read_eol(in) < 0) return -1;
+        cnet_half_widen(
+            half_type,
+            layer->half,
+            layer->weights[0],
+            layer->w_rows * layer->w_cols
         );
-        clayer *layer = nn->layers[i];
+    } else {
+        for(int j = 0; j < layer->w_rows; j++) {
+            for(int k = 0; k < layer->w_cols; k++) {
+                if (fscanf(in, " %le", &(layer->weights[j][k])) != 1)
+                    return -1;
+            }
+            if (read_eol(in) < 0) return -1;
+        }
+    }
 
-        // load biases
-        for(int j = 0; j < layer->out_size; j++) {
-            fscanf(in, " %le", &(layer->bias[j]));
+    // load sparse weights
+    if (layer->type != sparse_layer) return 0;
+    for(int j = 0; j < layer->out_size; j++) {
+        for(int t = layer->csr_rows[j]; t < layer->csr_rows[j + 1]; t++) {
+            if (fscanf(
+                in,
+                " %d %le",
+                &(layer->csr_cols[t]),
+                &(layer->csr_vals[t])
+            ) != 2) return -1;
+            if (layer->csr_cols[t] < 0 || layer->csr_cols[t] >= in_size)
+                return -1;
         }
-        fscanf(in, "\n");
+        if (read_eol(in) < 0) return -1;
+    }
+    return 0;
+}
 
-        // load weights
-        for(int j = 0; j < layer->out_size; j++) {
-            for(int k = 0; k < layer->in_size; k++) {
-                fscanf(in, " %le", &(layer->weights[j][k]));
-            }
-            fscanf(in, "\n");
+
+/**
+ * Load CNet from File. */
+cnet *nn_load(
+    FILE *in
+){
+    // load file version, files without it only hold dense layers
+    int version = 1;
+    if (fscanf(in, " cnet %d \n", &version) != 1) version = 1;
+    if (version < 1 || version > CNET_FILE_VERSION) return NULL;
+
+    // load basic network info
+    int in_size, out_size, n_layers;
+    if (fscanf(in, "%d %d %d \n", &in_size, &out_size, &n_layers) != 3 ||
+        in_size < 1 || out_size < 1 || n_layers < 1) return NULL;
+
+    // init cnet, then free the layers loaded so far at the first error
+    cnet *nn = nn_init(in_size, out_size, n_layers);
+    for(int i = 0; i < n_layers; i++) {
+        if (load_layer(nn, in, version) < 0) {
+            nn->n_layers = nn->last_layer;
+            nn_free(nn);
+            return NULL;
         }
     }
 
@@ -0,0 +1,232 @@
+/*****************************************************************************
+ *                               CONVOLUTION
+ * Implementation of the convolution and pooling layers passes.
+ ****************************************************************************/
+
+#include <string.h>
+#include "../include/conv.h"
+#include "../include/blas.h"
+#include "../include/helpers.h"
+
+
+/// im2col
+
+
+/**
+ * Image to Columns */
+void cnet_im2col(
+    double const *in,
+    cnet_shape shape,
+    int kernel,
+    int stride,
+    int padding,
+    double *cols
+){
+    int out_h = (shape.height + 2*padding - kernel) / stride + 1;
+    int out_w = (shape.width + 2*padding - kernel) / stride + 1;
+
+    // every row holds a (channel, ky, kx) kernel element for all windows
+    for(int c = 0; c < shape.channels; c++)
+    for(int ky = 0; ky < kernel; ky++)
+    for(int kx = 0; kx < kernel; kx++) {
+        double *row = cols + ((c*kernel + ky)*kernel + kx) * out_h*out_w;
+        for(int oy = 0; oy < out_h; oy++) {
+            int y = oy*stride - padding + ky;
+            for(int ox = 0; ox < out_w; ox++) {
+                int x = ox*stride - padding + kx;
+                int inside = y >= 0 && y < shape.height &&
+                             x >= 0 && x < shape.width;
+                row[oy*out_w + ox] = inside ?
+                    in[(c*shape.height + y)*shape.width + x] : 0;
+            }
+        }
+    }
+}
+
+
+/**
+ * Columns to Image */
+void cnet_col2im(
+    double const *cols,
+    cnet_shape shape,
+    int kernel,
+    int stride,
+    int padding,
+    double *in
+){
+    int out_h = (shape.height + 2*padding - kernel) / stride + 1;
+    int out_w = (shape.width + 2*padding - kernel) / stride + 1;
+
+    for(int c = 0; c < shape.channels; c++)
+    for(int ky = 0; ky < kernel; ky++)
+    for(int kx = 0; kx < kernel; kx++) {
+        double const *row = cols + ((c*kernel + ky)*kernel + kx) * out_h*out_w;
+        for(int oy = 0; oy < out_h; oy++) {
+            int y = oy*stride - padding + ky;
+            if (y < 0 || y >= shape.height) continue;
+            for(int ox = 0; ox < out_w; ox++) {
+                int x = ox*stride - padding + kx;
+                if (x < 0 || x >= shape.width) continue;
+                in[(c*shape.height + y)*shape.width + x] += row[oy*out_w + ox];
+            }
+        }
+    }
+}
+
+
+/// Convolution
+
+
+/**
+ * Convolution Forward Pass */
+void cnet_conv_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    double *cols
+){
+    int positions = layer->out_shape.height * layer->out_shape.width;
+
+    cnet_im2col(
+        in,
+        layer->in_shape,
+        layer->kernel,
+        layer->stride,
+        layer->padding,
+        cols
+    );
+
+    // out (filters x positions) = weights (filters x w_cols) * cols
+    cnet_gemm(
+        0, 0,
+        layer->w_rows, positions, layer->w_cols,
+        1, layer->weights[0], layer->w_cols,
+        cols, positions,
+        0, out, positions
+    );
+
+    for(int f = 0; f < layer->w_rows; f++)
+        for(int p = 0; p < positions; p++)
+            out[f*positions + p] += layer->bias[f];
+}
+
+
+/**
+ * Convolution Parameters Gradient */
+void cnet_conv_gradient(
+    clayer const *layer,
+    double scale,
+    double *dw,
+    double *db
+){
+    int positions = layer->out_shape.height * layer->out_shape.width;
+
+    // dw += scale * delta (filters x positions) * cols^T
+    cnet_gemm(
+        0, 1,
+        layer->w_rows, layer->w_cols, positions,
+        scale, layer->delta, positions,
+        layer->cols, positions,
+        1, dw, layer->w_cols
+    );
+
+    for(int f = 0; f < layer->w_rows; f++)
+        db[f] += scale * cnet_sum(layer->delta + f*positions, positions);
+}
+
+
+/**
+ * Convolution Delta Backpropagation */
+void cnet_conv_backprop(
+    clayer *layer,
+    double *dst
+){
+    int positions = layer->out_shape.height * layer->out_shape.width;
+
+    // cols = weights^T * delta, then fold the windows back into the input
+    cnet_gemm(
+        1, 0,
+        layer->w_cols, positions, layer->w_rows,
+        1, layer->weights[0], layer->w_cols,
+        layer->delta, positions,
+        0, layer->cols, positions
+    );
+
+    memset(dst, 0, sizeof(double)*layer->in_size);
+    cnet_col2im(
+        layer->cols,
+        layer->in_shape,
+        layer->kernel,
+        layer->stride,
+        layer->padding,
+        dst
+    );
+}
+
+
+/// Pooling
+
+
+/**
+ * Pooling Forward Pass */
+void cnet_pool_forward(
+    clayer const *layer,
+    double const *in,
+    double *out
+){
+    cnet_shape is = layer->in_shape, os = layer->out_shape;
+    int size = layer->kernel;
+
+    for(int c = 0; c < os.channels; c++)
+    for(int oy = 0; oy < os.height; oy++)
+    for(int ox = 0; ox < os.width; ox++) {
+        double const *window = in + (c*is.height + oy*layer->stride)*is.width
+                                  + ox*layer->stride;
+        double res = layer->type == maxpool_layer ? window[0] : 0;
+        for(int ky = 0; ky < size; ky++) {
+            for(int kx = 0; kx < size; kx++) {
+                double v = window[ky*is.width + kx];
+                if (layer->type == maxpool_layer) res = v > res ? v : res;
+                else res += v;
+            }
+        }
+        if (layer->type == avgpool_layer) res /= size * size;
+        out[(c*os.height + oy)*os.width + ox] = res;
+    }
+}
+
+
+/**
+ * Pooling Delta Backpropagation */
+void cnet_pool_backprop(
+    clayer const *layer,
+    double const *in,
+    double *dst
+){
+    cnet_shape is = layer->in_shape, os = layer->out_shape;
+    int size = layer->kernel;
+
+    memset(dst, 0, sizeof(double)*layer->in_size);
+    for(int c = 0; c < os.channels; c++)
+    for(int oy = 0; oy < os.height; oy++)
+    for(int ox = 0; ox < os.width; ox++) {
+        int offset = (c*is.height + oy*layer->stride)*is.width
+                     + ox*layer->stride;
+        double delta = layer->delta[(c*os.height + oy)*os.width + ox];
+
+        if (layer->type == avgpool_layer) {
+            for(int ky = 0; ky < size; ky++)
+                for(int kx = 0; kx < size; kx++)
+                    dst[offset + ky*is.width + kx] += delta / (size * size);
+            continue;
+        }
+
+        // max pooling: only the max element gets the delta
+        int max = offset;
+        for(int ky = 0; ky < size; ky++)
+            for(int kx = 0; kx < size; kx++)
+                if (in[offset + ky*is.width + kx] > in[max])
+                    max = offset + ky*is.width + kx;
+        dst[max] += delta;
+    }
+}
@@ -0,0 +1,487 @@
+/*****************************************************************************
+ *                                 DATASET
+ * Implementation of the dataset sources.
+ ****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../include/dataset.h"
+#include "../include/helpers.h"
+
+
+/// Arrays
+
+
+typedef struct array_dataset {
+    cnet_dataset base;
+
+    double **X, **Y;
+    int const *labels;
+    int size, batch;
+
+    /* samples order, shuffled from one epoch to the next, and the next
+       sample of the epoch */
+    int *order;
+    int shuffled, pos;
+
+    /* batch pointers, gathered in the shuffled order */
+    double **X_batch, **Y_batch;
+    int *labels_batch;
+} array_dataset;
+
+
+static int array_size(
+    cnet_dataset *ds
+){
+    return ((array_dataset *) ds)->size;
+}
+
+
+/**
+ * Start an epoch: the order is shuffled again (not reset), the dataset
+ * order being handed out directly. */
+static void array_rewind(
+    cnet_dataset *ds,
+    int shuffle
+){
+    array_dataset *a = (array_dataset *) ds;
+    if (shuffle) cnet_shuffle(a->order, a->size);
+    a->shuffled = shuffle;
+    a->pos = 0;
+}
+
+
+static int array_next(
+    cnet_dataset *ds,
+    cnet_batch *batch
+){
+    array_dataset *a = (array_dataset *) ds;
+    if (a->pos >= a->size) return 0;
+    int size = a->size - a->pos < a->batch ? a->size - a->pos : a->batch;
+
+    if (!a->shuffled) {
+        *batch = (cnet_batch){
+            a->X + a->pos,
+            a->Y ? a->Y + a->pos : NULL,
+            a->labels ? a->labels + a->pos : NULL,
+            size
+        };
+    } else {
+        int const *order = a->order + a->pos;
+        for(int i = 0; i < size; i++) {
+            a->X_batch[i] = a->X[order[i]];
+            if (a->Y) a->Y_batch[i] = a->Y[order[i]];
+            else a->labels_batch[i] = a->labels[order[i]];
+        }
+        *batch = (cnet_batch){
+            a->X_batch,
+            a->Y ? a->Y_batch : NULL,
+            a->labels ? a->labels_batch : NULL,
+            size
+        };
+    }
+    a->pos += size;
+    return 1;
+}
+
+
+static void array_free(
+    cnet_dataset *ds
+){
+    array_dataset *a = (array_dataset *) ds;
+    free(a->labels_batch);
+    free(a->Y_batch);
+    free(a->X_batch);
+    free(a->order);
+    free(a);
+}
+
+
+static cnet_dataset_ops const array_ops = {
+    array_size, array_rewind, array_next, array_free
+};
+
+
+/**
+ * Create a dataset over samples in memory. */
+cnet_dataset *cnet_dataset_arrays(
+    double **X,
+    double **Y,
+    int const *labels,
+    int size,
+    int batch
+){
+    array_dataset *a = calloc(1, sizeof(array_dataset));
+    a->base.ops = &array_ops;
+    a->X = X;
+    a->Y = Y;
+    a->labels = labels;
+    a->size = size;
+    a->batch = batch < 1 ? 1 : batch;
+    a->order = cnet_idx(size);
+
+    int buffered = a->batch < size ? a->batch : size;
+    a->X_batch = malloc(sizeof(double *)*buffered);
+    if (Y) a->Y_batch = malloc(sizeof(double *)*buffered);
+    else a->labels_batch = malloc(sizeof(int)*buffered);
+    return &a->base;
+}
+
+
+/// Files
+
+
+typedef struct file_dataset {
+    cnet_dataset base;
+
+    cnet_matrix *inputs, *targets;
+    int labels, mapped;
+    int rows, chunk, batch, n_chunks;
+
+    /* chunks order, position of the loaded chunk in it, and whether the
+       rows are shuffled */
+    int *chunks;
+    int current, shuffle;
+
+    /* loaded chunk: converted rows, their order, and the next one */
+    double *x, *y;
+    int *y_labels;
+    int *order;
+    int loaded, pos;
+
+    /* batch pointers */
+    double **X_batch, **Y_batch;
+    int *labels_batch;
+
+    /* chunked reads: bytes of the chunk read ahead, by the reader thread
+       if reading is set */
+    unsigned char *x_bytes, *y_bytes;
+    pthread_t reader;
+    int reading, read_chunk, read_failed;
+} file_dataset;
+
+
+/**
+ * Read rows of a matrix file with sequential reads, then drop them from
+ * the page cache. */
+static int read_rows(
+    cnet_matrix const *m,
+    long first,
+    int count,
+    unsigned char *bytes
+){
+    size_t size = count * m->row_bytes;
+    off_t offset = m->offset + first * m->row_bytes;
+    for(size_t done = 0; done < size;) {
+        ssize_t n = pread(m->fd, bytes + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    posix_fadvise(m->fd, offset, size, POSIX_FADV_DONTNEED);
+    return 0;
+}
+
+
+/**
+ * Number of rows of a chunk. */
+static int chunk_rows(
+    file_dataset const *f,
+    int chunk
+){
+    long first = (long) chunk * f->chunk;
+    return f->rows - first < f->chunk ? f->rows - first : f->chunk;
+}
+
+
+/**
+ * Reader thread: reads a chunk of both files. */
+static void *read_chunk(
+    void *arg
+){
+    file_dataset *f = arg;
+    long first = (long) f->read_chunk * f->chunk;
+    int count = chunk_rows(f, f->read_chunk);
+    f->read_failed = read_rows(f->inputs, first, count, f->x_bytes)
+                  || read_rows(f->targets, first, count, f->y_bytes);
+    return NULL;
+}
+
+
+/**
+ * Start reading a chunk ahead (chunked), or prefetching its pages (mapped). */
+static void read_ahead(
+    file_dataset *f,
+    int chunk
+){
+    if (f->mapped) {
+        long first = (long) chunk * f->chunk;
+        cnet_matrix_advise(f->inputs, first, chunk_rows(f, chunk), 1);
+        cnet_matrix_advise(f->targets, first, chunk_rows(f, chunk), 1);
+        return;
+    }
+    f->read_chunk = chunk;
+    f->reading = 1;
+    pthread_create(&f->reader, NULL, read_chunk, f);
+}
+
+
+/**
+ * Wait for the chunk read ahead, if any. */
+static void read_wait(
+    file_dataset *f
+){
+    if (!f->reading) return;
+    pthread_join(f->reader, NULL);
+    f->reading = 0;
+}
+
+
+/**
+ * Load the next chunk of the epoch: convert its rows, and start reading
+ * the one after. */
+static int load_chunk(
+    file_dataset *f
+){
+    int chunk = f->chunks[++f->current];
+    long first = (long) chunk * f->chunk;
+    int count = chunk_rows(f, chunk);
+
+    if (f->mapped) {
+        cnet_matrix_rows(f->inputs, first, count, f->x);
+        cnet_matrix_rows(f->targets, first, count, f->y);
+        cnet_matrix_advise(f->inputs, first, count, 0);
+        cnet_matrix_advise(f->targets, first, count, 0);
+    } else {
+        // the chunk is normally the one read ahead
+        int ready = f->reading && f->read_chunk == chunk;
+        read_wait(f);
+        if (!ready) {
+            f->read_chunk = chunk;
+            read_chunk(f);
+        }
+        if (f->read_failed) {
+            fprintf(stderr, "Failed to read dataset files\n");
+            return -1;
+        }
+        cnet_matrix_convert(f->inputs, f->x_bytes, count, f->x);
+        cnet_matrix_convert(f->targets, f->y_bytes, count, f->y);
+    }
+    // classes are whole non negative numbers (their range is checked
+    // against the network outputs by the training)
+    for(int i = 0; f->labels && i < count; i++) {
+        double y = f->y[i];
+        if (!(y >= 0 && y <= INT_MAX) || (int) y != y) {
+            fprintf(stderr, "Invalid class label: %g (row %ld)\n", y, first + i);
+            return -1;
+        }
+        f->y_labels[i] = (int) y;
+    }
+
+    for(int i = 0; i < count; i++)
+        f->order[i] = i;
+    if (f->shuffle) cnet_shuffle(f->order, count);
+    f->loaded = count;
+    f->pos = 0;
+
+    if (f->current + 1 < f->n_chunks)
+        read_ahead(f, f->chunks[f->current + 1]);
+    return 0;
+}
+
+
+static int file_size(
+    cnet_dataset *ds
+){
+    return ((file_dataset *) ds)->rows;
+}
+
+
+static void file_rewind(
+    cnet_dataset *ds,
+    int shuffle
+){
+    file_dataset *f = (file_dataset *) ds;
+    read_wait(f);
+
+    if (shuffle) {
+        cnet_shuffle(f->chunks, f->n_chunks);
+    } else {
+        for(int c = 0; c < f->n_chunks; c++)
+            f->chunks[c] = c;
+    }
+    f->shuffle = shuffle;
+    f->current = -1;
+    f->loaded = f->pos = 0;
+    if (f->n_chunks) read_ahead(f, f->chunks[0]);
+}
+
+
+static int file_next(
+    cnet_dataset *ds,
+    cnet_batch *batch
+){
+    file_dataset *f = (file_dataset *) ds;
+    if (f->pos >= f->loaded) {
+        if (f->current + 1 >= f->n_chunks) return 0;
+        if (load_chunk(f)) return -1;
+    }
+
+    int size = f->loaded - f->pos < f->batch ? f->loaded - f->pos : f->batch;
+    int const *order = f->order + f->pos;
+    int cols = f->targets->cols;
+    for(int i = 0; i < size; i++) {
+        f->X_batch[i] = f->x + (long) order[i] * f->inputs->cols;
+        if (f->labels) f->labels_batch[i] = f->y_labels[order[i]];
+        else f->Y_batch[i] = f->y + (long) order[i] * cols;
+    }
+    *batch = (cnet_batch){
+        f->X_batch,
+        f->labels ? NULL : f->Y_batch,
+        f->labels ? f->labels_batch : NULL,
+        size
+    };
+    f->pos += size;
+    return 1;
+}
+
+
+static void file_free(
+    cnet_dataset *ds
+){
+    file_dataset *f = (file_dataset *) ds;
+    read_wait(f);
+    cnet_matrix_close(f->targets);
+    cnet_matrix_close(f->inputs);
+    free(f->y_bytes);
+    free(f->x_bytes);
+    free(f->labels_batch);
+    free(f->Y_batch);
+    free(f->X_batch);
+    free(f->order);
+    free(f->y_labels);
+    free(f->y);
+    free(f->x);
+    free(f->chunks);
+    free(f);
+}
+
+
+static cnet_dataset_ops const file_ops = {
+    file_size, file_rewind, file_next, file_free
+};
+
+
+/**
+ * Create a dataset over matrix files: chunks are rounded up to whole
+ * batches, so that only the last chunk ends with a smaller batch. */
+static cnet_dataset *file_dataset_init(
+    cnet_matrix *inputs,
+    cnet_matrix *targets,
+    int labels,
+    int chunk,
+    int batch,
+    int mapped
+){
+    if (inputs->rows != targets->rows || inputs->rows > INT_MAX
+            || (labels && targets->cols != 1))
+        return NULL;
+
+    file_dataset *f = calloc(1, sizeof(file_dataset));
+    f->base.ops = &file_ops;
+    f->inputs = inputs;
+    f->targets = targets;
+    f->labels = labels;
+    f->mapped = mapped;
+    f->rows = inputs->rows;
+    f->batch = batch < 1 ? 1 : batch;
+    f->chunk = chunk < f->batch ? f->batch : (chunk + f->batch - 1) / f->batch * f->batch;
+    f->n_chunks = (f->rows + f->chunk - 1) / f->chunk;
+    f->chunks = cnet_idx(f->n_chunks);
+    f->current = -1;
+
+    // targets are outputs or classes, never pixels
+    targets->scale = 1;
+
+    f->x = malloc(sizeof(double)*f->chunk*(size_t)inputs->cols);
+    f->y = malloc(sizeof(double)*f->chunk*(size_t)targets->cols);
+    if (labels) f->y_labels = malloc(sizeof(int)*f->chunk);
+    f->order = malloc(sizeof(int)*f->chunk);
+    f->X_batch = malloc(sizeof(double *)*f->batch);
+    if (labels) f->labels_batch = malloc(sizeof(int)*f->batch);
+    else f->Y_batch = malloc(sizeof(double *)*f->batch);
+
+    if (!mapped) {
+        f->x_bytes = malloc(f->chunk * inputs->row_bytes);
+        f->y_bytes = malloc(f->chunk * targets->row_bytes);
+        posix_fadvise(inputs->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(targets->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return &f->base;
+}
+
+
+/**
+ * Create a dataset over memory mapped files. */
+cnet_dataset *cnet_dataset_mapped(
+    cnet_matrix *inputs,
+    cnet_matrix *targets,
+    int labels,
+    int chunk,
+    int batch
+){
+    return file_dataset_init(inputs, targets, labels, chunk, batch, 1);
+}
+
+
+/**
+ * Create a dataset over files read a chunk at a time. */
+cnet_dataset *cnet_dataset_chunked(
+    cnet_matrix *inputs,
+    cnet_matrix *targets,
+    int labels,
+    int chunk,
+    int batch
+){
+    return file_dataset_init(inputs, targets, labels, chunk, batch, 0);
+}
+
+
+/// Interface
+
+
+int cnet_dataset_size(
+    cnet_dataset *ds
+){
+    return ds->ops->size(ds);
+}
+
+
+void cnet_dataset_rewind(
+    cnet_dataset *ds,
+    int shuffle
+){
+    ds->ops->rewind(ds, shuffle);
+}
+
+
+int cnet_dataset_next(
+    cnet_dataset *ds,
+    cnet_batch *batch
+){
+    return ds->ops->next(ds, batch);
+}
+
+
+void cnet_dataset_free(
+    cnet_dataset *ds
+){
+    if (ds) ds->ops->free(ds);
+}
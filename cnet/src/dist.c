@@ -0,0 +1,498 @@
+/*****************************************************************************
+ *                                  DIST
+ * Implementation of the ring all-reduce over sockets.
+ ****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/dist.h"
+
+#define DIST_CHUNK (1 << 16)        // bytes per transfer (reduced as they arrive)
+#define DIST_SETUP_MS 60000         // time given to the other ranks to come up
+#define DIST_RETRY_MS 50            // delay between connection attempts
+
+
+/**
+ * Pending all-reduce. */
+typedef struct dist_op {
+    double *buf;
+    long n;
+} dist_op;
+
+
+struct cnet_dist {
+    int rank, size;
+
+    /* ring connections: from the previous rank, to the next one */
+    int left, right;
+
+    /* received chunk, before being added */
+    double *chunk;
+
+    /* communication thread and its queue of all-reduces */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    dist_op *ops;
+    int head, count, capacity;
+    int failed, stop;
+};
+
+
+/// Connections
+
+/**
+ * Socket address of a rank. */
+static int dist_address(
+    char const *address,
+    int rank,
+    struct sockaddr_storage *sa,
+    socklen_t *len
+){
+    memset(sa, 0, sizeof(*sa));
+
+    if (!strncmp(address, "unix:", 5)) {
+        struct sockaddr_un *un = (struct sockaddr_un *)sa;
+        un->sun_family = AF_UNIX;
+        int n = snprintf(un->sun_path, sizeof(un->sun_path), "%s.%d", address + 5, rank);
+        if (n < 0 || n >= (int)sizeof(un->sun_path)) return -1;
+        *len = sizeof(struct sockaddr_un);
+        return 0;
+    }
+    if (strncmp(address, "tcp:", 4)) return -1;
+
+    // the rank entry of a list, or the single host with a port per rank
+    char const *entry = address + 4;
+    int single = !strchr(entry, ',');
+    for(int r = 0; !single && r < rank; r++) {
+        entry = strchr(entry, ',');
+        if (!entry) return -1;
+        entry++;
+    }
+
+    char host[256];
+    size_t entry_len = strcspn(entry, ",");
+    char const *colon = entry + entry_len;
+    while (colon > entry && *colon != ':') colon--;
+    if (colon == entry || (size_t)(colon - entry) >= sizeof(host)) return -1;
+    memcpy(host, entry, colon - entry);
+    host[colon - entry] = 0;
+
+    char port[16];
+    snprintf(port, sizeof(port), "%d", atoi(colon + 1) + (single ? rank : 0));
+
+    struct addrinfo hints = {0}, *info;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &info)) return -1;
+    memcpy(sa, info->ai_addr, info->ai_addrlen);
+    *len = info->ai_addrlen;
+    freeaddrinfo(info);
+    return 0;
+}
+
+
+/**
+ * Milliseconds since an arbitrary point. */
+static long dist_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+
+/**
+ * Low latency, non blocking connection. */
+static void dist_setup_socket(
+    int fd
+){
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));    // fails on unix sockets
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+
+/**
+ * Connect to the next rank, retrying until it listens. */
+static int dist_connect(
+    struct sockaddr_storage const *sa,
+    socklen_t len
+){
+    long deadline = dist_ms() + DIST_SETUP_MS;
+    struct timespec retry = {0, DIST_RETRY_MS * 1000000L};
+
+    do {
+        int fd = socket(sa->ss_family, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (!connect(fd, (struct sockaddr const *)sa, len)) return fd;
+        close(fd);
+        nanosleep(&retry, NULL);
+    } while (dist_ms() < deadline);
+    return -1;
+}
+
+
+/**
+ * Blocking transfer of a few bytes (ring set up). */
+static int dist_transfer(
+    int fd,
+    void *buf,
+    size_t size,
+    int sending
+){
+    for(size_t done = 0; done < size;) {
+        ssize_t n = sending ?
+            send(fd, (char *)buf + done, size - done, MSG_NOSIGNAL) :
+            recv(fd, (char *)buf + done, size - done, 0);
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+
+/**
+ * Set up the ring connections. */
+static int dist_ring(
+    cnet_dist *dist,
+    char const *address
+){
+    struct sockaddr_storage own, next;
+    socklen_t own_len, next_len;
+    int next_rank = (dist->rank + 1) % dist->size;
+    int previous_rank = (dist->rank + dist->size - 1) % dist->size;
+    if (dist_address(address, dist->rank, &own, &own_len) ||
+        dist_address(address, next_rank, &next, &next_len))
+        return -1;
+
+    // listen first, so that the previous rank can connect while this one
+    // is waiting for the next rank
+    int one = 1;
+    int server = socket(own.ss_family, SOCK_STREAM, 0);
+    if (server < 0) return -1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (own.ss_family == AF_UNIX)
+        unlink(((struct sockaddr_un *)&own)->sun_path);
+    if (bind(server, (struct sockaddr *)&own, own_len) || listen(server, 1)) {
+        close(server);
+        return -1;
+    }
+
+    dist->right = dist_connect(&next, next_len);
+    struct pollfd pending = {server, POLLIN, 0};
+    if (dist->right >= 0 && poll(&pending, 1, DIST_SETUP_MS) == 1)
+        dist->left = accept(server, NULL, NULL);
+    close(server);
+    if (own.ss_family == AF_UNIX)
+        unlink(((struct sockaddr_un *)&own)->sun_path);
+    if (dist->left < 0 || dist->right < 0) return -1;
+
+    // check the ring order
+    int rank = dist->rank;
+    if (dist_transfer(dist->right, &rank, sizeof(rank), 1) ||
+        dist_transfer(dist->left, &rank, sizeof(rank), 0) ||
+        rank != previous_rank)
+        return -1;
+
+    dist_setup_socket(dist->left);
+    dist_setup_socket(dist->right);
+    return 0;
+}
+
+
+/// All-reduce
+
+/**
+ * Ring Exchange
+ *
+ * Sends a block to the next rank while receiving one from the previous
+ * rank, chunk by chunk as the sockets are ready. Received chunks are
+ * either added to the destination as soon as they are complete, or
+ * copied over it.
+ *
+ * @param cnet_dist *dist: Communicator
+ * @param double const *out: Sent block
+ * @param long n_out: Sent block size
+ * @param double *in: Received block destination
+ * @param long n_in: Received block size
+ * @param int add: Add the received block instead of copying it
+ * @return int: 0, or -1 if a connection failed
+ */
+static int dist_exchange(
+    cnet_dist *dist,
+    double const *out,
+    long n_out,
+    double *in,
+    long n_in,
+    int add
+){
+    size_t out_bytes = n_out * sizeof(double), in_bytes = n_in * sizeof(double);
+    size_t sent = 0, received = 0;
+
+    while (sent < out_bytes || received < in_bytes) {
+        // a direction is only polled while bytes are owed in it: poll
+        // reports hang-ups unasked, and a neighbour done with its last
+        // exchange may already have closed its side
+        struct pollfd fds[2] = {
+            {sent < out_bytes ? dist->right : -1, POLLOUT, 0},
+            {received < in_bytes ? dist->left : -1, POLLIN, 0}
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP) || fds[1].revents & POLLERR)
+            return -1;
+
+        if (fds[0].revents & POLLOUT) {
+            size_t size = out_bytes - sent < DIST_CHUNK ? out_bytes - sent : DIST_CHUNK;
+            ssize_t n = send(dist->right, (char const *)out + sent, size, MSG_NOSIGNAL);
+            if (n < 0 && errno != EAGAIN && errno != EINTR) return -1;
+            if (n > 0) sent += n;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            size_t offset = received % DIST_CHUNK;
+            size_t size = in_bytes - received < DIST_CHUNK - offset ?
+                in_bytes - received : DIST_CHUNK - offset;
+            char *dst = add ? (char *)dist->chunk + offset : (char *)in + received;
+            ssize_t n = recv(dist->left, dst, size, 0);
+            if (!n || (n < 0 && errno != EAGAIN && errno != EINTR)) return -1;
+            if (n < 0) continue;
+            received += n;
+
+            // a complete chunk is added right away
+            if (add && (received % DIST_CHUNK == 0 || received == in_bytes)) {
+                size_t start = (received - 1) / DIST_CHUNK * DIST_CHUNK;
+                double *sum = in + start / sizeof(double);
+                for(size_t i = 0; i < (received - start) / sizeof(double); i++)
+                    sum[i] += dist->chunk[i];
+            }
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Ring All-Reduce
+ *
+ * The buffer is cut into a block per rank. In size - 1 steps, every rank
+ * passes a block on to the next one, which adds it to its own (reduce
+ * scatter): each rank ends up with the whole sum of one block. In size - 1
+ * more steps, the summed blocks go around the ring (all gather).
+ *
+ * @param cnet_dist *dist: Communicator
+ * @param double *buf: Buffer
+ * @param long n: Buffer size
+ * @return int: 0, or -1 if a connection failed
+ */
+static int dist_ring_allreduce(
+    cnet_dist *dist,
+    double *buf,
+    long n
+){
+    int p = dist->size, r = dist->rank;
+    #define BLOCK(b) (buf + n * (b) / p)
+    #define BLOCK_SIZE(b) (n * ((b) + 1) / p - n * (b) / p)
+
+    for(int k = 0; k < p - 1; k++) {
+        int out = (r - k + p) % p, in = (r - k - 1 + p) % p;
+        if (dist_exchange(dist, BLOCK(out), BLOCK_SIZE(out), BLOCK(in), BLOCK_SIZE(in), 1))
+            return -1;
+    }
+    for(int k = 0; k < p - 1; k++) {
+        int out = (r + 1 - k + p) % p, in = (r - k + p) % p;
+        if (dist_exchange(dist, BLOCK(out), BLOCK_SIZE(out), BLOCK(in), BLOCK_SIZE(in), 0))
+            return -1;
+    }
+
+    #undef BLOCK
+    #undef BLOCK_SIZE
+    return 0;
+}
+
+
+/**
+ * Communication thread, running the all-reduces in submission order. */
+static void *dist_loop(
+    void *arg
+){
+    cnet_dist *dist = arg;
+
+    pthread_mutex_lock(&dist->lock);
+    for(;;) {
+        while (!dist->count && !dist->stop)
+            pthread_cond_wait(&dist->changed, &dist->lock);
+        if (!dist->count) break;
+        dist_op op = dist->ops[dist->head];
+        int failed = dist->failed;
+        pthread_mutex_unlock(&dist->lock);
+
+        // a broken ring only drains the queue
+        if (!failed) failed = dist_ring_allreduce(dist, op.buf, op.n) < 0;
+
+        pthread_mutex_lock(&dist->lock);
+        dist->failed = failed;
+        dist->head = (dist->head + 1) % dist->capacity;
+        dist->count--;
+        pthread_cond_broadcast(&dist->changed);
+    }
+    pthread_mutex_unlock(&dist->lock);
+    return NULL;
+}
+
+
+/// Communicator
+
+/**
+ * Join a ring of processes. */
+cnet_dist *cnet_dist_init(
+    int rank,
+    int size,
+    char const *address
+){
+    if (size < 1 || rank < 0 || rank >= size) return NULL;
+
+    cnet_dist *dist = malloc(sizeof(cnet_dist));
+    dist->rank = rank;
+    dist->size = size;
+    dist->left = dist->right = -1;
+    dist->chunk = malloc(DIST_CHUNK);
+    dist->capacity = 64;
+    dist->ops = malloc(sizeof(dist_op)*dist->capacity);
+    dist->head = dist->count = 0;
+    dist->failed = dist->stop = 0;
+    pthread_mutex_init(&dist->lock, NULL);
+    pthread_cond_init(&dist->changed, NULL);
+
+    if ((size > 1 && dist_ring(dist, address)) ||
+        pthread_create(&dist->thread, NULL, dist_loop, dist)) {
+        if (dist->left >= 0) close(dist->left);
+        if (dist->right >= 0) close(dist->right);
+        pthread_mutex_destroy(&dist->lock);
+        pthread_cond_destroy(&dist->changed);
+        free(dist->ops);
+        free(dist->chunk);
+        free(dist);
+        return NULL;
+    }
+    return dist;
+}
+
+
+/**
+ * Leave the ring. */
+void cnet_dist_free(
+    cnet_dist *dist
+){
+    pthread_mutex_lock(&dist->lock);
+    dist->stop = 1;
+    pthread_cond_broadcast(&dist->changed);
+    pthread_mutex_unlock(&dist->lock);
+    pthread_join(dist->thread, NULL);
+
+    if (dist->left >= 0) close(dist->left);
+    if (dist->right >= 0) close(dist->right);
+    pthread_mutex_destroy(&dist->lock);
+    pthread_cond_destroy(&dist->changed);
+    free(dist->ops);
+    free(dist->chunk);
+    free(dist);
+}
+
+
+/**
+ * Rank of this process. */
+int cnet_dist_rank(
+    cnet_dist const *dist
+){
+    return dist->rank;
+}
+
+
+/**
+ * Number of processes of the ring. */
+int cnet_dist_size(
+    cnet_dist const *dist
+){
+    return dist->size;
+}
+
+
+/**
+ * Start summing a buffer over all the ranks. */
+void cnet_dist_allreduce_async(
+    cnet_dist *dist,
+    double *buf,
+    long n
+){
+    if (dist->size == 1 || n <= 0) return;
+
+    pthread_mutex_lock(&dist->lock);
+    if (dist->count == dist->capacity) {
+        // grow the queue, unwrapping it
+        dist_op *ops = malloc(sizeof(dist_op)*dist->capacity*2);
+        for(int i = 0; i < dist->count; i++)
+            ops[i] = dist->ops[(dist->head + i) % dist->capacity];
+        free(dist->ops);
+        dist->ops = ops;
+        dist->head = 0;
+        dist->capacity *= 2;
+    }
+    dist->ops[(dist->head + dist->count++) % dist->capacity] = (dist_op){buf, n};
+    pthread_cond_broadcast(&dist->changed);
+    pthread_mutex_unlock(&dist->lock);
+}
+
+
+/**
+ * Wait for the submitted all-reduces. */
+int cnet_dist_wait(
+    cnet_dist *dist
+){
+    pthread_mutex_lock(&dist->lock);
+    while (dist->count)
+        pthread_cond_wait(&dist->changed, &dist->lock);
+    int failed = dist->failed;
+    pthread_mutex_unlock(&dist->lock);
+    return failed ? -1 : 0;
+}
+
+
+/**
+ * Sum a buffer over all the ranks. */
+int cnet_dist_allreduce(
+    cnet_dist *dist,
+    double *buf,
+    long n
+){
+    cnet_dist_allreduce_async(dist, buf, n);
+    return cnet_dist_wait(dist);
+}
+
+
+/**
+ * Copy a buffer of rank 0 to all the ranks: the other ranks add zeros. */
+int cnet_dist_broadcast(
+    cnet_dist *dist,
+    double *buf,
+    long n
+){
+    if (dist->rank) memset(buf, 0, sizeof(double)*n);
+    return cnet_dist_allreduce(dist, buf, n);
+}
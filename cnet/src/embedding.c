@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *                                EMBEDDING
+ * Implementation of the embedding layers passes.
+ ****************************************************************************/
+
+#include <assert.h>
+#include <string.h>
+#include "../include/embedding.h"
+#include "../include/blas.h"
+
+
+/**
+ * Row of the embeddings table for a field index. */
+static inline int embedding_row(
+    clayer const *layer,
+    double index
+){
+    int row = (int)index;
+    assert(row >= 0 && row < layer->w_rows);
+    return row;
+}
+
+
+/**
+ * Embedding Forward Pass */
+void cnet_embedding_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    int batch
+){
+    int dim = layer->w_cols;
+    for(int b = 0; b < batch; b++) {
+        double const *x = in + b*layer->in_size;
+        double *y = out + b*layer->out_size;
+        for(int f = 0; f < layer->in_size; f++)
+            memcpy(
+                y + f*dim,
+                layer->weights[embedding_row(layer, x[f])],
+                sizeof(double)*dim
+            );
+    }
+}
+
+
+/**
+ * Embedding Weights Gradient */
+void cnet_embedding_gradient(
+    clayer const *layer,
+    double const *in,
+    double scale,
+    double *dw
+){
+    int dim = layer->w_cols;
+    for(int f = 0; f < layer->in_size; f++) {
+        double *row = dw + (long)embedding_row(layer, in[f])*dim;
+        double const *delta = layer->delta + f*dim;
+        for(int j = 0; j < dim; j++)
+            row[j] += scale * delta[j];
+    }
+}
+
+
+/**
+ * Embedding Touched Rows */
+void cnet_embedding_touch(
+    clayer *layer,
+    double const *in
+){
+    if (!layer->touched) return;
+    for(int f = 0; f < layer->in_size; f++) {
+        int row = embedding_row(layer, in[f]);
+        if (layer->touched_mark[row]) continue;
+        layer->touched_mark[row] = 1;
+        layer->touched[layer->n_touched++] = row;
+    }
+}
+
+
+/**
+ * Embedding Optimizer Step */
+void cnet_embedding_step(
+    clayer *layer,
+    double scale
+){
+    int dim = layer->w_cols;
+    for(int t = 0; t < layer->n_touched; t++) {
+        int row = layer->touched[t];
+        double *w = layer->weights[row];
+        double *g = layer->grad + (long)row*dim;
+        cnet_axpy(dim, scale, g, w);
+        if (layer->mask)
+            for(int j = 0; j < dim; j++)
+                if (!layer->mask[(long)row*dim + j]) w[j] = 0;
+        memset(g, 0, sizeof(double)*dim);
+        layer->touched_mark[row] = 0;
+    }
+    layer->n_touched = 0;
+}
@@ -0,0 +1,280 @@
+/*****************************************************************************
+ *                                  HALF
+ * Implementation of the 16 bit weights storage.
+ * Doubles are first rounded to float, then to 16 bits, which is what the
+ * F16C instructions do, so both paths give the same values. Widening,
+ * the hot path of the forward passes, also has an SSE2 version (always
+ * available on x86-64) for builds without F16C.
+ ****************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/half.h"
+
+#if defined(__F16C__) && defined(__AVX__)
+#include <immintrin.h>
+#define HAVE_F16C
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/// Scalar conversions
+
+
+static inline uint32_t float_bits(
+    float f
+){
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+
+static inline float bits_float(
+    uint32_t x
+){
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+
+/**
+ * Float to bfloat16 (the top half of the float, rounded). */
+static inline uint16_t float_to_bf16(
+    float f
+){
+    uint32_t x = float_bits(f);
+    if ((x & 0x7FFFFFFF) > 0x7F800000) return (x >> 16) | 0x40;
+    x += 0x7FFF + ((x >> 16) & 1);
+    return x >> 16;
+}
+
+
+static inline float bf16_to_float(
+    uint16_t h
+){
+    return bits_float((uint32_t)h << 16);
+}
+
+
+/**
+ * Float to IEEE fp16, with subnormals, overflows to infinity. */
+static inline uint16_t float_to_fp16(
+    float f
+){
+    uint32_t x = float_bits(f);
+    uint32_t sign = (x >> 16) & 0x8000, mant = x & 0x7FFFFF;
+    int exp = (int)((x >> 23) & 0xFF) - 127 + 15;
+
+    // infinity and nan
+    if (((x >> 23) & 0xFF) == 0xFF)
+        return sign | 0x7C00 | (mant ? 0x200 : 0);
+    if (exp >= 31) return sign | 0x7C00;
+
+    // subnormals: shift the mantissa (with its implicit bit) into place
+    if (exp <= 0) {
+        if (exp < -10) return sign;
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t half = mant >> shift, rem = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1))) half++;
+        return sign | half;
+    }
+
+    // a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = sign | (exp << 10) | (mant >> 13), rem = mant & 0x1FFF;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) half++;
+    return half;
+}
+
+
+static inline float fp16_to_float(
+    uint16_t h
+){
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F, mant = h & 0x3FF;
+    if (!exp) return (sign ? -1.0f : 1.0f) * mant * 0x1p-24f;
+    if (exp == 31) return bits_float(sign | 0x7F800000 | (mant << 13));
+    return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+
+/**
+ * Widen a single 16 bit value. */
+double cnet_half_get(
+    enum cnet_half_type type,
+    uint16_t value
+){
+    return type == half_bf16 ? bf16_to_float(value) : fp16_to_float(value);
+}
+
+
+/// Bulk conversions
+
+
+#if defined(__SSE2__) && !defined(HAVE_F16C)
+/**
+ * Four fp16 (in the low half of 32 bit lanes) to floats.
+ * Exponent and mantissa are moved into place and rebiased by a multiply,
+ * which is exact for normals and subnormals, infinity and nan are set apart.
+ */
+static inline __m128 fp16x4_to_ps(
+    __m128i x
+){
+    __m128i em = _mm_and_si128(x, _mm_set1_epi32(0x7FFF));
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x8000)), 16);
+    __m128i shifted = _mm_slli_epi32(em, 13);
+    __m128i finite = _mm_castps_si128(
+        _mm_mul_ps(_mm_castsi128_ps(shifted), _mm_set1_ps(0x1p112f))
+    );
+    __m128i special = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x7BFF));
+    __m128i inf = _mm_or_si128(shifted, _mm_set1_epi32(0x7F800000));
+    __m128i bits = _mm_or_si128(
+        _mm_andnot_si128(special, finite),
+        _mm_and_si128(special, inf)
+    );
+    return _mm_castsi128_ps(_mm_or_si128(bits, sign));
+}
+#endif
+
+
+#ifdef __SSE2__
+/**
+ * Store four floats as doubles. */
+static inline void store_ps_pd(
+    double *dst,
+    __m128 f
+){
+    _mm_storeu_pd(dst, _mm_cvtps_pd(f));
+    _mm_storeu_pd(dst + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+}
+#endif
+
+
+/**
+ * Pack doubles into 16 bit values. */
+void cnet_half_pack(
+    enum cnet_half_type type,
+    double const *src,
+    uint16_t *dst,
+    int size
+){
+    int i = 0;
+    if (type == half_bf16) {
+        for(; i < size; i++)
+            dst[i] = float_to_bf16((float)src[i]);
+        return;
+    }
+
+#ifdef HAVE_F16C
+    for(; i + 8 <= size; i += 8) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4));
+        __m256 f = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+        _mm_storeu_si128(
+            (__m128i *)(dst + i),
+            _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT)
+        );
+    }
+#endif
+    for(; i < size; i++)
+        dst[i] = float_to_fp16((float)src[i]);
+}
+
+
+/**
+ * Widen 16 bit values into doubles. */
+void cnet_half_widen(
+    enum cnet_half_type type,
+    uint16_t const *src,
+    double *dst,
+    int size
+){
+    int i = 0;
+    if (type == half_bf16) {
+#ifdef __SSE2__
+        // bf16 are the top half of floats: interleave them with zeros
+        for(; i + 8 <= size; i += 8) {
+            __m128i h = _mm_loadu_si128((__m128i const *)(src + i));
+            __m128i zero = _mm_setzero_si128();
+            store_ps_pd(dst + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, h)));
+            store_ps_pd(dst + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, h)));
+        }
+#endif
+        for(; i < size; i++)
+            dst[i] = bf16_to_float(src[i]);
+        return;
+    }
+
+#if defined(HAVE_F16C)
+    for(; i + 8 <= size; i += 8) {
+        __m256 f = _mm256_cvtph_ps(_mm_loadu_si128((__m128i const *)(src + i)));
+        _mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm256_castps256_ps128(f)));
+        _mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)));
+    }
+#elif defined(__SSE2__)
+    for(; i + 8 <= size; i += 8) {
+        __m128i h = _mm_loadu_si128((__m128i const *)(src + i));
+        __m128i zero = _mm_setzero_si128();
+        store_ps_pd(dst + i, fp16x4_to_ps(_mm_unpacklo_epi16(h, zero)));
+        store_ps_pd(dst + i + 4, fp16x4_to_ps(_mm_unpackhi_epi16(h, zero)));
+    }
+#endif
+    for(; i < size; i++)
+        dst[i] = fp16_to_float(src[i]);
+}
+
+
+/// Layers
+
+
+/**
+ * Refresh the 16 bit weights of a layer. */
+void cnet_half_refresh(
+    clayer *layer
+){
+    if (!layer->half) return;
+    cnet_half_pack(
+        layer->half_type,
+        layer->weights[0],
+        layer->half,
+        layer->w_rows * layer->w_cols
+    );
+}
+
+
+/**
+ * Set the weights storage of a layer. */
+void cnet_layer_half(
+    clayer *layer,
+    enum cnet_half_type type
+){
+    assert(layer->type == dense_layer);
+    free(layer->half);
+    free(layer->cols);
+    layer->half = NULL;
+    layer->cols = NULL;
+    layer->half_type = type;
+    if (type == half_none) return;
+
+    // rows are widened into the (otherwise unused) cols buffer
+    layer->half = malloc(sizeof(uint16_t)*layer->w_rows*layer->w_cols);
+    layer->cols = malloc(sizeof(double)*layer->w_cols);
+    cnet_half_refresh(layer);
+}
+
+
+/**
+ * Set the weights storage of the network. */
+void nn_set_half(
+    cnet *nn,
+    enum cnet_half_type type
+){
+    for(int i = 0; i < nn->last_layer; i++)
+        if (nn->layers[i]->type == dense_layer)
+            cnet_layer_half(nn->layers[i], type);
+}
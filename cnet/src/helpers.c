@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include "../include/helpers.h"
+#include "../include/random.h"
 
 
 /// Array Helpers
@@ -29,12 +30,11 @@ double cnet_mean(double *arr, int size) {
 
 
 /**
- * Array random suffle
- * https://stackoverflow.com/questions/6127503/shuffle-array-in-c */
+ * Array random suffle (Fisher-Yates, with the thread generator) */
 void cnet_shuffle(int *arr, int size) {
-    if (size < 1) return;
+    cnet_rng *rng = cnet_rng_local();
     for (int i = 0; i < size - 1; i++) {
-      int j = i + rand() / (RAND_MAX / (size - i) + 1);
+      int j = i + (int)cnet_rng_below(rng, size - i);
       int t = arr[j];
       arr[j] = arr[i];
       arr[i] = t;
@@ -53,6 +53,15 @@ int *cnet_idx(int size) {
 }
 
 
+/**
+ * Check Labels */
+int cnet_check_labels(int const *labels, int size, int classes) {
+    for(int i = 0; i < size; i++)
+        if (labels[i] < 0 || labels[i] >= classes) return i;
+    return -1;
+}
+
+
 /**
  * ArgMax */
 double cnet_argmax(double const *arr, int size) {
@@ -66,41 +75,6 @@ double cnet_argmax(double const *arr, int size) {
 }
 
 
-/**
- * Vector Dot Product */
-double cnet_dot_vector(
-    double const *x,
-    double const *y,
-    int size
-){
-    double res = 0;
-    for(int i = 0; i < size; i++)
-        res += x[i] * y[i];
-    return res;
-}
-
-
-/**
- * Vector Matrix Dot Product */
-void cnet_dot_mat(
-    double *vector,
-    double **matrix,
-    int size
-){
-    // create the temporary vector to store the result
-    double *temp = malloc(sizeof(double) * size);
-
-    // compute the dot product
-    for(int i = 0; i < size; i++)
-        temp[i] = cnet_dot_vector(vector, matrix[i], size);
-
-    // store the result and free
-    for(int i = 0; i < size; i++)
-        vector[i] = temp[i];
-    free(temp);
-}
-
-
 /**
  * Vector Clipping */
 void cnet_clip(
@@ -0,0 +1,219 @@
+/*****************************************************************************
+ *                                LOCALITY
+ * Implementation of the NUMA placement helpers, over libnuma when built
+ * with CNET_NUMA, no-ops otherwise.
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../include/locality.h"
+#include "../include/tpool.h"
+
+#ifdef CNET_NUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+
+/* pool of the NUMA mode, pinned node by node */
+static cnet_tpool *numa_pool = NULL;
+
+
+/// Nodes and memory
+
+
+/**
+ * NUMA nodes. */
+int cnet_numa_nodes(void) {
+#ifdef CNET_NUMA
+    if (numa_available() >= 0) return numa_num_configured_nodes();
+#endif
+    return 1;
+}
+
+
+/**
+ * Node of a CPU (0 without NUMA). */
+static int numa_cpu_node(
+    int cpu
+){
+#ifdef CNET_NUMA
+    if (numa_available() >= 0) {
+        int node = numa_node_of_cpu(cpu);
+        return node < 0 ? 0 : node;
+    }
+#endif
+    (void)cpu;
+    return 0;
+}
+
+
+/**
+ * Local allocation. */
+void *cnet_numa_alloc_local(
+    size_t size
+){
+#ifdef CNET_NUMA
+    if (numa_available() >= 0) return numa_alloc_local(size);
+#endif
+    return malloc(size);
+}
+
+
+/**
+ * Free local memory. */
+void cnet_numa_free(
+    void *ptr,
+    size_t size
+){
+#ifdef CNET_NUMA
+    if (numa_available() >= 0) {
+        numa_free(ptr, size);
+        return;
+    }
+#endif
+    (void)size;
+    free(ptr);
+}
+
+
+/**
+ * Interleave a memory range. */
+void cnet_numa_interleave(
+    void *ptr,
+    size_t size
+){
+#ifdef CNET_NUMA
+    if (!ptr || !size || numa_available() < 0 || cnet_numa_nodes() < 2) return;
+
+    // the policy applies to whole pages, those around the range included
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t)ptr & ~(page - 1);
+    uintptr_t to = ((uintptr_t)ptr + size + page - 1) & ~(page - 1);
+    mbind(
+        (void *)from,
+        to - from,
+        MPOL_INTERLEAVE,
+        numa_all_nodes_ptr->maskp,
+        numa_all_nodes_ptr->size + 1,
+        MPOL_MF_MOVE
+    );
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+
+/**
+ * Interleave dataset rows. */
+void cnet_numa_interleave_rows(
+    double **X,
+    int size,
+    int cols
+){
+    if (cnet_numa_nodes() < 2) return;
+
+    // rows allocated in a single block are interleaved at once
+    for(int i = 0; i < size; i++) {
+        int j = i + 1;
+        while (j < size && X[j] == X[j - 1] + cols) j++;
+        cnet_numa_interleave(X[i], sizeof(double)*(j - i)*cols);
+        i = j - 1;
+    }
+}
+
+
+/**
+ * Interleave the network parameters. */
+void nn_numa_interleave(
+    cnet *nn
+){
+    if (cnet_numa_nodes() < 2) return;
+
+    for(int i = 0; i < nn->last_layer; i++) {
+        clayer *layer = nn->layers[i];
+        if (layer->weights)
+            cnet_numa_interleave(
+                layer->weights[0],
+                sizeof(double)*layer->w_rows*layer->w_cols
+            );
+        cnet_numa_interleave(layer->bias, sizeof(double)*layer->b_size);
+        cnet_numa_interleave(
+            layer->half,
+            sizeof(uint16_t)*layer->w_rows*layer->w_cols
+        );
+        cnet_numa_interleave(layer->csr_vals, sizeof(double)*layer->csr_nnz);
+        cnet_numa_interleave(layer->csr_cols, sizeof(int)*layer->csr_nnz);
+    }
+}
+
+
+/// Threads
+
+
+/**
+ * CPUs the process may run on (its affinity mask, else the online ones). */
+static int *numa_allowed_cpus(
+    int *count
+){
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        int *cpus = malloc(sizeof(int)*CPU_COUNT(&set));
+        *count = 0;
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set)) cpus[(*count)++] = cpu;
+        return cpus;
+    }
+#endif
+    int online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    *count = online < 1 ? 1 : online;
+    int *cpus = malloc(sizeof(int)**count);
+    for(int cpu = 0; cpu < *count; cpu++)
+        cpus[cpu] = cpu;
+    return cpus;
+}
+
+
+/**
+ * Enable the NUMA mode. */
+int cnet_numa_init(void) {
+    int nodes = cnet_numa_nodes();
+    int cores;
+    int *allowed = numa_allowed_cpus(&cores);
+
+    // allowed cores, node by node (unknown nodes last)
+    int *cpus = malloc(sizeof(int)*cores);
+    int n = 0;
+    for(int node = 0; node < nodes; node++)
+        for(int c = 0; c < cores; c++)
+            if (numa_cpu_node(allowed[c]) == node) cpus[n++] = allowed[c];
+    for(int c = 0; c < cores && n < cores; c++)
+        if (numa_cpu_node(allowed[c]) >= nodes) cpus[n++] = allowed[c];
+    free(allowed);
+
+    // the caller takes the first core, the workers the next ones
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[0], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        free(cpus);
+        return -1;
+    }
+#endif
+
+    cnet_tpool *pool = cnet_tpool_init(cores, cpus + 1);
+    cnet_tpool_use(pool);
+    if (numa_pool) cnet_tpool_free(numa_pool);
+    numa_pool = pool;
+
+    free(cpus);
+    return nodes;
+}
@@ -5,6 +5,7 @@
 
 #include <math.h>
 #include <float.h>
+#include <stddef.h>
 #include "../include/loss.h"
 #include "../include/helpers.h"
 
@@ -51,6 +52,47 @@ void MSE_Dx(
 }
 
 
+/**
+ * Sparse Mean Squared Error.
+ *
+ * @param double *: Prediction
+ * @param int: Target class
+ * @param int : size
+ * @return double
+ */
+double MSE_Sparse(
+    double const *pred,
+    int target,
+    int size
+){
+    double mse = 0;
+    for(int i = 0; i < size; i++)
+        mse += pred[i] * pred[i];
+    mse += 1 - 2 * pred[target];
+    return mse / size;
+}
+
+
+/**
+ * Sparse Mean Squared Error Derivative
+ *
+ * @param double *: Prediction
+ * @param int: Target class
+ * @param double *: Destination array
+ * @param int: Size of the given arrays
+ */
+void MSE_Sparse_Dx(
+    double const *pred,
+    int target,
+    double *dst,
+    int size
+){
+    for(int i = 0; i < size; i++)
+        dst[i] = 2 * pred[i];
+    dst[target] -= 2;
+}
+
+
 /// Cross Entropy
 
 
@@ -91,7 +133,108 @@ void CrossEntropy_Dx(
     int size
 ){
     for(int i = 0; i < size; i++)
-        dst[i] = (pred[i] - target[i]);
+        dst[i] = -target[i] / non_zero(pred[i]);
+}
+
+
+/**
+ * Sparse Cross Entropy (only the target prediction counts)
+ *
+ * @param double *: Prediction
+ * @param int: Target class
+ * @param int : size
+ * @return double
+ */
+double CrossEntropy_Sparse(
+    double const *pred,
+    int target,
+    int size
+){
+    (void)size;
+    return -log(non_zero(pred[target]));
+}
+
+
+/**
+ * Sparse Cross Entropy Derivative
+ *
+ * @param double *: Prediction
+ * @param int: Target class
+ * @param double *: Destination array
+ * @param int: Size of the given arrays
+ */
+void CrossEntropy_Sparse_Dx(
+    double const *pred,
+    int target,
+    double *dst,
+    int size
+){
+    for(int i = 0; i < size; i++)
+        dst[i] = 0;
+    dst[target] = -1 / non_zero(pred[target]);
+}
+
+
+/// Softmax Cross Entropy
+
+
+/**
+ * Fused Softmax Cross Entropy */
+double cnet_softmax_cross_entropy(
+    double *z,
+    double const *target,
+    double *delta,
+    int size
+){
+    // log-sum-exp, shifted by the max logit
+    double max = z[0];
+    for(int i = 1; i < size; i++)
+        max = max < z[i] ? z[i] : max;
+
+    double sum = 0;
+    for(int i = 0; i < size; i++) {
+        delta[i] = exp(z[i] - max);
+        sum += delta[i];
+    }
+    double lse = max + log(sum);
+
+    // -log(p_i) = lse - z_i, and the gradient over z is p - target
+    double ce = 0;
+    for(int i = 0; i < size; i++) {
+        ce += target[i] * (lse - z[i]);
+        z[i] = delta[i] / sum;
+        delta[i] = z[i] - target[i];
+    }
+    return ce;
+}
+
+
+/**
+ * Fused Softmax Sparse Cross Entropy */
+double cnet_softmax_sparse_cross_entropy(
+    double *z,
+    int target,
+    double *delta,
+    int size
+){
+    double max = z[0];
+    for(int i = 1; i < size; i++)
+        max = max < z[i] ? z[i] : max;
+
+    double sum = 0;
+    for(int i = 0; i < size; i++) {
+        delta[i] = exp(z[i] - max);
+        sum += delta[i];
+    }
+
+    // only the target logit goes into the loss
+    double ce = max + log(sum) - z[target];
+    for(int i = 0; i < size; i++) {
+        z[i] = delta[i] / sum;
+        delta[i] = z[i];
+    }
+    delta[target] -= 1;
+    return ce;
 }
 
 
@@ -103,6 +246,7 @@ cnet_loss_func *cnet_get_loss(enum cnet_loss_type type) {
         case mse_loss: return MSE;
         case cross_entropy_loss: return CrossEntropy;
     }
+    return NULL;
 }
 
 
@@ -111,4 +255,23 @@ cnet_loss_func_dx *cnet_get_loss_dx(enum cnet_loss_type type) {
         case mse_loss: return MSE_Dx;
         case cross_entropy_loss: return CrossEntropy_Dx;
     }
+    return NULL;
+}
+
+
+cnet_loss_sparse_func *cnet_get_loss_sparse(enum cnet_loss_type type) {
+    switch(type) {
+        case mse_loss: return MSE_Sparse;
+        case cross_entropy_loss: return CrossEntropy_Sparse;
+    }
+    return NULL;
+}
+
+
+cnet_loss_sparse_func_dx *cnet_get_loss_sparse_dx(enum cnet_loss_type type) {
+    switch(type) {
+        case mse_loss: return MSE_Sparse_Dx;
+        case cross_entropy_loss: return CrossEntropy_Sparse_Dx;
+    }
+    return NULL;
 }
@@ -0,0 +1,281 @@
+/*****************************************************************************
+ *                                 MATRIX
+ * Implementation of the memory mapped input matrices.
+ ****************************************************************************/
+
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/matrix.h"
+
+
+static char const *type_names[] = {"u8", "i8", "i16", "i32", "f32", "f64"};
+static int const type_sizes[] = {1, 1, 2, 4, 4, 8};
+
+// IDX type codes, indexed by cnet_matrix_type
+static int const idx_types[] = {0x08, 0x09, 0x0B, 0x0C, 0x0D, 0x0E};
+
+
+/**
+ * Map a whole file, read only. */
+static cnet_matrix *matrix_map(
+    char const *path
+){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    cnet_matrix *m = calloc(1, sizeof(cnet_matrix));
+    m->map = map;
+    m->map_size = st.st_size;
+    m->fd = fd;
+    return m;
+}
+
+
+/**
+ * Set the values type and its default scale. */
+static void matrix_type(
+    cnet_matrix *m,
+    enum cnet_matrix_type type
+){
+    m->type = type;
+    m->scale = type == matrix_u8 ? 1. / 255 : 1.;
+}
+
+
+/**
+ * Read a big endian 32 bits integer. */
+static uint32_t read_be32(
+    unsigned char const *p
+){
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16
+         | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+}
+
+
+/**
+ * Map an IDX file. */
+cnet_matrix *cnet_matrix_open_idx(
+    char const *path
+){
+    cnet_matrix *m = matrix_map(path);
+    if (!m) return NULL;
+    unsigned char const *bytes = m->map;
+
+    // magic: two zero bytes, the values type, the number of dimensions
+    int type = -1, dims = m->map_size >= 4 ? bytes[3] : 0;
+    for(int t = 0; m->map_size >= 4 && t <= matrix_f64; t++)
+        if (bytes[0] == 0 && bytes[1] == 0 && bytes[2] == idx_types[t])
+            type = t;
+    size_t header = 4 + 4 * (size_t) dims;
+    if (type < 0 || dims == 0 || m->map_size < header) {
+        cnet_matrix_close(m);
+        return NULL;
+    }
+
+    // the columns are the product of the other dimensions, checked as
+    // they go (a zero dimension gives no columns)
+    size_t cols = 1;
+    for(int d = 1; d < dims && cols <= INT32_MAX; d++)
+        cols *= read_be32(bytes + 4 + 4 * d);
+
+    matrix_type(m, type);
+    m->rows = read_be32(bytes + 4);
+    m->cols = cols;
+    m->big_endian = 1;
+    m->data = bytes + header;
+    m->offset = header;
+    m->row_bytes = cols * type_sizes[type];
+
+    // the rows must fit in the file, without overflowing their size
+    if (cols == 0 || cols > INT32_MAX ||
+        (size_t) m->rows > (m->map_size - header) / m->row_bytes) {
+        cnet_matrix_close(m);
+        return NULL;
+    }
+    return m;
+}
+
+
+/**
+ * Map a raw matrix file. */
+cnet_matrix *cnet_matrix_open_raw(
+    char const *path,
+    int cols,
+    enum cnet_matrix_type type
+){
+    if (cols < 1) return NULL;
+    cnet_matrix *m = matrix_map(path);
+    if (!m) return NULL;
+
+    matrix_type(m, type);
+    m->rows = m->map_size / ((size_t) cols * type_sizes[type]);
+    m->cols = cols;
+    m->data = m->map;
+    m->row_bytes = (size_t) cols * type_sizes[type];
+    return m;
+}
+
+
+/**
+ * Unmap a matrix. */
+void cnet_matrix_close(
+    cnet_matrix *m
+){
+    if (!m) return;
+    munmap(m->map, m->map_size);
+    close(m->fd);
+    free(m);
+}
+
+
+/**
+ * Parse a values type name. */
+int cnet_matrix_type_parse(
+    char const *name,
+    enum cnet_matrix_type *type
+){
+    for(int t = 0; t <= matrix_f64; t++) {
+        if (!strcmp(name, type_names[t])) {
+            *type = t;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Read a value (of size bytes) in the native byte order. */
+static void read_value(
+    unsigned char const *p,
+    int size,
+    int swap,
+    void *value
+){
+    unsigned char *v = value;
+    for(int b = 0; b < size; b++)
+        v[b] = p[swap ? size - 1 - b : b];
+}
+
+
+/**
+ * Convert rows: the bytes and native doubles, the common cases, are
+ * converted directly, the others value by value. */
+void cnet_matrix_convert(
+    cnet_matrix const *m,
+    void const *rows,
+    int count,
+    double *out
+){
+    int size = type_sizes[m->type];
+    long n = (long) count * m->cols;
+    unsigned char const *p = rows;
+    double scale = m->scale;
+
+    uint16_t order = 1;
+    int swap = m->big_endian == (*(unsigned char *) &order == 1);
+
+    if (m->type == matrix_u8) {
+        for(long i = 0; i < n; i++)
+            out[i] = p[i] * scale;
+        return;
+    }
+    if (m->type == matrix_f64 && !swap) {
+        memcpy(out, p, n * sizeof(double));
+        if (scale != 1.)
+            for(long i = 0; i < n; i++)
+                out[i] *= scale;
+        return;
+    }
+
+    for(long i = 0; i < n; i++, p += size) {
+        switch(m->type) {
+        case matrix_i8:
+            out[i] = (int8_t) *p * scale;
+            break;
+        case matrix_i16: {
+            int16_t v;
+            read_value(p, size, swap, &v);
+            out[i] = v * scale;
+            break;
+        }
+        case matrix_i32: {
+            int32_t v;
+            read_value(p, size, swap, &v);
+            out[i] = v * scale;
+            break;
+        }
+        case matrix_f32: {
+            float v;
+            read_value(p, size, swap, &v);
+            out[i] = v * scale;
+            break;
+        }
+        default: {
+            double v;
+            read_value(p, size, swap, &v);
+            out[i] = v * scale;
+            break;
+        }
+        }
+    }
+}
+
+
+/**
+ * Convert consecutive rows. */
+void cnet_matrix_rows(
+    cnet_matrix const *m,
+    long first,
+    int count,
+    double *out
+){
+    cnet_matrix_convert(m, m->data + first * m->row_bytes, count, out);
+}
+
+
+/**
+ * Hint the kernel about rows, over the whole pages they cover. */
+void cnet_matrix_advise(
+    cnet_matrix const *m,
+    long first,
+    long count,
+    int needed
+){
+    if (count <= 0) return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t from = m->offset + first * m->row_bytes;
+    size_t to = from + count * m->row_bytes;
+
+    // only drop the pages entirely inside the rows
+    if (to > m->map_size) to = m->map_size;
+    if (needed) from -= from % page;
+    else {
+        from += (page - from % page) % page;
+        if (to < m->map_size) to -= to % page;
+    }
+    if (to <= from) return;
+
+    madvise((char *) m->map + from, to - from,
+            needed ? MADV_WILLNEED : MADV_DONTNEED);
+}
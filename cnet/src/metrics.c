@@ -2,10 +2,15 @@
  * Metric Functions for CNet.
  */
 
-
 #include <math.h>
+#include <stdlib.h>
 #include "../include/metrics.h"
 #include "../include/helpers.h"
+#include "../include/locality.h"
+#include "../include/cnet.h"
+#include "../include/tpool.h"
+
+#define EVAL_BATCH 64
 
 
 double accuracy_round(
@@ -32,6 +37,28 @@ double accuracy_argmax(
 }
 
 
+double accuracy_round_sparse(
+    double const *pred,
+    int real,
+    int size
+){
+    double res = 0;
+    for(int i = 0; i < size; i++) {
+        res += round(pred[i]) == (i == real);
+    }
+    return res / size;
+}
+
+
+double accuracy_argmax_sparse(
+    double const *pred,
+    int real,
+    int size
+){
+    return (int)cnet_argmax(pred, size) == real ? 1 : 0;
+}
+
+
 /// getters
 
 
@@ -40,6 +67,16 @@ cnet_metric_fun *cnet_get_metric(enum cnet_metric_type type) {
         case metric_accuracy_round: return accuracy_round;
         case metric_accuracy_argmax: return accuracy_argmax;
     }
+    return NULL;
+}
+
+
+cnet_metric_sparse_fun *cnet_get_metric_sparse(enum cnet_metric_type type) {
+    switch(type) {
+        case metric_accuracy_round: return accuracy_round_sparse;
+        case metric_accuracy_argmax: return accuracy_argmax_sparse;
+    }
+    return NULL;
 }
 
 
@@ -48,4 +85,238 @@ const char *cnet_get_metric_name(enum cnet_metric_type type) {
         case metric_accuracy_round: return "Accuracy";
         case metric_accuracy_argmax: return "Accuracy";
     }
+    return NULL;
+}
+
+
+/// evaluation
+
+
+/**
+ * Evaluation task: a range of samples evaluated by a single thread of
+ * the pool, into its own confusion matrix. */
+typedef struct eval_task {
+    cnet const *nn;
+    double **X, **Y;
+    int const *labels;
+    int from, to;
+    int *confusion;
+} eval_task;
+
+
+/**
+ * Evaluate a range of samples in batches. */
+static void eval_range(
+    eval_task *task
+){
+    cnet const *nn = task->nn;
+
+    // buffers on the node of the running thread
+    size_t ws_size = sizeof(double)*nn_workspace_size(nn, EVAL_BATCH);
+    size_t out_size = sizeof(double)*EVAL_BATCH*nn->out_size;
+    double *workspace = cnet_numa_alloc_local(ws_size);
+    double *out = cnet_numa_alloc_local(out_size);
+
+    for(int s = task->from; s < task->to; s += EVAL_BATCH) {
+        int batch = task->to - s < EVAL_BATCH ? task->to - s : EVAL_BATCH;
+        nn_predict_batch(nn, task->X + s, batch, out, workspace);
+
+        // take the argmax for each sample
+        for(int b = 0; b < batch; b++) {
+            int real = task->labels ? task->labels[s + b] :
+                (int)cnet_argmax(task->Y[s + b], nn->out_size);
+            int pred = (int)cnet_argmax(out + b*nn->out_size, nn->out_size);
+            task->confusion[real*nn->out_size + pred]++;
+        }
+    }
+
+    cnet_numa_free(out, out_size);
+    cnet_numa_free(workspace, ws_size);
+}
+
+
+/**
+ * Run a range of evaluation tasks. */
+static void eval_tasks(
+    void *arg,
+    long from,
+    long to
+){
+    eval_task *tasks = arg;
+    for(long t = from; t < to; t++)
+        eval_range(&tasks[t]);
+}
+
+
+/**
+ * Evaluate a network, over one-hot (Y) or class index (labels) targets. */
+static cnet_report *evaluate(
+    cnet const *nn,
+    double **X,
+    double **Y,
+    int const *labels,
+    int size,
+    int n_threads
+){
+    int n_classes = nn->out_size;
+
+    // split the dataset between the threads of the pool
+    cnet_tpool *pool = cnet_tpool_get();
+    if (n_threads <= 0) n_threads = cnet_tpool_threads(pool);
+    if (n_threads > size) n_threads = size;
+    if (n_threads < 1) n_threads = 1;
+
+    eval_task *tasks = malloc(sizeof(eval_task)*n_threads);
+    for(int t = 0; t < n_threads; t++) {
+        tasks[t] = (eval_task){
+            .nn = nn,
+            .X = X,
+            .Y = Y,
+            .labels = labels,
+            .from = (int)((long)size * t / n_threads),
+            .to = (int)((long)size * (t + 1) / n_threads),
+            .confusion = calloc(n_classes * n_classes, sizeof(int))
+        };
+    }
+    cnet_parallel_for(pool, 0, n_threads, 1, eval_tasks, tasks);
+
+    // merge the confusion matrices
+    cnet_report *report = malloc(sizeof(cnet_report));
+    report->n_classes = n_classes;
+    report->samples = size;
+    report->confusion = calloc(n_classes * n_classes, sizeof(int));
+    for(int t = 0; t < n_threads; t++) {
+        for(int i = 0; i < n_classes * n_classes; i++)
+            report->confusion[i] += tasks[t].confusion[i];
+        free(tasks[t].confusion);
+    }
+    free(tasks);
+
+    // compute the classification report
+    report->support = calloc(n_classes, sizeof(int));
+    report->precision = malloc(sizeof(double)*n_classes);
+    report->recall = malloc(sizeof(double)*n_classes);
+    report->f1 = malloc(sizeof(double)*n_classes);
+
+    int correct = 0;
+    for(int i = 0; i < n_classes; i++) {
+        int tp = report->confusion[i*n_classes + i];
+        int fp = 0, fn = 0;
+        for(int j = 0; j < n_classes; j++) {
+            report->support[i] += report->confusion[i*n_classes + j];
+            fp += j != i ? report->confusion[j*n_classes + i] : 0;
+            fn += j != i ? report->confusion[i*n_classes + j] : 0;
+        }
+
+        double precision = tp + fp ? (double)tp / (tp + fp) : 0;
+        double recall = tp + fn ? (double)tp / (tp + fn) : 0;
+        report->precision[i] = precision;
+        report->recall[i] = recall;
+        report->f1[i] = precision + recall ?
+            2*(recall * precision) / (recall + precision) : 0;
+        correct += tp;
+    }
+    report->accuracy = size ? (double)correct / size : 0;
+
+    return report;
+}
+
+
+/**
+ * Evaluate a network over a dataset. */
+cnet_report *nn_evaluate(
+    cnet const *nn,
+    double **X,
+    double **Y,
+    int size,
+    int n_threads
+){
+    return evaluate(nn, X, Y, NULL, size, n_threads);
+}
+
+
+/**
+ * Evaluate a network over a dataset with class index targets. */
+cnet_report *nn_evaluate_labels(
+    cnet const *nn,
+    double **X,
+    int const *labels,
+    int size,
+    int n_threads
+){
+    int bad = cnet_check_labels(labels, size, nn->out_size);
+    if (bad >= 0) {
+        fprintf(stderr, "Invalid class label: %d (sample %d)\n", labels[bad], bad);
+        return NULL;
+    }
+    return evaluate(nn, X, NULL, labels, size, n_threads);
+}
+
+
+/**
+ * Free a classification report. */
+void cnet_report_free(
+    cnet_report *report
+){
+    free(report->confusion);
+    free(report->support);
+    free(report->precision);
+    free(report->recall);
+    free(report->f1);
+    free(report);
+}
+
+
+/**
+ * Print a classification report. */
+void cnet_report_print(
+    cnet_report const *report,
+    char const *label,
+    FILE *out
+){
+    fprintf(out,
+        "CLASSIFICATION REPORT \n\n"
+        "         precision  recall     f1-score   support \n"
+    );
+
+    for(int i = 0; i < report->n_classes; i++) {
+        fprintf(
+            out,
+            "%s %d  %lf  %lf  %lf  %d \n",
+            label,
+            i,
+            report->precision[i],
+            report->recall[i],
+            report->f1[i],
+            report->support[i]
+        );
+    }
+
+    fprintf(
+        out,
+        "\n\nFinal Accuracy: %lf - Samples: %d",
+        report->accuracy,
+        report->samples
+    );
+}
+
+
+/**
+ * Save the confusion matrix. */
+void cnet_report_save_confusion(
+    cnet_report const *report,
+    FILE *out
+){
+    int n = report->n_classes;
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < n; j++) {
+            fprintf(
+                out,
+                "%lf ",
+                report->support[i] ?
+                    (double)report->confusion[i*n + j] / report->support[i] : 0
+            );
+        }
+        fprintf(out, "\n");
+    }
 }
@@ -0,0 +1,150 @@
+/*****************************************************************************
+ *                                  MODEL
+ * Implementation of the model handles.
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "../include/model.h"
+
+
+/**
+ * Version of a model: a network and its references (the handle holds one
+ * while it is the current version). */
+struct cnet_version {
+    cnet *nn;
+    long serial;
+    atomic_long refs;
+};
+
+
+struct cnet_model {
+
+    /* current version */
+    _Atomic(struct cnet_version *) current;
+
+    /* readers in the middle of an acquisition, counted by the parity of
+       the epoch they started in */
+    atomic_uint epoch;
+    atomic_long acquiring[2];
+
+    /* publications, one at a time */
+    pthread_mutex_t publish;
+    long serial;
+};
+
+
+/**
+ * Drop a version reference, the last one frees it. */
+static void version_put(
+    struct cnet_version *version
+){
+    if (atomic_fetch_sub(&version->refs, 1) > 1) return;
+    nn_free(version->nn);
+    free(version);
+}
+
+
+/**
+ * Create a model handle. */
+cnet_model *cnet_model_init(
+    cnet *nn
+){
+    struct cnet_version *version = malloc(sizeof(struct cnet_version));
+    version->nn = nn;
+    version->serial = 1;
+    atomic_init(&version->refs, 1);
+
+    cnet_model *model = malloc(sizeof(cnet_model));
+    atomic_init(&model->current, version);
+    atomic_init(&model->epoch, 0);
+    atomic_init(&model->acquiring[0], 0);
+    atomic_init(&model->acquiring[1], 0);
+    pthread_mutex_init(&model->publish, NULL);
+    model->serial = 1;
+    return model;
+}
+
+
+/**
+ * Free a model handle. */
+void cnet_model_free(
+    cnet_model *model
+){
+    version_put(atomic_load(&model->current));
+    pthread_mutex_destroy(&model->publish);
+    free(model);
+}
+
+
+/**
+ * Acquire the current version: the acquisition counter keeps the loaded
+ * version alive until it holds its own reference. */
+cnet_ref cnet_model_acquire(
+    cnet_model *model
+){
+    unsigned parity = atomic_load(&model->epoch) & 1;
+    atomic_fetch_add(&model->acquiring[parity], 1);
+    struct cnet_version *version = atomic_load(&model->current);
+    atomic_fetch_add(&version->refs, 1);
+    atomic_fetch_sub(&model->acquiring[parity], 1);
+    return (cnet_ref){version->nn, version->serial, version};
+}
+
+
+/**
+ * Release a reference. */
+void cnet_model_release(
+    cnet_ref *ref
+){
+    if (!ref->version) return;
+    version_put(ref->version);
+    ref->version = NULL;
+    ref->nn = NULL;
+}
+
+
+/**
+ * Publish a new network. */
+long cnet_model_publish(
+    cnet_model *model,
+    cnet *nn
+){
+    struct cnet_version *version = malloc(sizeof(struct cnet_version));
+    version->nn = nn;
+    atomic_init(&version->refs, 1);
+
+    pthread_mutex_lock(&model->publish);
+    long serial = version->serial = ++model->serial;
+    struct cnet_version *previous = atomic_exchange(&model->current, version);
+
+    // a reader still acquiring may have loaded the previous version: wait
+    // for both acquisition counters to be seen empty, flipping the epoch
+    // first so that new readers count on the other one
+    for(int round = 0; round < 2; round++) {
+        unsigned parity = atomic_fetch_add(&model->epoch, 1) & 1;
+        while (atomic_load(&model->acquiring[parity]))
+            sched_yield();
+    }
+    pthread_mutex_unlock(&model->publish);
+
+    version_put(previous);
+    return serial;
+}
+
+
+/**
+ * Load a saved network and publish it. */
+long cnet_model_load(
+    cnet_model *model,
+    char const *path
+){
+    FILE *in = fopen(path, "r");
+    if (!in) return -1;
+    cnet *nn = nn_load(in);
+    fclose(in);
+    if (!nn) return -1;
+    return cnet_model_publish(model, nn);
+}
@@ -0,0 +1,438 @@
+/*****************************************************************************
+ *                                PIPELINE
+ * Implementation of the pipeline parallel training stages.
+ ****************************************************************************/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/pipeline.h"
+#include "../include/blas.h"
+#include "../include/team.h"
+
+
+/**
+ * Bounded queue of micro-batch indices, from one stage to another. */
+typedef struct pipe_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int *items;
+    int head, size, capacity;
+} pipe_queue;
+
+
+struct cnet_pipeline {
+    cnet const *nn;
+    int n_stages, micro_batch, max_batch;
+
+    /* first layer of every stage (then nn->n_layers) */
+    int *first;
+
+    /* stage threads */
+    cnet_team *team;
+
+    /* batch inputs, and every layer outputs and deltas, by sample rows
+       (max_batch rows): each micro-batch keeps its own rows until its
+       backward pass */
+    double *input;
+    double **outputs, **deltas;
+
+    /* inbound queues of every stage, forward and backward */
+    pipe_queue *forward, *backward;
+
+    /* loss and metric of every sample of the batch */
+    double *loss, *metric;
+
+    /* current batch */
+    double **X, **Y;
+    int const *labels, *samples;
+    int size;
+    enum cnet_loss_type loss_type;
+    enum cnet_metric_type metric_type;
+    int fused;
+};
+
+
+/// Queues
+
+static void pipe_queue_init(
+    pipe_queue *queue,
+    int capacity
+){
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->items = malloc(sizeof(int)*capacity);
+    queue->head = queue->size = 0;
+    queue->capacity = capacity;
+}
+
+
+static void pipe_queue_free(
+    pipe_queue *queue
+){
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->items);
+}
+
+
+/**
+ * Hand a micro-batch over, waiting while the queue is full. */
+static void pipe_push(
+    pipe_queue *queue,
+    int micro
+){
+    pthread_mutex_lock(&queue->lock);
+    while (queue->size == queue->capacity)
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    queue->items[(queue->head + queue->size++) % queue->capacity] = micro;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+
+/**
+ * Take the next micro-batch, waiting while the queue is empty. */
+static int pipe_pop(
+    pipe_queue *queue
+){
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->size)
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    int micro = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->size--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return micro;
+}
+
+
+/// Stages
+
+/**
+ * Forward a micro-batch through the layers of a stage. */
+static void pipe_forward(
+    cnet_pipeline *pipe,
+    int stage,
+    int from,
+    int rows
+){
+    cnet const *nn = pipe->nn;
+
+    // the first stage gathers the micro-batch inputs
+    if (!stage)
+        for(int b = 0; b < rows; b++)
+            memcpy(
+                pipe->input + (from + b)*nn->in_size,
+                pipe->X[pipe->samples[from + b]],
+                sizeof(double)*nn->in_size
+            );
+
+    for(int l = pipe->first[stage]; l < pipe->first[stage + 1]; l++) {
+        clayer const *layer = nn->layers[l];
+        double const *in = l ?
+            pipe->outputs[l - 1] + from*layer->in_size :
+            pipe->input + from*layer->in_size;
+        double *out = pipe->outputs[l] + from*layer->out_size;
+
+        // out (rows x out_size) = in (rows x in_size) * weights^T
+        cnet_gemm(
+            0, 1,
+            rows, layer->out_size, layer->in_size,
+            1, in, layer->in_size,
+            layer->weights[0], layer->in_size,
+            0, out, layer->out_size
+        );
+        for(int b = 0; b < rows; b++)
+            cnet_axpy(layer->out_size, 1, layer->bias, out + b*layer->out_size);
+
+        // the fused loss takes the logits
+        if (l == nn->n_layers - 1 && pipe->fused) continue;
+        cnet_act_func *act = cnet_get_act(layer->activation);
+        for(int b = 0; b < rows; b++)
+            act(out + b*layer->out_size, layer->out_size);
+    }
+}
+
+
+/**
+ * Loss and metric of a micro-batch, leaving the loss derivative in the
+ * output layer deltas (last stage). */
+static void pipe_loss(
+    cnet_pipeline *pipe,
+    int from,
+    int rows
+){
+    cnet const *nn = pipe->nn;
+    int size = nn->out_size;
+
+    for(int i = from; i < from + rows; i++) {
+        int sample = pipe->samples[i];
+        double *out = pipe->outputs[nn->n_layers - 1] + i*size;
+        double *delta = pipe->deltas[nn->n_layers - 1] + i*size;
+
+        if (pipe->Y) {
+            double const *Y = pipe->Y[sample];
+            if (pipe->fused) {
+                pipe->loss[i] = cnet_softmax_cross_entropy(out, Y, delta, size);
+            } else {
+                cnet_get_loss_dx(pipe->loss_type)(out, Y, delta, size);
+                pipe->loss[i] = cnet_get_loss(pipe->loss_type)(out, Y, size);
+            }
+            pipe->metric[i] = cnet_get_metric(pipe->metric_type)(out, Y, size);
+            continue;
+        }
+
+        int label = pipe->labels[sample];
+        if (pipe->fused) {
+            pipe->loss[i] = cnet_softmax_sparse_cross_entropy(out, label, delta, size);
+        } else {
+            cnet_get_loss_sparse_dx(pipe->loss_type)(out, label, delta, size);
+            pipe->loss[i] = cnet_get_loss_sparse(pipe->loss_type)(out, label, size);
+        }
+        pipe->metric[i] = cnet_get_metric_sparse(pipe->metric_type)(out, label, size);
+    }
+}
+
+
+/**
+ * Backpropagate a micro-batch through the layers of a stage, from the
+ * deltas over their outputs, accumulating the layers gradients. */
+static void pipe_backward(
+    cnet_pipeline *pipe,
+    int stage,
+    int from,
+    int rows
+){
+    cnet const *nn = pipe->nn;
+
+    for(int l = pipe->first[stage + 1]; l-->pipe->first[stage];) {
+        clayer const *layer = nn->layers[l];
+        int in_size = layer->in_size, out_size = layer->out_size;
+        double const *in = l ?
+            pipe->outputs[l - 1] + from*in_size :
+            pipe->input + from*in_size;
+        double const *out = pipe->outputs[l] + from*out_size;
+        double *delta = pipe->deltas[l] + from*out_size;
+
+        // delta over the logits (already there for the fused loss)
+        if (l < nn->n_layers - 1 || !pipe->fused) {
+            cnet_act_func_dx *act_dx = cnet_get_act_dx(layer->activation);
+            for(int b = 0; b < rows; b++)
+                act_dx(out + b*out_size, delta + b*out_size, out_size);
+        }
+
+        // dw (out_size x in_size) += delta^T * in, db += delta rows
+        double *dw = layer->grad, *db = layer->grad + out_size*in_size;
+        cnet_gemm(
+            1, 0,
+            out_size, in_size, rows,
+            1, delta, out_size,
+            in, in_size,
+            1, dw, in_size
+        );
+        for(int b = 0; b < rows; b++)
+            cnet_axpy(out_size, 1, delta + b*out_size, db);
+
+        // previous layer delta (rows x in_size) = delta * weights
+        if (l)
+            cnet_gemm(
+                0, 0,
+                rows, in_size, out_size,
+                1, delta, out_size,
+                layer->weights[0], in_size,
+                0, pipe->deltas[l - 1] + from*in_size, in_size
+            );
+    }
+}
+
+
+/**
+ * Stage thread: forwards every micro-batch, then backpropagates them as
+ * their deltas come back (the last stage backpropagates each micro-batch
+ * right after its loss). */
+static void pipe_stage(
+    void *arg,
+    int stage,
+    int n_threads
+){
+    cnet_pipeline *pipe = arg;
+    int mb = pipe->micro_batch;
+    int micros = (pipe->size + mb - 1) / mb;
+    int last = stage == pipe->n_stages - 1;
+    (void)n_threads;
+
+    for(int i = 0; i < micros; i++) {
+        int m = stage ? pipe_pop(&pipe->forward[stage]) : i;
+        int rows = pipe->size - m*mb < mb ? pipe->size - m*mb : mb;
+        pipe_forward(pipe, stage, m*mb, rows);
+        if (!last) {
+            pipe_push(&pipe->forward[stage + 1], m);
+            continue;
+        }
+
+        pipe_loss(pipe, m*mb, rows);
+        pipe_backward(pipe, stage, m*mb, rows);
+        if (stage) pipe_push(&pipe->backward[stage - 1], m);
+    }
+
+    for(int i = 0; !last && i < micros; i++) {
+        int m = pipe_pop(&pipe->backward[stage]);
+        int rows = pipe->size - m*mb < mb ? pipe->size - m*mb : mb;
+        pipe_backward(pipe, stage, m*mb, rows);
+        if (stage) pipe_push(&pipe->backward[stage - 1], m);
+    }
+}
+
+
+/// Pipeline
+
+/**
+ * Split the layers into stages of about the same number of weights, each
+ * one getting at least a layer. */
+static void pipe_partition(
+    cnet_pipeline *pipe
+){
+    cnet const *nn = pipe->nn;
+    double total = 0, done = 0;
+    for(int l = 0; l < nn->n_layers; l++)
+        total += (double)nn->layers[l]->w_rows * nn->layers[l]->w_cols;
+
+    int l = 0;
+    for(int s = 0; s < pipe->n_stages; s++) {
+        pipe->first[s] = l;
+        double target = total * (s + 1) / pipe->n_stages;
+        int limit = nn->n_layers - (pipe->n_stages - s - 1);
+
+        // take the layers whose middle falls before the stage target
+        do {
+            done += (double)nn->layers[l]->w_rows * nn->layers[l]->w_cols;
+            l++;
+        } while (
+            l < limit &&
+            (s == pipe->n_stages - 1 ||
+             done + (double)nn->layers[l]->w_rows * nn->layers[l]->w_cols / 2 <= target)
+        );
+    }
+    pipe->first[pipe->n_stages] = nn->n_layers;
+}
+
+
+/**
+ * Create a training pipeline. */
+cnet_pipeline *cnet_pipeline_init(
+    cnet const *nn,
+    int stages,
+    int micro_batch,
+    int max_batch
+){
+    assert(stages >= 1 && micro_batch >= 1 && max_batch >= 1);
+    for(int l = 0; l < nn->n_layers; l++)
+        assert(nn->layers[l]->type == dense_layer && !nn->layers[l]->half);
+
+    cnet_pipeline *pipe = malloc(sizeof(cnet_pipeline));
+    pipe->nn = nn;
+    pipe->micro_batch = micro_batch < max_batch ? micro_batch : max_batch;
+    pipe->max_batch = max_batch;
+
+    // a thread per stage, as many as could be started
+    pipe->team = cnet_team_init(stages < nn->n_layers ? stages : nn->n_layers, NULL);
+    pipe->n_stages = cnet_team_threads(pipe->team);
+    pipe->first = malloc(sizeof(int)*(pipe->n_stages + 1));
+    pipe_partition(pipe);
+
+    pipe->input = malloc(sizeof(double)*max_batch*nn->in_size);
+    pipe->outputs = malloc(sizeof(double*)*nn->n_layers);
+    pipe->deltas = malloc(sizeof(double*)*nn->n_layers);
+    for(int l = 0; l < nn->n_layers; l++) {
+        pipe->outputs[l] = malloc(sizeof(double)*max_batch*nn->layers[l]->out_size);
+        pipe->deltas[l] = malloc(sizeof(double)*max_batch*nn->layers[l]->out_size);
+    }
+
+    // room for all the micro-batches of a batch: a stage still forwarding
+    // never blocks the deltas coming back
+    int micros = (max_batch + pipe->micro_batch - 1) / pipe->micro_batch;
+    pipe->forward = malloc(sizeof(pipe_queue)*pipe->n_stages);
+    pipe->backward = malloc(sizeof(pipe_queue)*pipe->n_stages);
+    for(int s = 0; s < pipe->n_stages; s++) {
+        pipe_queue_init(&pipe->forward[s], micros);
+        pipe_queue_init(&pipe->backward[s], micros);
+    }
+
+    pipe->loss = malloc(sizeof(double)*max_batch);
+    pipe->metric = malloc(sizeof(double)*max_batch);
+    return pipe;
+}
+
+
+/**
+ * Free a training pipeline. */
+void cnet_pipeline_free(
+    cnet_pipeline *pipe
+){
+    cnet_team_free(pipe->team);
+    for(int s = 0; s < pipe->n_stages; s++) {
+        pipe_queue_free(&pipe->forward[s]);
+        pipe_queue_free(&pipe->backward[s]);
+    }
+    for(int l = 0; l < pipe->nn->n_layers; l++) {
+        free(pipe->outputs[l]);
+        free(pipe->deltas[l]);
+    }
+    free(pipe->metric);
+    free(pipe->loss);
+    free(pipe->backward);
+    free(pipe->forward);
+    free(pipe->deltas);
+    free(pipe->outputs);
+    free(pipe->input);
+    free(pipe->first);
+    free(pipe);
+}
+
+
+/**
+ * Number of stages of a pipeline. */
+int cnet_pipeline_stages(
+    cnet_pipeline const *pipe
+){
+    return pipe->n_stages;
+}
+
+
+/**
+ * Pipeline Batch */
+void cnet_pipeline_batch(
+    cnet_pipeline *pipe,
+    double **X,
+    double **Y,
+    int const *labels,
+    int const *samples,
+    int size,
+    enum cnet_loss_type loss_type,
+    enum cnet_metric_type metric_type,
+    double *loss,
+    double *metric
+){
+    cnet const *nn = pipe->nn;
+    assert(size <= pipe->max_batch);
+
+    pipe->X = X;
+    pipe->Y = Y;
+    pipe->labels = labels;
+    pipe->samples = samples;
+    pipe->size = size;
+    pipe->loss_type = loss_type;
+    pipe->metric_type = metric_type;
+    pipe->fused = loss_type == cross_entropy_loss &&
+                  nn->layers[nn->n_layers - 1]->activation == softmax_act;
+    cnet_team_run(pipe->team, pipe_stage, pipe);
+
+    *loss = *metric = 0;
+    for(int i = 0; i < size; i++) {
+        *loss += pipe->loss[i];
+        *metric += pipe->metric[i];
+    }
+}
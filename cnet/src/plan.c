@@ -0,0 +1,413 @@
+/*****************************************************************************
+ *                                  PLAN
+ * Implementation of the compiled execution plans.
+ ****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/plan.h"
+#include "../include/activation.h"
+#include "../include/blas.h"
+#include "../include/conv.h"
+#include "../include/embedding.h"
+#include "../include/half.h"
+#include "../include/sparse.h"
+#include "../include/tpool.h"
+
+/* min multiply-adds per range of the parallel dense kernel */
+#define PLAN_RANGE_SIZE (1L << 16)
+
+
+typedef struct plan_step plan_step;
+
+
+/**
+ * Step kernel
+ *
+ * Computes the output of a step layer for a batch of inputs.
+ *
+ * @param plan_step const *: Step
+ * @param double const *: Inputs (sized batch x layer->in_size)
+ * @param int: Number of samples
+ */
+typedef void plan_kernel(plan_step const *, double const *, int);
+
+
+struct plan_step {
+
+    /* kernel and the layer it runs */
+    plan_kernel *kernel;
+    clayer const *layer;
+
+    /* output and im2col buffers */
+    double *out, *cols;
+
+    /* activation left after the kernel (NULL if fused into it) */
+    cnet_act_func *activate;
+
+    /* output neurons function of the parallel dense kernel */
+    cnet_range_func *rows;
+};
+
+
+struct cnet_plan {
+
+    /* input/output dimensions and max batch size */
+    int in_size, out_size, max_batch;
+
+    /* steps, one per layer */
+    int n_steps;
+    plan_step *steps;
+
+    /* gathered batch inputs, and ping-pong / im2col buffers */
+    double *input, *buffers;
+};
+
+
+/// Dense kernels
+
+
+/**
+ * Apply an elementwise activation to a single value. */
+static inline double act_apply(
+    double z,
+    enum cnet_act_type act
+){
+    switch(act) {
+        case relu_act: return z > 0 ? z : 0;
+        case sigmoid_act: return 1/(1 + expf(-z));
+        default: return z;
+    }
+}
+
+
+/**
+ * Dot product with independent accumulators. */
+static inline double dot4(
+    double const *w,
+    double const *x,
+    int n
+){
+    double z0 = 0, z1 = 0, z2 = 0, z3 = 0;
+    int j = 0;
+    for(; j + 3 < n; j += 4) {
+        z0 += w[j] * x[j];
+        z1 += w[j + 1] * x[j + 1];
+        z2 += w[j + 2] * x[j + 2];
+        z3 += w[j + 3] * x[j + 3];
+    }
+    for(; j < n; j++)
+        z0 += w[j] * x[j];
+    return (z0 + z1) + (z2 + z3);
+}
+
+
+/**
+ * Dense kernel, with the activation fused into the output store.
+ * Batches are computed four samples at a time, so every loaded weight is
+ * used four times. Inlined with a constant activation by the kernels below.
+ * Computes the output neurons [from, to) of the step.
+ */
+static inline void dense_kernel(
+    plan_step const *step,
+    double const *in,
+    int batch,
+    int from,
+    int to,
+    enum cnet_act_type act
+){
+    clayer const *layer = step->layer;
+    int n = layer->in_size, m = layer->out_size;
+    double *out = step->out;
+
+    for(int k = from; k < to; k++) {
+        double const *w = layer->weights[k];
+        double bias = layer->bias[k];
+
+        int b = 0;
+        for(; b + 3 < batch; b += 4) {
+            double const *x0 = in + b*n, *x1 = x0 + n, *x2 = x1 + n, *x3 = x2 + n;
+            double z0 = 0, z1 = 0, z2 = 0, z3 = 0;
+            for(int j = 0; j < n; j++) {
+                double wj = w[j];
+                z0 += wj * x0[j];
+                z1 += wj * x1[j];
+                z2 += wj * x2[j];
+                z3 += wj * x3[j];
+            }
+            out[b*m + k] = act_apply(z0 + bias, act);
+            out[(b + 1)*m + k] = act_apply(z1 + bias, act);
+            out[(b + 2)*m + k] = act_apply(z2 + bias, act);
+            out[(b + 3)*m + k] = act_apply(z3 + bias, act);
+        }
+        for(; b < batch; b++)
+            out[b*m + k] = act_apply(dot4(w, in + b*n, n) + bias, act);
+    }
+}
+
+
+/**
+ * Dense step call, split by output neurons over the pool. */
+typedef struct dense_call {
+    plan_step const *step;
+    double const *in;
+    int batch;
+} dense_call;
+
+
+static void dense_linear(void *arg, long from, long to) {
+    dense_call const *c = arg;
+    dense_kernel(c->step, c->in, c->batch, (int)from, (int)to, linear_act);
+}
+
+
+static void dense_relu(void *arg, long from, long to) {
+    dense_call const *c = arg;
+    dense_kernel(c->step, c->in, c->batch, (int)from, (int)to, relu_act);
+}
+
+
+static void dense_sigmoid(void *arg, long from, long to) {
+    dense_call const *c = arg;
+    dense_kernel(c->step, c->in, c->batch, (int)from, (int)to, sigmoid_act);
+}
+
+
+/**
+ * Dense kernel: ranges of output neurons run on the library pool, each
+ * one large enough to be worth a task. */
+static void dense_parallel(plan_step const *step, double const *in, int batch) {
+    dense_call call = {step, in, batch};
+    long grain = PLAN_RANGE_SIZE / ((long)batch * step->layer->in_size) + 1;
+    cnet_parallel_for(
+        cnet_tpool_get(),
+        0,
+        step->layer->out_size,
+        grain,
+        step->rows,
+        &call
+    );
+}
+
+
+/**
+ * Dense kernel over 16 bit weights: each row is widened into the step
+ * buffer once, then used by the whole batch (activation left apart). */
+static void dense_half(plan_step const *step, double const *in, int batch) {
+    clayer const *layer = step->layer;
+    int n = layer->in_size, m = layer->out_size;
+
+    for(int k = 0; k < m; k++) {
+        cnet_half_widen(layer->half_type, layer->half + k*n, step->cols, n);
+        for(int b = 0; b < batch; b++)
+            step->out[b*m + k] = dot4(step->cols, in + b*n, n) + layer->bias[k];
+    }
+}
+
+
+/**
+ * Dense kernel through the gemm, for layers autotuned for the plan batch
+ * size (see tune.h). */
+static void dense_gemm(plan_step const *step, double const *in, int batch) {
+    clayer const *layer = step->layer;
+    cnet_gemm(
+        0, 1,
+        batch, layer->out_size, layer->in_size,
+        1, in, layer->in_size,
+        layer->weights[0], layer->in_size,
+        0, step->out, layer->out_size
+    );
+    for(int b = 0; b < batch; b++)
+        cnet_axpy(layer->out_size, 1, layer->bias, step->out + b*layer->out_size);
+}
+
+
+/// Other layers kernels
+
+
+static void conv_kernel(plan_step const *step, double const *in, int batch) {
+    clayer const *layer = step->layer;
+    for(int b = 0; b < batch; b++)
+        cnet_conv_forward(
+            layer,
+            in + b*layer->in_size,
+            step->out + b*layer->out_size,
+            step->cols
+        );
+}
+
+
+static void pool_kernel(plan_step const *step, double const *in, int batch) {
+    clayer const *layer = step->layer;
+    for(int b = 0; b < batch; b++)
+        cnet_pool_forward(
+            layer,
+            in + b*layer->in_size,
+            step->out + b*layer->out_size
+        );
+}
+
+
+static void csr_kernel(plan_step const *step, double const *in, int batch) {
+    cnet_csr_forward(step->layer, in, step->out, batch);
+}
+
+
+static void embedding_kernel(plan_step const *step, double const *in, int batch) {
+    cnet_embedding_forward(step->layer, in, step->out, batch);
+}
+
+
+/// Plan
+
+
+/**
+ * Pick the kernel for a layer.
+ *
+ * Elementwise activations of dense layers are fused into their kernel,
+ * everything else (including 16 bit dense layers, and dense layers with
+ * tuned gemm parameters for the max batch) keeps its activation as a
+ * separate pass.
+ *
+ * @param plan_step *step: Step to fill
+ * @param clayer const *layer: Layer
+ * @param int max_batch: Max number of samples per prediction
+ */
+static void plan_select(
+    plan_step *step,
+    clayer const *layer,
+    int max_batch
+){
+    step->layer = layer;
+    step->activate = layer->activation == linear_act ?
+        NULL : cnet_get_act(layer->activation);
+
+    switch(layer->type) {
+        case dense_layer:
+            if (layer->half) {
+                step->kernel = dense_half;
+                break;
+            }
+            if (cnet_gemm_lookup(
+                    0, 1, max_batch, layer->out_size, layer->in_size)) {
+                step->kernel = dense_gemm;
+                break;
+            }
+            switch(layer->activation) {
+                case relu_act: step->rows = dense_relu; break;
+                case sigmoid_act: step->rows = dense_sigmoid; break;
+                default: step->rows = dense_linear; break;
+            }
+            if (step->rows != dense_linear) step->activate = NULL;
+            step->kernel = dense_parallel;
+            break;
+        case conv2d_layer: step->kernel = conv_kernel; break;
+        case maxpool_layer:
+        case avgpool_layer: step->kernel = pool_kernel; break;
+        case sparse_layer: step->kernel = csr_kernel; break;
+        case embedding_layer: step->kernel = embedding_kernel; break;
+    }
+}
+
+
+/**
+ * Compile a network. */
+cnet_plan *nn_compile(
+    cnet const *nn,
+    int max_batch
+){
+    cnet_plan *plan = malloc(sizeof(cnet_plan));
+    plan->in_size = nn->in_size;
+    plan->out_size = nn->out_size;
+    plan->max_batch = max_batch;
+    plan->n_steps = nn->last_layer;
+    plan->steps = malloc(sizeof(plan_step)*plan->n_steps);
+
+    // size the ping-pong buffers after the widest layer
+    int width = 0, cols = 0;
+    for(int i = 0; i < nn->last_layer; i++) {
+        clayer const *layer = nn->layers[i];
+        width = layer->out_size > width ? layer->out_size : width;
+        if (layer->type == conv2d_layer) {
+            int size = layer->w_cols *
+                layer->out_shape.height * layer->out_shape.width;
+            cols = size > cols ? size : cols;
+        }
+        if (layer->half)
+            cols = layer->w_cols > cols ? layer->w_cols : cols;
+    }
+    plan->input = malloc(sizeof(double)*max_batch*nn->in_size);
+    plan->buffers = malloc(sizeof(double)*(2*max_batch*width + cols));
+
+    // every layer writes into the buffer its previous layer did not use
+    for(int i = 0; i < plan->n_steps; i++) {
+        plan_step *step = &plan->steps[i];
+        plan_select(step, nn->layers[i], max_batch);
+        step->out = plan->buffers + (i % 2)*max_batch*width;
+        step->cols = plan->buffers + 2*max_batch*width;
+    }
+
+    return plan;
+}
+
+
+/**
+ * Plan Prediction. */
+const double *cnet_plan_predict(
+    cnet_plan *plan,
+    double const *X
+){
+    double *in[1] = {(double *)X};
+    return cnet_plan_predict_batch(plan, in, 1);
+}
+
+
+/**
+ * Plan Batch Prediction. */
+const double *cnet_plan_predict_batch(
+    cnet_plan *plan,
+    double **X,
+    int batch
+){
+    assert(batch >= 1 && batch <= plan->max_batch);
+
+    // single samples are read in place, batches are gathered first
+    double const *in = X[0];
+    if (batch > 1) {
+        for(int b = 0; b < batch; b++)
+            memcpy(
+                plan->input + b*plan->in_size,
+                X[b],
+                sizeof(double)*plan->in_size
+            );
+        in = plan->input;
+    }
+
+    for(int i = 0; i < plan->n_steps; i++) {
+        plan_step const *step = &plan->steps[i];
+        step->kernel(step, in, batch);
+
+        if (step->activate) {
+            int size = step->layer->out_size;
+            for(int b = 0; b < batch; b++)
+                step->activate(step->out + b*size, size);
+        }
+        in = step->out;
+    }
+
+    return in;
+}
+
+
+/**
+ * Free a plan. */
+void cnet_plan_free(
+    cnet_plan *plan
+){
+    free(plan->steps);
+    free(plan->input);
+    free(plan->buffers);
+    free(plan);
+}
@@ -0,0 +1,234 @@
+/*****************************************************************************
+ *                                 RANDOM
+ * Implementation of the xoshiro256+ generators.
+ ****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "../include/random.h"
+#include "../include/tpool.h"
+
+#define RNG_LANES 4
+#define RNG_CHUNK (1 << 16)
+
+
+/* global seed, and its generation to detect reseeds from other threads */
+static atomic_uint_fast64_t global_seed = CNET_DEFAULT_SEED;
+static atomic_long global_gen = 0;
+static atomic_long next_stream = 0;
+
+static _Thread_local cnet_rng local_rng;
+static _Thread_local long local_gen = -1;
+
+
+static inline uint64_t rotl(
+    uint64_t x,
+    int k
+){
+    return (x << k) | (x >> (64 - k));
+}
+
+
+/**
+ * SplitMix64 step, used to expand seeds into full states. */
+static inline uint64_t splitmix64(
+    uint64_t *x
+){
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * Map the top 52 bits to a double in [0, 1).
+ * Built from the bit pattern of a double in [1, 2), which vectorizes
+ * (unlike 64 bit integer conversions). */
+static inline double to_unit(
+    uint64_t bits
+){
+    union { uint64_t u; double d; } v = {
+        .u = (bits >> 12) | 0x3FF0000000000000ull
+    };
+    return v.d - 1.0;
+}
+
+
+/// Generators
+
+
+/**
+ * Set the global seed. */
+void cnet_seed(
+    uint64_t seed
+){
+    atomic_store(&global_seed, seed);
+    atomic_store(&next_stream, 1);
+    local_gen = atomic_fetch_add(&global_gen, 1) + 1;
+    cnet_rng_init(&local_rng, seed, 0);
+}
+
+
+/**
+ * Initialize a generator. */
+void cnet_rng_init(
+    cnet_rng *rng,
+    uint64_t seed,
+    uint64_t stream
+){
+    uint64_t a = seed, b = stream ^ 0x5851F42D4C957F2Dull;
+    uint64_t x = splitmix64(&a) ^ rotl(splitmix64(&b), 32);
+    for(int i = 0; i < 4; i++)
+        rng->s[i] = splitmix64(&x);
+}
+
+
+/**
+ * Thread Generator. */
+cnet_rng *cnet_rng_local(void) {
+    long gen = atomic_load(&global_gen);
+    if (local_gen != gen) {
+        local_gen = gen;
+        cnet_rng_init(
+            &local_rng,
+            atomic_load(&global_seed),
+            atomic_fetch_add(&next_stream, 1)
+        );
+    }
+    return &local_rng;
+}
+
+
+/**
+ * Next 64 random bits. */
+uint64_t cnet_rng_next(
+    cnet_rng *rng
+){
+    uint64_t *s = rng->s;
+    uint64_t res = s[0] + s[3];
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return res;
+}
+
+
+/**
+ * Uniform double in [0, 1). */
+double cnet_rng_uniform(
+    cnet_rng *rng
+){
+    return to_unit(cnet_rng_next(rng));
+}
+
+
+/**
+ * Uniform integer in [0, n) (Lemire's multiply and reject). */
+uint32_t cnet_rng_below(
+    cnet_rng *rng,
+    uint32_t n
+){
+    uint64_t m = (cnet_rng_next(rng) >> 32) * n;
+    if ((uint32_t)m < n) {
+        uint32_t threshold = -n % n;
+        while((uint32_t)m < threshold)
+            m = (cnet_rng_next(rng) >> 32) * n;
+    }
+    return (uint32_t)(m >> 32);
+}
+
+
+/// Bulk generation
+
+
+/**
+ * Bulk uniform generation. */
+void cnet_rng_fill(
+    cnet_rng *rng,
+    double *out,
+    long size,
+    double lo,
+    double hi
+){
+    double scale = hi - lo;
+    long i = 0;
+
+    // interleaved lanes (struct of arrays), seeded from the generator
+    if (size >= 4*RNG_LANES) {
+        uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+        for(int l = 0; l < RNG_LANES; l++) {
+            uint64_t x = cnet_rng_next(rng);
+            s0[l] = splitmix64(&x);
+            s1[l] = splitmix64(&x);
+            s2[l] = splitmix64(&x);
+            s3[l] = splitmix64(&x);
+        }
+
+        for(; i + RNG_LANES <= size; i += RNG_LANES) {
+            for(int l = 0; l < RNG_LANES; l++) {
+                uint64_t res = s0[l] + s3[l];
+                uint64_t t = s1[l] << 17;
+                s2[l] ^= s0[l];
+                s3[l] ^= s1[l];
+                s1[l] ^= s2[l];
+                s0[l] ^= s3[l];
+                s2[l] ^= t;
+                s3[l] = rotl(s3[l], 45);
+                out[i + l] = lo + scale * to_unit(res);
+            }
+        }
+    }
+
+    for(; i < size; i++)
+        out[i] = lo + scale * cnet_rng_uniform(rng);
+}
+
+
+/**
+ * Stream fill: every chunk is drawn from its own stream. */
+typedef struct fill_task {
+    uint64_t seed;
+    double *out;
+    long size;
+    double lo, hi;
+} fill_task;
+
+
+static void fill_chunks(
+    void *arg,
+    long from,
+    long to
+){
+    fill_task const *task = arg;
+    cnet_rng rng;
+    for(long c = from; c < to; c++) {
+        long first = c*RNG_CHUNK;
+        long n = task->size - first < RNG_CHUNK ? task->size - first : RNG_CHUNK;
+        cnet_rng_init(&rng, task->seed, c);
+        cnet_rng_fill(&rng, task->out + first, n, task->lo, task->hi);
+    }
+}
+
+
+/**
+ * Multi-threaded bulk uniform generation. */
+void cnet_rng_fill_streams(
+    uint64_t seed,
+    double *out,
+    long size,
+    double lo,
+    double hi
+){
+    fill_task task = {seed, out, size, lo, hi};
+    long chunks = (size + RNG_CHUNK - 1) / RNG_CHUNK;
+    cnet_parallel_for(cnet_tpool_get(), 0, chunks, 1, fill_chunks, &task);
+}
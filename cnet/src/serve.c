@@ -0,0 +1,717 @@
+/*****************************************************************************
+ *                                  SERVE
+ * Implementation of the inference server and its client.
+ ****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/serve.h"
+
+#define SERVE_MAX_PAYLOAD (1 << 26)     // bytes of a prediction input
+
+
+/**
+ * Prediction request, owned by its connection thread. */
+typedef struct serve_request {
+    double *X, *out;
+    int in_size, out_size, out_capacity;
+    double start;
+    int done, status;
+    pthread_cond_t ready;
+    struct serve_request *next;
+} serve_request;
+
+
+/**
+ * Client connection, served by its own thread. */
+typedef struct serve_conn {
+    cnet_server *server;
+    int fd;
+    atomic_int done;
+    pthread_t thread;
+    struct serve_conn *next;
+} serve_conn;
+
+
+struct cnet_server {
+
+    /* served network, or model handle (see model.h) */
+    cnet const *nn;
+    cnet_model *model;
+
+    cnet_server_config config;
+    int listener;
+    char *unix_path;
+
+    /* stop pipe, written by cnet_server_stop */
+    int stop[2];
+
+    /* connections */
+    serve_conn *conns;
+
+    /* pending requests, and the batching workers */
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    serve_request *head, *tail;
+    int queued, stopping;
+    pthread_t *workers;
+
+    /* statistics (under the lock) */
+    double started;
+    long requests, batches;
+    long histogram[CNET_SERVE_HISTOGRAM];
+};
+
+
+/**
+ * Microseconds since an arbitrary point. */
+static double serve_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/// Sockets
+
+/**
+ * Socket address, "unix:<path>" or "tcp:<host>:<port>". */
+static int serve_address(
+    char const *address,
+    struct sockaddr_storage *sa,
+    socklen_t *len
+){
+    memset(sa, 0, sizeof(*sa));
+
+    if (!strncmp(address, "unix:", 5)) {
+        struct sockaddr_un *un = (struct sockaddr_un *)sa;
+        if (strlen(address + 5) >= sizeof(un->sun_path)) return -1;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address + 5);
+        *len = sizeof(struct sockaddr_un);
+        return 0;
+    }
+    if (strncmp(address, "tcp:", 4)) return -1;
+
+    char host[256];
+    char const *colon = strrchr(address + 4, ':');
+    if (!colon || (size_t)(colon - address - 4) >= sizeof(host)) return -1;
+    memcpy(host, address + 4, colon - address - 4);
+    host[colon - address - 4] = 0;
+
+    struct addrinfo hints = {0}, *info;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, colon + 1, &hints, &info)) return -1;
+    memcpy(sa, info->ai_addr, info->ai_addrlen);
+    *len = info->ai_addrlen;
+    freeaddrinfo(info);
+    return 0;
+}
+
+
+/**
+ * Read exactly size bytes, -1 on failure or end of stream. */
+static int serve_read(
+    int fd,
+    void *buf,
+    size_t size
+){
+    for(size_t done = 0; done < size;) {
+        ssize_t n = recv(fd, (char *)buf + done, size - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+
+/**
+ * Write exactly size bytes, -1 on failure. */
+static int serve_write(
+    int fd,
+    void const *buf,
+    size_t size
+){
+    for(size_t done = 0; done < size;) {
+        ssize_t n = send(fd, (char const *)buf + done, size - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+
+/**
+ * Write a message: two uint32 (op or status, payload bytes), then the
+ * payload. */
+static int serve_message(
+    int fd,
+    uint32_t code,
+    void const *payload,
+    uint32_t bytes
+){
+    uint32_t header[2] = {code, bytes};
+    return serve_write(fd, header, sizeof(header)) || serve_write(fd, payload, bytes) ? -1 : 0;
+}
+
+
+/// Batching
+
+/**
+ * Reference to the served network. */
+static cnet_ref serve_acquire(
+    cnet_server *server
+){
+    if (server->model) return cnet_model_acquire(server->model);
+    return (cnet_ref){server->nn, 0, NULL};
+}
+
+
+/**
+ * Histogram bucket of a latency. */
+static int serve_bucket(
+    double us
+){
+    int bucket = (int)(4 * log2(us + 1));
+    return bucket < CNET_SERVE_HISTOGRAM ? bucket : CNET_SERVE_HISTOGRAM - 1;
+}
+
+
+/**
+ * Queue a prediction request and wait for its result. */
+static void serve_submit(
+    cnet_server *server,
+    serve_request *req
+){
+    pthread_mutex_lock(&server->lock);
+    req->start = serve_now_us();
+    req->done = 0;
+    req->next = NULL;
+    if (server->tail) server->tail->next = req;
+    else server->head = req;
+    server->tail = req;
+    server->queued++;
+    pthread_cond_broadcast(&server->arrived);
+
+    while (!req->done)
+        pthread_cond_wait(&req->ready, &server->lock);
+    pthread_mutex_unlock(&server->lock);
+}
+
+
+/**
+ * Batching worker: waits for a full batch, or for the latency window of
+ * the oldest request, then predicts the batch. */
+static void *serve_worker(
+    void *arg
+){
+    cnet_server *server = arg;
+    int max_batch = server->config.max_batch;
+
+    // buffers follow the sizes of the network versions
+    serve_request **batch = malloc(sizeof(serve_request*)*max_batch);
+    serve_request **valid = malloc(sizeof(serve_request*)*max_batch);
+    double **X = malloc(sizeof(double*)*max_batch);
+    double *out = NULL, *workspace = NULL;
+    long out_capacity = 0, workspace_capacity = 0;
+
+    pthread_mutex_lock(&server->lock);
+    while (!server->stopping) {
+        if (!server->head) {
+            pthread_cond_wait(&server->arrived, &server->lock);
+            continue;
+        }
+
+        // the batch leaves when full, or when its first request is due
+        double deadline = server->head->start + server->config.window_us;
+        if (server->queued < max_batch && serve_now_us() < deadline) {
+            struct timespec ts = {
+                (time_t)(deadline / 1e6),
+                (long)fmod(deadline * 1e3, 1e9)
+            };
+            pthread_cond_timedwait(&server->arrived, &server->lock, &ts);
+            continue;
+        }
+
+        int n = 0;
+        for(; server->head && n < max_batch; n++) {
+            batch[n] = server->head;
+            server->head = server->head->next;
+        }
+        if (!server->head) server->tail = NULL;
+        server->queued -= n;
+        pthread_mutex_unlock(&server->lock);
+
+        // the whole batch goes through the version current at its start
+        cnet_ref ref = serve_acquire(server);
+        cnet const *nn = ref.nn;
+        if ((long)max_batch * nn->out_size > out_capacity) {
+            out_capacity = (long)max_batch * nn->out_size;
+            out = realloc(out, sizeof(double)*out_capacity);
+        }
+        if (nn_workspace_size(nn, max_batch) > workspace_capacity) {
+            workspace_capacity = nn_workspace_size(nn, max_batch);
+            workspace = realloc(workspace, sizeof(double)*workspace_capacity);
+        }
+
+        int m = 0;
+        for(int i = 0; i < n; i++) {
+            batch[i]->status = batch[i]->in_size == nn->in_size ?
+                CNET_SERVE_OK : CNET_SERVE_BAD_REQUEST;
+            if (batch[i]->status != CNET_SERVE_OK) continue;
+            valid[m] = batch[i];
+            X[m++] = batch[i]->X;
+        }
+        if (m) nn_predict_batch(nn, X, m, out, workspace);
+        for(int i = 0; i < m; i++) {
+            serve_request *req = valid[i];
+            if (req->out_capacity < nn->out_size) {
+                req->out_capacity = nn->out_size;
+                req->out = realloc(req->out, sizeof(double)*req->out_capacity);
+            }
+            req->out_size = nn->out_size;
+            memcpy(req->out, out + i*nn->out_size, sizeof(double)*nn->out_size);
+        }
+        cnet_model_release(&ref);
+        double end = serve_now_us();
+
+        pthread_mutex_lock(&server->lock);
+        for(int i = 0; i < n; i++) {
+            server->histogram[serve_bucket(end - batch[i]->start)]++;
+            batch[i]->done = 1;
+            pthread_cond_signal(&batch[i]->ready);
+        }
+        server->requests += n;
+        server->batches++;
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    free(workspace);
+    free(out);
+    free(X);
+    free(valid);
+    free(batch);
+    return NULL;
+}
+
+
+/**
+ * Connection thread, answering the requests in order. */
+static void *serve_connection(
+    void *arg
+){
+    serve_conn *conn = arg;
+    cnet_server *server = conn->server;
+
+    // inputs are checked against the network version predicting them
+    serve_request req;
+    uint32_t in_capacity = 0;
+    req.X = req.out = NULL;
+    req.out_capacity = 0;
+    pthread_cond_init(&req.ready, NULL);
+
+    uint32_t header[2];
+    while (!serve_read(conn->fd, header, sizeof(header))) {
+        uint32_t op = header[0], bytes = header[1];
+
+        if (op == CNET_SERVE_PREDICT && bytes && bytes <= SERVE_MAX_PAYLOAD &&
+            bytes % sizeof(double) == 0) {
+            if (bytes > in_capacity) {
+                in_capacity = bytes;
+                req.X = realloc(req.X, in_capacity);
+            }
+            if (serve_read(conn->fd, req.X, bytes)) break;
+            req.in_size = bytes / sizeof(double);
+            serve_submit(server, &req);
+
+            int failed = req.status == CNET_SERVE_OK ?
+                serve_message(conn->fd, CNET_SERVE_OK, req.out, sizeof(double)*req.out_size) :
+                serve_message(conn->fd, req.status, NULL, 0);
+            if (failed) break;
+            continue;
+        }
+
+        if (op == CNET_SERVE_INFO && !bytes) {
+            cnet_ref ref = serve_acquire(server);
+            uint32_t sizes[2] = {ref.nn->in_size, ref.nn->out_size};
+            cnet_model_release(&ref);
+            if (serve_message(conn->fd, CNET_SERVE_OK, sizes, sizeof(sizes))) break;
+            continue;
+        }
+
+        if (op == CNET_SERVE_STATS && !bytes) {
+            char *text;
+            size_t size;
+            FILE *out = open_memstream(&text, &size);
+            cnet_server_stats stats = cnet_server_get_stats(server);
+            cnet_server_print_stats(&stats, out);
+            fclose(out);
+            int failed = serve_message(conn->fd, CNET_SERVE_OK, text, size);
+            free(text);
+            if (failed) break;
+            continue;
+        }
+
+        // unknown request: its payload is skipped
+        char skip[256];
+        int failed = 0;
+        for(uint32_t left = bytes; left && !failed; left -= left < sizeof(skip) ? left : sizeof(skip))
+            failed = serve_read(conn->fd, skip, left < sizeof(skip) ? left : sizeof(skip));
+        if (failed || serve_message(conn->fd, CNET_SERVE_BAD_REQUEST, NULL, 0)) break;
+    }
+
+    pthread_cond_destroy(&req.ready);
+    free(req.out);
+    free(req.X);
+    atomic_store(&conn->done, 1);
+    return NULL;
+}
+
+
+/**
+ * Join the connections whose client left (all of them if asked). */
+static void serve_reap(
+    cnet_server *server,
+    int all
+){
+    for(serve_conn **link = &server->conns; *link;) {
+        serve_conn *conn = *link;
+        if (all) shutdown(conn->fd, SHUT_RDWR);
+        if (!all && !atomic_load(&conn->done)) {
+            link = &conn->next;
+            continue;
+        }
+        pthread_join(conn->thread, NULL);
+        close(conn->fd);
+        *link = conn->next;
+        free(conn);
+    }
+}
+
+
+/// Server
+
+/**
+ * Create an inference server, over a network or a model handle. */
+static cnet_server *serve_init(
+    cnet const *nn,
+    cnet_model *model,
+    char const *address,
+    cnet_server_config const *config
+){
+    struct sockaddr_storage sa;
+    socklen_t len;
+    if (serve_address(address, &sa, &len)) return NULL;
+
+    int one = 1;
+    int listener = socket(sa.ss_family, SOCK_STREAM, 0);
+    if (listener < 0) return NULL;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (sa.ss_family == AF_UNIX)
+        unlink(((struct sockaddr_un *)&sa)->sun_path);
+    if (bind(listener, (struct sockaddr *)&sa, len) || listen(listener, SOMAXCONN)) {
+        close(listener);
+        return NULL;
+    }
+
+    cnet_server *server = malloc(sizeof(cnet_server));
+    server->nn = nn;
+    server->model = model;
+    server->config = *config;
+    if (server->config.max_batch < 1) server->config.max_batch = 1;
+    if (server->config.window_us < 0) server->config.window_us = 0;
+    if (server->config.workers < 1) server->config.workers = 1;
+    server->listener = listener;
+    server->unix_path = sa.ss_family == AF_UNIX ?
+        strdup(((struct sockaddr_un *)&sa)->sun_path) : NULL;
+    if (pipe(server->stop)) server->stop[0] = server->stop[1] = -1;
+    server->conns = NULL;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->arrived, &attr);
+    pthread_condattr_destroy(&attr);
+    server->head = server->tail = NULL;
+    server->queued = server->stopping = 0;
+
+    server->started = serve_now_us();
+    server->requests = server->batches = 0;
+    memset(server->histogram, 0, sizeof(server->histogram));
+
+    server->workers = malloc(sizeof(pthread_t)*server->config.workers);
+    for(int i = 0; i < server->config.workers; i++)
+        pthread_create(&server->workers[i], NULL, serve_worker, server);
+    return server;
+}
+
+
+/**
+ * Create an inference server. */
+cnet_server *cnet_server_init(
+    cnet const *nn,
+    char const *address,
+    cnet_server_config const *config
+){
+    return serve_init(nn, NULL, address, config);
+}
+
+
+/**
+ * Create an inference server over a model handle. */
+cnet_server *cnet_server_init_model(
+    cnet_model *model,
+    char const *address,
+    cnet_server_config const *config
+){
+    return serve_init(NULL, model, address, config);
+}
+
+
+/**
+ * Serve the connections. */
+void cnet_server_run(
+    cnet_server *server
+){
+    struct pollfd fds[2] = {
+        {server->listener, POLLIN, 0},
+        {server->stop[0], POLLIN, 0}
+    };
+
+    for(;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int fd = accept(server->listener, NULL, NULL);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));    // fails on unix sockets
+
+        serve_reap(server, 0);
+        serve_conn *conn = malloc(sizeof(serve_conn));
+        conn->server = server;
+        conn->fd = fd;
+        atomic_init(&conn->done, 0);
+        if (pthread_create(&conn->thread, NULL, serve_connection, conn)) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        conn->next = server->conns;
+        server->conns = conn;
+    }
+}
+
+
+/**
+ * Stop a running server. */
+void cnet_server_stop(
+    cnet_server *server
+){
+    char byte = 0;
+    if (write(server->stop[1], &byte, 1) < 0) return;
+}
+
+
+/**
+ * Free a server. */
+void cnet_server_free(
+    cnet_server *server
+){
+    // connections first: their pending requests still get predicted
+    serve_reap(server, 1);
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = 1;
+    pthread_cond_broadcast(&server->arrived);
+    pthread_mutex_unlock(&server->lock);
+    for(int i = 0; i < server->config.workers; i++)
+        pthread_join(server->workers[i], NULL);
+
+    close(server->listener);
+    if (server->unix_path) unlink(server->unix_path);
+    close(server->stop[0]);
+    close(server->stop[1]);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->arrived);
+    free(server->workers);
+    free(server->unix_path);
+    free(server);
+}
+
+
+/**
+ * Get the server statistics. */
+cnet_server_stats cnet_server_get_stats(
+    cnet_server *server
+){
+    cnet_server_stats stats;
+    pthread_mutex_lock(&server->lock);
+    stats.requests = server->requests;
+    stats.batches = server->batches;
+    memcpy(stats.histogram, server->histogram, sizeof(stats.histogram));
+    pthread_mutex_unlock(&server->lock);
+    stats.elapsed = (serve_now_us() - server->started) / 1e6;
+
+    // percentiles, as the upper bound of their bucket
+    double *marks[] = {&stats.p50, &stats.p90, &stats.p99, &stats.max};
+    double ranks[] = {0.5, 0.9, 0.99, 1};
+    long seen = 0;
+    int m = 0;
+    for(int i = 0; i < 4; i++) *marks[i] = 0;
+    for(int b = 0; b < CNET_SERVE_HISTOGRAM && m < 4; b++) {
+        seen += stats.histogram[b];
+        while (m < 4 && stats.requests && seen >= ranks[m] * stats.requests)
+            *marks[m++] = pow(2, (b + 1) / 4.0) - 1;
+    }
+    return stats;
+}
+
+
+/**
+ * Write the server statistics as text. */
+void cnet_server_print_stats(
+    cnet_server_stats const *stats,
+    FILE *out
+){
+    fprintf(
+        out,
+        "Requests: %ld - Batches: %ld - Mean batch: %.2lf - Throughput: %.1lf req/s \n"
+        "Latency (us): p50 %.1lf - p90 %.1lf - p99 %.1lf - max %.1lf \n",
+        stats->requests,
+        stats->batches,
+        stats->batches ? (double)stats->requests / stats->batches : 0,
+        stats->elapsed > 0 ? stats->requests / stats->elapsed : 0,
+        stats->p50,
+        stats->p90,
+        stats->p99,
+        stats->max
+    );
+    for(int b = 0; b < CNET_SERVE_HISTOGRAM; b++)
+        if (stats->histogram[b])
+            fprintf(
+                out,
+                "  [%.1lf, %.1lf) us: %ld \n",
+                pow(2, b / 4.0) - 1,
+                pow(2, (b + 1) / 4.0) - 1,
+                stats->histogram[b]
+            );
+}
+
+
+/// Client
+
+/**
+ * Connect to an inference server. */
+int cnet_client_connect(
+    char const *address
+){
+    struct sockaddr_storage sa;
+    socklen_t len;
+    if (serve_address(address, &sa, &len)) return -1;
+
+    int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&sa, len)) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+
+/**
+ * Send a request and read the header of its response, -1 if it failed. */
+static int client_call(
+    int fd,
+    uint32_t op,
+    void const *payload,
+    uint32_t bytes,
+    uint32_t *response_bytes
+){
+    uint32_t header[2];
+    if (serve_message(fd, op, payload, bytes) || serve_read(fd, header, sizeof(header)))
+        return -1;
+    *response_bytes = header[1];
+    return header[0] == CNET_SERVE_OK ? 0 : -1;
+}
+
+
+/**
+ * Get the input and output sizes of the served network. */
+int cnet_client_info(
+    int fd,
+    int *in_size,
+    int *out_size
+){
+    uint32_t bytes, sizes[2];
+    if (client_call(fd, CNET_SERVE_INFO, NULL, 0, &bytes) ||
+        bytes != sizeof(sizes) ||
+        serve_read(fd, sizes, sizeof(sizes)))
+        return -1;
+    *in_size = sizes[0];
+    *out_size = sizes[1];
+    return 0;
+}
+
+
+/**
+ * Predict a sample on the server. */
+int cnet_client_predict(
+    int fd,
+    double const *X,
+    int in_size,
+    double *out,
+    int out_size
+){
+    uint32_t bytes;
+    if (client_call(fd, CNET_SERVE_PREDICT, X, sizeof(double)*in_size, &bytes) ||
+        bytes != sizeof(double)*out_size)
+        return -1;
+    return serve_read(fd, out, bytes);
+}
+
+
+/**
+ * Get the server statistics text. */
+int cnet_client_stats(
+    int fd,
+    char *text,
+    int size
+){
+    uint32_t bytes;
+    if (size < 1 || client_call(fd, CNET_SERVE_STATS, NULL, 0, &bytes)) return -1;
+
+    // the text is truncated to the destination, the rest is read anyway
+    char skip[256];
+    uint32_t kept = bytes < (uint32_t)size - 1 ? bytes : (uint32_t)size - 1;
+    if (serve_read(fd, text, kept)) return -1;
+    text[kept] = 0;
+    for(uint32_t left = bytes - kept; left; left -= left < sizeof(skip) ? left : sizeof(skip))
+        if (serve_read(fd, skip, left < sizeof(skip) ? left : sizeof(skip))) return -1;
+    return 0;
+}
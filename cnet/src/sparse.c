@@ -0,0 +1,350 @@
+/*****************************************************************************
+ *                                 SPARSE
+ * Implementation of magnitude pruning and the sparse (CSR) layers.
+ ****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/sparse.h"
+#include "../include/blas.h"
+#include "../include/half.h"
+#include "../include/helpers.h"
+
+
+/**
+ * Compare two doubles (qsort helper). */
+static int cmp_double(
+    void const *a,
+    void const *b
+){
+    double x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Compare two ints (qsort helper). */
+static int cmp_int(
+    void const *a,
+    void const *b
+){
+    int x = *(int const *)a, y = *(int const *)b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Prune a dense layer
+ *
+ * Zeros the n smallest-magnitude weights and records them in the mask.
+ *
+ * @param clayer *layer: Dense layer
+ * @param double sparsity: Ratio of weights to prune
+ */
+static void clayer_prune(
+    clayer *layer,
+    double sparsity
+){
+    int size = layer->w_rows * layer->w_cols;
+    int n_pruned = (int)(sparsity * size);
+    double *w = layer->weights[0];
+
+    if (!layer->mask) {
+        layer->mask = malloc(size);
+        for(int i = 0; i < size; i++)
+            layer->mask[i] = 1;
+    }
+    if (!n_pruned) return;
+
+    // find the magnitude threshold
+    double *magnitudes = malloc(sizeof(double)*size);
+    for(int i = 0; i < size; i++)
+        magnitudes[i] = fabs(w[i]);
+    qsort(magnitudes, size, sizeof(double), cmp_double);
+    double threshold = magnitudes[n_pruned - 1];
+    free(magnitudes);
+
+    // prune everything under the threshold, then ties until the target
+    int pruned = 0;
+    for(int i = 0; i < size; i++) {
+        if (fabs(w[i]) < threshold) {
+            w[i] = 0;
+            layer->mask[i] = 0;
+            pruned++;
+        }
+    }
+    for(int i = 0; i < size && pruned < n_pruned; i++) {
+        if (layer->mask[i] && fabs(w[i]) == threshold) {
+            w[i] = 0;
+            layer->mask[i] = 0;
+            pruned++;
+        }
+    }
+    cnet_half_refresh(layer);
+}
+
+
+/**
+ * Magnitude Pruning */
+void nn_prune(
+    cnet *nn,
+    double sparsity
+){
+    for(int i = 0; i < nn->last_layer; i++)
+        if (nn->layers[i]->type == dense_layer)
+            clayer_prune(nn->layers[i], sparsity);
+}
+
+
+/**
+ * Clear the pruning masks */
+void nn_unmask(
+    cnet *nn
+){
+    for(int i = 0; i < nn->last_layer; i++) {
+        free(nn->layers[i]->mask);
+        nn->layers[i]->mask = NULL;
+    }
+}
+
+
+/**
+ * Keep the given rows (neurons) of a dense layer.
+ *
+ * @param clayer *layer: Dense layer
+ * @param int const *keep: Rows to keep, in ascending order
+ * @param int n: Number of rows to keep
+ */
+static void clayer_keep_rows(
+    clayer *layer,
+    int const *keep,
+    int n
+){
+    int cols = layer->w_cols;
+    double *weights = malloc(sizeof(double)*n*cols);
+    unsigned char *mask = layer->mask ? malloc(n*cols) : NULL;
+
+    for(int i = 0; i < n; i++) {
+        memcpy(weights + i*cols, layer->weights[keep[i]], sizeof(double)*cols);
+        if (mask) memcpy(mask + i*cols, layer->mask + keep[i]*cols, cols);
+        layer->bias[i] = layer->bias[keep[i]];
+    }
+
+    free(layer->weights[0]);
+    free(layer->mask);
+    layer->mask = mask;
+    for(int i = 0; i < n; i++)
+        layer->weights[i] = weights + i*cols;
+
+    layer->out_size = layer->w_rows = layer->b_size = n;
+    if (layer->half) cnet_layer_half(layer, layer->half_type);
+}
+
+
+/**
+ * Keep the given columns (inputs) of a dense layer.
+ *
+ * @param clayer *layer: Dense layer
+ * @param int const *keep: Columns to keep, in ascending order
+ * @param int n: Number of columns to keep
+ */
+static void clayer_keep_cols(
+    clayer *layer,
+    int const *keep,
+    int n
+){
+    int rows = layer->w_rows;
+    double *weights = malloc(sizeof(double)*rows*n);
+    unsigned char *mask = layer->mask ? malloc(rows*n) : NULL;
+
+    for(int k = 0; k < rows; k++) {
+        for(int j = 0; j < n; j++) {
+            weights[k*n + j] = layer->weights[k][keep[j]];
+            if (mask) mask[k*n + j] = layer->mask[k*layer->w_cols + keep[j]];
+        }
+    }
+
+    free(layer->weights[0]);
+    free(layer->mask);
+    layer->mask = mask;
+    for(int k = 0; k < rows; k++)
+        layer->weights[k] = weights + k*n;
+
+    layer->in_size = layer->w_cols = n;
+    if (layer->half) cnet_layer_half(layer, layer->half_type);
+}
+
+
+/**
+ * Structured Neuron Pruning */
+void nn_prune_neurons(
+    cnet *nn,
+    int index,
+    int keep,
+    enum cnet_neuron_score score,
+    double **X,
+    int size
+){
+    assert(index >= 0 && index < nn->last_layer - 1);
+    clayer *layer = nn->layers[index], *next = nn->layers[index + 1];
+    assert(layer->type == dense_layer && next->type == dense_layer);
+    assert(keep > 0 && keep <= layer->out_size);
+
+    // score every neuron by its outgoing weights norm...
+    int n = layer->out_size;
+    double *scores = calloc(n, sizeof(double));
+    for(int j = 0; j < next->out_size; j++)
+        for(int k = 0; k < n; k++)
+            scores[k] += next->weights[j][k] * next->weights[j][k];
+
+    // ...times its incoming weights norm or its mean activation
+    double *factor = calloc(n, sizeof(double));
+    if (score == neuron_weight_norm) {
+        for(int k = 0; k < n; k++)
+            factor[k] = sqrt(cnet_dot(
+                layer->in_size,
+                layer->weights[k],
+                layer->weights[k]
+            ));
+    } else {
+        for(int s = 0; s < size; s++) {
+            nn_predict(nn, X[s]);
+            for(int k = 0; k < n; k++)
+                factor[k] += fabs(layer->output[k]) / size;
+        }
+    }
+
+    // rank the neurons, keeping the best ones in their original order
+    int *order = cnet_idx(n);
+    for(int k = 0; k < n; k++)
+        scores[k] = sqrt(scores[k]) * factor[k];
+    for(int i = 1; i < n; i++) {
+        int k = order[i], j = i;
+        for(; j > 0 && scores[order[j - 1]] < scores[k]; j--)
+            order[j] = order[j - 1];
+        order[j] = k;
+    }
+    qsort(order, keep, sizeof(int), cmp_int);
+
+    clayer_keep_rows(layer, order, keep);
+    clayer_keep_cols(next, order, keep);
+
+    free(order);
+    free(factor);
+    free(scores);
+}
+
+
+/**
+ * Layer Sparsity */
+double cnet_layer_sparsity(
+    clayer const *layer
+){
+    int size = layer->in_size * layer->out_size;
+    if (layer->type == sparse_layer)
+        return 1 - (double)layer->csr_nnz / size;
+
+    int zeros = 0;
+    for(int i = 0; i < size; i++)
+        zeros += layer->weights[0][i] == 0;
+    return (double)zeros / size;
+}
+
+
+/**
+ * Convert a dense layer into a sparse layer, in place. */
+static void clayer_sparsify(
+    clayer *layer
+){
+    double const *w = layer->weights[0];
+    int size = layer->w_rows * layer->w_cols;
+
+    // count non-zeros and build the compressed rows
+    int nnz = 0;
+    for(int i = 0; i < size; i++)
+        nnz += w[i] != 0;
+
+    layer->csr_nnz = nnz;
+    layer->csr_rows = malloc(sizeof(int)*(layer->out_size + 1));
+    layer->csr_cols = malloc(sizeof(int)*nnz);
+    layer->csr_vals = malloc(sizeof(double)*nnz);
+
+    int t = 0;
+    for(int k = 0; k < layer->out_size; k++) {
+        layer->csr_rows[k] = t;
+        for(int j = 0; j < layer->in_size; j++) {
+            if (layer->weights[k][j] == 0) continue;
+            layer->csr_cols[t] = j;
+            layer->csr_vals[t++] = layer->weights[k][j];
+        }
+    }
+    layer->csr_rows[layer->out_size] = t;
+
+    // drop the dense buffers, the biases are kept as they are
+    free(layer->weights[0]);
+    free(layer->weights);
+    free(layer->mask);
+    free(layer->nz_idx);
+    free(layer->nz_val);
+    cnet_layer_half(layer, half_none);
+    layer->weights = NULL;
+    layer->mask = NULL;
+    layer->nz_idx = NULL;
+    layer->nz_val = NULL;
+    layer->w_rows = layer->w_cols = 0;
+    layer->type = sparse_layer;
+}
+
+
+/**
+ * Sparsify */
+int nn_sparsify(
+    cnet *nn,
+    double min_sparsity
+){
+    int converted = 0;
+    for(int i = 0; i < nn->last_layer; i++) {
+        clayer *layer = nn->layers[i];
+        if (layer->type != dense_layer) continue;
+        if (cnet_layer_sparsity(layer) < min_sparsity) continue;
+        clayer_sparsify(layer);
+        converted++;
+    }
+    return converted;
+}
+
+
+/**
+ * CSR Forward Pass */
+void cnet_csr_forward(
+    clayer const *layer,
+    double const *in,
+    double *out,
+    int batch
+){
+    int const *cols = layer->csr_cols;
+    double const *vals = layer->csr_vals;
+
+    for(int k = 0; k < layer->out_size; k++) {
+        int from = layer->csr_rows[k], to = layer->csr_rows[k + 1];
+        for(int b = 0; b < batch; b++) {
+            double const *x = in + b*layer->in_size;
+
+            // independent accumulators, to overlap the gathered loads
+            double z0 = 0, z1 = 0, z2 = 0, z3 = 0;
+            int t = from;
+            for(; t + 3 < to; t += 4) {
+                z0 += vals[t] * x[cols[t]];
+                z1 += vals[t + 1] * x[cols[t + 1]];
+                z2 += vals[t + 2] * x[cols[t + 2]];
+                z3 += vals[t + 3] * x[cols[t + 3]];
+            }
+            for(; t < to; t++)
+                z0 += vals[t] * x[cols[t]];
+
+            out[b*layer->out_size + k] = (z0 + z1) + (z2 + z3) + layer->bias[k];
+        }
+    }
+}
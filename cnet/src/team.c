@@ -0,0 +1,207 @@
+/*****************************************************************************
+ *                                  TEAM
+ * Implementation of the worker teams and their spin barriers.
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "../include/team.h"
+
+#define TEAM_LINE 64
+#define TEAM_SPINS (1 << 16)    // idle spins before a worker sleeps
+#define TEAM_YIELD 1024         // spins between yields (oversubscribed cores)
+
+
+typedef struct team_worker {
+    cnet_team *team;
+    int id;
+} team_worker;
+
+
+struct cnet_team {
+
+    /* run generation, bumped to start a run (func NULL to stop) */
+    _Alignas(TEAM_LINE) atomic_uint run;
+    cnet_team_func *func;
+    void *arg;
+
+    /* barrier arrivals and generation, on their own cache line */
+    _Alignas(TEAM_LINE) atomic_int arrived;
+    atomic_uint passed;
+
+    /* threads (workers and caller) */
+    _Alignas(TEAM_LINE) int n_threads;
+    pthread_t *threads;
+    team_worker *workers;
+
+    /* sleeping workers, woken up by the next run */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_int sleeping;
+};
+
+
+/**
+ * Spin loop hint. */
+static inline void team_relax(
+    int spins
+){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    if (spins % TEAM_YIELD == TEAM_YIELD - 1) sched_yield();
+}
+
+
+/**
+ * Spin Barrier */
+void cnet_team_barrier(
+    cnet_team *team
+){
+    // the generation is read before arriving, the last thread bumps it
+    unsigned passed = atomic_load(&team->passed);
+    if (atomic_fetch_add(&team->arrived, 1) == team->n_threads - 1) {
+        atomic_store(&team->arrived, 0);
+        atomic_store(&team->passed, passed + 1);
+        return;
+    }
+    for(int spins = 0; atomic_load(&team->passed) == passed; spins++)
+        team_relax(spins);
+}
+
+
+static void *team_worker_loop(
+    void *arg
+){
+    team_worker *worker = arg;
+    cnet_team *team = worker->team;
+    unsigned seen = 0;
+
+    for(;;) {
+        // spin for the next run, then sleep until it starts
+        int spins = 0;
+        for(; spins < TEAM_SPINS && atomic_load(&team->run) == seen; spins++)
+            team_relax(spins);
+        if (spins == TEAM_SPINS) {
+            pthread_mutex_lock(&team->lock);
+            atomic_fetch_add(&team->sleeping, 1);
+            while (atomic_load(&team->run) == seen)
+                pthread_cond_wait(&team->wake, &team->lock);
+            atomic_fetch_sub(&team->sleeping, 1);
+            pthread_mutex_unlock(&team->lock);
+        }
+        seen = atomic_load(&team->run);
+
+        if (!team->func) return NULL;
+        team->func(team->arg, worker->id, team->n_threads);
+        cnet_team_barrier(team);
+    }
+}
+
+
+/**
+ * Start a run on the workers. */
+static void team_start(
+    cnet_team *team,
+    cnet_team_func *func,
+    void *arg
+){
+    team->func = func;
+    team->arg = arg;
+    atomic_fetch_add(&team->run, 1);
+
+    if (atomic_load(&team->sleeping)) {
+        pthread_mutex_lock(&team->lock);
+        pthread_cond_broadcast(&team->wake);
+        pthread_mutex_unlock(&team->lock);
+    }
+}
+
+
+/**
+ * Run a function on a team. */
+void cnet_team_run(
+    cnet_team *team,
+    cnet_team_func *func,
+    void *arg
+){
+    if (team->n_threads == 1) {
+        func(arg, 0, 1);
+        return;
+    }
+
+    team_start(team, func, arg);
+    func(arg, 0, team->n_threads);
+    cnet_team_barrier(team);
+}
+
+
+/**
+ * Create a worker team. */
+cnet_team *cnet_team_init(
+    int n_threads,
+    int const *cpus
+){
+    if (n_threads < 1) n_threads = 1;
+
+    cnet_team *team = aligned_alloc(TEAM_LINE, sizeof(cnet_team));
+    atomic_init(&team->run, 0);
+    atomic_init(&team->arrived, 0);
+    atomic_init(&team->passed, 0);
+    atomic_init(&team->sleeping, 0);
+    team->func = NULL;
+    team->arg = NULL;
+    team->threads = malloc(sizeof(pthread_t)*n_threads);
+    team->workers = malloc(sizeof(team_worker)*n_threads);
+    pthread_mutex_init(&team->lock, NULL);
+    pthread_cond_init(&team->wake, NULL);
+
+    // the team shrinks to the workers that could be started
+    team->n_threads = 1;
+    for(int i = 1; i < n_threads; i++) {
+        team->workers[i] = (team_worker){team, i};
+        if (pthread_create(&team->threads[i], NULL, team_worker_loop, &team->workers[i]))
+            break;
+        team->n_threads++;
+
+#ifdef __linux__
+        if (cpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i - 1], &set);
+            pthread_setaffinity_np(team->threads[i], sizeof(set), &set);
+        }
+#endif
+    }
+    return team;
+}
+
+
+/**
+ * Free a worker team. */
+void cnet_team_free(
+    cnet_team *team
+){
+    if (team->n_threads > 1) team_start(team, NULL, NULL);
+    for(int i = 1; i < team->n_threads; i++)
+        pthread_join(team->threads[i], NULL);
+
+    pthread_mutex_destroy(&team->lock);
+    pthread_cond_destroy(&team->wake);
+    free(team->workers);
+    free(team->threads);
+    free(team);
+}
+
+
+/**
+ * Team threads. */
+int cnet_team_threads(
+    cnet_team const *team
+){
+    return team->n_threads;
+}
@@ -0,0 +1,370 @@
+/*****************************************************************************
+ *                               THREAD POOL
+ * Implementation of the work-stealing thread pool.
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../include/tpool.h"
+
+#define POOL_DEQUE_SIZE 64
+#define POOL_SPINS 256          // failed steals before a worker sleeps
+
+
+/**
+ * Parallel for: the pending elements are counted down by the ranges as
+ * they are done, the caller returns once they all are. */
+typedef struct pool_job {
+    cnet_range_func *func;
+    void *arg;
+    long grain;
+    atomic_long pending;
+} pool_job;
+
+
+typedef struct pool_range {
+    pool_job *job;
+    long from, to;
+} pool_range;
+
+
+/**
+ * Ranges deque: the owner pushes and pops at the bottom, thieves steal
+ * from the top (ring buffer, grown when full). */
+typedef struct pool_deque {
+    pthread_mutex_t lock;
+    pool_range *ranges;
+    int top, size, capacity;
+} pool_deque;
+
+
+typedef struct pool_worker {
+    cnet_tpool *pool;
+    int id;
+} pool_worker;
+
+
+struct cnet_tpool {
+
+    /* running threads (workers and caller), and worker slots */
+    int n_threads, n_workers;
+    pthread_t *threads;
+    pool_worker *workers;
+
+    /* one deque per worker, then one shared by the other threads */
+    pool_deque *deques;
+
+    /* ranges in all the deques */
+    atomic_int queued;
+
+    /* sleeping workers, woken up by new ranges or on stop */
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    atomic_int sleeping;
+    int stop;
+};
+
+
+/* pool of the running worker thread (NULL for other threads), and its id */
+static _Thread_local cnet_tpool *self_pool;
+static _Thread_local int self_id;
+
+/* default pool, and the one set by the user (if any) */
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static cnet_tpool *default_pool;
+static _Atomic(cnet_tpool *) user_pool;
+
+
+/// Deques
+
+
+static void deque_push(
+    pool_deque *deque,
+    pool_range range
+){
+    pthread_mutex_lock(&deque->lock);
+    if (deque->size == deque->capacity) {
+        pool_range *ranges = malloc(sizeof(pool_range)*2*deque->capacity);
+        for(int i = 0; i < deque->size; i++)
+            ranges[i] = deque->ranges[(deque->top + i) % deque->capacity];
+        free(deque->ranges);
+        deque->ranges = ranges;
+        deque->top = 0;
+        deque->capacity *= 2;
+    }
+    deque->ranges[(deque->top + deque->size++) % deque->capacity] = range;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+
+static int deque_pop(
+    pool_deque *deque,
+    pool_range *range
+){
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->size > 0;
+    if (found)
+        *range = deque->ranges[(deque->top + --deque->size) % deque->capacity];
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+
+static int deque_steal(
+    pool_deque *deque,
+    pool_range *range
+){
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->size > 0;
+    if (found) {
+        *range = deque->ranges[deque->top];
+        deque->top = (deque->top + 1) % deque->capacity;
+        deque->size--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+
+/// Scheduling
+
+
+/**
+ * Push a range into a deque, waking up a sleeping worker. */
+static void pool_push(
+    cnet_tpool *pool,
+    int own,
+    pool_range range
+){
+    deque_push(&pool->deques[own], range);
+    atomic_fetch_add(&pool->queued, 1);
+
+    if (atomic_load(&pool->sleeping)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+
+/**
+ * Take a range: from the bottom of the own deque, or stolen from the top
+ * of the others. */
+static int pool_take(
+    cnet_tpool *pool,
+    int own,
+    pool_range *range
+){
+    if (!atomic_load(&pool->queued)) return 0;
+
+    int found = deque_pop(&pool->deques[own], range);
+    for(int i = 1; !found && i <= pool->n_workers; i++)
+        found = deque_steal(&pool->deques[(own + i) % (pool->n_workers + 1)], range);
+
+    if (found) atomic_fetch_sub(&pool->queued, 1);
+    return found;
+}
+
+
+/**
+ * Run a range: the upper halves are left to the thieves until the range
+ * is under two grains. */
+static void pool_run(
+    cnet_tpool *pool,
+    int own,
+    pool_range range
+){
+    pool_job *job = range.job;
+    while (range.to - range.from >= 2*job->grain) {
+        long mid = range.from + (range.to - range.from) / 2;
+        pool_push(pool, own, (pool_range){job, mid, range.to});
+        range.to = mid;
+    }
+
+    // the job can be gone as soon as its last elements are counted down
+    job->func(job->arg, range.from, range.to);
+    atomic_fetch_sub(&job->pending, range.to - range.from);
+}
+
+
+static void *pool_worker_loop(
+    void *arg
+){
+    pool_worker *worker = arg;
+    cnet_tpool *pool = worker->pool;
+    self_pool = pool;
+    self_id = worker->id;
+
+    for(int idle = 0;;) {
+        pool_range range;
+        if (pool_take(pool, worker->id, &range)) {
+            pool_run(pool, worker->id, range);
+            idle = 0;
+            continue;
+        }
+        if (++idle < POOL_SPINS) {
+            sched_yield();
+            continue;
+        }
+
+        // nothing to steal for a while, sleep until new ranges are pushed
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleeping, 1);
+        while (!atomic_load(&pool->queued) && !pool->stop)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        atomic_fetch_sub(&pool->sleeping, 1);
+        int stop = pool->stop && !atomic_load(&pool->queued);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) return NULL;
+        idle = 0;
+    }
+}
+
+
+/**
+ * Parallel For */
+void cnet_parallel_for(
+    cnet_tpool *pool,
+    long from,
+    long to,
+    long grain,
+    cnet_range_func *func,
+    void *arg
+){
+    if (to <= from) return;
+    if (grain < 1) grain = 1;
+    if (pool->n_threads == 1 || to - from < 2*grain) {
+        func(arg, from, to);
+        return;
+    }
+
+    // threads out of the pool work through the shared deque
+    int own = self_pool == pool ? self_id : pool->n_workers;
+
+    pool_job job = {.func = func, .arg = arg, .grain = grain};
+    atomic_init(&job.pending, to - from);
+    pool_run(pool, own, (pool_range){&job, from, to});
+
+    // help with any pending range until the stolen ones are done
+    while (atomic_load(&job.pending) > 0) {
+        pool_range range;
+        if (pool_take(pool, own, &range)) pool_run(pool, own, range);
+        else sched_yield();
+    }
+}
+
+
+/// Pools
+
+
+/**
+ * Create a thread pool. */
+cnet_tpool *cnet_tpool_init(
+    int n_threads,
+    int const *cpus
+){
+    if (n_threads <= 0) n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads < 1) n_threads = 1;
+
+    cnet_tpool *pool = calloc(1, sizeof(cnet_tpool));
+    pool->threads = malloc(sizeof(pthread_t)*n_threads);
+    pool->workers = malloc(sizeof(pool_worker)*n_threads);
+    pool->deques = malloc(sizeof(pool_deque)*n_threads);
+    for(int i = 0; i < n_threads; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].ranges = malloc(sizeof(pool_range)*POOL_DEQUE_SIZE);
+        pool->deques[i].top = pool->deques[i].size = 0;
+        pool->deques[i].capacity = POOL_DEQUE_SIZE;
+    }
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->sleeping, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+
+    // start the workers, the pool shrinks to the ones that could be started
+    // (the deques of the others stay empty)
+    pool->n_workers = n_threads - 1;
+    pool->n_threads = 1;
+    for(int i = 0; i < pool->n_workers; i++) {
+        pool->workers[i] = (pool_worker){pool, i};
+        if (pthread_create(&pool->threads[i], NULL, pool_worker_loop, &pool->workers[i]))
+            break;
+        pool->n_threads++;
+
+#ifdef __linux__
+        if (cpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i], &set);
+            pthread_setaffinity_np(pool->threads[i], sizeof(set), &set);
+        }
+#endif
+    }
+    return pool;
+}
+
+
+/**
+ * Free a thread pool. */
+void cnet_tpool_free(
+    cnet_tpool *pool
+){
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int i = 0; i < pool->n_threads - 1; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for(int i = 0; i <= pool->n_workers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].ranges);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+
+/**
+ * Pool threads. */
+int cnet_tpool_threads(
+    cnet_tpool const *pool
+){
+    return pool->n_threads;
+}
+
+
+static void pool_default_init(void) {
+    default_pool = cnet_tpool_init(0, NULL);
+}
+
+
+/**
+ * Library pool. */
+cnet_tpool *cnet_tpool_get(void) {
+    cnet_tpool *pool = atomic_load(&user_pool);
+    if (pool) return pool;
+
+    pthread_once(&default_once, pool_default_init);
+    return default_pool;
+}
+
+
+/**
+ * Set the library pool. */
+void cnet_tpool_use(
+    cnet_tpool *pool
+){
+    atomic_store(&user_pool, pool);
+}
@@ -0,0 +1,360 @@
+/*****************************************************************************
+ *                                  TUNE
+ * Implementation of the gemm autotuner and its cache file.
+ ****************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/tune.h"
+#include "../include/blas.h"
+#include "../include/random.h"
+#include "../include/tpool.h"
+
+#define TUNE_MIN_TIME 5e-3      // seconds of benchmark per candidate
+#define TUNE_LINE 512
+#define TUNE_TMP_SUFFIX ".tmp"
+
+
+typedef struct tune_shape {
+    int trans_a, trans_b, m, n, k;
+} tune_shape;
+
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+/// CPU model
+
+
+/**
+ * CPU Model. */
+char const *cnet_cpu_model(void) {
+    static char model[TUNE_LINE] = "";
+    if (model[0]) return model;
+
+    strcpy(model, "unknown");
+    FILE *info = fopen("/proc/cpuinfo", "r");
+    if (!info) return model;
+
+    char line[TUNE_LINE];
+    while(fgets(line, sizeof(line), info)) {
+        char *value = strchr(line, ':');
+        if (strncmp(line, "model name", 10) || !value) continue;
+
+        // trim the separator and the line end
+        value += 1 + strspn(value + 1, " \t");
+        value[strcspn(value, "\n")] = 0;
+        if (*value) strcpy(model, value);
+        break;
+    }
+    fclose(info);
+    return model;
+}
+
+
+/// Benchmark
+
+
+/**
+ * Add a shape to the list, unless it is already there. */
+static void shape_add(
+    tune_shape *shapes,
+    int *size,
+    tune_shape shape
+){
+    if (shape.m <= 0 || shape.n <= 0 || shape.k <= 0) return;
+    for(int i = 0; i < *size; i++)
+        if (!memcmp(&shapes[i], &shape, sizeof(shape))) return;
+    shapes[(*size)++] = shape;
+}
+
+
+/**
+ * Gemm shapes of a network.
+ *
+ * @param cnet const *nn: cnet
+ * @param int batch: Prediction batch size
+ * @param tune_shape *shapes: Destination (room for 5 shapes per layer)
+ * @return int: Number of shapes
+ */
+static int nn_shapes(
+    cnet const *nn,
+    int batch,
+    tune_shape *shapes
+){
+    int size = 0;
+    for(int l = 0; l < nn->last_layer; l++) {
+        clayer const *layer = nn->layers[l];
+        int positions = layer->out_shape.height * layer->out_shape.width;
+        switch(layer->type) {
+            case dense_layer:
+                if (layer->half) break;
+                shape_add(shapes, &size, (tune_shape){
+                    0, 1, 1, layer->out_size, layer->in_size
+                });
+                shape_add(shapes, &size, (tune_shape){
+                    0, 1, batch, layer->out_size, layer->in_size
+                });
+                break;
+            case conv2d_layer:
+                // forward, weights gradient and delta backpropagation
+                shape_add(shapes, &size, (tune_shape){
+                    0, 0, layer->w_rows, positions, layer->w_cols
+                });
+                shape_add(shapes, &size, (tune_shape){
+                    0, 1, layer->w_rows, layer->w_cols, positions
+                });
+                shape_add(shapes, &size, (tune_shape){
+                    1, 0, layer->w_cols, positions, layer->w_rows
+                });
+                break;
+            case maxpool_layer:
+            case avgpool_layer:
+            case sparse_layer:
+            case embedding_layer:
+                break;
+        }
+    }
+    return size;
+}
+
+
+/**
+ * Seconds per gemm with the given parameters. */
+static double gemm_time(
+    tune_shape s,
+    cnet_gemm_params const *params,
+    double const *a,
+    double const *b,
+    double *c
+){
+    int lda = s.trans_a ? s.m : s.k, ldb = s.trans_b ? s.k : s.n;
+
+    // one warm up call, then as many as fit in the benchmark time
+    int reps = 0;
+    double start = 0, elapsed = 0;
+    for(; reps == 0 || elapsed < TUNE_MIN_TIME; reps++) {
+        if (reps == 1) start = now();
+        cnet_gemm_ex(
+            params,
+            s.trans_a, s.trans_b,
+            s.m, s.n, s.k,
+            1, a, lda,
+            b, ldb,
+            0, c, s.n
+        );
+        if (reps > 0) elapsed = now() - start;
+    }
+    return elapsed / (reps - 1);
+}
+
+
+/**
+ * Fastest parameters for a shape, also timing the defaults. */
+static cnet_gemm_params tune_shape_params(
+    tune_shape s,
+    double *best_time,
+    double *default_time
+){
+    static int const nrs[] = {1, 2, 4, 8};
+    static int const kcs[] = {0, 64, 256};
+    int cores = cnet_tpool_threads(cnet_tpool_get());
+
+    double *a = malloc(sizeof(double)*s.m*s.k);
+    double *b = malloc(sizeof(double)*s.k*s.n);
+    double *c = malloc(sizeof(double)*s.m*s.n);
+    cnet_rng_fill(cnet_rng_local(), a, (long)s.m*s.k, -1, 1);
+    cnet_rng_fill(cnet_rng_local(), b, (long)s.k*s.n, -1, 1);
+
+    cnet_gemm_params best = cnet_gemm_defaults();
+    *default_time = *best_time = gemm_time(s, &best, a, b, c);
+
+    // threads: powers of two below the pool size, then all of them
+    for(int threads = 1;; threads = 2*threads < cores ? 2*threads : cores) {
+        for(unsigned i = 0; i < sizeof(nrs) / sizeof(int); i++)
+        for(unsigned j = 0; j < sizeof(kcs) / sizeof(int); j++) {
+            if (kcs[j] >= s.k) continue;
+            cnet_gemm_params params = {nrs[i], kcs[j], threads};
+            double time = gemm_time(s, &params, a, b, c);
+            if (time < *best_time) {
+                *best_time = time;
+                best = params;
+            }
+        }
+        if (threads == cores) break;
+    }
+
+    free(a);
+    free(b);
+    free(c);
+    return best;
+}
+
+
+/// Cache
+
+
+/**
+ * Parse a cache line (modified in place). Entries with parameters the
+ * kernels do not support (edited or corrupted caches) are not valid.
+ *
+ * @return int: Whether the line is a valid entry
+ */
+static int parse_line(
+    char *line,
+    char **model,
+    tune_shape *s,
+    cnet_gemm_params *p
+){
+    char *shape = strchr(line, '\t');
+    if (!shape) return 0;
+    *shape++ = 0;
+    *model = line;
+
+    char *params = strchr(shape, '\t');
+    if (!params) return 0;
+    *params++ = 0;
+
+    if (sscanf(
+        shape,
+        "%d %d %d %d %d",
+        &s->trans_a, &s->trans_b, &s->m, &s->n, &s->k
+    ) != 5 || sscanf(
+        params,
+        "%d %d %d",
+        &p->nr, &p->kc, &p->threads
+    ) != 3) return 0;
+
+    int nr_valid = p->nr == 1 || p->nr == 2 || p->nr == 4 || p->nr == 8;
+    return nr_valid && p->kc >= 0 && p->threads >= 0;
+}
+
+
+/**
+ * Load a tuning cache. */
+int cnet_tune_load(
+    char const *cache_path
+){
+    FILE *in = fopen(cache_path, "r");
+    if (!in) return -1;
+
+    int loaded = 0;
+    char line[TUNE_LINE];
+    while(fgets(line, sizeof(line), in)) {
+        char *model;
+        tune_shape s;
+        cnet_gemm_params p;
+        if (!parse_line(line, &model, &s, &p)) continue;
+        if (strcmp(model, cnet_cpu_model())) continue;
+
+        cnet_gemm_register(s.trans_a, s.trans_b, s.m, s.n, s.k, p);
+        loaded++;
+    }
+    fclose(in);
+    return loaded;
+}
+
+
+/**
+ * Save the tuned shapes into the cache, keeping the other entries.
+ * Written into a temporary file, then renamed, so readers never see a
+ * partial cache. */
+static int tune_save(
+    char const *cache_path,
+    tune_shape const *shapes,
+    cnet_gemm_params const *params,
+    int size
+){
+    char *tmp_path = malloc(strlen(cache_path) + sizeof(TUNE_TMP_SUFFIX));
+    strcpy(tmp_path, cache_path);
+    strcat(tmp_path, TUNE_TMP_SUFFIX);
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        free(tmp_path);
+        return -1;
+    }
+
+    // previous entries, unless replaced
+    FILE *in = fopen(cache_path, "r");
+    char line[TUNE_LINE], parsed[TUNE_LINE];
+    while(in && fgets(line, sizeof(line), in)) {
+        char *model;
+        tune_shape s;
+        cnet_gemm_params p;
+        strcpy(parsed, line);
+        if (!parse_line(parsed, &model, &s, &p)) continue;
+
+        int replaced = 0;
+        for(int i = 0; i < size && !strcmp(model, cnet_cpu_model()); i++)
+            replaced |= !memcmp(&shapes[i], &s, sizeof(s));
+        if (!replaced) fputs(line, out);
+    }
+    if (in) fclose(in);
+
+    for(int i = 0; i < size; i++)
+        fprintf(
+            out,
+            "%s\t%d %d %d %d %d\t%d %d %d\n",
+            cnet_cpu_model(),
+            shapes[i].trans_a, shapes[i].trans_b,
+            shapes[i].m, shapes[i].n, shapes[i].k,
+            params[i].nr, params[i].kc, params[i].threads
+        );
+
+    int failed = fclose(out) != 0;
+    failed |= !failed && rename(tmp_path, cache_path) != 0;
+    free(tmp_path);
+    return failed ? -1 : 0;
+}
+
+
+/// Autotune
+
+
+/**
+ * Autotune the gemm shapes of a network. */
+int nn_autotune(
+    cnet const *nn,
+    int batch,
+    char const *cache_path,
+    FILE *log
+){
+    // vendor libraries do their own tuning
+    if (strcmp(cnet_blas_backend(), "builtin")) return 0;
+
+    tune_shape *shapes = malloc(sizeof(tune_shape)*5*nn->last_layer);
+    int size = nn_shapes(nn, batch, shapes);
+    cnet_gemm_params *params = malloc(sizeof(cnet_gemm_params)*size);
+
+    for(int i = 0; i < size; i++) {
+        tune_shape s = shapes[i];
+        double time, default_time;
+        params[i] = tune_shape_params(s, &time, &default_time);
+        cnet_gemm_register(s.trans_a, s.trans_b, s.m, s.n, s.k, params[i]);
+
+        if (log)
+            fprintf(
+                log,
+                "gemm %c%c %dx%dx%d: nr %d - kc %d - threads %d "
+                "- %.3lf GFLOPS (default %.3lf) \n",
+                s.trans_a ? 'T' : 'N', s.trans_b ? 'T' : 'N',
+                s.m, s.n, s.k,
+                params[i].nr, params[i].kc, params[i].threads,
+                2e-9 * s.m * s.n * s.k / time,
+                2e-9 * s.m * s.n * s.k / default_time
+            );
+    }
+
+    int failed = tune_save(cache_path, shapes, params, size);
+    free(params);
+    free(shapes);
+    return failed ? -1 : size;
+}
@@ -11,6 +11,10 @@
 #define CONF_FILE_PATH          "./mnist/out/conf_matrix.dat"
 #define REPORT_FILE_PATH        "./mnist/out/report.txt"
 #define MODEL_FILE_PATH         "./mnist/out/model.cnet"
+#define CHECKPOINT_FILE_PATH    "./mnist/out/checkpoint.cnet"
+#define PRUNED_MODEL_FILE_PATH  "./mnist/out/model_pruned.cnet"
+#define PRUNE_REPORT_FILE_PATH  "./mnist/out/prune_report.txt"
+#define TUNE_CACHE_FILE_PATH    "./mnist/out/tune.cache"
 
 
 /* DATASET PATHS */
@@ -31,4 +35,17 @@
 #define INFO_LABEL_LEN  2       // number of information bytes in val file
 
 
+/* TRAINING */
+
+#define CHECKPOINT_EVERY 10000  // training steps between checkpoints
+#define NUMA_MODE       0       // pool pinned node by node, dataset and
+                                // weights interleaved (make NUMA=1)
+
+
+/* PRUNING */
+
+#define PRUNE_CALIB_SIZE 1000   // training samples used to rank neurons
+#define PRUNE_KEEP_RATIO 0.625  // hidden neurons kept in the saved model
+
+
 #endif /* MNIST_CFG_H */
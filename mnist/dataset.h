@@ -24,7 +24,7 @@
 typedef struct mnist_dataset {
     int size;
     double **images;
-    double **labels;
+    int *labels;
 } mnist_dataset;
 
 
@@ -66,7 +66,7 @@ void mnist_read_data_image_file(
 
 void mnist_read_data_label_file(
     char const *file_path,
-    double **data,
+    int *data,
     int data_len
 ){
     // open file
@@ -80,13 +80,12 @@ void mnist_read_data_label_file(
     int info_arr[INFO_LABEL_LEN];
     read(file, info_arr, INFO_LABEL_LEN * sizeof(int));
 
-    // read data
+    // read data (digits, used as class indices)
     for(int i = 0; i < data_len; i++) {
         unsigned char d;
         read(file, &d, sizeof(unsigned char));
-        for(int j = 0; j < OUTPUT_SIZE; j++) {
-            data[i][j] = d == ((unsigned char)j) ? 1 : 0;
-        }
+        assert(d < OUTPUT_SIZE);
+        data[i] = d;
     }
 }
 
@@ -105,11 +104,9 @@ mnist_dataset *mnist_init(
 
     // alloc data arrays
     ds->images = malloc(sizeof(double *)*size);
-    ds->labels = malloc(sizeof(double *)*size);
-    for(int i = 0; i < size; i++) {
+    ds->labels = malloc(sizeof(int)*size);
+    for(int i = 0; i < size; i++)
         ds->images[i] = malloc(sizeof(double)*INPUT_SIZE);
-        ds->labels[i] = malloc(sizeof(double)*OUTPUT_SIZE);
-    }
 
     // read train images
     mnist_read_data_image_file(
@@ -133,10 +130,8 @@ void mnist_free(
     mnist_dataset *ds
 ){
     // free data arrays
-    for(int i = 0; i < ds->size; i++) {
+    for(int i = 0; i < ds->size; i++)
         free(ds->images[i]);
-        free(ds->labels[i]);
-    }
     free(ds->images);
     free(ds->labels);
 
@@ -0,0 +1,119 @@
+/**
+ * Shrink the saved CNet model hidden layers (structured neuron pruning)
+ * and report the accuracy / latency trade-off over the MNIST test-set.
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+#include "cnet.h"
+#include "sparse.h"
+#include "metrics.h"
+#include "dataset.h"
+#include "config.h"
+
+
+/**
+ * Mean nn_predict latency over a dataset, in microseconds. */
+double predict_latency(
+    cnet const *nn,
+    mnist_dataset const *ds
+){
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0; i < ds->size; i++)
+        nn_predict(nn, ds->images[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e6 +
+                     (end.tv_nsec - start.tv_nsec) / 1e3;
+    return elapsed / ds->size;
+}
+
+
+int main() {
+
+    // load model from file
+    FILE *model_file = fopen(MODEL_FILE_PATH, "r");
+    if (!model_file) {
+        fprintf(stderr, "Failed to open file: %s\n", MODEL_FILE_PATH);
+        return 1;
+    }
+    cnet *nn = nn_load(model_file);
+    fclose(model_file);
+    if (!nn) {
+        fprintf(stderr, "Failed to load model: %s\n", MODEL_FILE_PATH);
+        return 1;
+    }
+
+    // load the calibration and test sets
+    mnist_dataset *calib_set = mnist_train_set(PRUNE_CALIB_SIZE);
+    mnist_dataset *val_set = mnist_val_set(VAL_SIZE);
+
+    FILE *report_file = fopen(PRUNE_REPORT_FILE_PATH, "w");
+    fprintf(report_file,
+        "STRUCTURED PRUNING REPORT \n\n"
+        "keep      hidden      params    accuracy   latency (us) \n"
+    );
+
+    double ratios[] = {1, 0.875, 0.75, PRUNE_KEEP_RATIO, 0.5, 0.375, 0.25};
+    for(unsigned r = 0; r < sizeof(ratios) / sizeof(double); r++) {
+        cnet *pruned = nn_clone(nn);
+
+        // shrink every hidden layer to the same ratio
+        for(int l = 0; l < pruned->n_layers - 1; l++) {
+            int keep = (int)(ratios[r] * pruned->layers[l]->out_size);
+            nn_prune_neurons(
+                pruned,
+                l,
+                keep > 0 ? keep : 1,
+                neuron_activation,
+                calib_set->images,
+                calib_set->size
+            );
+        }
+
+        cnet_report *report = nn_evaluate_labels(
+            pruned,
+            val_set->images,
+            val_set->labels,
+            val_set->size,
+            0
+        );
+
+        int params = 0;
+        for(int l = 0; l < pruned->n_layers; l++)
+            params += (pruned->layers[l]->in_size + 1) *
+                       pruned->layers[l]->out_size;
+
+        fprintf(
+            report_file,
+            "%.3lf     %4d-%-4d   %8d  %lf   %lf \n",
+            ratios[r],
+            pruned->layers[0]->out_size,
+            pruned->layers[1]->out_size,
+            params,
+            report->accuracy,
+            predict_latency(pruned, val_set)
+        );
+
+        // save the selected trade-off
+        if (ratios[r] == PRUNE_KEEP_RATIO) {
+            FILE *pruned_file = fopen(PRUNED_MODEL_FILE_PATH, "w");
+            nn_save(pruned, pruned_file);
+            fclose(pruned_file);
+        }
+
+        cnet_report_free(report);
+        nn_free(pruned);
+    }
+
+    // free all objects
+    fclose(report_file);
+    nn_free(nn);
+    mnist_free(calib_set);
+    mnist_free(val_set);
+
+    return 0;
+}
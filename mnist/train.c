@@ -4,7 +4,10 @@
 
 #include <stdio.h>
 #include "cnet.h"
+#include "checkpoint.h"
 #include "dataset.h"
+#include "locality.h"
+#include "tune.h"
 #include "config.h"
 
 
@@ -21,9 +24,21 @@ int main() {
     int output_size = OUTPUT_SIZE;
     int input_size = INPUT_SIZE;
 
+    // use the gemm parameters tuned for this machine, if any (cnet-tune)
+    cnet_tune_load(TUNE_CACHE_FILE_PATH);
+
+    // on multi-socket machines, train on every node (see locality.h)
+    int numa = NUMA_MODE && cnet_numa_init() > 0;
+    if (NUMA_MODE && !numa)
+        fprintf(stderr, "Failed to pin the training thread, NUMA mode disabled\n");
+
     // load mnist dataset
     mnist_dataset *train_set = mnist_train_set(train_size);
     mnist_dataset *val_set = mnist_val_set(val_size);
+    if (numa) {
+        cnet_numa_interleave_rows(train_set->images, train_set->size, input_size);
+        cnet_numa_interleave_rows(val_set->images, val_set->size, input_size);
+    }
 
     // init model
     int n_layers = 3;
@@ -37,12 +52,17 @@ int main() {
     nn_add(nn,  input_size,     256,            sigmoid_act);
     nn_add(nn,  256,            128,            sigmoid_act);
     nn_add(nn,  128,            output_size,    sigmoid_act);
+    if (numa) nn_numa_interleave(nn);
+
+    // save checkpoints in the background while training
+    cnet_ckpt *ckpt = cnet_ckpt_init(nn, CHECKPOINT_FILE_PATH);
+    nn_set_checkpoint(nn, ckpt, CHECKPOINT_EVERY);
 
     // create a file to save output
     FILE *history_file = fopen(HISTORY_FILE_PATH, "w");
 
     // train
-    nn_train(
+    int status = nn_train_labels(
         nn,
         train_set->images,
         train_set->labels,
@@ -58,16 +78,19 @@ int main() {
     );
 
     // save model
-    FILE *model_file = fopen(MODEL_FILE_PATH, "w");
-    nn_save(
-        nn,
-        model_file
-    );
+    if (!status) {
+        FILE *model_file = fopen(MODEL_FILE_PATH, "w");
+        nn_save(
+            nn,
+            model_file
+        );
+    }
 
     // free all objects
+    cnet_ckpt_free(ckpt);
     nn_free(nn);
     mnist_free(train_set);
     mnist_free(val_set);
 
-    return 0;
+    return status ? 1 : 0;
 }
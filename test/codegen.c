@@ -0,0 +1,75 @@
+/**
+ * Code Generation Tests for CNet.
+ * Linked with the code cnet-codegen generates from test/codegen.cnet
+ * (conv, max/avg pooling, sparse and dense layers).
+ * */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "cnet.h"
+
+
+/* generated by cnet-codegen test/codegen.cnet ... model */
+void model_predict(double const *in, double *out);
+
+
+/**
+ * Passes random inputs through the loaded model and the generated code,
+ * and checks that their outputs match.
+ * */
+void test_codegen_random_inputs() {
+    int samples = 1000;
+
+    FILE *model_file = fopen("test/codegen.cnet", "r");
+    cnet *nn = nn_load(model_file);
+    fclose(model_file);
+
+    double *x = malloc(sizeof(double)*nn->in_size);
+    double *y = malloc(sizeof(double)*nn->out_size);
+
+    double max_err = 0;
+    for(int s = 0; s < samples; s++) {
+        for(int j = 0; j < nn->in_size; j++)
+            x[j] = ((double)rand())/((double)RAND_MAX);
+
+        model_predict(x, y);
+        double const *expected = nn_predict(nn, x);
+        for(int k = 0; k < nn->out_size; k++) {
+            double err = fabs(y[k] - expected[k]);
+            max_err = err > max_err ? err : max_err;
+        }
+    }
+    printf("max error: %g\n", max_err);
+    assert(max_err < 1e-9);
+
+    // free all objects
+    free(x);
+    free(y);
+    nn_free(nn);
+}
+
+
+/**
+ * Run all tests. */
+int main() {
+
+    // set random seed
+    srand((unsigned int)23);
+
+    printf(
+        "*************************************************************\n"
+        "               RUNNING GENERATED CODE VS PREDICT             \n"
+        "*************************************************************\n"
+    );
+
+    test_codegen_random_inputs();
+
+    printf(
+        "*************************************************************\n"
+        "                           PASSED                            \n"
+        "*************************************************************\n"
+    );
+
+}
@@ -2,10 +2,29 @@
  * Integration Tests for CNet.
  * */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "cnet.h"
+#include "blas.h"
+#include "checkpoint.h"
+#include "dataset.h"
+#include "dist.h"
+#include "half.h"
+#include "locality.h"
+#include "model.h"
+#include "random.h"
+#include "serve.h"
+#include "team.h"
+#include "tpool.h"
 
 
 #define print(x) printf("%s\n", x); fflush(NULL);
@@ -111,12 +130,1243 @@ void test_random_inputs() {
 }
 
 
+/**
+ * Trains a small convolutional net over random images, then saves and
+ * loads it back, checking that the loaded net predicts the same values.
+ * */
+void test_conv_random_inputs() {
+    // sizes
+    cnet_shape input_shape = {1, 12, 12};
+    int input_size = 144;
+    int output_size = 4;
+
+    // samples
+    int train_size = 100;
+    int epochs = 10;
+    double lr = 0.01;
+
+    // create training samples
+    double **X = malloc(sizeof(double*)*train_size);
+    double **Y = malloc(sizeof(double*)*train_size);
+    for (int i = 0; i < train_size; i++) {
+        X[i] = malloc(sizeof(double)*input_size);
+        for(int j = 0; j < input_size; j++)
+            X[i][j] = ((double)rand())/((double)RAND_MAX);
+
+        Y[i] = malloc(sizeof(double)*output_size);
+        for(int j = 0; j < output_size; j++)
+            Y[i][j] = i % output_size == j;
+    }
+
+    /// conv (4x12x12) -> max pool (4x6x6) -> conv (8x2x2) -> avg pool -> dense
+    cnet *nn = nn_init(input_size, output_size, 5);
+    nn_add_conv2d(nn, input_shape, 4, 3, 1, 1, relu_act);
+    nn_add_pool(nn, maxpool_layer, (cnet_shape){4, 12, 12}, 2, 2);
+    nn_add_conv2d(nn, (cnet_shape){4, 6, 6}, 8, 3, 2, 0, sigmoid_act);
+    nn_add_pool(nn, avgpool_layer, (cnet_shape){8, 2, 2}, 2, 2);
+    nn_add(nn, 8, output_size, sigmoid_act);
+
+    // train
+    FILE *history_file = fopen("test/test_conv_random_inputs.dat", "w");
+    nn_train(
+        nn,
+        X,
+        Y,
+        X,
+        Y,
+        train_size,
+        train_size,
+        mse_loss,
+        metric_accuracy_argmax,
+        lr,
+        epochs,
+        history_file
+    );
+    fclose(history_file);
+
+    // save and load
+    FILE *model_file = fopen("test/test_conv_random_inputs.cnet", "w");
+    nn_save(nn, model_file);
+    fclose(model_file);
+    model_file = fopen("test/test_conv_random_inputs.cnet", "r");
+    cnet *loaded = nn_load(model_file);
+    fclose(model_file);
+
+    for(int i = 0; i < train_size; i++) {
+        double expected = nn_predict(nn, X[i])[0];
+        assert(fabs(nn_predict(loaded, X[i])[0] - expected) < 1e-12);
+    }
+
+    // free all objects
+    nn_free(loaded);
+    nn_free(nn);
+    for(int i = 0; i < train_size; i++) {
+        free(X[i]);
+        free(Y[i]);
+    }
+    free(X); free(Y);
+}
+
+
+/**
+ * Trains a net starting with an embedding layer over random categorical
+ * inputs (class index targets), checking that the rows of unseen
+ * categories are left untouched, and that a loaded net predicts the
+ * same values.
+ * */
+void test_embedding_random_inputs() {
+    // sizes
+    int fields = 3;
+    int vocab = 500;
+    int dim = 4;
+    int output_size = 4;
+
+    // samples, only using the first half of the categories
+    int train_size = 100;
+    int epochs = 10;
+    double lr = 0.01;
+
+    double **X = malloc(sizeof(double*)*train_size);
+    int *y = malloc(sizeof(int)*train_size);
+    for (int i = 0; i < train_size; i++) {
+        X[i] = malloc(sizeof(double)*fields);
+        for(int j = 0; j < fields; j++)
+            X[i][j] = rand() % (vocab / 2);
+        y[i] = (int)X[i][0] % output_size;
+    }
+
+    /// embedding (3x4) -> dense -> dense
+    cnet *nn = nn_init(fields, output_size, 3);
+    nn_add_embedding(nn, fields, vocab, dim);
+    nn_add(nn, fields * dim, 16, relu_act);
+    nn_add(nn, 16, output_size, softmax_act);
+    double unseen = nn->layers[0]->weights[vocab - 1][0];
+
+    // train
+    FILE *history_file = fopen("test/test_embedding_random_inputs.dat", "w");
+    int status = nn_train_labels(
+        nn,
+        X,
+        y,
+        X,
+        y,
+        train_size,
+        train_size,
+        cross_entropy_loss,
+        metric_accuracy_argmax,
+        lr,
+        epochs,
+        history_file
+    );
+    fclose(history_file);
+    assert(status == 0);
+    assert(nn->layers[0]->weights[vocab - 1][0] == unseen);
+
+    // save and load
+    FILE *model_file = fopen("test/test_embedding_random_inputs.cnet", "w");
+    nn_save(nn, model_file);
+    fclose(model_file);
+    model_file = fopen("test/test_embedding_random_inputs.cnet", "r");
+    cnet *loaded = nn_load(model_file);
+    fclose(model_file);
+
+    for(int i = 0; i < train_size; i++) {
+        double expected = nn_predict(nn, X[i])[0];
+        assert(fabs(nn_predict(loaded, X[i])[0] - expected) < 1e-12);
+    }
+
+    // free all objects
+    nn_free(loaded);
+    nn_free(nn);
+    for(int i = 0; i < train_size; i++)
+        free(X[i]);
+    free(X); free(y);
+}
+
+
+/**
+ * Trains a net with bfloat16 weights, then checkpoints it with a writer
+ * created before the training, checking that the loaded checkpoint
+ * predicts the same values as the trained net.
+ * */
+void test_half_checkpoint_random_inputs() {
+    // sizes
+    int input_size = 8;
+    int output_size = 2;
+
+    // samples
+    int train_size = 50;
+    int epochs = 20;
+    double lr = 0.5;
+
+    double **X = malloc(sizeof(double*)*train_size);
+    double **Y = malloc(sizeof(double*)*train_size);
+    for (int i = 0; i < train_size; i++) {
+        X[i] = malloc(sizeof(double)*input_size);
+        Y[i] = calloc(output_size, sizeof(double));
+        for(int j = 0; j < input_size; j++)
+            X[i][j] = (double)rand() / RAND_MAX;
+        Y[i][rand() % output_size] = 1;
+    }
+
+    /// 8 -> 4 -> 2, bfloat16 weights
+    cnet *nn = nn_init(input_size, output_size, 2);
+    nn_add(nn, input_size, 4, sigmoid_act);
+    nn_add(nn, 4, output_size, sigmoid_act);
+    nn_set_half(nn, half_bf16);
+    cnet_ckpt *ckpt = cnet_ckpt_init(nn, "test/test_half_checkpoint_random_inputs.cnet");
+
+    // train
+    FILE *history_file = fopen("test/test_half_checkpoint_random_inputs.dat", "w");
+    nn_train(
+        nn,
+        X,
+        Y,
+        X,
+        Y,
+        train_size,
+        train_size,
+        mse_loss,
+        metric_accuracy_argmax,
+        lr,
+        epochs,
+        history_file
+    );
+    fclose(history_file);
+
+    // checkpoint and load
+    cnet_ckpt_submit(ckpt, nn);
+    cnet_ckpt_wait(ckpt);
+    assert(cnet_ckpt_get_stats(ckpt).written == 1);
+    cnet_ckpt_free(ckpt);
+    FILE *model_file = fopen("test/test_half_checkpoint_random_inputs.cnet", "r");
+    cnet *loaded = nn_load(model_file);
+    fclose(model_file);
+
+    for(int i = 0; i < train_size; i++) {
+        double expected = nn_predict(nn, X[i])[0];
+        assert(fabs(nn_predict(loaded, X[i])[0] - expected) < 1e-12);
+    }
+
+    // free all objects
+    nn_free(loaded);
+    nn_free(nn);
+    for(int i = 0; i < train_size; i++) {
+        free(X[i]);
+        free(Y[i]);
+    }
+    free(X); free(Y);
+}
+
+
+/**
+ * Fills a matrix with random values, and its padding (columns past cols
+ * up to ld) with NaNs, which must never be read nor written.
+ * */
+void fill_padded(
+    double *x,
+    int rows,
+    int cols,
+    int ld
+){
+    for(int i = 0; i < rows; i++)
+        for(int j = 0; j < ld; j++)
+            x[i*ld + j] = j < cols ? 2.0 * rand() / RAND_MAX - 1 : NAN;
+}
+
+
+/**
+ * Checks a matrix against the expected values, and that its padding is
+ * left untouched.
+ * */
+void check_padded(
+    double const *x,
+    double const *expected,
+    int rows,
+    int cols,
+    int ld,
+    double tol
+){
+    for(int i = 0; i < rows; i++)
+        for(int j = 0; j < ld; j++) {
+            if (j >= cols) assert(isnan(x[i*ld + j]));
+            else assert(fabs(x[i*ld + j] - expected[i*ld + j]) <= tol);
+        }
+}
+
+
+/**
+ * Compares gemm, gemv and ger with naive loops over odd shapes, padded
+ * leading dimensions, every transposition, scales, and every register
+ * block and inner tile the tuner tries (split in parts or not).
+ * */
+void test_blas_random_inputs() {
+    // shapes (m, n, k), the inner ones spanning several tiles
+    int shapes[][3] = {{1, 1, 1}, {5, 3, 7}, {13, 11, 67}, {3, 17, 261}, {9, 2, 130}};
+    double alphas[] = {1, -0.5, 0};
+    double betas[] = {0, 1, 0.75};
+    int nrs[] = {1, 2, 3, 4, 8}, kcs[] = {0, 64, 256}, threads[] = {1, 3};
+    int max = 261 + 3;
+
+    double *a = malloc(sizeof(double)*max*max);
+    double *b = malloc(sizeof(double)*max*max);
+    double *c = malloc(sizeof(double)*max*max);
+    double *c0 = malloc(sizeof(double)*max*max);
+    double *expected = malloc(sizeof(double)*max*max);
+
+    for(unsigned s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        int m = shapes[s][0], n = shapes[s][1], k = shapes[s][2];
+        double tol = 1e-13 * k;
+
+        for(int trans = 0; trans < 4; trans++) {
+            int trans_a = trans & 1, trans_b = trans >> 1;
+            int lda = (trans_a ? m : k) + 3, ldb = (trans_b ? k : n) + 2, ldc = n + 1;
+            fill_padded(a, trans_a ? k : m, trans_a ? m : k, lda);
+            fill_padded(b, trans_b ? n : k, trans_b ? k : n, ldb);
+            fill_padded(c0, m, n, ldc);
+
+            for(int ab = 0; ab < 9; ab++) {
+                double alpha = alphas[ab / 3], beta = betas[ab % 3];
+
+                // C = alpha * op(A) * op(B) + beta * C
+                for(int i = 0; i < m*ldc; i++)
+                    expected[i] = c0[i];
+                for(int i = 0; i < m; i++)
+                    for(int j = 0; j < n; j++) {
+                        double x = 0;
+                        for(int p = 0; p < k; p++)
+                            x += (trans_a ? a[p*lda + i] : a[i*lda + p])
+                               * (trans_b ? b[j*ldb + p] : b[p*ldb + j]);
+                        expected[i*ldc + j] = alpha * x + (beta == 0 ? 0 : beta * c0[i*ldc + j]);
+                    }
+
+                for(int i = 0; i < m*ldc; i++)
+                    c[i] = c0[i];
+                cnet_gemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+                check_padded(c, expected, m, n, ldc, tol);
+
+                for(int p = 0; p < 5*3*2; p++) {
+                    cnet_gemm_params params = {nrs[p / 6], kcs[p / 2 % 3], threads[p % 2]};
+                    for(int i = 0; i < m*ldc; i++)
+                        c[i] = c0[i];
+                    cnet_gemm_ex(&params, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+                    check_padded(c, expected, m, n, ldc, tol);
+                }
+            }
+        }
+
+        // y = alpha * op(A) * x + beta * y, then A += alpha * x * y^T
+        int lda = n + 3;
+        fill_padded(a, m, n, lda);
+        fill_padded(b, 1, m > n ? m : n, max);
+        fill_padded(c0, 1, m > n ? m : n, max);
+        for(int t = 0; t < 2*9; t++) {
+            int trans = t / 9, rows = trans ? n : m, cols = trans ? m : n;
+            double alpha = alphas[t / 3 % 3], beta = betas[t % 3];
+            for(int i = 0; i < rows; i++) {
+                double x = 0;
+                for(int j = 0; j < cols; j++)
+                    x += (trans ? a[j*lda + i] : a[i*lda + j]) * b[j];
+                expected[i] = alpha * x + (beta == 0 ? 0 : beta * c0[i]);
+                c[i] = c0[i];
+            }
+            cnet_gemv(trans, m, n, alpha, a, lda, b, beta, c);
+            for(int i = 0; i < rows; i++)
+                assert(fabs(c[i] - expected[i]) <= 1e-13 * cols);
+        }
+        for(int t = 0; t < 3; t++) {
+            for(int i = 0; i < m*lda; i++)
+                expected[i] = c[i] = a[i];
+            for(int i = 0; i < m; i++)
+                for(int j = 0; j < n; j++)
+                    expected[i*lda + j] += alphas[t] * b[i] * c0[j];
+            cnet_ger(m, n, alphas[t], b, c0, c, lda);
+            check_padded(c, expected, m, n, lda, 1e-15);
+        }
+    }
+
+    // free all objects
+    free(a); free(b); free(c); free(c0); free(expected);
+}
+
+
+/**
+ * Checks the generators: seeded sequences are reproducible, streams and
+ * seeds differ, bounded integers stay in range and are uniform, and the
+ * stream fill gives the same values whatever the pool threads.
+ * */
+void test_rng_random_inputs() {
+    int draws = 70000;
+
+    // same seed and stream, same sequence; another stream, another one
+    cnet_rng a, b, c;
+    cnet_rng_init(&a, 99, 3);
+    cnet_rng_init(&b, 99, 3);
+    cnet_rng_init(&c, 99, 4);
+    int same = 1;
+    for(int i = 0; i < 100; i++) {
+        uint64_t x = cnet_rng_next(&a);
+        assert(x == cnet_rng_next(&b));
+        same &= x == cnet_rng_next(&c);
+    }
+    assert(!same);
+
+    // the global seed replays the thread generator
+    double first[16];
+    cnet_seed(7);
+    for(int i = 0; i < 16; i++)
+        first[i] = cnet_rng_uniform(cnet_rng_local());
+    cnet_seed(7);
+    for(int i = 0; i < 16; i++)
+        assert(cnet_rng_uniform(cnet_rng_local()) == first[i]);
+
+    // bounded integers, in range for any bound, uniform for a small one
+    uint32_t bounds[] = {1, 2, 3, 1000, 2147483649u, 4294967295u};
+    for(unsigned n = 0; n < sizeof(bounds) / sizeof(uint32_t); n++)
+        for(int i = 0; i < draws; i++)
+            assert(cnet_rng_below(&a, bounds[n]) < bounds[n]);
+    int counts[7] = {0};
+    for(int i = 0; i < draws; i++)
+        counts[cnet_rng_below(&a, 7)]++;
+    for(int v = 0; v < 7; v++)
+        assert(abs(counts[v] - draws / 7) < draws / 7 / 20);
+    for(int i = 0; i < draws; i++) {
+        double u = cnet_rng_uniform(&a);
+        assert(u >= 0 && u < 1);
+    }
+
+    // bulk fills, over several stream chunks
+    long size = 3*(1 << 16) + 5;
+    double *x = malloc(sizeof(double)*size);
+    double *y = malloc(sizeof(double)*size);
+    cnet_rng_init(&b, 5, 0);
+    cnet_rng_init(&c, 5, 0);
+    cnet_rng_fill(&b, x, size, -2, 3);
+    cnet_rng_fill(&c, y, size, -2, 3);
+    for(long i = 0; i < size; i++)
+        assert(x[i] == y[i] && x[i] >= -2 && x[i] < 3);
+
+    cnet_rng_fill_streams(11, x, size, -1, 1);
+    cnet_tpool *pool = cnet_tpool_init(3, NULL);
+    cnet_tpool_use(pool);
+    cnet_rng_fill_streams(11, y, size, -1, 1);
+    cnet_tpool_use(NULL);
+    cnet_tpool_free(pool);
+    for(long i = 0; i < size; i++)
+        assert(x[i] == y[i] && x[i] >= -1 && x[i] < 1);
+    cnet_rng_fill_streams(12, y, size, -1, 1);
+    same = 1;
+    for(long i = 0; i < size; i++)
+        same &= x[i] == y[i];
+    assert(!same);
+
+    // free all objects, and reseed for the next tests
+    free(x); free(y);
+    cnet_seed(23);
+}
+
+
+/**
+ * A nested parallel for of the pool test: every index of the inner
+ * ranges is counted. */
+typedef struct nested_for {
+    cnet_tpool *pool;
+    atomic_int *hits;
+    int inner;
+} nested_for;
+
+
+/**
+ * Inner range: counts its indices. */
+void count_range(
+    void *arg,
+    long from,
+    long to
+){
+    nested_for const *nested = arg;
+    for(long j = from; j < to; j++)
+        atomic_fetch_add(&nested->hits[j], 1);
+}
+
+
+/**
+ * Outer range: runs a parallel for over the inner indices of each of its
+ * indices. */
+void nest_range(
+    void *arg,
+    long from,
+    long to
+){
+    nested_for const *nested = arg;
+    for(long i = from; i < to; i++)
+        cnet_parallel_for(
+            nested->pool,
+            i * nested->inner,
+            (i + 1) * nested->inner,
+            3,
+            count_range,
+            (void *)nested
+        );
+}
+
+
+/**
+ * Runs parallel fors nested in parallel fors, on pools with and without
+ * workers, checking that every inner index is run exactly once.
+ * */
+void test_tpool_random_inputs() {
+    int outer = 64, inner = 101, rounds = 20;
+    atomic_int *hits = malloc(sizeof(atomic_int)*outer*inner);
+
+    int threads[] = {1, 2, 4};
+    for(unsigned t = 0; t < sizeof(threads) / sizeof(int); t++) {
+        cnet_tpool *pool = cnet_tpool_init(threads[t], NULL);
+        assert(cnet_tpool_threads(pool) == threads[t]);
+        nested_for nested = {pool, hits, inner};
+
+        for(int round = 0; round < rounds; round++) {
+            for(int j = 0; j < outer*inner; j++)
+                atomic_init(&hits[j], 0);
+            cnet_parallel_for(pool, 0, outer, 1 + round % 4, nest_range, &nested);
+            for(int j = 0; j < outer*inner; j++)
+                assert(atomic_load(&hits[j]) == 1);
+        }
+
+        // an empty range runs nothing
+        cnet_parallel_for(pool, 5, 5, 1, nest_range, &nested);
+        for(int j = 0; j < outer*inner; j++)
+            assert(atomic_load(&hits[j]) == 1);
+        cnet_tpool_free(pool);
+    }
+
+    // free all objects
+    free(hits);
+}
+
+
+/**
+ * Predicts through wide dense layers with and without a worker team,
+ * checking that the team predictions are exactly the same.
+ * */
+void test_team_random_inputs() {
+    // sizes
+    int input_size = 32;
+    int output_size = 4;
+    int samples = 50;
+
+    /// 32 -> 128 -> 64 -> 4
+    cnet *nn = nn_init(input_size, output_size, 3);
+    nn_add(nn, input_size, 128, relu_act);
+    nn_add(nn, 128, 64, sigmoid_act);
+    nn_add(nn, 64, output_size, softmax_act);
+    cnet_team *team = cnet_team_init(3, NULL);
+
+    double *X = malloc(sizeof(double)*input_size);
+    double *expected = malloc(sizeof(double)*output_size);
+    for(int i = 0; i < samples; i++) {
+        for(int j = 0; j < input_size; j++)
+            X[j] = (double)rand() / RAND_MAX;
+
+        nn_set_team(nn, NULL);
+        const double *out = nn_predict(nn, X);
+        for(int j = 0; j < output_size; j++)
+            expected[j] = out[j];
+
+        nn_set_team(nn, team);
+        out = nn_predict(nn, X);
+        for(int j = 0; j < output_size; j++)
+            assert(out[j] == expected[j]);
+    }
+
+    // free all objects
+    nn_set_team(nn, NULL);
+    cnet_team_free(team);
+    nn_free(nn);
+    free(X); free(expected);
+}
+
+
+/**
+ * Trains a net in a pipeline of two stages, and a clone of it with plain
+ * gradient accumulation over the same batches, checking that they end up
+ * with the same parameters.
+ * */
+void test_pipeline_random_inputs() {
+    // sizes
+    int input_size = 16;
+    int output_size = 3;
+
+    // samples
+    int train_size = 60;
+    int epochs = 3;
+    int batch = 8;
+    double lr = 0.1;
+
+    double **X = malloc(sizeof(double*)*train_size);
+    double **Y = malloc(sizeof(double*)*train_size);
+    double **X_acc = malloc(sizeof(double*)*train_size);
+    double **Y_acc = malloc(sizeof(double*)*train_size);
+    for (int i = 0; i < train_size; i++) {
+        X[i] = malloc(sizeof(double)*input_size);
+        Y[i] = calloc(output_size, sizeof(double));
+        for(int j = 0; j < input_size; j++)
+            X[i][j] = (double)rand() / RAND_MAX;
+        Y[i][rand() % output_size] = 1;
+        X_acc[i] = X[i];
+        Y_acc[i] = Y[i];
+    }
+
+    /// 16 -> 32 -> 24 -> 3, in two stages of micro-batches of 2
+    cnet *nn = nn_init(input_size, output_size, 3);
+    nn_add(nn, input_size, 32, relu_act);
+    nn_add(nn, 32, 24, sigmoid_act);
+    nn_add(nn, 24, output_size, softmax_act);
+    cnet *acc = nn_clone(nn);
+    nn_set_accumulation(nn, batch);
+    nn_set_accumulation(acc, batch);
+    nn_set_pipeline(nn, 2, 2);
+
+    // train both, over the same shuffles
+    FILE *history_file = fopen("test/test_pipeline_random_inputs.dat", "w");
+    cnet_seed(45);
+    nn_train(
+        nn,
+        X,
+        Y,
+        X,
+        Y,
+        train_size,
+        train_size,
+        cross_entropy_loss,
+        metric_accuracy_argmax,
+        lr,
+        epochs,
+        history_file
+    );
+    cnet_seed(45);
+    nn_train(
+        acc,
+        X_acc,
+        Y_acc,
+        X_acc,
+        Y_acc,
+        train_size,
+        train_size,
+        cross_entropy_loss,
+        metric_accuracy_argmax,
+        lr,
+        epochs,
+        history_file
+    );
+    fclose(history_file);
+
+    for(int l = 0; l < nn->n_layers; l++) {
+        clayer const *layer = nn->layers[l];
+        for(int k = 0; k < layer->w_rows * layer->w_cols; k++)
+            assert(fabs(layer->weights[0][k] - acc->layers[l]->weights[0][k]) < 1e-12);
+        for(int k = 0; k < layer->b_size; k++)
+            assert(fabs(layer->bias[k] - acc->layers[l]->bias[k]) < 1e-12);
+    }
+
+    // free all objects
+    nn_free(acc);
+    nn_free(nn);
+    for(int i = 0; i < train_size; i++) {
+        free(X[i]);
+        free(Y[i]);
+    }
+    free(X); free(Y);
+    free(X_acc); free(Y_acc);
+}
+
+
+/**
+ * Writes a big endian 32 bits integer (IDX dimensions and values). */
+void put_be32(
+    FILE *file,
+    long v
+){
+    for(int shift = 24; shift >= 0; shift -= 8)
+        fputc((v >> shift) & 0xFF, file);
+}
+
+
+/**
+ * Checks an epoch of a file dataset over the rows written by
+ * test_dataset_random_inputs: every row comes once, with its inputs and
+ * class, in batches which do not span two chunks, all full but the last
+ * one of the last chunk (which holds what is left of the rows).
+ * */
+void check_dataset_epoch(
+    cnet_dataset *ds,
+    int shuffle,
+    int const *labels,
+    int rows,
+    int chunk,
+    int batch
+){
+    int *seen = calloc(rows, sizeof(int));
+    int last_chunk = (rows - 1) / chunk, last_rows = 0, partial = 0, next = 0;
+
+    cnet_batch b;
+    cnet_dataset_rewind(ds, shuffle);
+    while (cnet_dataset_next(ds, &b) == 1) {
+        assert(b.labels && !b.Y && b.size >= 1 && b.size <= batch);
+        int first = (int)b.X[0][0];
+        for(int i = 0; i < b.size; i++) {
+            int row = (int)b.X[i][0];
+            assert(row >= 0 && row < rows);
+            assert(row / chunk == first / chunk);
+            assert(shuffle || row == next++);
+            assert(b.X[i][1] == row % 7 && b.X[i][2] == -(row % 3));
+            assert(b.labels[i] == labels[row]);
+            seen[row]++;
+            last_rows += row / chunk == last_chunk;
+        }
+        if (b.size < batch) {
+            partial++;
+            assert(first / chunk == last_chunk);
+            assert(b.size == rows % chunk % batch);
+        }
+    }
+
+    for(int i = 0; i < rows; i++)
+        assert(seen[i] == 1);
+    assert(last_rows == rows - last_chunk * chunk);
+    assert(partial == (rows % chunk % batch != 0));
+    free(seen);
+}
+
+
+/**
+ * Trains a net over a dataset for an epoch, from the same weights and
+ * shuffle as the others.
+ * */
+cnet *train_dataset_epoch(
+    cnet const *init,
+    cnet_dataset *ds,
+    FILE *history_file
+){
+    cnet *nn = nn_clone(init);
+    nn_set_accumulation(nn, 5);
+    cnet_seed(47);
+    int status = nn_train_dataset(
+        nn,
+        ds,
+        NULL,
+        cross_entropy_loss,
+        metric_accuracy_argmax,
+        0.01,
+        1,
+        history_file
+    );
+    assert(status == 0);
+    cnet_dataset_free(ds);
+    return nn;
+}
+
+
+/**
+ * Writes samples to raw matrix files (doubles inputs, 32 bits classes)
+ * and to IDX files (32 bits integers inputs, bytes classes), and reads
+ * them back through the mapped and chunked datasets, over shuffled and
+ * ordered epochs. Then trains over the files, each in a single chunk,
+ * checking that the nets match the one trained over the arrays, and that
+ * an invalid class stops the training.
+ * */
+void test_dataset_random_inputs() {
+    // sizes: the chunks are rounded up to 20 rows, the last one holds 7
+    int rows = 107, cols = 3, classes = 4;
+    int chunk = 18, rounded = 20, batch = 5;
+
+    double **X = malloc(sizeof(double*)*rows);
+    int *labels = malloc(sizeof(int)*rows);
+    FILE *x_raw = fopen("test/test_dataset_random_inputs.x.raw", "w");
+    FILE *y_raw = fopen("test/test_dataset_random_inputs.y.raw", "w");
+    FILE *x_idx = fopen("test/test_dataset_random_inputs.x.idx", "w");
+    FILE *y_idx = fopen("test/test_dataset_random_inputs.y.idx", "w");
+    put_be32(x_idx, 0x0C02);
+    put_be32(x_idx, rows);
+    put_be32(x_idx, cols);
+    put_be32(y_idx, 0x0801);
+    put_be32(y_idx, rows);
+    for(int i = 0; i < rows; i++) {
+        X[i] = malloc(sizeof(double)*cols);
+        X[i][0] = i;
+        X[i][1] = i % 7;
+        X[i][2] = -(i % 3);
+        labels[i] = rand() % classes;
+        fwrite(X[i], sizeof(double), cols, x_raw);
+        fwrite(&labels[i], sizeof(int), 1, y_raw);
+        for(int j = 0; j < cols; j++)
+            put_be32(x_idx, (long)X[i][j]);
+        fputc(labels[i], y_idx);
+    }
+    fclose(x_raw); fclose(y_raw); fclose(x_idx); fclose(y_idx);
+
+    // every row once per epoch, from both sources
+    cnet_dataset *mapped = cnet_dataset_mapped(
+        cnet_matrix_open_idx("test/test_dataset_random_inputs.x.idx"),
+        cnet_matrix_open_idx("test/test_dataset_random_inputs.y.idx"),
+        1, chunk, batch
+    );
+    cnet_dataset *chunked = cnet_dataset_chunked(
+        cnet_matrix_open_raw("test/test_dataset_random_inputs.x.raw", cols, matrix_f64),
+        cnet_matrix_open_raw("test/test_dataset_random_inputs.y.raw", 1, matrix_i32),
+        1, chunk, batch
+    );
+    assert(cnet_dataset_size(mapped) == rows && cnet_dataset_size(chunked) == rows);
+    for(int epoch = 0; epoch < 3; epoch++) {
+        check_dataset_epoch(mapped, epoch < 2, labels, rows, rounded, batch);
+        check_dataset_epoch(chunked, epoch < 2, labels, rows, rounded, batch);
+    }
+    cnet_dataset_free(mapped);
+    cnet_dataset_free(chunked);
+
+    /// 3 -> 8 -> 4, trained from the same weights over each source
+    cnet *init = nn_init(cols, classes, 2);
+    nn_add(init, cols, 8, relu_act);
+    nn_add(init, 8, classes, softmax_act);
+
+    FILE *history_file = fopen("test/test_dataset_random_inputs.dat", "w");
+    cnet *nn = train_dataset_epoch(
+        init, cnet_dataset_arrays(X, NULL, labels, rows, 10), history_file
+    );
+    cnet *from_idx = train_dataset_epoch(init, cnet_dataset_mapped(
+        cnet_matrix_open_idx("test/test_dataset_random_inputs.x.idx"),
+        cnet_matrix_open_idx("test/test_dataset_random_inputs.y.idx"),
+        1, rows, 10
+    ), history_file);
+    cnet *from_raw = train_dataset_epoch(init, cnet_dataset_chunked(
+        cnet_matrix_open_raw("test/test_dataset_random_inputs.x.raw", cols, matrix_f64),
+        cnet_matrix_open_raw("test/test_dataset_random_inputs.y.raw", 1, matrix_i32),
+        1, rows, 10
+    ), history_file);
+
+    int trained = 0;
+    for(int l = 0; l < nn->n_layers; l++) {
+        clayer const *layer = nn->layers[l];
+        for(int k = 0; k < layer->w_rows * layer->w_cols; k++) {
+            trained |= layer->weights[0][k] != init->layers[l]->weights[0][k];
+            assert(from_idx->layers[l]->weights[0][k] == layer->weights[0][k]);
+            assert(from_raw->layers[l]->weights[0][k] == layer->weights[0][k]);
+        }
+        for(int k = 0; k < layer->b_size; k++) {
+            assert(from_idx->layers[l]->bias[k] == layer->bias[k]);
+            assert(from_raw->layers[l]->bias[k] == layer->bias[k]);
+        }
+    }
+    assert(trained);
+
+    // a class out of the outputs, then one which is not a whole number
+    FILE *y_bad = fopen("test/test_dataset_random_inputs.bad.idx", "w");
+    put_be32(y_bad, 0x0801);
+    put_be32(y_bad, rows);
+    for(int i = 0; i < rows; i++)
+        fputc(i == rows / 2 ? classes : labels[i], y_bad);
+    fclose(y_bad);
+    cnet_dataset *bad = cnet_dataset_mapped(
+        cnet_matrix_open_idx("test/test_dataset_random_inputs.x.idx"),
+        cnet_matrix_open_idx("test/test_dataset_random_inputs.bad.idx"),
+        1, chunk, batch
+    );
+    assert(nn_train_dataset(
+        nn, bad, NULL, cross_entropy_loss, metric_accuracy_argmax, 0.01, 1, history_file
+    ) == -1);
+    cnet_dataset_free(bad);
+
+    y_bad = fopen("test/test_dataset_random_inputs.bad.raw", "w");
+    for(int i = 0; i < rows; i++) {
+        double y = i == rows / 2 ? 0.5 : labels[i];
+        fwrite(&y, sizeof(double), 1, y_bad);
+    }
+    fclose(y_bad);
+    bad = cnet_dataset_chunked(
+        cnet_matrix_open_raw("test/test_dataset_random_inputs.x.raw", cols, matrix_f64),
+        cnet_matrix_open_raw("test/test_dataset_random_inputs.bad.raw", 1, matrix_f64),
+        1, chunk, batch
+    );
+    cnet_batch b;
+    int status;
+    cnet_dataset_rewind(bad, 0);
+    while ((status = cnet_dataset_next(bad, &b)) > 0);
+    assert(status == -1);
+    cnet_dataset_free(bad);
+    fclose(history_file);
+
+    // free all objects
+    nn_free(from_raw);
+    nn_free(from_idx);
+    nn_free(nn);
+    nn_free(init);
+    for(int i = 0; i < rows; i++)
+        free(X[i]);
+    free(X); free(labels);
+}
+
+
+/**
+ * Runs a rank of the loopback ring: trains a small net over its shard,
+ * then all-reduces buffers, checking their sums. The last exchanges end
+ * with the ranks done first leaving while the others still receive.
+ *
+ * @return int: Exit status of the rank
+ */
+int run_dist_rank(
+    int rank,
+    int size,
+    char const *address
+){
+    cnet_dist *dist = cnet_dist_init(rank, size, address);
+    if (!dist) return 1;
+
+    // a shard of the samples per rank
+    int input_size = 8, output_size = 2, shard = 20;
+    double **X = malloc(sizeof(double*)*shard);
+    int *y = malloc(sizeof(int)*shard);
+    for(int i = 0; i < shard; i++) {
+        X[i] = malloc(sizeof(double)*input_size);
+        for(int j = 0; j < input_size; j++)
+            X[i][j] = (double)rand() / RAND_MAX;
+        y[i] = X[i][0] > 0.5;
+    }
+
+    cnet *nn = nn_init(input_size, output_size, 2);
+    nn_add(nn, input_size, 8, relu_act);
+    nn_add(nn, 8, output_size, softmax_act);
+    nn_set_accumulation(nn, 4);
+    nn_set_dist(nn, dist);
+    FILE *history_file = fopen("/dev/null", "w");
+    int failed = nn_train_labels(
+        nn, X, y, X, y, shard, shard,
+        cross_entropy_loss, metric_accuracy_argmax, 0.1, 3, history_file
+    ) != 0;
+    fclose(history_file);
+
+    // sums over the ranks, back to back: every slot is multiplied by the
+    // number of ranks from the second sum on
+    int n = 25000, reps = 20;
+    double *buf = malloc(sizeof(double)*n);
+    for(int i = 0; i < n; i++)
+        buf[i] = rank + i % 10;
+    for(int r = 0; r < reps; r++)
+        failed |= cnet_dist_allreduce(dist, buf, n);
+    for(int i = 0; i < n; i++)
+        failed |= buf[i] != (size*(size - 1)/2 + size*(i % 10)) * pow(size, reps - 1);
+
+    nn_free(nn);
+    cnet_dist_free(dist);
+    for(int i = 0; i < shard; i++)
+        free(X[i]);
+    free(X); free(y); free(buf);
+    return failed != 0;
+}
+
+
+/**
+ * Runs rings of local processes, several times, checking the exit status
+ * of every rank (a rank must not fail when its neighbours are done and
+ * leave the ring first).
+ * */
+void test_dist_random_inputs() {
+    int size = 6;
+    int runs = 10;
+    char address[64];
+    snprintf(address, sizeof(address), "unix:/tmp/cnet-test-dist-%d", (int)getpid());
+
+    for(int run = 0; run < runs; run++) {
+        fflush(NULL);
+        for(int rank = 0; rank < size; rank++) {
+            if (fork()) continue;
+            srand(rank + 1);
+            freopen("/dev/null", "w", stdout);
+            exit(run_dist_rank(rank, size, address));
+        }
+
+        for(int rank = 0; rank < size; rank++) {
+            int status;
+            assert(wait(&status) > 0);
+            assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+    }
+}
+
+
+/**
+ * A client of the server test: its samples and their expected outputs. */
+typedef struct serve_client {
+    char const *address;
+    double **X;
+    double *expected;
+    int samples, in_size, out_size;
+    int failed;
+} serve_client;
+
+
+/**
+ * Runs the server until it is stopped. */
+void *run_server(
+    void *arg
+){
+    cnet_server_run(arg);
+    return NULL;
+}
+
+
+/**
+ * Sends the samples of a client back to back over its own connection,
+ * comparing the predictions with the expected ones. */
+void *run_serve_client(
+    void *arg
+){
+    serve_client *c = arg;
+    int fd = cnet_client_connect(c->address);
+    if (fd < 0) {
+        c->failed = 1;
+        return NULL;
+    }
+    double *out = malloc(sizeof(double)*c->out_size);
+    for(int i = 0; i < c->samples; i++) {
+        c->failed |= cnet_client_predict(fd, c->X[i], c->in_size, out, c->out_size) != 0;
+        for(int j = 0; j < c->out_size; j++)
+            c->failed |= fabs(out[j] - c->expected[i*c->out_size + j]) > 1e-12;
+    }
+    close(fd);
+    free(out);
+    return NULL;
+}
+
+
+/**
+ * Starts a server in process, predicts samples from several concurrent
+ * clients (so that they are batched), checking the results against
+ * nn_predict, then stops it.
+ * */
+void test_serve_random_inputs() {
+    // sizes
+    int input_size = 12;
+    int output_size = 3;
+    int samples = 100, n_clients = 4;
+
+    /// 12 -> 16 -> 3
+    cnet *nn = nn_init(input_size, output_size, 2);
+    nn_add(nn, input_size, 16, relu_act);
+    nn_add(nn, 16, output_size, softmax_act);
+
+    double **X = malloc(sizeof(double*)*samples);
+    double *expected = malloc(sizeof(double)*samples*output_size);
+    for(int i = 0; i < samples; i++) {
+        X[i] = malloc(sizeof(double)*input_size);
+        for(int j = 0; j < input_size; j++)
+            X[i][j] = (double)rand() / RAND_MAX;
+        const double *out = nn_predict(nn, X[i]);
+        for(int j = 0; j < output_size; j++)
+            expected[i*output_size + j] = out[j];
+    }
+
+    char address[64];
+    snprintf(address, sizeof(address), "unix:/tmp/cnet-test-serve-%d", (int)getpid());
+    cnet_server_config config = {8, 500, 2};
+    cnet_server *server = cnet_server_init(nn, address, &config);
+    assert(server);
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, run_server, server);
+
+    // sizes, then a wrong input size, on a connection still usable after
+    int fd = cnet_client_connect(address);
+    int in_size, out_size;
+    assert(fd >= 0);
+    assert(cnet_client_info(fd, &in_size, &out_size) == 0);
+    assert(in_size == input_size && out_size == output_size);
+    double out[3];
+    assert(cnet_client_predict(fd, X[0], input_size - 1, out, output_size) == -1);
+    assert(cnet_client_predict(fd, X[0], input_size, out, output_size) == 0);
+    assert(fabs(out[0] - expected[0]) <= 1e-12);
+
+    // every client predicts all the samples
+    pthread_t threads[4];
+    serve_client clients[4];
+    for(int c = 0; c < n_clients; c++) {
+        clients[c] = (serve_client){
+            address, X, expected, samples, input_size, output_size, 0
+        };
+        pthread_create(&threads[c], NULL, run_serve_client, &clients[c]);
+    }
+    for(int c = 0; c < n_clients; c++) {
+        pthread_join(threads[c], NULL);
+        assert(!clients[c].failed);
+    }
+
+    cnet_server_stats stats = cnet_server_get_stats(server);
+    // (the wrong input size was answered too)
+    assert(stats.requests == 2 + n_clients*samples);
+    assert(stats.batches >= 1 && stats.batches <= stats.requests);
+
+    // free all objects
+    close(fd);
+    cnet_server_stop(server);
+    pthread_join(server_thread, NULL);
+    cnet_server_free(server);
+    nn_free(nn);
+    for(int i = 0; i < samples; i++)
+        free(X[i]);
+    free(X); free(expected);
+}
+
+
+/**
+ * A reader of the model test: the published state, and what it saw. */
+typedef struct model_reader {
+    cnet_model *model;
+    atomic_int *done;
+    long acquired;
+    int failed;
+} model_reader;
+
+
+/**
+ * Acquires and releases the model until the publisher is done, checking
+ * that the versions never go back, and that every network is the one of
+ * its version (its bias is its serial).
+ * */
+void *read_model(
+    void *arg
+){
+    model_reader *reader = arg;
+    long last = 0;
+    while (!atomic_load(reader->done)) {
+        cnet_ref ref = cnet_model_acquire(reader->model);
+        reader->failed |= ref.serial < last;
+        reader->failed |= ref.nn->layers[0]->bias[0] != ref.serial;
+        last = ref.serial;
+        cnet_model_release(&ref);
+        reader->acquired++;
+    }
+    return NULL;
+}
+
+
+/**
+ * A network of the model test, its bias set to its serial.
+ * */
+cnet *model_version(
+    long serial
+){
+    cnet *nn = nn_init(128, 128, 1);
+    nn_add(nn, 128, 128, sigmoid_act);
+    nn->layers[0]->bias[0] = serial;
+    return nn;
+}
+
+
+/**
+ * Publishes networks while readers acquire and release the model, then
+ * checks that the serials increase, and that every version but the
+ * current one was freed: the weights, larger than what the allocator
+ * caches per thread, are back to the heap as soon as freed, so the heap
+ * in use grows by a version at most.
+ * */
+void test_model_random_inputs() {
+    int versions = 200, n_readers = 3;
+    size_t weights = sizeof(double)*128*128;
+    size_t heap = mallinfo2().uordblks;
+
+    cnet_model *model = cnet_model_init(model_version(1));
+    assert(mallinfo2().uordblks >= heap + weights);
+
+    atomic_int done;
+    atomic_init(&done, 0);
+    pthread_t threads[3];
+    model_reader readers[3];
+    for(int r = 0; r < n_readers; r++) {
+        readers[r] = (model_reader){model, &done, 0, 0};
+        pthread_create(&threads[r], NULL, read_model, &readers[r]);
+    }
+
+    for(long serial = 2; serial <= versions; serial++) {
+        assert(cnet_model_publish(model, model_version(serial)) == serial);
+        sched_yield();
+    }
+    atomic_store(&done, 1);
+    for(int r = 0; r < n_readers; r++) {
+        pthread_join(threads[r], NULL);
+        assert(!readers[r].failed && readers[r].acquired > 0);
+    }
+
+    // only the current version is left, until the handle is freed
+    cnet_ref ref = cnet_model_acquire(model);
+    assert(ref.serial == versions);
+    cnet_model_release(&ref);
+    assert(mallinfo2().uordblks < heap + 2*weights);
+    cnet_model_free(model);
+    assert(mallinfo2().uordblks < heap + weights);
+}
+
+
+/**
+ * Enables the NUMA mode and interleaves a dataset and a net, checking
+ * that the predictions are unchanged (on a single node, or without
+ * libnuma, only the pool is replaced). Run last: it pins the main thread.
+ * */
+void test_numa_random_inputs() {
+    // sizes
+    int input_size = 16;
+    int output_size = 4;
+    int samples = 40;
+
+    // rows in a single block, then rows of their own
+    double *block = malloc(sizeof(double)*samples*input_size);
+    double **X = malloc(sizeof(double*)*samples);
+    for(int i = 0; i < samples; i++) {
+        X[i] = i < samples / 2 ? block + i*input_size : malloc(sizeof(double)*input_size);
+        for(int j = 0; j < input_size; j++)
+            X[i][j] = (double)rand() / RAND_MAX;
+    }
+
+    /// 16 -> 32 -> 4
+    cnet *nn = nn_init(input_size, output_size, 2);
+    nn_add(nn, input_size, 32, relu_act);
+    nn_add(nn, 32, output_size, softmax_act);
+    double *expected = malloc(sizeof(double)*samples*output_size);
+    for(int i = 0; i < samples; i++)
+        for(int j = 0; j < output_size; j++)
+            expected[i*output_size + j] = nn_predict(nn, X[i])[j];
+
+    // the pool is replaced, unless the main thread cannot be pinned
+    cnet_tpool *pool = cnet_tpool_get();
+    int nodes = cnet_numa_init();
+    assert(nodes == cnet_numa_nodes() || nodes == -1);
+    assert(nodes < 0 || cnet_tpool_get() != pool);
+    assert(cnet_tpool_threads(cnet_tpool_get()) >= 1);
+
+    cnet_numa_interleave_rows(X, samples, input_size);
+    nn_numa_interleave(nn);
+    for(int i = 0; i < samples; i++)
+        for(int j = 0; j < output_size; j++)
+            assert(nn_predict(nn, X[i])[j] == expected[i*output_size + j]);
+
+    // local memory is usable
+    double *local = cnet_numa_alloc_local(sizeof(double)*samples);
+    for(int i = 0; i < samples; i++)
+        local[i] = i;
+    assert(local[samples - 1] == samples - 1);
+    cnet_numa_free(local, sizeof(double)*samples);
+
+    // free all objects
+    nn_free(nn);
+    for(int i = samples / 2; i < samples; i++)
+        free(X[i]);
+    free(X); free(block); free(expected);
+}
+
+
 /**
  * Run all tests. */
 int main() {
 
-    // set random seed
+    // set random seeds (samples and weights)
     srand((unsigned int)23);
+    cnet_seed(23);
 
     // random inputs
     printf(
@@ -127,6 +1377,123 @@ int main() {
 
     test_random_inputs();
 
+    // convolutional net
+    printf(
+        "*************************************************************\n"
+        "                 RUNNING CONV WITH RANDOM INPUT              \n"
+        "*************************************************************\n"
+    );
+
+    test_conv_random_inputs();
+
+    // embedding net
+    printf(
+        "*************************************************************\n"
+        "              RUNNING EMBEDDING WITH RANDOM INPUT            \n"
+        "*************************************************************\n"
+    );
+
+    test_embedding_random_inputs();
+
+    // half precision checkpoint
+    printf(
+        "*************************************************************\n"
+        "          RUNNING HALF CHECKPOINT WITH RANDOM INPUT          \n"
+        "*************************************************************\n"
+    );
+
+    test_half_checkpoint_random_inputs();
+
+    // prediction team
+    printf(
+        "*************************************************************\n"
+        "                RUNNING TEAM WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_team_random_inputs();
+
+    // nested parallel fors
+    printf(
+        "*************************************************************\n"
+        "               RUNNING TPOOL WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_tpool_random_inputs();
+
+    // random generators
+    printf(
+        "*************************************************************\n"
+        "                RUNNING RNG WITH RANDOM INPUT                \n"
+        "*************************************************************\n"
+    );
+
+    test_rng_random_inputs();
+
+    // linear algebra
+    printf(
+        "*************************************************************\n"
+        "                RUNNING BLAS WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_blas_random_inputs();
+
+    // pipeline training
+    printf(
+        "*************************************************************\n"
+        "              RUNNING PIPELINE WITH RANDOM INPUT             \n"
+        "*************************************************************\n"
+    );
+
+    test_pipeline_random_inputs();
+
+    // dataset files
+    printf(
+        "*************************************************************\n"
+        "              RUNNING DATASET WITH RANDOM INPUT              \n"
+        "*************************************************************\n"
+    );
+
+    test_dataset_random_inputs();
+
+    // distributed training
+    printf(
+        "*************************************************************\n"
+        "                RUNNING DIST WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_dist_random_inputs();
+
+    // model handle
+    printf(
+        "*************************************************************\n"
+        "               RUNNING MODEL WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_model_random_inputs();
+
+    // inference server
+    printf(
+        "*************************************************************\n"
+        "               RUNNING SERVE WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_serve_random_inputs();
+
+    // NUMA mode
+    printf(
+        "*************************************************************\n"
+        "                RUNNING NUMA WITH RANDOM INPUT               \n"
+        "*************************************************************\n"
+    );
+
+    test_numa_random_inputs();
+
     printf(
         "*************************************************************\n"
         "                           PASSED                            \n"
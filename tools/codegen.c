@@ -0,0 +1,290 @@
+/**
+ * CNet Code Generator.
+ *
+ * Reads a saved CNet model and emits a standalone C11 source file with a
+ * fixed-shape inference function. The weights are emitted as aligned
+ * `static const` arrays and every loop bound is a compile-time constant,
+ * so the compiler can unroll and vectorize each layer. The generated code
+ * does not use the heap and does not depend on libcnet (only on libm).
+ *
+ * Usage: cnet-codegen <model file> <output .c file> [name]
+ *
+ * The generated file defines:
+ *   <name>_IN_SIZE, <name>_OUT_SIZE
+ *   void <name>_predict(double const *in, double *out);
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include "cnet.h"
+
+#define ALIGNMENT 64
+
+
+/**
+ * Emit a constant array. */
+void emit_array(
+    FILE *out,
+    char const *type,
+    char const *name,
+    int layer,
+    void const *values,
+    int size
+){
+    fprintf(
+        out,
+        "_Alignas(%d) static const %s %s%d[%d] = {",
+        ALIGNMENT,
+        type,
+        name,
+        layer,
+        size > 0 ? size : 1
+    );
+    for(int i = 0; i < size; i++) {
+        if (i % 4 == 0) fprintf(out, "\n   ");
+        if (!strcmp(type, "int"))
+            fprintf(out, " %d,", ((int const *)values)[i]);
+        else
+            fprintf(out, " %.17g,", ((double const *)values)[i]);
+    }
+    fprintf(out, "%s\n};\n\n", size > 0 ? "" : " 0");
+}
+
+
+/**
+ * Emit the activation of a layer output. */
+void emit_activation(
+    FILE *out,
+    enum cnet_act_type activation,
+    char const *dst,
+    int size
+){
+    switch(activation) {
+        case relu_act:
+            fprintf(out,
+                "    for (int i = 0; i < %d; i++)\n"
+                "        %s[i] = %s[i] > 0 ? %s[i] : 0;\n",
+                size, dst, dst, dst);
+            break;
+        case sigmoid_act:
+            fprintf(out,
+                "    for (int i = 0; i < %d; i++)\n"
+                "        %s[i] = 1/(1 + expf(-%s[i]));\n",
+                size, dst, dst);
+            break;
+        case softmax_act:
+            fprintf(out,
+                "    {\n"
+                "        double max = %s[0], sum = 0;\n"
+                "        for (int i = 0; i < %d; i++)\n"
+                "            max = max < %s[i] ? %s[i] : max;\n"
+                "        for (int i = 0; i < %d; i++)\n"
+                "            sum += expf(%s[i] - max);\n"
+                "        for (int i = 0; i < %d; i++)\n"
+                "            %s[i] = expf(%s[i] - max) / sum;\n"
+                "    }\n",
+                dst, size, dst, dst, size, dst, size, dst, dst);
+            break;
+        case linear_act:
+            break;
+    }
+}
+
+
+/**
+ * Emit the parameters of a layer. */
+void emit_params(
+    FILE *out,
+    clayer const *layer,
+    int l
+){
+    if (layer->b_size)
+        emit_array(out, "double", "b", l, layer->bias, layer->b_size);
+    if (layer->w_rows)
+        emit_array(
+            out,
+            "double",
+            "w",
+            l,
+            layer->weights[0],
+            layer->w_rows * layer->w_cols
+        );
+    if (layer->type == sparse_layer) {
+        emit_array(out, "int", "r", l, layer->csr_rows, layer->out_size + 1);
+        emit_array(out, "int", "c", l, layer->csr_cols, layer->csr_nnz);
+        emit_array(out, "double", "v", l, layer->csr_vals, layer->csr_nnz);
+    }
+}
+
+
+/**
+ * Emit the forward pass of a layer, from src into dst. */
+void emit_layer(
+    FILE *out,
+    clayer const *layer,
+    int l,
+    char const *src,
+    char const *dst
+){
+    cnet_shape is = layer->in_shape, os = layer->out_shape;
+    fprintf(out, "    /* layer %d */\n", l);
+
+    switch(layer->type) {
+        case dense_layer:
+            fprintf(out,
+                "    for (int k = 0; k < %d; k++) {\n"
+                "        double z = 0;\n"
+                "        for (int j = 0; j < %d; j++)\n"
+                "            z += w%d[k*%d + j] * %s[j];\n"
+                "        %s[k] = z + b%d[k];\n"
+                "    }\n",
+                layer->out_size, layer->in_size, l, layer->in_size, src,
+                dst, l);
+            break;
+        case sparse_layer:
+            fprintf(out,
+                "    for (int k = 0; k < %d; k++) {\n"
+                "        double z0 = 0, z1 = 0, z2 = 0, z3 = 0;\n"
+                "        int t = r%d[k];\n"
+                "        for (; t + 3 < r%d[k + 1]; t += 4) {\n"
+                "            z0 += v%d[t] * %s[c%d[t]];\n"
+                "            z1 += v%d[t + 1] * %s[c%d[t + 1]];\n"
+                "            z2 += v%d[t + 2] * %s[c%d[t + 2]];\n"
+                "            z3 += v%d[t + 3] * %s[c%d[t + 3]];\n"
+                "        }\n"
+                "        for (; t < r%d[k + 1]; t++)\n"
+                "            z0 += v%d[t] * %s[c%d[t]];\n"
+                "        %s[k] = (z0 + z1) + (z2 + z3) + b%d[k];\n"
+                "    }\n",
+                layer->out_size, l, l, l, src, l, l, src, l, l, src, l,
+                l, src, l, l, l, src, l, dst, l);
+            break;
+        case embedding_layer:
+            fprintf(out,
+                "    for (int f = 0; f < %d; f++)\n"
+                "        for (int j = 0; j < %d; j++)\n"
+                "            %s[f*%d + j] = w%d[(int)%s[f]*%d + j];\n",
+                layer->in_size, layer->w_cols,
+                dst, layer->w_cols, l, src, layer->w_cols);
+            break;
+        case conv2d_layer:
+            fprintf(out,
+                "    for (int f = 0; f < %d; f++)\n"
+                "    for (int oy = 0; oy < %d; oy++)\n"
+                "    for (int ox = 0; ox < %d; ox++) {\n"
+                "        double z = 0;\n"
+                "        for (int c = 0; c < %d; c++)\n"
+                "        for (int ky = 0; ky < %d; ky++)\n"
+                "        for (int kx = 0; kx < %d; kx++) {\n"
+                "            int iy = oy*%d - %d + ky, ix = ox*%d - %d + kx;\n"
+                "            if (iy < 0 || iy >= %d || ix < 0 || ix >= %d) continue;\n"
+                "            z += w%d[f*%d + (c*%d + ky)*%d + kx] *\n"
+                "                 %s[(c*%d + iy)*%d + ix];\n"
+                "        }\n"
+                "        %s[(f*%d + oy)*%d + ox] = z + b%d[f];\n"
+                "    }\n",
+                os.channels, os.height, os.width,
+                is.channels, layer->kernel, layer->kernel,
+                layer->stride, layer->padding, layer->stride, layer->padding,
+                is.height, is.width,
+                l, layer->w_cols, layer->kernel, layer->kernel,
+                src, is.height, is.width,
+                dst, os.height, os.width, l);
+            break;
+        case maxpool_layer:
+        case avgpool_layer:
+            fprintf(out,
+                "    for (int c = 0; c < %d; c++)\n"
+                "    for (int oy = 0; oy < %d; oy++)\n"
+                "    for (int ox = 0; ox < %d; ox++) {\n"
+                "        double const *win = %s + (c*%d + oy*%d)*%d + ox*%d;\n"
+                "        double res = %s;\n"
+                "        for (int ky = 0; ky < %d; ky++)\n"
+                "        for (int kx = 0; kx < %d; kx++)\n",
+                os.channels, os.height, os.width,
+                src, is.height, layer->stride, is.width, layer->stride,
+                layer->type == maxpool_layer ? "win[0]" : "0",
+                layer->kernel, layer->kernel);
+            if (layer->type == maxpool_layer)
+                fprintf(out,
+                    "            res = win[ky*%d + kx] > res ? win[ky*%d + kx] : res;\n"
+                    "        %s[(c*%d + oy)*%d + ox] = res;\n"
+                    "    }\n",
+                    is.width, is.width, dst, os.height, os.width);
+            else
+                fprintf(out,
+                    "            res += win[ky*%d + kx];\n"
+                    "        %s[(c*%d + oy)*%d + ox] = res / %d;\n"
+                    "    }\n",
+                    is.width, dst, os.height, os.width,
+                    layer->kernel * layer->kernel);
+            break;
+    }
+
+    emit_activation(out, layer->activation, dst, layer->out_size);
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <model> <output.c> [name]\n", argv[0]);
+        return 1;
+    }
+    char const *name = argc > 3 ? argv[3] : "cnet_model";
+
+    // load model from file
+    FILE *model_file = fopen(argv[1], "r");
+    if (!model_file) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[1]);
+        return 1;
+    }
+    cnet *nn = nn_load(model_file);
+    fclose(model_file);
+    if (!nn) {
+        fprintf(stderr, "Failed to load model: %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[2]);
+        nn_free(nn);
+        return 1;
+    }
+
+    // header and parameters
+    fprintf(out,
+        "/**\n"
+        " * Generated by cnet-codegen from %s.\n"
+        " * Standalone fixed-shape inference, do not edit.\n"
+        " **/\n\n"
+        "#include <math.h>\n\n"
+        "#define %s_IN_SIZE %d\n"
+        "#define %s_OUT_SIZE %d\n\n"
+        "void %s_predict(double const *in, double *out);\n\n\n",
+        argv[1], name, nn->in_size, name, nn->out_size, name);
+
+    for(int l = 0; l < nn->n_layers; l++)
+        emit_params(out, nn->layers[l], l);
+
+    // inference function, every layer output lives on the stack
+    fprintf(out, "\nvoid %s_predict(double const *in, double *out)\n{\n", name);
+    for(int l = 0; l < nn->n_layers - 1; l++)
+        fprintf(out, "    double h%d[%d];\n", l, nn->layers[l]->out_size);
+    fprintf(out, "\n");
+
+    // every layer reads the previous output, the last one writes out
+    char src[32] = "in", dst[32];
+    for(int l = 0; l < nn->n_layers; l++) {
+        if (l < nn->n_layers - 1) sprintf(dst, "h%d", l);
+        else sprintf(dst, "out");
+        if (l) fprintf(out, "\n");
+        emit_layer(out, nn->layers[l], l, src, dst);
+        strcpy(src, dst);
+    }
+    fprintf(out, "}\n");
+
+    fclose(out);
+    nn_free(nn);
+    return 0;
+}
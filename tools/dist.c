@@ -0,0 +1,169 @@
+/**
+ * CNet Distributed Training Demo.
+ *
+ * Trains a random MLP over a synthetic classification dataset split in
+ * shards between a ring of processes (see nn_set_dist), checks that every
+ * rank ends up with the same parameters, and measures the all-reduce
+ * throughput over a buffer the size of the network gradient. Every rank
+ * starts from its own random weights, replaced by those of the rank 0.
+ * Without a rank, all the processes are started on this machine (over
+ * loopback for a tcp address); only the rank 0 logs its training.
+ *
+ * Usage: cnet-dist [processes] [address] [rank]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "cnet.h"
+#include "dist.h"
+#include "helpers.h"
+#include "random.h"
+
+#define DEFAULT_PROCESSES 4
+#define DEFAULT_ADDRESS "unix:/tmp/cnet-dist"
+#define SAMPLES 4096
+#define FEATURES 64
+#define HIDDEN 128
+#define CLASSES 4
+#define BATCH 32
+#define EPOCHS 5
+#define REPS 20
+
+
+/**
+ * Seconds since an arbitrary point. */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Train a shard on one rank, returns the exit status. */
+int run_rank(
+    int rank,
+    int size,
+    char const *address
+){
+    cnet_dist *dist = cnet_dist_init(rank, size, address);
+    if (!dist) {
+        fprintf(stderr, "Rank %d: could not join the ring at %s\n", rank, address);
+        return 1;
+    }
+    if (rank) freopen("/dev/null", "w", stdout);
+
+    // the same dataset on every rank, labelled by a random linear teacher
+    cnet_seed(1);
+    double *data = malloc(sizeof(double)*SAMPLES*FEATURES);
+    double *teacher = malloc(sizeof(double)*CLASSES*FEATURES);
+    cnet_rng_fill(cnet_rng_local(), data, (long)SAMPLES*FEATURES, -1, 1);
+    cnet_rng_fill(cnet_rng_local(), teacher, CLASSES*FEATURES, -1, 1);
+
+    // every rank keeps one sample out of size (shard), and validates on
+    // the samples of the rank 0
+    int shard = 0, val = 0;
+    double **X = malloc(sizeof(double*)*SAMPLES), **X_val = malloc(sizeof(double*)*SAMPLES);
+    int *y = malloc(sizeof(int)*SAMPLES), *y_val = malloc(sizeof(int)*SAMPLES);
+    for(int i = 0; i < SAMPLES; i++) {
+        double *x = data + (long)i*FEATURES, scores[CLASSES];
+        for(int c = 0; c < CLASSES; c++) {
+            scores[c] = 0;
+            for(int j = 0; j < FEATURES; j++)
+                scores[c] += teacher[c*FEATURES + j] * x[j];
+        }
+        int label = (int)cnet_argmax(scores, CLASSES);
+        if (i % size == rank) {
+            X[shard] = x;
+            y[shard++] = label;
+        }
+        if (i % size == 0) {
+            X_val[val] = x;
+            y_val[val++] = label;
+        }
+    }
+
+    // different random weights on every rank, until the broadcast
+    cnet_seed(100 + rank);
+    cnet *nn = nn_init(FEATURES, CLASSES, 3);
+    nn_add(nn, FEATURES, HIDDEN, relu_act);
+    nn_add(nn, HIDDEN, HIDDEN, relu_act);
+    nn_add(nn, HIDDEN, CLASSES, softmax_act);
+    nn_set_accumulation(nn, BATCH);
+    nn_set_dist(nn, dist);
+
+    printf("Ranks: %d - Samples per rank: %d - Batch per rank: %d \n", size, shard, BATCH);
+    FILE *history = fopen("/dev/null", "w");
+    double start = now();
+    int failed = nn_train_labels(
+        nn, X, y, X_val, y_val, shard, val,
+        cross_entropy_loss, metric_accuracy_argmax, 0.1, EPOCHS, history
+    );
+    printf("Training: %.3lf s \n", now() - start);
+    fclose(history);
+
+    // every rank sums its parameters, the ranks compare their sums
+    long n_params = 0;
+    double *sums = calloc(size, sizeof(double));
+    for(int l = 0; l < nn->n_layers; l++) {
+        clayer const *layer = nn->layers[l];
+        for(int k = 0; k < layer->w_rows * layer->w_cols; k++)
+            sums[rank] += layer->weights[0][k] * (k % 7 + 1);
+        for(int k = 0; k < layer->b_size; k++)
+            sums[rank] += layer->bias[k];
+        n_params += layer->w_rows * layer->w_cols + layer->b_size;
+    }
+    failed |= cnet_dist_allreduce(dist, sums, size);
+    for(int r = 1; r < size; r++)
+        failed |= sums[r] != sums[0];
+    printf("Parameters %s on every rank \n", failed ? "DIFFER" : "identical");
+
+    // all-reduce throughput over a gradient sized buffer
+    double *buf = calloc(n_params, sizeof(double));
+    cnet_dist_allreduce(dist, buf, n_params);
+    start = now();
+    for(int r = 0; r < REPS; r++)
+        failed |= cnet_dist_allreduce(dist, buf, n_params);
+    double elapsed = (now() - start) / REPS;
+    printf(
+        "All-reduce, %ld doubles: %.3lf ms - %.1lf MB/s \n",
+        n_params,
+        elapsed * 1e3,
+        n_params * sizeof(double) / elapsed / 1e6
+    );
+
+    free(buf);
+    free(sums);
+    nn_free(nn);
+    cnet_dist_free(dist);
+    free(y_val);
+    free(y);
+    free(X_val);
+    free(X);
+    free(teacher);
+    free(data);
+    return failed;
+}
+
+
+int main(int argc, char **argv) {
+    int size = argc > 1 ? atoi(argv[1]) : DEFAULT_PROCESSES;
+    char const *address = argc > 2 ? argv[2] : DEFAULT_ADDRESS;
+    if (argc > 3) return run_rank(atoi(argv[3]), size, address);
+
+    // all the ranks on this machine
+    for(int rank = 0; rank < size; rank++)
+        if (!fork()) return run_rank(rank, size, address);
+
+    int failed = 0, status;
+    for(int rank = 0; rank < size; rank++)
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            failed = 1;
+    return failed;
+}
@@ -0,0 +1,113 @@
+/**
+ * CNet Single Prediction Latency Benchmark.
+ *
+ * Times nn_predict on a random MLP with square hidden layers, predicting
+ * alone and with worker teams of growing size splitting the layers (see
+ * nn_set_team), and reports the median and tail latencies of each size.
+ * The first line predicts without a team (large layers may still be split
+ * on the thread pool). The workers are pinned to the cores following the
+ * calling thread.
+ *
+ * Usage: cnet-latency [max threads] [width] [hidden layers] [predictions]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "cnet.h"
+#include "random.h"
+#include "team.h"
+
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_LAYERS 3
+#define DEFAULT_PREDICTIONS 2000
+#define WARMUP 100
+
+
+/**
+ * Microseconds since an arbitrary point. */
+double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/**
+ * Compare two doubles (qsort helper). */
+int cmp_double(
+    void const *a,
+    void const *b
+){
+    double x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+
+int main(int argc, char **argv) {
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = argc > 1 ? atoi(argv[1]) : cores;
+    int width = argc > 2 ? atoi(argv[2]) : DEFAULT_WIDTH;
+    int layers = argc > 3 ? atoi(argv[3]) : DEFAULT_LAYERS;
+    int predictions = argc > 4 ? atoi(argv[4]) : DEFAULT_PREDICTIONS;
+
+    // random MLP and inputs
+    cnet *nn = nn_init(width, 10, layers + 1);
+    for(int i = 0; i < layers; i++)
+        nn_add(nn, width, width, relu_act);
+    nn_add(nn, width, 10, softmax_act);
+
+    double *X = malloc(sizeof(double)*width);
+    cnet_rng_fill(cnet_rng_local(), X, width, -1, 1);
+
+    int *cpus = malloc(sizeof(int)*(max_threads > 1 ? max_threads : 1));
+    for(int i = 0; i < max_threads; i++)
+        cpus[i] = (i + 1) % cores;
+    double *times = malloc(sizeof(double)*predictions);
+
+    printf(
+        "Width: %d - Hidden layers: %d - Cores: %d \n"
+        "threads  p50 (us)   p99 (us)   max (us)   speedup (p50) \n",
+        width,
+        layers,
+        cores
+    );
+
+    double base = 0;
+    for(int threads = 1; threads <= max_threads; threads++) {
+        cnet_team *team = cnet_team_init(threads, cpus);
+        nn_set_team(nn, threads > 1 ? team : NULL);
+
+        for(int i = 0; i < WARMUP; i++)
+            nn_predict(nn, X);
+        for(int i = 0; i < predictions; i++) {
+            double start = now_us();
+            nn_predict(nn, X);
+            times[i] = now_us() - start;
+        }
+        qsort(times, predictions, sizeof(double), cmp_double);
+
+        double p50 = times[predictions / 2];
+        if (threads == 1) base = p50;
+        printf(
+            "%-8d %-10.2lf %-10.2lf %-10.2lf %.2lf \n",
+            threads,
+            p50,
+            times[(int)(predictions * 0.99)],
+            times[predictions - 1],
+            base / p50
+        );
+
+        nn_set_team(nn, NULL);
+        cnet_team_free(team);
+    }
+
+    free(times);
+    free(cpus);
+    free(X);
+    nn_free(nn);
+    return 0;
+}
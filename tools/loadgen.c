@@ -0,0 +1,143 @@
+/**
+ * CNet Inference Server Load Generator.
+ *
+ * Opens a connection per client to a cnet-serve server (see serve.h),
+ * every client sending random prediction requests back to back, then
+ * reports the request throughput and the latencies seen by the clients,
+ * followed by the server statistics.
+ *
+ * Usage: cnet-loadgen <address> [clients] [requests per client]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "random.h"
+#include "serve.h"
+
+#define DEFAULT_CLIENTS 16
+#define DEFAULT_REQUESTS 1000
+#define STATS_SIZE 8192
+
+
+typedef struct client {
+    char const *address;
+    int requests, failed;
+    double *latencies;
+} client;
+
+
+/**
+ * Microseconds since an arbitrary point. */
+double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/**
+ * Compare two doubles (qsort helper). */
+int cmp_double(
+    void const *a,
+    void const *b
+){
+    double x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+
+void *run_client(
+    void *arg
+){
+    client *c = arg;
+    int in_size, out_size;
+    int fd = cnet_client_connect(c->address);
+    if (fd < 0 || cnet_client_info(fd, &in_size, &out_size)) {
+        c->failed = c->requests;
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+
+    double *X = malloc(sizeof(double)*in_size);
+    double *out = malloc(sizeof(double)*out_size);
+    for(int r = 0; r < c->requests; r++) {
+        cnet_rng_fill(cnet_rng_local(), X, in_size, 0, 1);
+        double start = now_us();
+        if (cnet_client_predict(fd, X, in_size, out, out_size)) {
+            c->failed = c->requests - r;
+            break;
+        }
+        c->latencies[r] = now_us() - start;
+    }
+
+    free(out);
+    free(X);
+    close(fd);
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <address> [clients] [requests per client]\n", argv[0]);
+        return 1;
+    }
+    int n_clients = argc > 2 ? atoi(argv[2]) : DEFAULT_CLIENTS;
+    int requests = argc > 3 ? atoi(argv[3]) : DEFAULT_REQUESTS;
+
+    client *clients = malloc(sizeof(client)*n_clients);
+    pthread_t *threads = malloc(sizeof(pthread_t)*n_clients);
+    double *latencies = malloc(sizeof(double)*n_clients*requests);
+
+    double start = now_us();
+    for(int i = 0; i < n_clients; i++) {
+        clients[i] = (client){argv[1], requests, 0, latencies + (long)i*requests};
+        pthread_create(&threads[i], NULL, run_client, &clients[i]);
+    }
+    int failed = 0;
+    for(int i = 0; i < n_clients; i++) {
+        pthread_join(threads[i], NULL);
+        failed += clients[i].failed;
+    }
+    double elapsed = (now_us() - start) / 1e6;
+
+    // latencies of the answered requests
+    int answered = 0;
+    for(int i = 0; i < n_clients; i++)
+        for(int r = 0; r < requests - clients[i].failed; r++)
+            latencies[answered++] = clients[i].latencies[r];
+    qsort(latencies, answered, sizeof(double), cmp_double);
+
+    printf(
+        "Clients: %d - Requests: %d - Failed: %d - Throughput: %.1lf req/s \n",
+        n_clients,
+        answered,
+        failed,
+        answered / elapsed
+    );
+    if (answered)
+        printf(
+            "Client latency (us): p50 %.1lf - p90 %.1lf - p99 %.1lf - max %.1lf \n",
+            latencies[answered / 2],
+            latencies[(int)(answered * 0.9)],
+            latencies[(int)(answered * 0.99)],
+            latencies[answered - 1]
+        );
+
+    // server side statistics
+    char text[STATS_SIZE];
+    int fd = cnet_client_connect(argv[1]);
+    if (fd >= 0 && !cnet_client_stats(fd, text, STATS_SIZE))
+        printf("Server:\n%s", text);
+    if (fd >= 0) close(fd);
+
+    free(latencies);
+    free(threads);
+    free(clients);
+    return failed ? 1 : 0;
+}
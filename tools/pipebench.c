@@ -0,0 +1,130 @@
+/**
+ * CNet Pipeline Training Benchmark.
+ *
+ * Streams batches of a random dataset through the pipeline stages (see
+ * pipeline.h) of a random MLP with square hidden layers, for every number
+ * of stages, and reports the training throughput (forward, loss and
+ * backward passes, without the optimizer steps). One stage is the same
+ * micro-batched training on the calling thread alone.
+ *
+ * Usage: cnet-pipebench [max stages] [width] [hidden layers] [batch] [micro batch]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "cnet.h"
+#include "helpers.h"
+#include "pipeline.h"
+#include "random.h"
+
+#define DEFAULT_WIDTH 512
+#define DEFAULT_LAYERS 7
+#define DEFAULT_BATCH 64
+#define DEFAULT_MICRO 8
+#define SAMPLES 1024
+#define CLASSES 10
+
+
+/**
+ * Seconds since an arbitrary point. */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv) {
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int layers = argc > 3 ? atoi(argv[3]) : DEFAULT_LAYERS;
+    int max_stages = argc > 1 ? atoi(argv[1]) : layers + 1;
+    int width = argc > 2 ? atoi(argv[2]) : DEFAULT_WIDTH;
+    int batch = argc > 4 ? atoi(argv[4]) : DEFAULT_BATCH;
+    int micro = argc > 5 ? atoi(argv[5]) : DEFAULT_MICRO;
+
+    // random MLP, dataset and labels
+    cnet *nn = nn_init(width, CLASSES, layers + 1);
+    for(int i = 0; i < layers; i++)
+        nn_add(nn, width, width, relu_act);
+    nn_add(nn, width, CLASSES, softmax_act);
+
+    double *data = malloc(sizeof(double)*SAMPLES*width);
+    double **X = malloc(sizeof(double*)*SAMPLES);
+    int *labels = malloc(sizeof(int)*SAMPLES);
+    cnet_rng_fill(cnet_rng_local(), data, (long)SAMPLES*width, -1, 1);
+    for(int i = 0; i < SAMPLES; i++) {
+        X[i] = data + (long)i*width;
+        labels[i] = i % CLASSES;
+    }
+    int *samples = cnet_idx(SAMPLES);
+
+    // the gradient buffers the pipeline accumulates into
+    double **grads = malloc(sizeof(double*)*nn->n_layers);
+    for(int l = 0; l < nn->n_layers; l++) {
+        clayer *layer = nn->layers[l];
+        grads[l] = calloc(layer->w_rows * layer->w_cols + layer->b_size, sizeof(double));
+        layer->grad = grads[l];
+    }
+
+    printf(
+        "Width: %d - Hidden layers: %d - Batch: %d - Micro batch: %d - Cores: %d \n"
+        "stages   samples/s    speedup \n",
+        width,
+        layers,
+        batch,
+        micro,
+        cores
+    );
+
+    double base = 0;
+    for(int stages = 1; stages <= max_stages; stages++) {
+        cnet_pipeline *pipe = cnet_pipeline_init(nn, stages, micro, batch);
+        if (cnet_pipeline_stages(pipe) < stages) {
+            cnet_pipeline_free(pipe);
+            break;
+        }
+
+        // a first batch untimed, to warm the caches up
+        double loss, metric;
+        cnet_pipeline_batch(
+            pipe, X, NULL, labels, samples, batch,
+            cross_entropy_loss, metric_accuracy_argmax, &loss, &metric
+        );
+
+        double start = now();
+        for(int s = 0; s + batch <= SAMPLES; s += batch)
+            cnet_pipeline_batch(
+                pipe,
+                X,
+                NULL,
+                labels,
+                samples + s,
+                batch,
+                cross_entropy_loss,
+                metric_accuracy_argmax,
+                &loss,
+                &metric
+            );
+        double rate = (double)(SAMPLES / batch * batch) / (now() - start);
+
+        if (stages == 1) base = rate;
+        printf("%-8d %-12.1lf %.2lf \n", stages, rate, rate / base);
+        cnet_pipeline_free(pipe);
+    }
+
+    for(int l = 0; l < nn->n_layers; l++) {
+        nn->layers[l]->grad = NULL;
+        free(grads[l]);
+    }
+    free(grads);
+    free(samples);
+    free(labels);
+    free(X);
+    free(data);
+    nn_free(nn);
+    return 0;
+}
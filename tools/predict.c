@@ -0,0 +1,266 @@
+/**
+ * CNet Batch Scoring.
+ *
+ * Scores a large input file with a saved CNet model, offline. The input
+ * (an IDX file, or a raw matrix with --raw) is memory mapped and read in
+ * chunks of rows: the batches of a chunk are predicted in parallel on the
+ * thread pool (each range of batches with its own workspace), while the
+ * previous chunk is written by a writer thread. The predictions (or their
+ * argmax labels with --labels) are written as native doubles (int32 labels)
+ * or as CSV with --csv, "-" writing to the standard output. The throughput
+ * is reported on the standard error.
+ *
+ * Usage: cnet-predict <model file> <input> <output> [--raw <cols> <u8|i8|i16|i32|f32|f64>]
+ *                     [--scale <factor>] [--labels] [--csv] [--batch <size>] [--threads <n>]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cnet.h"
+#include "helpers.h"
+#include "locality.h"
+#include "matrix.h"
+#include "tpool.h"
+
+#define DEFAULT_BATCH 256
+#define CHUNK_BATCHES 64        // batches per chunk (and per thread at least)
+
+
+typedef struct scoring {
+
+    cnet const *nn;
+    cnet_matrix const *input;
+    int batch;
+
+    /* chunk being predicted: first row and number of rows */
+    long first;
+    long rows;
+    double *out;
+
+} scoring;
+
+
+typedef struct writer {
+
+    FILE *file;
+    int labels, csv, out_size;
+
+    /* chunk to write */
+    double const *out;
+    long rows;
+    int failed;
+
+} writer;
+
+
+/**
+ * Seconds since an arbitrary point. */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Predict a range of batches of the chunk, converting their rows in a
+ * thread local buffer. */
+void score_range(
+    void *arg,
+    long from,
+    long to
+){
+    scoring const *s = arg;
+    int in_size = s->nn->in_size, out_size = s->nn->out_size;
+
+    size_t input_size = sizeof(double) * s->batch * in_size;
+    size_t rows_size = sizeof(double *) * s->batch;
+    size_t work_size = sizeof(double) * nn_workspace_size(s->nn, s->batch);
+    double *input = cnet_numa_alloc_local(input_size);
+    double **X = cnet_numa_alloc_local(rows_size);
+    double *workspace = cnet_numa_alloc_local(work_size);
+
+    for(long b = from; b < to; b++) {
+        long row = b * s->batch;
+        int size = row + s->batch > s->rows ? s->rows - row : s->batch;
+
+        cnet_matrix_rows(s->input, s->first + row, size, input);
+        for(int i = 0; i < size; i++)
+            X[i] = input + (long) i * in_size;
+        nn_predict_batch(s->nn, X, size, s->out + row * out_size, workspace);
+    }
+
+    cnet_numa_free(workspace, work_size);
+    cnet_numa_free(X, rows_size);
+    cnet_numa_free(input, input_size);
+}
+
+
+/**
+ * Write a chunk of predictions. */
+void *write_chunk(
+    void *arg
+){
+    writer *w = arg;
+    for(long r = 0; r < w->rows; r++) {
+        double const *pred = w->out + r * w->out_size;
+        if (w->labels && w->csv) {
+            fprintf(w->file, "%d\n", (int) cnet_argmax(pred, w->out_size));
+        } else if (w->labels) {
+            int32_t label = cnet_argmax(pred, w->out_size);
+            fwrite(&label, sizeof(int32_t), 1, w->file);
+        } else if (w->csv) {
+            for(int j = 0; j < w->out_size; j++)
+                fprintf(w->file, j ? ",%.17g" : "%.17g", pred[j]);
+            fputc('\n', w->file);
+        }
+    }
+    if (!w->labels && !w->csv)
+        fwrite(w->out, sizeof(double) * w->out_size, w->rows, w->file);
+    w->failed = ferror(w->file);
+    return NULL;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <model file> <input> <output> "
+                "[--raw <cols> <u8|i8|i16|i32|f32|f64>] [--scale <factor>] "
+                "[--labels] [--csv] [--batch <size>] [--threads <n>]\n", argv[0]);
+        return 1;
+    }
+
+    int raw_cols = 0, labels = 0, csv = 0, batch = DEFAULT_BATCH, threads = 0;
+    double scale = 0;
+    enum cnet_matrix_type type = matrix_f64;
+    for(int a = 4; a < argc; a++) {
+        if (!strcmp(argv[a], "--raw") && a + 2 < argc) {
+            raw_cols = atoi(argv[++a]);
+            if (cnet_matrix_type_parse(argv[++a], &type)) {
+                fprintf(stderr, "Unknown values type: %s\n", argv[a]);
+                return 1;
+            }
+        } else if (!strcmp(argv[a], "--scale") && a + 1 < argc) {
+            scale = atof(argv[++a]);
+        } else if (!strcmp(argv[a], "--labels")) {
+            labels = 1;
+        } else if (!strcmp(argv[a], "--csv")) {
+            csv = 1;
+        } else if (!strcmp(argv[a], "--batch") && a + 1 < argc) {
+            batch = atoi(argv[++a]);
+        } else if (!strcmp(argv[a], "--threads") && a + 1 < argc) {
+            threads = atoi(argv[++a]);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[a]);
+            return 1;
+        }
+    }
+    if (batch < 1) batch = DEFAULT_BATCH;
+
+    FILE *model_file = fopen(argv[1], "r");
+    if (!model_file) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[1]);
+        return 1;
+    }
+    cnet *nn = nn_load(model_file);
+    fclose(model_file);
+    if (!nn) {
+        fprintf(stderr, "Failed to load model: %s\n", argv[1]);
+        return 1;
+    }
+    int in_size = nn->in_size, out_size = nn->out_size;
+
+    cnet_matrix *input = raw_cols
+        ? cnet_matrix_open_raw(argv[2], raw_cols, type)
+        : cnet_matrix_open_idx(argv[2]);
+    if (!input) {
+        fprintf(stderr, "Failed to map input: %s\n", argv[2]);
+        nn_free(nn);
+        return 1;
+    }
+    if (input->cols != in_size) {
+        fprintf(stderr, "Input has %d columns, the model expects %d\n",
+                input->cols, in_size);
+        cnet_matrix_close(input);
+        nn_free(nn);
+        return 1;
+    }
+    if (scale) input->scale = scale;
+
+    FILE *out = strcmp(argv[3], "-") ? fopen(argv[3], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[3]);
+        cnet_matrix_close(input);
+        nn_free(nn);
+        return 1;
+    }
+
+    cnet_tpool *pool = NULL;
+    if (threads > 0) {
+        pool = cnet_tpool_init(threads, NULL);
+        cnet_tpool_use(pool);
+    }
+
+    // a chunk gives every thread a few batches, and is written while the
+    // next one is predicted, hence two output buffers
+    long chunk = (long) batch * CHUNK_BATCHES * cnet_tpool_threads(cnet_tpool_get());
+    double *buffers[2] = {
+        malloc(sizeof(double) * chunk * out_size),
+        malloc(sizeof(double) * chunk * out_size)
+    };
+
+    writer w = {out, labels, csv, out_size, NULL, 0, 0};
+    pthread_t writing;
+    int pending = 0;
+
+    double start = now();
+    cnet_matrix_advise(input, 0, chunk, 1);
+    for(long first = 0, c = 0; first < input->rows; first += chunk, c++) {
+        long rows = first + chunk > input->rows ? input->rows - first : chunk;
+        cnet_matrix_advise(input, first + chunk, chunk, 1);
+
+        scoring s = {nn, input, batch, first, rows, buffers[c & 1]};
+        cnet_parallel_for(cnet_tpool_get(), 0, (rows + batch - 1) / batch, 1,
+                          score_range, &s);
+        cnet_matrix_advise(input, first, rows, 0);
+
+        if (pending) pthread_join(writing, NULL);
+        pending = 0;
+        if (w.failed) break;
+        w.out = s.out;
+        w.rows = rows;
+        pthread_create(&writing, NULL, write_chunk, &w);
+        pending = 1;
+    }
+    if (pending) pthread_join(writing, NULL);
+    if (fflush(out)) w.failed = 1;
+    double elapsed = now() - start;
+
+    if (w.failed)
+        fprintf(stderr, "Failed to write file: %s\n", argv[3]);
+    else
+        fprintf(
+            stderr,
+            "Rows: %ld - Time: %.3lf s - Throughput: %.1lf rows/s \n",
+            input->rows,
+            elapsed,
+            input->rows / elapsed
+        );
+
+    if (out != stdout) fclose(out);
+    free(buffers[0]);
+    free(buffers[1]);
+    if (pool) {
+        cnet_tpool_use(NULL);
+        cnet_tpool_free(pool);
+    }
+    cnet_matrix_close(input);
+    nn_free(nn);
+    return w.failed ? 1 : 0;
+}
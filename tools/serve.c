@@ -0,0 +1,126 @@
+/**
+ * CNet Inference Server.
+ *
+ * Loads a saved CNet model and serves its predictions on a Unix domain
+ * socket or a TCP port (see serve.h), coalescing the concurrent requests
+ * into batches. SIGHUP reloads the model file in the background and swaps
+ * it in atomically, without stopping the predictions (see model.h), e.g.
+ * after a training process wrote a new checkpoint. Stops on SIGINT /
+ * SIGTERM, printing the throughput and latency statistics (also available
+ * to the clients, see cnet-loadgen).
+ *
+ * Usage: cnet-serve <model file> <address> [max batch] [window us] [workers]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cnet.h"
+#include "model.h"
+#include "serve.h"
+
+#define DEFAULT_MAX_BATCH 64
+#define DEFAULT_WINDOW_US 500
+#define DEFAULT_WORKERS 2
+
+
+typedef struct signals {
+    sigset_t set;
+    cnet_server *server;
+    cnet_model *model;
+    char const *path;
+} signals;
+
+
+/**
+ * Signal thread: reloads the model on SIGHUP, until asked to stop. */
+void *handle_signals(
+    void *arg
+){
+    signals *sig = arg;
+    for(;;) {
+        int number;
+        if (sigwait(&sig->set, &number)) continue;
+        if (number != SIGHUP) {
+            cnet_server_stop(sig->server);
+            return NULL;
+        }
+
+        long serial = cnet_model_load(sig->model, sig->path);
+        if (serial < 0)
+            fprintf(stderr, "Failed to reload: %s\n", sig->path);
+        else
+            printf("Reloaded %s - Version: %ld \n", sig->path, serial);
+        fflush(stdout);
+    }
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <model> <address> [max batch] [window us] [workers]\n", argv[0]);
+        return 1;
+    }
+    cnet_server_config config = {
+        argc > 3 ? atoi(argv[3]) : DEFAULT_MAX_BATCH,
+        argc > 4 ? atoi(argv[4]) : DEFAULT_WINDOW_US,
+        argc > 5 ? atoi(argv[5]) : DEFAULT_WORKERS
+    };
+
+    // load model from file
+    FILE *model_file = fopen(argv[1], "r");
+    if (!model_file) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[1]);
+        return 1;
+    }
+    cnet *nn = nn_load(model_file);
+    fclose(model_file);
+    if (!nn) {
+        fprintf(stderr, "Failed to load model: %s\n", argv[1]);
+        return 1;
+    }
+
+    // the signals are only taken by the signal thread (blocked before any
+    // other thread starts, which inherit the mask)
+    signals sig = {.path = argv[1]};
+    sigemptyset(&sig.set);
+    sigaddset(&sig.set, SIGHUP);
+    sigaddset(&sig.set, SIGINT);
+    sigaddset(&sig.set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sig.set, NULL);
+
+    sig.model = cnet_model_init(nn);
+    sig.server = cnet_server_init_model(sig.model, argv[2], &config);
+    if (!sig.server) {
+        fprintf(stderr, "Failed to listen on: %s\n", argv[2]);
+        cnet_model_free(sig.model);
+        return 1;
+    }
+
+    printf(
+        "Serving %s on %s - Inputs: %d - Outputs: %d - "
+        "Max batch: %d - Window: %d us - Workers: %d \n",
+        argv[1],
+        argv[2],
+        nn->in_size,
+        nn->out_size,
+        config.max_batch,
+        config.window_us,
+        config.workers
+    );
+    fflush(stdout);
+
+    pthread_t signal_thread;
+    pthread_create(&signal_thread, NULL, handle_signals, &sig);
+    cnet_server_run(sig.server);
+    pthread_join(signal_thread, NULL);
+
+    cnet_server_stats stats = cnet_server_get_stats(sig.server);
+    cnet_server_print_stats(&stats, stdout);
+    cnet_server_free(sig.server);
+    cnet_model_free(sig.model);
+    return 0;
+}
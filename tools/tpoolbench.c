@@ -0,0 +1,107 @@
+/**
+ * CNet Thread Pool Benchmark.
+ *
+ * Measures the task dispatch overhead of the thread pool (see tpool.h):
+ * the latency of a parallel for with a single range per thread, the cost
+ * of every range of a parallel for split in small ranges, and, as a
+ * reference, the cost of starting and joining as many threads (what every
+ * parallel call did before the pool).
+ *
+ * Usage: cnet-tpoolbench [threads] [repetitions]
+ **/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tpool.h"
+
+#define DEFAULT_REPS 10000
+#define RANGE_ELEMENTS (1L << 20)
+
+
+/**
+ * Seconds since an arbitrary point. */
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Range task, doing nothing (only called through the pool). */
+void empty_range(
+    void *arg,
+    long from,
+    long to
+){
+    (void)arg;
+    (void)from;
+    (void)to;
+}
+
+
+void *empty_thread(
+    void *arg
+){
+    return arg;
+}
+
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 0;
+    int reps = argc > 2 ? atoi(argv[2]) : DEFAULT_REPS;
+
+    cnet_tpool *pool = cnet_tpool_init(threads, NULL);
+    threads = cnet_tpool_threads(pool);
+    printf("Threads: %d - Repetitions: %d \n", threads, reps);
+
+    // a range per thread
+    cnet_parallel_for(pool, 0, threads, 1, empty_range, NULL);
+    double start = now();
+    for(int r = 0; r < reps; r++)
+        cnet_parallel_for(pool, 0, threads, 1, empty_range, NULL);
+    printf(
+        "parallel for, %d ranges: %.3lf us \n",
+        threads,
+        (now() - start) / reps * 1e6
+    );
+
+    // small ranges, the fixed cost of each one
+    for(long grain = 16; grain <= 4096; grain *= 4) {
+        long ranges = RANGE_ELEMENTS / grain;
+        int n = reps / 100 > 0 ? reps / 100 : 1;
+        start = now();
+        for(int r = 0; r < n; r++)
+            cnet_parallel_for(pool, 0, RANGE_ELEMENTS, grain, empty_range, NULL);
+        printf(
+            "parallel for, grain %ld: %.1lf ns per range \n",
+            grain,
+            (now() - start) / ((double)n * ranges) * 1e9
+        );
+    }
+
+    // reference: a thread started per range
+    pthread_t *ids = malloc(sizeof(pthread_t)*threads);
+    int n = reps / 10 > 0 ? reps / 10 : 1;
+    start = now();
+    for(int r = 0; r < n; r++) {
+        for(int t = 1; t < threads; t++)
+            pthread_create(&ids[t], NULL, empty_thread, NULL);
+        empty_thread(NULL);
+        for(int t = 1; t < threads; t++)
+            pthread_join(ids[t], NULL);
+    }
+    printf(
+        "pthread create/join, %d threads: %.3lf us \n",
+        threads,
+        (now() - start) / n * 1e6
+    );
+
+    free(ids);
+    cnet_tpool_free(pool);
+    return 0;
+}
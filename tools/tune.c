@@ -0,0 +1,58 @@
+/**
+ * CNet Autotuner.
+ *
+ * Benchmarks the builtin gemm blocking and thread counts on the layer
+ * shapes of a saved CNet model, and keeps the fastest parameters in a
+ * tuning cache, keyed by the CPU model (see tune.h). Running it on every
+ * machine type of a fleet fills the same cache for all of them; programs
+ * then load it at startup with cnet_tune_load.
+ *
+ * Usage: cnet-tune <model file> <cache file> [batch size]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cnet.h"
+#include "blas.h"
+#include "tune.h"
+
+#define DEFAULT_BATCH 64
+
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <model> <cache> [batch]\n", argv[0]);
+        return 1;
+    }
+    int batch = argc > 3 ? atoi(argv[3]) : DEFAULT_BATCH;
+
+    // load model from file
+    FILE *model_file = fopen(argv[1], "r");
+    if (!model_file) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[1]);
+        return 1;
+    }
+    cnet *nn = nn_load(model_file);
+    fclose(model_file);
+    if (!nn) {
+        fprintf(stderr, "Failed to load model: %s\n", argv[1]);
+        return 1;
+    }
+
+    printf(
+        "CPU: %s - BLAS backend: %s - Batch: %d \n",
+        cnet_cpu_model(),
+        cnet_blas_backend(),
+        batch
+    );
+
+    int tuned = nn_autotune(nn, batch, argv[2], stdout);
+    nn_free(nn);
+    if (tuned < 0) {
+        fprintf(stderr, "Failed to save the cache: %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%d shapes tuned into %s \n", tuned, argv[2]);
+    return 0;
+}